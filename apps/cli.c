@@ -0,0 +1,100 @@
+// Helpers shared by the command-line tools (see cli.h)
+#define _POSIX_C_SOURCE 200809L
+#include "cli.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+uint8_t *read_all(FILE *in, size_t *length) {
+    size_t size = 64 * 1024;
+    size_t used = 0;
+    uint8_t *buf = malloc(size);
+
+    while (buf) {
+        used += fread(buf + used, 1, size - used, in);
+        if (used < size) {
+            break;
+        }
+        uint8_t *bigger = realloc(buf, 2 * size);
+        if (!bigger) {
+            free(buf);
+            return NULL;
+        }
+        buf = bigger;
+        size *= 2;
+    }
+    if (buf && ferror(in)) {
+        free(buf);
+        return NULL;
+    }
+    *length = used;
+    return buf;
+}
+
+int redirect(const char *in_path, const char *out_path) {
+    if (in_path) {
+        int fd = open(in_path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0 || dup2(fd, STDIN_FILENO) < 0) {
+            perror(in_path);
+            return -1;
+        }
+        close(fd);
+    }
+    if (out_path) {
+        struct stat in_st;
+        struct stat out_st;
+        if (stat(out_path, &out_st) == 0 && fstat(STDIN_FILENO, &in_st) == 0 &&
+            in_st.st_dev == out_st.st_dev && in_st.st_ino == out_st.st_ino) {
+            fprintf(stderr, "%s: output and input are the same file\n", out_path);
+            return -1;
+        }
+        int fd = open(out_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (fd < 0 || dup2(fd, STDOUT_FILENO) < 0) {
+            perror(out_path);
+            return -1;
+        }
+        close(fd);
+    }
+    return 0;
+}
+
+int parse_u64(const char *text, uint64_t *value) {
+    char *end;
+    errno = 0;
+    unsigned long long v = strtoull(text, &end, 10);
+    if (errno != 0 || end == text || *end != '\0' || text[0] == '-') {
+        return -1;
+    }
+    *value = (uint64_t)v;
+    return 0;
+}
+
+int parse_size(const char *text, size_t *value) {
+    uint64_t v;
+    if (parse_u64(text, &v) != 0 || v > SIZE_MAX) {
+        return -1;
+    }
+    *value = (size_t)v;
+    return 0;
+}
+
+int parse_shard(const char *text, uint32_t *index, uint32_t *count) {
+    char k[24];
+    uint64_t kv;
+    uint64_t nv;
+    const char *slash = strchr(text, '/');
+    if (!slash || (size_t)(slash - text) >= sizeof(k)) {
+        return -1;
+    }
+    memcpy(k, text, (size_t)(slash - text));
+    k[slash - text] = '\0';
+    if (parse_u64(k, &kv) != 0 || parse_u64(slash + 1, &nv) != 0 || nv == 0 || nv > UINT32_MAX || kv >= nv) {
+        return -1;
+    }
+    *index = (uint32_t)kv;
+    *count = (uint32_t)nv;
+    return 0;
+}
@@ -0,0 +1,27 @@
+#ifndef CLI_H
+#define CLI_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Helpers shared by the command-line tools (cli.c)
+
+// Read all of a stream; returns NULL on error (*length = 0 and a non-NULL
+// buffer for empty input)
+uint8_t *read_all(FILE *in, size_t *length);
+
+// --in / --out: open the files as stdin / stdout. The output is opened
+// read-write so it can be mapped, and must not be the input (it is truncated).
+// Returns 0, or -1 after printing why.
+int redirect(const char *in_path, const char *out_path);
+
+// Whole decimal option values; return -1 for anything else, or for a value
+// that does not fit
+int parse_u64(const char *text, uint64_t *value);
+int parse_size(const char *text, size_t *value);
+
+// --shard K/N: both numbers, 0 <= K < N
+int parse_shard(const char *text, uint32_t *index, uint32_t *count);
+
+#endif // CLI_H
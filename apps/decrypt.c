@@ -1,23 +1,283 @@
 // Decryption application - reads from stdin, writes to stdout
+#define _POSIX_C_SOURCE 200809L
 #include "../include/taes.h"
 #include "../include/counter_mode.h"
+#include "../include/taes_container.h"
+#include "../include/taes_pipeline.h"
+#include "../include/taes_shard.h"
+#include "../include/taes_utils.h"
+#include "../include/taesd.h"
+#include "cli.h"
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-// External functions from utils.c
-extern int derive_key_from_password(const char *password, uint8_t *key, int key_size);
-extern int derive_tweak_from_password(const char *password, uint8_t *tweak);
+// Output of --offset/--length is decrypted in pieces of this size
+#define RANGE_PIECE (1024 * 1024)
+
+// --shard K/N: decrypt shard K of N of the seekable stdin (the whole
+// ciphertext) to stdout, reading only its bytes
+static int decrypt_shard(const taes_ctx *ctx, uint32_t index, uint32_t count) {
+    taes_shard shard;
+    off_t size = lseek(STDIN_FILENO, 0, SEEK_END);
+    if (size < 0) {
+        fprintf(stderr, "--shard needs a seekable input (--in FILE)\n");
+        return -1;
+    }
+    if (taes_shard_range((uint64_t)size, index, count, &shard) != 0) {
+        fprintf(stderr, "Counter mode needs more than 16 bytes of input\n");
+        return -1;
+    }
+    taes_pool *pool = taes_pool_create(0);
+    if (!pool) {
+        fprintf(stderr, "Cannot start threads\n");
+        return -1;
+    }
+    int ret = taes_shard_crypt_fd(ctx, TAES_SHARD_DECRYPT, STDIN_FILENO, shard.offset, &shard, STDOUT_FILENO, pool);
+    taes_pool_destroy(pool);
+    if (ret != 0) {
+        fprintf(stderr, "I/O error: %s\n", strerror(errno));
+    }
+    return ret;
+}
+
+// --offset/--length: decrypt bytes [offset, offset + length) of a seekable
+// input (to its end without --length). Only the blocks the range needs are
+// read, with pread(), so the cost does not depend on the input size.
+static int decrypt_range(const taes_ctx *ctx, size_t offset, size_t length, int to_end) {
+    off_t size = lseek(STDIN_FILENO, 0, SEEK_END);
+    if (size < 0) {
+        fprintf(stderr, "--offset and --length need a seekable input (--in FILE)\n");
+        return -1;
+    }
+    size_t total = (size_t)size;
+    if (to_end) {
+        length = offset <= total ? total - offset : 0;
+    }
+    size_t span_off;
+    size_t span_len;
+    if (counter_mode_range_span(total, offset, length, &span_off, &span_len) != 0) {
+        fprintf(stderr, "Range outside the %zu-byte ciphertext (counter mode needs more than 16 bytes)\n",
+                total);
+        return -1;
+    }
+
+    // A piece's span: its blocks, plus the stolen pair (up to 31 bytes)
+    static uint8_t span[RANGE_PIECE + 4 * AES_BLOCK_SIZE];
+    static uint8_t out[RANGE_PIECE];
+    int ret = 0;
+    for (size_t pos = offset; ret == 0 && pos < offset + length;) {
+        size_t n = offset + length - pos < RANGE_PIECE ? offset + length - pos : RANGE_PIECE;
+        counter_mode_range_span(total, pos, n, &span_off, &span_len);
+
+        size_t got = 0;
+        while (got < span_len) {
+            ssize_t r = pread(STDIN_FILENO, span + got, span_len - got, (off_t)(span_off + got));
+            if (r < 0 && errno == EINTR) {
+                continue;
+            }
+            if (r <= 0) {
+                fprintf(stderr, "Cannot read input: %s\n", r < 0 ? strerror(errno) : "file shrank");
+                ret = -1;
+                break;
+            }
+            got += (size_t)r;
+        }
+        if (ret == 0) {
+            counter_mode_decrypt_span(ctx, span, total, pos, n, out);
+            if (fwrite(out, 1, n, stdout) != n) {
+                fprintf(stderr, "Cannot write output\n");
+                ret = -1;
+            }
+        }
+        pos += n;
+    }
+    if (ret == 0 && fflush(stdout) != 0) {
+        fprintf(stderr, "Cannot write output\n");
+        ret = -1;
+    }
+    memset(out, 0, sizeof(out));
+    return ret;
+}
+
+// --container: decrypt a container on stdin (taes_container.h), with the
+// keys of its header. Streamed, chunks in parallel; with a range, through
+// the index: only the chunks the range falls in are read.
+static int decrypt_container(int key_bits, const char *password, const char *tweak_password, int use_range,
+                             size_t offset, size_t length, int to_end) {
+    taes_container_params params;
+    taes_container *container = NULL;
+    if (use_range) {
+        if (lseek(STDIN_FILENO, 0, SEEK_CUR) < 0) {
+            fprintf(stderr, "--offset and --length need a seekable input (--in FILE)\n");
+            return -1;
+        }
+        container = taes_container_open(STDIN_FILENO);
+        if (!container) {
+            fprintf(stderr, "Not a container: %s\n", strerror(errno));
+            return -1;
+        }
+        params = *taes_container_get_params(container);
+    } else if (taes_container_read_params(STDIN_FILENO, &params) != 0) {
+        fprintf(stderr, "Not a container: %s\n", strerror(errno));
+        return -1;
+    }
+
+    taes_ctx ctx;
+    taes_pool *pool = NULL;
+    int ret = -1;
+    if (params.key_bits != (uint32_t)key_bits) {
+        fprintf(stderr, "This is an AES-%u container\n", params.key_bits);
+    } else if (container_context(&ctx, &params, password, tweak_password, 1) != 0) {
+        fprintf(stderr, "Key derivation failed\n");
+    } else if (use_range) {
+        uint64_t total = taes_container_length(container);
+        if (to_end) {
+            length = offset <= total ? (size_t)(total - offset) : 0;
+        }
+        if (offset > total || length > total - offset) {
+            fprintf(stderr, "Range outside the %llu-byte plaintext\n", (unsigned long long)total);
+        } else {
+            static uint8_t out[RANGE_PIECE];
+            ret = 0;
+            for (size_t pos = offset; ret == 0 && pos < offset + length; pos += RANGE_PIECE) {
+                size_t n = offset + length - pos < RANGE_PIECE ? offset + length - pos : RANGE_PIECE;
+                ret = taes_container_read(container, &ctx, pos, n, out);
+                if (ret != 0) {
+                    fprintf(stderr, "Cannot read input: %s\n", strerror(errno));
+                } else if (fwrite(out, 1, n, stdout) != n) {
+                    fprintf(stderr, "Cannot write output\n");
+                    ret = -1;
+                }
+            }
+            if (ret == 0 && fflush(stdout) != 0) {
+                fprintf(stderr, "Cannot write output\n");
+                ret = -1;
+            }
+            memset(out, 0, sizeof(out));
+        }
+    } else if (!(pool = taes_pool_create(0))) {
+        fprintf(stderr, "Cannot start threads\n");
+    } else {
+        ret = taes_container_decrypt(&ctx, &params, STDIN_FILENO, STDOUT_FILENO, pool);
+        if (ret != 0) {
+            fprintf(stderr, errno == EBADMSG ? "Malformed container\n" : "I/O error: %s\n", strerror(errno));
+        }
+    }
+
+    taes_pool_destroy(pool);
+    taes_cleanup(&ctx);
+    taes_container_close(container);
+    return ret;
+}
 
 int main(int argc, char *argv[]) {
+    // Options come first. --daemon: hand the work to taesd, which keeps the
+    // derived keys warm
+    int use_daemon = 0;
+    int use_container = 0;
+    const char *in_path = NULL;
+    const char *out_path = NULL;
+    const char *offset_arg = NULL;
+    const char *length_arg = NULL;
+    const char *shard_arg = NULL;
+    const char *block_offset_arg = NULL;
+    int opt = 1;
+    while (opt < argc && strncmp(argv[opt], "--", 2) == 0) {
+        if (strcmp(argv[opt], "--daemon") == 0) {
+            use_daemon = 1;
+            opt++;
+        } else if (strcmp(argv[opt], "--container") == 0) {
+            use_container = 1;
+            opt++;
+        } else if (strcmp(argv[opt], "--in") == 0 && opt + 1 < argc) {
+            in_path = argv[opt + 1];
+            opt += 2;
+        } else if (strcmp(argv[opt], "--out") == 0 && opt + 1 < argc) {
+            out_path = argv[opt + 1];
+            opt += 2;
+        } else if (strcmp(argv[opt], "--offset") == 0 && opt + 1 < argc) {
+            offset_arg = argv[opt + 1];
+            opt += 2;
+        } else if (strcmp(argv[opt], "--length") == 0 && opt + 1 < argc) {
+            length_arg = argv[opt + 1];
+            opt += 2;
+        } else if (strcmp(argv[opt], "--shard") == 0 && opt + 1 < argc) {
+            shard_arg = argv[opt + 1];
+            opt += 2;
+        } else if (strcmp(argv[opt], "--block-offset") == 0 && opt + 1 < argc) {
+            block_offset_arg = argv[opt + 1];
+            opt += 2;
+        } else {
+            argc = 0;  // Unknown option: usage
+            break;
+        }
+    }
+    if (argc > 0) {
+        argv[opt - 1] = argv[0];
+        argv += opt - 1;
+        argc -= opt - 1;
+    }
+
     if (argc < 3 || argc > 4) {
-        fprintf(stderr, "Usage: %s <key_size> <password> [tweak_password]\n", argv[0]);
+        fprintf(stderr, "Usage: %s [--daemon] [--container] [--in FILE] [--out FILE] [--offset N] [--length N]\n",
+                argv[0]);
+        fprintf(stderr, "       [--shard K/N | --block-offset B]\n");
+        fprintf(stderr, "       <key_size> <password> [tweak_password]\n");
         fprintf(stderr, "  key_size: 128, 192, or 256\n");
         fprintf(stderr, "  password: Password for key derivation\n");
         fprintf(stderr, "  tweak_password: Optional password for tweak (enables counter mode)\n");
+        fprintf(stderr, "  --daemon: Send the data to taesd ($TAESD_SOCKET, default\n"
+                        "            $XDG_RUNTIME_DIR/%s)\n", TAESD_SOCKET_NAME);
+        fprintf(stderr, "  --in, --out: Read / write FILE instead of stdin / stdout (mapped, no copies)\n");
+        fprintf(stderr, "  --offset, --length: Decrypt only this byte range of a seekable counter-mode input\n");
+        fprintf(stderr, "  --container: The input is a container (encrypt --container)\n");
+        fprintf(stderr, "  --shard: Decrypt only shard K of N of the input (as encrypt --shard cuts it)\n");
+        fprintf(stderr, "  --block-offset: The input is the part of a ciphertext starting at block B\n");
+        return 1;
+    }
+    if (use_container && (use_daemon || argc != 4)) {
+        fprintf(stderr, "--container needs a tweak password, without --daemon\n");
         return 1;
     }
 
+    // Byte range: counter mode on a local, seekable input
+    int use_range = offset_arg || length_arg;
+    size_t offset = 0;
+    size_t length = 0;
+    if (use_range) {
+        if ((offset_arg && parse_size(offset_arg, &offset) != 0) ||
+            (length_arg && parse_size(length_arg, &length) != 0)) {
+            fprintf(stderr, "Invalid --offset or --length\n");
+            return 1;
+        }
+        if (use_daemon || argc != 4) {
+            fprintf(stderr, "--offset and --length need counter mode (a tweak password), without --daemon\n");
+            return 1;
+        }
+    }
+
+    // Shards: counter mode under the tweak advanced to the shard's block
+    uint32_t shard_index = 0;
+    uint32_t shard_count = 0;
+    size_t block_offset = 0;
+    if (shard_arg || block_offset_arg) {
+        if ((shard_arg && parse_shard(shard_arg, &shard_index, &shard_count) != 0) ||
+            (block_offset_arg && parse_size(block_offset_arg, &block_offset) != 0)) {
+            fprintf(stderr, "Invalid --shard or --block-offset\n");
+            return 1;
+        }
+        if (use_daemon || use_container || use_range || argc != 4 || (shard_arg && block_offset_arg)) {
+            fprintf(stderr, "--shard and --block-offset need counter mode (a tweak password), without --daemon,\n");
+            fprintf(stderr, "--container, --offset or --length, and not each other\n");
+            return 1;
+        }
+    }
+
     // Parse key size
     int key_bits = atoi(argv[1]);
     int key_size;
@@ -30,6 +290,41 @@ int main(int argc, char *argv[]) {
             return 1;
     }
 
+    if (redirect(in_path, out_path) != 0) {
+        return 1;
+    }
+
+    if (use_container) {
+        return decrypt_container(key_bits, argv[2], argv[3], use_range, offset, length, !length_arg) == 0 ? 0 : 1;
+    }
+
+    if (use_daemon) {
+        // One request carries the whole ciphertext
+        size_t length;
+        uint8_t *data = read_all(stdin, &length);
+        if (!data) {
+            fprintf(stderr, "Cannot read input\n");
+            return 1;
+        }
+        int sock = taesd_connect(NULL);
+        if (sock < 0) {
+            fprintf(stderr, "Cannot connect to taesd\n");
+            free(data);
+            return 1;
+        }
+        int ret = taesd_crypt(sock, 1, key_bits, argv[2], argc == 4 ? argv[3] : NULL, data, length);
+        close(sock);
+        if (ret != 0) {
+            fprintf(stderr, "taesd could not decrypt the input\n");
+            free(data);
+            return 1;
+        }
+        int ok = fwrite(data, 1, length, stdout) == length && fflush(stdout) == 0;
+        memset(data, 0, length);
+        free(data);
+        return ok ? 0 : 1;
+    }
+
     // Derive key from password
     uint8_t key[32];
     if (derive_key_from_password(argv[2], key, key_size) != 0) {
@@ -51,19 +346,38 @@ int main(int argc, char *argv[]) {
         use_counter_mode = 1;
     }
 
-    if (taes_init(&ctx, key, key_size, tweak) != 0) {
+    if (taes_init_decrypt(&ctx, key, key_size, tweak) != 0) {
         fprintf(stderr, "T-AES initialization failed\n");
         return 1;
     }
 
-    // TODO: Read ciphertext from stdin
-    // TODO: Decrypt using either ECB mode (single block) or counter mode (multiple blocks)
-    // TODO: Write plaintext to stdout
+    if (shard_arg) {
+        int ret = decrypt_shard(&ctx, shard_index, shard_count);
+        taes_cleanup(&ctx);
+        memset(key, 0, sizeof(key));
+        memset(tweak, 0, sizeof(tweak));
+        return ret == 0 ? 0 : 1;
+    }
+    taes_advance_tweak(&ctx, block_offset);
+
+    // A regular input file is mapped and decrypted without copies; else read,
+    // decrypt and write overlap (reader thread, cipher workers, this thread)
+    int flags = TAES_PIPELINE_DECRYPT | (use_counter_mode ? 0 : TAES_PIPELINE_ECB);
+    int ret = use_range ? decrypt_range(&ctx, offset, length, !length_arg)
+                        : taes_crypt_fd(&ctx, flags, STDIN_FILENO, STDOUT_FILENO, 0);
+    if (use_range) {
+        // decrypt_range() reported its errors
+    } else if (ret == TAES_PIPELINE_BAD_LENGTH) {
+        fprintf(stderr, use_counter_mode ? "Counter mode needs more than 16 bytes of input\n"
+                                         : "ECB mode needs a multiple of 16 bytes (give a tweak password)\n");
+    } else if (ret != 0) {
+        fprintf(stderr, "I/O error: %s\n", strerror(errno));
+    }
 
     // Clean up
     taes_cleanup(&ctx);
     memset(key, 0, sizeof(key));
     memset(tweak, 0, sizeof(tweak));
 
-    return 0;
+    return ret == 0 ? 0 : 1;
 }
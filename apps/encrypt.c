@@ -1,20 +1,300 @@
 // Encryption application - reads from stdin, writes to stdout
+#define _POSIX_C_SOURCE 200809L
 #include "../include/taes.h"
-#include "../include/counter_mode.h"
+#include "../include/taes_container.h"
+#include "../include/taes_pipeline.h"
+#include "../include/taes_shard.h"
+#include "../include/taes_update.h"
+#include "../include/taes_utils.h"
+#include "../include/taesd.h"
+#include "cli.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <openssl/rand.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-// External functions from utils.c
-extern int derive_key_from_password(const char *password, uint8_t *key, int key_size);
-extern int derive_tweak_from_password(const char *password, uint8_t *tweak);
+// PBKDF2 iterations of new containers (as derive_key_from_password())
+#define CONTAINER_KDF_ITERATIONS 100000
+
+// --container: stdin to a new container on stdout, under keys salted with a
+// fresh random salt (stored in its header). --append FILE: stdin as new
+// chunks of the container FILE, with the keys of its header.
+static int encrypt_container(int key_bits, const char *password, const char *tweak_password,
+                             const char *append_path) {
+    taes_container_params params = {0};
+    taes_container *container = NULL;
+    int fd = -1;
+    if (append_path) {
+        struct stat in_st;
+        struct stat out_st;
+        fd = open(append_path, O_RDWR | O_CLOEXEC);
+        if (fd < 0 || !(container = taes_container_open(fd))) {
+            fprintf(stderr, "%s: %s\n", append_path, strerror(errno));
+            if (fd >= 0) {
+                close(fd);
+            }
+            return -1;
+        }
+        if (fstat(STDIN_FILENO, &in_st) == 0 && fstat(fd, &out_st) == 0 && in_st.st_dev == out_st.st_dev &&
+            in_st.st_ino == out_st.st_ino) {
+            fprintf(stderr, "%s: cannot append a container to itself\n", append_path);
+            taes_container_close(container);
+            close(fd);
+            return -1;
+        }
+        params = *taes_container_get_params(container);
+    } else {
+        params.key_bits = (uint32_t)key_bits;
+        params.kdf = TAES_CONTAINER_KDF_PBKDF2_SHA256;
+        params.kdf_iterations = CONTAINER_KDF_ITERATIONS;
+        params.chunk_size = TAES_CONTAINER_DEFAULT_CHUNK;
+        if (RAND_bytes(params.salt, sizeof(params.salt)) != 1) {
+            fprintf(stderr, "Cannot generate a salt\n");
+            return -1;
+        }
+    }
+
+    taes_ctx ctx;
+    taes_pool *pool = NULL;
+    int ret = -1;
+    if (params.key_bits != (uint32_t)key_bits) {
+        fprintf(stderr, "The container is AES-%u\n", params.key_bits);
+    } else if (container_context(&ctx, &params, password, tweak_password, 0) != 0) {
+        fprintf(stderr, "Key derivation failed\n");
+    } else if (!(pool = taes_pool_create(0))) {
+        fprintf(stderr, "Cannot start threads\n");
+    } else {
+        ret = container ? taes_container_append(container, &ctx, STDIN_FILENO, pool)
+                        : taes_container_encrypt(&ctx, &params, STDIN_FILENO, STDOUT_FILENO, pool);
+        if (ret == TAES_CONTAINER_BAD_LENGTH) {
+            fprintf(stderr, "Counter mode needs more than 16 bytes of input\n");
+        } else if (ret != 0) {
+            fprintf(stderr, "I/O error: %s\n", strerror(errno));
+        }
+    }
+
+    taes_pool_destroy(pool);
+    taes_cleanup(&ctx);
+    if (container) {
+        taes_container_close(container);
+        close(fd);
+    }
+    return ret == 0 ? 0 : -1;
+}
+
+// --shard K/N: encrypt shard K of N of the seekable stdin (the whole
+// message) to stdout, reading only its bytes; --manifest FILE gets its line (with its digest)
+static int encrypt_shard(const taes_ctx *ctx, uint32_t index, uint32_t count, const char *manifest_path) {
+    taes_shard shard;
+    off_t size = lseek(STDIN_FILENO, 0, SEEK_END);
+    if (size < 0) {
+        fprintf(stderr, "--shard needs a seekable input (--in FILE)\n");
+        return -1;
+    }
+    if (taes_shard_range((uint64_t)size, index, count, &shard) != 0) {
+        fprintf(stderr, "Counter mode needs more than 16 bytes of input\n");
+        return -1;
+    }
+    taes_pool *pool = taes_pool_create(0);
+    if (!pool) {
+        fprintf(stderr, "Cannot start threads\n");
+        return -1;
+    }
+    int flags = manifest_path ? TAES_SHARD_DIGEST : 0;
+    int ret = taes_shard_crypt_fd(ctx, flags, STDIN_FILENO, shard.offset, &shard, STDOUT_FILENO, pool);
+    taes_pool_destroy(pool);
+    if (ret != 0) {
+        fprintf(stderr, "I/O error: %s\n", strerror(errno));
+        return -1;
+    }
+    if (manifest_path) {
+        char line[TAES_SHARD_LINE_MAX];
+        FILE *f = fopen(manifest_path, "w");
+        taes_shard_format(&shard, line);
+        if (!f || fputs(line, f) == EOF || fclose(f) != 0) {
+            fprintf(stderr, "%s: %s\n", manifest_path, strerror(errno));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// --update OLD NEW CIPHERTEXT: bring CIPHERTEXT, the counter-mode encryption
+// of OLD, up to date with NEW in place. --update-blocks takes a dirty-block
+// bitmap file (bit i of byte i / 8, low bit first, for block i) and the old
+// plaintext's length instead of OLD. The length is given, not taken from
+// CIPHERTEXT, which an interrupted run may have left at the new length.
+static int encrypt_update(const taes_ctx *ctx, int use_bitmap, uint64_t old_length, char *const paths[3]) {
+    int fds[3] = {-1, -1, -1};
+    uint8_t *bitmap = NULL;
+    size_t bitmap_length = 0;
+    if (use_bitmap) {
+        FILE *f = fopen(paths[0], "rb");
+        bitmap = f ? read_all(f, &bitmap_length) : NULL;
+        if (f) {
+            fclose(f);
+        }
+        if (!bitmap) {
+            perror(paths[0]);
+            return -1;
+        }
+    }
+    int ret = 0;
+    for (int i = use_bitmap ? 1 : 0; i < 3 && ret == 0; i++) {
+        fds[i] = open(paths[i], (i == 2 ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+        if (fds[i] < 0) {
+            perror(paths[i]);
+            ret = -1;
+        }
+    }
+    taes_update_stats stats;
+    if (ret == 0 && use_bitmap) {
+        ret = taes_update_blocks_fd(ctx, old_length, bitmap, 8 * (uint64_t)bitmap_length, fds[1], fds[2],
+                                    &stats);
+    } else if (ret == 0) {
+        ret = taes_update_fd(ctx, fds[0], fds[1], fds[2], &stats);
+    } else {
+        errno = 0;
+    }
+    if (ret == 0) {
+        fprintf(stderr, "Rewrote %llu of %llu blocks (%llu changed)\n", (unsigned long long)stats.written,
+                (unsigned long long)stats.blocks, (unsigned long long)stats.dirty);
+    } else if (ret == TAES_UPDATE_BAD_LENGTH) {
+        fprintf(stderr, "Counter mode needs more than 16 bytes of input\n");
+    } else if (errno == EINVAL && use_bitmap) {
+        fprintf(stderr, "%s is shorter than the old length %llu: not its ciphertext\n", paths[2],
+                (unsigned long long)old_length);
+    } else if (errno == EINVAL) {
+        fprintf(stderr, "%s is shorter than %s: not its ciphertext\n", paths[2], paths[0]);
+    } else if (errno != 0) {
+        fprintf(stderr, "I/O error: %s\n", strerror(errno));
+    }
+    for (int i = 0; i < 3; i++) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+        }
+    }
+    free(bitmap);
+    return ret;
+}
 
 int main(int argc, char *argv[]) {
+    // Options come first. --daemon: hand the work to taesd, which keeps the
+    // derived keys warm
+    int use_daemon = 0;
+    int use_container = 0;
+    const char *in_path = NULL;
+    const char *out_path = NULL;
+    const char *append_path = NULL;
+    const char *shard_arg = NULL;
+    const char *manifest_path = NULL;
+    const char *block_offset_arg = NULL;
+    char *update_paths[3] = {NULL, NULL, NULL};
+    const char *old_length_arg = NULL;
+    int opt = 1;
+    while (opt < argc && strncmp(argv[opt], "--", 2) == 0) {
+        if (strcmp(argv[opt], "--daemon") == 0) {
+            use_daemon = 1;
+            opt++;
+        } else if (strcmp(argv[opt], "--container") == 0) {
+            use_container = 1;
+            opt++;
+        } else if (strcmp(argv[opt], "--append") == 0 && opt + 1 < argc) {
+            append_path = argv[opt + 1];
+            opt += 2;
+        } else if (strcmp(argv[opt], "--shard") == 0 && opt + 1 < argc) {
+            shard_arg = argv[opt + 1];
+            opt += 2;
+        } else if (strcmp(argv[opt], "--manifest") == 0 && opt + 1 < argc) {
+            manifest_path = argv[opt + 1];
+            opt += 2;
+        } else if (strcmp(argv[opt], "--block-offset") == 0 && opt + 1 < argc) {
+            block_offset_arg = argv[opt + 1];
+            opt += 2;
+        } else if (strcmp(argv[opt], "--update") == 0 && opt + 3 < argc) {
+            memcpy(update_paths, argv + opt + 1, sizeof(update_paths));  // Before argv is shifted
+            opt += 4;
+        } else if (strcmp(argv[opt], "--update-blocks") == 0 && opt + 4 < argc) {
+            update_paths[0] = argv[opt + 1];
+            old_length_arg = argv[opt + 2];
+            update_paths[1] = argv[opt + 3];
+            update_paths[2] = argv[opt + 4];
+            opt += 5;
+        } else if (strcmp(argv[opt], "--in") == 0 && opt + 1 < argc) {
+            in_path = argv[opt + 1];
+            opt += 2;
+        } else if (strcmp(argv[opt], "--out") == 0 && opt + 1 < argc) {
+            out_path = argv[opt + 1];
+            opt += 2;
+        } else {
+            argc = 0;  // Unknown option: usage
+            break;
+        }
+    }
+    if (argc > 0) {
+        argv[opt - 1] = argv[0];
+        argv += opt - 1;
+        argc -= opt - 1;
+    }
+
     if (argc < 3 || argc > 4) {
-        fprintf(stderr, "Usage: %s <key_size> <password> [tweak_password]\n", argv[0]);
+        fprintf(stderr, "Usage: %s [--daemon] [--container [--append FILE]] [--shard K/N [--manifest FILE]]\n", argv[0]);
+        fprintf(stderr, "       [--block-offset B] [--update OLD NEW CIPHERTEXT]\n");
+        fprintf(stderr, "       [--update-blocks BITMAP OLD_LENGTH NEW CIPHERTEXT]\n");
+        fprintf(stderr, "       [--in FILE] [--out FILE]\n");
+        fprintf(stderr, "       <key_size> <password> [tweak_password]\n");
         fprintf(stderr, "  key_size: 128, 192, or 256\n");
         fprintf(stderr, "  password: Password for key derivation\n");
         fprintf(stderr, "  tweak_password: Optional password for tweak (enables counter mode)\n");
+        fprintf(stderr, "  --daemon: Send the data to taesd ($TAESD_SOCKET, default\n"
+                        "            $XDG_RUNTIME_DIR/%s)\n", TAESD_SOCKET_NAME);
+        fprintf(stderr, "  --in, --out: Read / write FILE instead of stdin / stdout (mapped, no copies)\n");
+        fprintf(stderr, "  --container: Write a chunked container (parallel and random-access decryption)\n");
+        fprintf(stderr, "  --append: Add the input to the end of container FILE\n");
+        fprintf(stderr, "  --shard: Encrypt only shard K of N of the input (0 <= K < N); the shards'\n");
+        fprintf(stderr, "           outputs concatenated are the whole ciphertext\n");
+        fprintf(stderr, "  --manifest: Write the shard's manifest line to FILE (taes-shard merge/verify)\n");
+        fprintf(stderr, "  --block-offset: The input is the part of a message starting at block B\n");
+        fprintf(stderr, "  --update: Rewrite in place only the blocks of CIPHERTEXT (counter mode of OLD)\n");
+        fprintf(stderr, "            that change for it to become the encryption of NEW\n");
+        fprintf(stderr, "  --update-blocks: The same, given a bitmap of the changed blocks (bit i of byte\n");
+        fprintf(stderr, "                   i/8, low bit first) and OLD's length in bytes instead of OLD\n");
+        return 1;
+    }
+    if ((use_container || append_path) && (use_daemon || argc != 4 || (append_path && (!use_container || out_path)))) {
+        fprintf(stderr, "--container needs a tweak password, without --daemon; --append needs --container, not --out\n");
+        return 1;
+    }
+
+    // Shards: counter mode under the tweak advanced to the shard's block
+    uint32_t shard_index = 0;
+    uint32_t shard_count = 0;
+    uint64_t block_offset = 0;
+    if (shard_arg || manifest_path || block_offset_arg) {
+        if ((shard_arg && parse_shard(shard_arg, &shard_index, &shard_count) != 0) ||
+            (block_offset_arg && parse_u64(block_offset_arg, &block_offset) != 0)) {
+            fprintf(stderr, "Invalid --shard or --block-offset\n");
+            return 1;
+        }
+        if (use_daemon || use_container || argc != 4 || (shard_arg && block_offset_arg) ||
+            (manifest_path && !shard_arg)) {
+            fprintf(stderr, "--shard and --block-offset need counter mode (a tweak password), without --daemon\n");
+            fprintf(stderr, "or --container, and not each other; --manifest needs --shard\n");
+            return 1;
+        }
+    }
+    if (update_paths[0] && (use_daemon || use_container || shard_arg || block_offset_arg || in_path ||
+                         out_path || argc != 4)) {
+        fprintf(stderr, "--update needs counter mode (a tweak password), and no other option\n");
+        return 1;
+    }
+    uint64_t old_length = 0;
+    if (old_length_arg && parse_u64(old_length_arg, &old_length) != 0) {
+        fprintf(stderr, "Invalid --update-blocks OLD_LENGTH\n");
         return 1;
     }
 
@@ -30,6 +310,41 @@ int main(int argc, char *argv[]) {
             return 1;
     }
 
+    if (redirect(in_path, out_path) != 0) {
+        return 1;
+    }
+
+    if (use_container) {
+        return encrypt_container(key_bits, argv[2], argv[3], append_path) == 0 ? 0 : 1;
+    }
+
+    if (use_daemon) {
+        // One request carries the whole plaintext
+        size_t length;
+        uint8_t *data = read_all(stdin, &length);
+        if (!data) {
+            fprintf(stderr, "Cannot read input\n");
+            return 1;
+        }
+        int sock = taesd_connect(NULL);
+        if (sock < 0) {
+            fprintf(stderr, "Cannot connect to taesd\n");
+            free(data);
+            return 1;
+        }
+        int ret = taesd_crypt(sock, 0, key_bits, argv[2], argc == 4 ? argv[3] : NULL, data, length);
+        close(sock);
+        if (ret != 0) {
+            fprintf(stderr, "taesd could not encrypt the input\n");
+            free(data);
+            return 1;
+        }
+        int ok = fwrite(data, 1, length, stdout) == length && fflush(stdout) == 0;
+        memset(data, 0, length);
+        free(data);
+        return ok ? 0 : 1;
+    }
+
     // Derive key from password
     uint8_t key[32];
     if (derive_key_from_password(argv[2], key, key_size) != 0) {
@@ -56,14 +371,38 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    // TODO: Read plaintext from stdin
-    // TODO: Encrypt using either ECB mode (single block) or counter mode (multiple blocks)
-    // TODO: Write ciphertext to stdout
+    if (update_paths[0]) {
+        int ret = encrypt_update(&ctx, old_length_arg != NULL, old_length, update_paths);
+        taes_cleanup(&ctx);
+        memset(key, 0, sizeof(key));
+        memset(tweak, 0, sizeof(tweak));
+        return ret == 0 ? 0 : 1;
+    }
+
+    if (shard_arg) {
+        int ret = encrypt_shard(&ctx, shard_index, shard_count, manifest_path);
+        taes_cleanup(&ctx);
+        memset(key, 0, sizeof(key));
+        memset(tweak, 0, sizeof(tweak));
+        return ret == 0 ? 0 : 1;
+    }
+    taes_advance_tweak(&ctx, block_offset);
+
+    // A regular input file is mapped and encrypted without copies; else read,
+    // encrypt and write overlap (reader thread, cipher workers, this thread)
+    int flags = use_counter_mode ? 0 : TAES_PIPELINE_ECB;
+    int ret = taes_crypt_fd(&ctx, flags, STDIN_FILENO, STDOUT_FILENO, 0);
+    if (ret == TAES_PIPELINE_BAD_LENGTH) {
+        fprintf(stderr, use_counter_mode ? "Counter mode needs more than 16 bytes of input\n"
+                                         : "ECB mode needs a multiple of 16 bytes (give a tweak password)\n");
+    } else if (ret != 0) {
+        fprintf(stderr, "I/O error: %s\n", strerror(errno));
+    }
 
     // Clean up
     taes_cleanup(&ctx);
     memset(key, 0, sizeof(key));
     memset(tweak, 0, sizeof(tweak));
 
-    return 0;
+    return ret == 0 ? 0 : 1;
 }
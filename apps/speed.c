@@ -1,15 +1,45 @@
 // Performance benchmarking application
 // Compares T-AES counter mode vs XTS mode, with and without AES-NI
+#define _POSIX_C_SOURCE 200809L
 #include "../include/taes.h"
 #include "../include/counter_mode.h"
+#include "../include/taes_mb.h"
+#include "../include/taes_pool.h"
+#include "../include/taes_async.h"
+#include "../include/taes_sector.h"
+#include <openssl/evp.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <sched.h>
+#include <sys/wait.h>
 #include <time.h>
+#include <unistd.h>
 
 #define BUFFER_SIZE 4096  // 4KB (one memory page)
 #define NUM_ITERATIONS 100000  // Minimum 100,000 measurements
-#define CLOCK_MONOTONIC 1
+#define KEY_SIZE AES_128_KEY_SIZE
+#define KEY_BATCH 64  // Keys set up per timed key-setup measurement
+#define MB_OBJECTS 64  // Independent objects per timed multi-buffer measurement
+#define PARALLEL_SIZE (64 * 1024 * 1024)  // Buffer of the thread scaling runs
+#define PARALLEL_RUNS 10  // Timed runs per thread count (minimum reported)
+#define SECTOR_RUN (64 * 1024)  // Consecutive sectors per timed sector run
+#define SECTOR_RUNS 2000  // Timed runs per sector size and mode (minimum reported)
+#define CHAIN_SIZE (64 * 1024)  // Message of the scatter-gather runs
+#define CHAIN_RUNS 2000  // Timed runs per fragment size (minimum reported)
+
+// OPENSSL_ia32cap value that masks OpenSSL's AES-NI bit (word 0, bit 57)
+#define OPENSSL_NO_AESNI "~0x200000000000000"
+
+typedef int (*ctr_func)(const taes_ctx *ctx, const uint8_t *in, uint8_t *out, size_t length);
+typedef int (*init_func)(taes_ctx *ctx, const uint8_t *key, int key_size, const uint8_t *tweak);
+
+static int num_iterations = NUM_ITERATIONS;
+static const char *program;
+static FILE *urandom;
+static uint8_t input[BUFFER_SIZE];
+static uint8_t output[BUFFER_SIZE];
 
 // Get time in nanoseconds
 static long long get_time_ns(void) {
@@ -18,32 +48,859 @@ static long long get_time_ns(void) {
     return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
 }
 
+// Fill a buffer from /dev/urandom
+static void random_bytes(uint8_t *buf, size_t len) {
+    if (fread(buf, 1, len, urandom) != len) {
+        fprintf(stderr, "Failed to read /dev/urandom\n");
+        exit(1);
+    }
+}
+
+// Print one result line: minimum time and the matching throughput
+static void report(const char *label, long long min_ns) {
+    printf("  %-32s %9lld ns  %9.1f MB/s\n", label, min_ns, BUFFER_SIZE * 1000.0 / min_ns);
+}
+
+// Counter mode over whole blocks with one taes_encrypt_block_ni() call per
+// block: the single-block baseline the 8-way kernel is compared against
+static int ctr_encrypt_single_ni(const taes_ctx *ctx, const uint8_t *in, uint8_t *out, size_t length) {
+    taes_ctx block_ctx = *ctx;
+    for (size_t i = 0; i < length; i += AES_BLOCK_SIZE) {
+        taes_encrypt_block_ni(&block_ctx, in + i, out + i);
+        taes_advance_tweak(&block_ctx, 1);
+    }
+    return 0;
+}
+
+static int ctr_decrypt_single_ni(const taes_ctx *ctx, const uint8_t *in, uint8_t *out, size_t length) {
+    taes_ctx block_ctx = *ctx;
+    for (size_t i = 0; i < length; i += AES_BLOCK_SIZE) {
+        taes_decrypt_block_ni(&block_ctx, in + i, out + i);
+        taes_advance_tweak(&block_ctx, 1);
+    }
+    return 0;
+}
+
+// Minimum time of one counter-mode call over the 4KB buffer.
+// A new random key and tweak is set up with init on every iteration; key setup is not timed.
+static long long time_ctr(init_func init, ctr_func fn) {
+    long long best = LLONG_MAX;
+    uint8_t key[KEY_SIZE];
+    uint8_t tweak[TWEAK_SIZE];
+    taes_ctx ctx;
+
+    for (int it = 0; it < num_iterations; it++) {
+        random_bytes(key, sizeof(key));
+        random_bytes(tweak, sizeof(tweak));
+        init(&ctx, key, KEY_SIZE, tweak);
+
+        long long start = get_time_ns();
+        fn(&ctx, input, output, BUFFER_SIZE);
+        long long elapsed = get_time_ns() - start;
+
+        if (elapsed < best) {
+            best = elapsed;
+        }
+    }
+
+    taes_cleanup(&ctx);
+    return best;
+}
+
+// Small PRNG for the random-class inputs of time_spread() (keeps
+// /dev/urandom reads out of the loop)
+static uint64_t xorshift64(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+static int compare_ll(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+// Median and interquartile range of sorted samples
+static void quartiles(long long *samples, int n, long long *median, long long *iqr) {
+    qsort(samples, n, sizeof(samples[0]), compare_ll);
+    *median = samples[n / 2];
+    *iqr = samples[3 * n / 4] - samples[n / 4];
+}
+
+// Timing variance of one counter-mode call over the 4KB buffer, as a
+// fixed-vs-random test: "fixed" calls use an all-zero key, tweak and
+// buffer, "random" calls fresh random ones, and the two classes are
+// interleaved at random so drift affects both alike. A constant-time
+// backend shows the same distribution for both; table lookups do not.
+static void report_spread(const char *label, init_func init, ctr_func fn) {
+    long long *samples[2];
+    int count[2] = {0, 0};
+    static uint8_t data[BUFFER_SIZE];
+    uint8_t key[KEY_SIZE];
+    uint8_t tweak[TWEAK_SIZE];
+    uint64_t rng;
+    taes_ctx ctx;
+
+    samples[0] = malloc(sizeof(long long) * num_iterations);
+    samples[1] = malloc(sizeof(long long) * num_iterations);
+    if (!samples[0] || !samples[1]) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    random_bytes((uint8_t *)&rng, sizeof(rng));
+    rng |= 1;
+
+    for (int it = 0; it < num_iterations; it++) {
+        int cls = (int)(xorshift64(&rng) & 1);
+        if (cls == 0) {
+            memset(key, 0, sizeof(key));
+            memset(tweak, 0, sizeof(tweak));
+            memset(data, 0, sizeof(data));
+        } else {
+            for (size_t i = 0; i < sizeof(data); i += 8) {
+                uint64_t r = xorshift64(&rng);
+                memcpy(data + i, &r, 8);
+            }
+            memcpy(key, data, sizeof(key));
+            memcpy(tweak, data + sizeof(key), sizeof(tweak));
+        }
+        init(&ctx, key, KEY_SIZE, tweak);
+
+        long long start = get_time_ns();
+        fn(&ctx, data, output, BUFFER_SIZE);
+        samples[cls][count[cls]++] = get_time_ns() - start;
+    }
+    taes_cleanup(&ctx);
+
+    if (count[0] == 0 || count[1] == 0) {
+        printf("  %-32s too few iterations\n", label);
+    } else {
+        long long median[2], iqr[2];
+        quartiles(samples[0], count[0], &median[0], &iqr[0]);
+        quartiles(samples[1], count[1], &median[1], &iqr[1]);
+        printf("  %-32s fixed %7lld ns (IQR %5lld)  random %7lld ns (IQR %5lld)  diff %+.1f%%\n",
+               label, median[0], iqr[0], median[1], iqr[1],
+               100.0 * (median[1] - median[0]) / median[0]);
+    }
+
+    free(samples[0]);
+    free(samples[1]);
+}
+
 // Benchmark T-AES counter mode
 void benchmark_taes(int use_aes_ni) {
-    // TODO: Implement T-AES counter mode benchmark
-    // 1. Initialize T-AES context with random key and tweak
-    // 2. Allocate 4KB buffer
-    // 3. Run 100,000+ encryption operations
-    // 4. Measure time using clock_gettime()
-    // 5. Report minimum time (maximum throughput)
-    // 6. Repeat for decryption
+    if (!use_aes_ni) {
+        long long byte_enc = time_ctr(taes_init_portable, counter_mode_encrypt_portable);
+        long long byte_dec = time_ctr(taes_init_portable, counter_mode_decrypt_portable);
+        long long table_enc = time_ctr(taes_init_ttable, counter_mode_encrypt_ttable);
+        long long table_dec = time_ctr(taes_init_decrypt_ttable, counter_mode_decrypt_ttable);
+        long long slice_enc = time_ctr(taes_init_bitslice, counter_mode_encrypt_bitslice);
+        long long slice_dec = time_ctr(taes_init_bitslice, counter_mode_decrypt_bitslice);
+
+        report("encrypt (portable, byte-wise)", byte_enc);
+        report("decrypt (portable, byte-wise)", byte_dec);
+        report("encrypt (T-table)", table_enc);
+        report("decrypt (T-table)", table_dec);
+        report("encrypt (bitsliced, 8 blocks)", slice_enc);
+        report("decrypt (bitsliced, 8 blocks)", slice_dec);
+        printf("  T-table speedup: %.2fx encrypt, %.2fx decrypt\n",
+               (double)byte_enc / table_enc, (double)byte_dec / table_dec);
+        printf("  bitsliced speedup: %.2fx encrypt, %.2fx decrypt\n",
+               (double)byte_enc / slice_enc, (double)byte_dec / slice_dec);
+        return;
+    }
+
+    if (!__builtin_cpu_supports("aes")) {
+        printf("  AES-NI not supported on this CPU\n");
+        return;
+    }
+
+    long long single_enc = time_ctr(taes_init_portable, ctr_encrypt_single_ni);
+    long long single_dec = time_ctr(taes_init_portable, ctr_decrypt_single_ni);
+    long long wide_enc = time_ctr(taes_init_portable, counter_mode_encrypt_ni);
+    long long wide_dec_derived = time_ctr(taes_init_portable, counter_mode_decrypt_ni);
+    long long wide_dec = time_ctr(taes_init_decrypt_ni, counter_mode_decrypt_ni);
+
+    report("encrypt (1 block at a time)", single_enc);
+    report("decrypt (1 block at a time)", single_dec);
+    report("encrypt (8 blocks in flight)", wide_enc);
+    report("decrypt (8 in flight, derived)", wide_dec_derived);
+    report("decrypt (8 in flight, dec ctx)", wide_dec);
+    printf("  8-way speedup: %.2fx encrypt, %.2fx decrypt\n",
+           (double)single_enc / wide_enc, (double)single_dec / wide_dec);
+
+    // Whatever decryption costs beyond encryption is the per-block handling
+    // of the tweaked round key (the other round keys are transformed at init)
+    printf("  decrypt/encrypt throughput: %.1f%%\n", 100.0 * wide_enc / wide_dec);
+    printf("  tweaked round key overhead: %.2f ns/block\n",
+           (double)(wide_dec - wide_enc) / (BUFFER_SIZE / AES_BLOCK_SIZE));
+}
+
+// Benchmark the VAES counter-mode kernels at each vector width the CPU has
+void benchmark_vaes(void) {
+    static const int widths[] = {4, 2};
+    int max_lanes = taes_vaes_lanes();
+
+    if (max_lanes == 0) {
+        printf("  VAES not supported on this CPU (AES-NI fallback)\n");
+        return;
+    }
+
+    for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); w++) {
+        if (widths[w] > max_lanes) {
+            continue;
+        }
+        taes_vaes_select(widths[w]);
+
+        char label[48];
+        snprintf(label, sizeof(label), "encrypt (%s, %d blocks/instr)", widths[w] == 4 ? "zmm" : "ymm", widths[w]);
+        report(label, time_ctr(taes_init_portable, counter_mode_encrypt_vaes));
+        snprintf(label, sizeof(label), "decrypt (%s, %d blocks/instr)", widths[w] == 4 ? "zmm" : "ymm", widths[w]);
+        report(label, time_ctr(taes_init_decrypt_ni, counter_mode_decrypt_vaes));
+    }
+
+    taes_vaes_select(max_lanes);
+}
+
+// Minimum time per key of setting up KEY_BATCH contexts.
+// mode 0: taes_init_portable(), 1: taes_init_ni(), 2: taes_init_many_ni()
+static double time_key_setup(int mode, int key_size) {
+    static uint8_t keys[KEY_BATCH][32];
+    static uint8_t tweaks[KEY_BATCH][TWEAK_SIZE];
+    static taes_ctx ctxs[KEY_BATCH];
+    const uint8_t *key_ptrs[KEY_BATCH];
+    const uint8_t *tweak_ptrs[KEY_BATCH];
+    taes_ctx *ctx_ptrs[KEY_BATCH];
+    long long best = LLONG_MAX;
+
+    for (int i = 0; i < KEY_BATCH; i++) {
+        key_ptrs[i] = keys[i];
+        tweak_ptrs[i] = tweaks[i];
+        ctx_ptrs[i] = &ctxs[i];
+    }
+
+    int rounds = num_iterations / KEY_BATCH > 0 ? num_iterations / KEY_BATCH : 1;
+    for (int it = 0; it < rounds; it++) {
+        random_bytes(&keys[0][0], sizeof(keys));
+        random_bytes(&tweaks[0][0], sizeof(tweaks));
+
+        long long start = get_time_ns();
+        if (mode == 2) {
+            taes_init_many_ni(ctx_ptrs, key_ptrs, key_size, tweak_ptrs, KEY_BATCH);
+        } else {
+            for (int i = 0; i < KEY_BATCH; i++) {
+                if (mode == 1) {
+                    taes_init_ni(&ctxs[i], keys[i], key_size, tweaks[i]);
+                } else {
+                    taes_init_portable(&ctxs[i], keys[i], key_size, tweaks[i]);
+                }
+            }
+        }
+        long long elapsed = get_time_ns() - start;
+
+        if (elapsed < best) {
+            best = elapsed;
+        }
+    }
+
+    return (double)best / KEY_BATCH;
+}
+
+// Benchmark key setup cost per key for every key size
+void benchmark_key_setup(void) {
+    int use_aes_ni = __builtin_cpu_supports("aes");
+
+    printf("  %-10s %14s %14s %14s\n", "", "portable", "taes_init_ni", "init_many_ni");
+    for (int key_size = 16; key_size <= 32; key_size += 8) {
+        char label[16];
+        snprintf(label, sizeof(label), "AES-%d", key_size * 8);
+        printf("  %-10s %11.1f ns", label, time_key_setup(0, key_size));
+        if (use_aes_ni) {
+            printf(" %11.1f ns %11.1f ns\n", time_key_setup(1, key_size), time_key_setup(2, key_size));
+        } else {
+            printf(" %14s %14s\n", "n/a", "n/a");
+        }
+    }
+}
+
+// Minimum time per object of encrypting MB_OBJECTS objects of `size` bytes,
+// each under its own key and tweak: one counter_mode_encrypt() call per
+// object, or all of them through the multi-buffer API
+static double time_multi_buffer(size_t size, int multi_buffer) {
+    static uint8_t data[MB_OBJECTS][BUFFER_SIZE];
+    static uint8_t out[MB_OBJECTS][BUFFER_SIZE];
+    static taes_ctx ctxs[MB_OBJECTS];
+    static taes_mb_job jobs[MB_OBJECTS];
+    uint8_t key[KEY_SIZE];
+    uint8_t tweak[TWEAK_SIZE];
+    long long best = LLONG_MAX;
+    taes_mb_mgr mgr;
+
+    random_bytes(&data[0][0], sizeof(data));
+    for (int i = 0; i < MB_OBJECTS; i++) {
+        random_bytes(key, sizeof(key));
+        random_bytes(tweak, sizeof(tweak));
+        taes_init(&ctxs[i], key, KEY_SIZE, tweak);
+        jobs[i] = (taes_mb_job){&ctxs[i], data[i], out[i], size, 0, 0};
+    }
+    taes_mb_init(&mgr);
+
+    int rounds = num_iterations / MB_OBJECTS > 0 ? num_iterations / MB_OBJECTS : 1;
+    for (int it = 0; it < rounds; it++) {
+        long long start = get_time_ns();
+        if (multi_buffer) {
+            for (int i = 0; i < MB_OBJECTS; i++) {
+                taes_mb_submit(&mgr, &jobs[i]);
+            }
+            taes_mb_flush(&mgr);
+        } else {
+            for (int i = 0; i < MB_OBJECTS; i++) {
+                counter_mode_encrypt(&ctxs[i], data[i], out[i], size);
+            }
+        }
+        long long elapsed = get_time_ns() - start;
+
+        if (elapsed < best) {
+            best = elapsed;
+        }
+    }
+
+    for (int i = 0; i < MB_OBJECTS; i++) {
+        taes_cleanup(&ctxs[i]);
+    }
+    return (double)best / MB_OBJECTS;
+}
+
+// Benchmark many small objects with different keys, one by one vs
+// multi-buffer, on the AES-NI and VAES backends
+void benchmark_multi_buffer(void) {
+    static const char *const names[] = {"aesni", "vaes"};
+    static const size_t sizes[] = {64, 256, 1000, 4096};
+    const char *selected = taes_backend_name();
+
+    printf("  %-8s %6s %16s %16s %9s\n", "", "bytes", "one by one", "multi-buffer", "speedup");
+    for (size_t n = 0; n < sizeof(names) / sizeof(names[0]); n++) {
+        if (taes_set_backend(names[n]) != 0) {
+            printf("  %-8s not supported on this CPU\n", names[n]);
+            continue;
+        }
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            double single = time_multi_buffer(sizes[s], 0);
+            double multi = time_multi_buffer(sizes[s], 1);
+            printf("  %-8s %6zu %13.1f ns %13.1f ns %8.2fx\n", names[n], sizes[s], single, multi, single / multi);
+        }
+    }
+
+    taes_set_backend(selected);
+}
+
+// Minimum time per block of encrypting the BUFFER_SIZE / 16 blocks of the
+// input, each under its own random tweak: taes_set_tweak() +
+// taes_encrypt_block() per block, or one taes_encrypt_blocks() call
+static double time_tweak_array(int batched) {
+    enum { BLOCKS = BUFFER_SIZE / AES_BLOCK_SIZE };
+    static uint8_t tweaks[BLOCKS * TWEAK_SIZE];
+    uint8_t key[KEY_SIZE];
+    long long best = LLONG_MAX;
+    taes_ctx ctx;
+
+    random_bytes(key, sizeof(key));
+    random_bytes(tweaks, sizeof(tweaks));
+    taes_init(&ctx, key, KEY_SIZE, NULL);
+
+    for (int it = 0; it < num_iterations; it++) {
+        long long start = get_time_ns();
+        if (batched) {
+            taes_encrypt_blocks(&ctx, input, output, tweaks, BLOCKS);
+        } else {
+            for (int i = 0; i < BLOCKS; i++) {
+                taes_set_tweak(&ctx, tweaks + i * TWEAK_SIZE);
+                taes_encrypt_block(&ctx, input + i * AES_BLOCK_SIZE, output + i * AES_BLOCK_SIZE);
+            }
+        }
+        long long elapsed = get_time_ns() - start;
+
+        if (elapsed < best) {
+            best = elapsed;
+        }
+    }
+
+    taes_cleanup(&ctx);
+    return (double)best / BLOCKS;
+}
+
+// Benchmark blocks with unrelated tweaks (e.g. table cells keyed by row ID)
+// on every backend, block by block vs taes_encrypt_blocks()
+void benchmark_tweak_array(void) {
+    static const char *const names[] = {"portable", "ttable", "bitslice", "aesni", "vaes"};
+    const char *selected = taes_backend_name();
+
+    printf("  %-8s %16s %16s %9s\n", "", "one by one", "tweak array", "speedup");
+    for (size_t n = 0; n < sizeof(names) / sizeof(names[0]); n++) {
+        if (taes_set_backend(names[n]) != 0) {
+            printf("  %-8s not supported on this CPU\n", names[n]);
+            continue;
+        }
+        double single = time_tweak_array(0);
+        double batched = time_tweak_array(1);
+        printf("  %-8s %13.1f ns %13.1f ns %8.2fx\n", names[n], single, batched, single / batched);
+    }
+
+    taes_set_backend(selected);
+}
+
+// Minimum time of encrypting PARALLEL_SIZE bytes on a pool of `threads`
+static long long time_parallel(uint8_t *in, uint8_t *out, int threads) {
+    uint8_t key[KEY_SIZE];
+    uint8_t tweak[TWEAK_SIZE];
+    long long best = LLONG_MAX;
+    taes_ctx ctx;
+
+    taes_pool *pool = taes_pool_create(threads);
+    if (!pool) {
+        return -1;
+    }
+    random_bytes(key, sizeof(key));
+    random_bytes(tweak, sizeof(tweak));
+    taes_init(&ctx, key, KEY_SIZE, tweak);
+
+    for (int it = 0; it < PARALLEL_RUNS; it++) {
+        long long start = get_time_ns();
+        counter_mode_encrypt_parallel(pool, &ctx, in, out, PARALLEL_SIZE, 0);
+        long long elapsed = get_time_ns() - start;
+
+        if (elapsed < best) {
+            best = elapsed;
+        }
+    }
+
+    taes_cleanup(&ctx);
+    taes_pool_destroy(pool);
+    return best;
+}
+
+// Scaling of parallel counter mode: 1, 2, 4, ... threads up to one per CPU
+void benchmark_parallel(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    uint8_t *in = malloc(PARALLEL_SIZE);
+    uint8_t *out = malloc(PARALLEL_SIZE);
+    long long base = 0;
+
+    if (!in || !out) {
+        printf("  cannot allocate %d bytes\n", PARALLEL_SIZE);
+        free(in);
+        free(out);
+        return;
+    }
+    random_bytes(in, PARALLEL_SIZE);
+    memcpy(out, in, PARALLEL_SIZE);  // Touch the pages before timing
+
+    printf("  %7s %14s %10s %9s\n", "threads", "time", "GB/s", "speedup");
+    for (long threads = 1;; threads = 2 * threads < cpus ? 2 * threads : cpus) {
+        long long ns = time_parallel(in, out, (int)threads);
+        if (ns < 0) {
+            printf("  %7ld cannot start threads\n", threads);
+            break;
+        }
+        if (threads == 1) {
+            base = ns;
+        }
+        printf("  %7ld %11.2f ms %10.2f %8.2fx\n", threads, ns / 1e6,
+               (double)PARALLEL_SIZE / ns, (double)base / ns);
+        if (threads >= cpus) {
+            break;
+        }
+    }
+
+    free(in);
+    free(out);
+}
+
+// Minimum time of moving PARALLEL_SIZE bytes of ciphertext to a new key and
+// tweak: decrypt into a plaintext buffer then encrypt it, or taes_transcrypt()
+static long long time_rotation(const uint8_t *in, uint8_t *plain, uint8_t *out, int fused) {
+    uint8_t key[KEY_SIZE];
+    uint8_t tweak[TWEAK_SIZE];
+    long long best = LLONG_MAX;
+    taes_ctx from;
+    taes_ctx to;
+
+    random_bytes(key, sizeof(key));
+    random_bytes(tweak, sizeof(tweak));
+    taes_init_decrypt(&from, key, KEY_SIZE, tweak);
+    random_bytes(key, sizeof(key));
+    random_bytes(tweak, sizeof(tweak));
+    taes_init(&to, key, KEY_SIZE, tweak);
+
+    for (int it = 0; it < PARALLEL_RUNS; it++) {
+        long long start = get_time_ns();
+        if (fused) {
+            taes_transcrypt(&from, &to, in, out, PARALLEL_SIZE);
+        } else {
+            counter_mode_decrypt(&from, in, plain, PARALLEL_SIZE);
+            counter_mode_encrypt(&to, plain, out, PARALLEL_SIZE);
+        }
+        long long elapsed = get_time_ns() - start;
+
+        if (elapsed < best) {
+            best = elapsed;
+        }
+    }
+
+    taes_cleanup(&from);
+    taes_cleanup(&to);
+    return best;
+}
+
+// Key / tweak rotation on one thread, two passes vs one
+void benchmark_rotation(void) {
+    uint8_t *in = malloc(PARALLEL_SIZE);
+    uint8_t *plain = malloc(PARALLEL_SIZE);
+    uint8_t *out = malloc(PARALLEL_SIZE);
+
+    if (!in || !plain || !out) {
+        printf("  cannot allocate %d bytes\n", 3 * PARALLEL_SIZE);
+    } else {
+        random_bytes(in, PARALLEL_SIZE);
+        memcpy(plain, in, PARALLEL_SIZE);  // Touch the pages before timing
+        memcpy(out, in, PARALLEL_SIZE);
+        long long two = time_rotation(in, plain, out, 0);
+        long long one = time_rotation(in, plain, out, 1);
+        printf("  %-22s %8.2f ms %8.2f GB/s\n", "decrypt, then encrypt", two / 1e6, (double)PARALLEL_SIZE / two);
+        printf("  %-22s %8.2f ms %8.2f GB/s (%.2fx)\n", "taes_transcrypt()", one / 1e6,
+               (double)PARALLEL_SIZE / one, (double)two / one);
+    }
+
+    free(in);
+    free(plain);
+    free(out);
+}
+
+// Minimum time per object of encrypting MB_OBJECTS objects of `size` bytes
+// through a queue with one worker: *submit_ns is the caller's share (posting
+// the jobs), the result the time until the last completion was polled
+static double time_async(taes_queue *queue, size_t size, double *submit_ns) {
+    static uint8_t data[MB_OBJECTS][BUFFER_SIZE];
+    static uint8_t out[MB_OBJECTS][BUFFER_SIZE];
+    static taes_ctx ctxs[MB_OBJECTS];
+    uint8_t key[KEY_SIZE];
+    uint8_t tweak[TWEAK_SIZE];
+    long long best = LLONG_MAX;
+    long long best_submit = LLONG_MAX;
+
+    random_bytes(&data[0][0], sizeof(data));
+    for (int i = 0; i < MB_OBJECTS; i++) {
+        random_bytes(key, sizeof(key));
+        random_bytes(tweak, sizeof(tweak));
+        taes_init(&ctxs[i], key, KEY_SIZE, tweak);
+    }
+
+    int rounds = num_iterations / MB_OBJECTS > 0 ? num_iterations / MB_OBJECTS : 1;
+    for (int it = 0; it < rounds; it++) {
+        taes_async_completion completions[MB_OBJECTS];
+        long long start = get_time_ns();
+        for (int i = 0; i < MB_OBJECTS; i++) {
+            taes_async_job job = {&ctxs[i], data[i], out[i], size, 0, NULL};
+            taes_submit(queue, &job);
+        }
+        long long submitted = get_time_ns() - start;
+        for (size_t done = 0; done < MB_OBJECTS;) {
+            size_t n = taes_poll(queue, completions, MB_OBJECTS);
+            if (n == 0) {
+                sched_yield();
+            }
+            done += n;
+        }
+        long long elapsed = get_time_ns() - start;
+
+        if (elapsed < best) {
+            best = elapsed;
+        }
+        if (submitted < best_submit) {
+            best_submit = submitted;
+        }
+    }
+
+    for (int i = 0; i < MB_OBJECTS; i++) {
+        taes_cleanup(&ctxs[i]);
+    }
+    *submit_ns = (double)best_submit / MB_OBJECTS;
+    return (double)best / MB_OBJECTS;
+}
+
+// Benchmark the asynchronous queue against calling counter mode directly
+void benchmark_async(void) {
+    static const size_t sizes[] = {64, 256, 1000, 4096};
+    taes_queue *queue = taes_queue_create(1, MB_OBJECTS);
+
+    if (!queue) {
+        printf("  cannot start the queue\n");
+        return;
+    }
+    printf("  %6s %16s %16s %16s\n", "bytes", "direct", "submit", "completed");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        double submit;
+        double direct = time_multi_buffer(sizes[s], 0);
+        double async = time_async(queue, sizes[s], &submit);
+        printf("  %6zu %13.1f ns %13.1f ns %13.1f ns\n", sizes[s], direct, submit, async);
+    }
+    taes_queue_destroy(queue);
+}
+
+// Minimum time of one XTS call over the 4KB buffer as one sector
+// (OpenSSL EVP_aes_128_xts: two 128-bit keys, the sector number as IV).
+// A new random key and sector number is set up on every iteration; key
+// setup is not timed, as in time_ctr().
+static long long time_xts(int decrypt) {
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    long long best = LLONG_MAX;
+    uint8_t key[2 * KEY_SIZE];
+    uint8_t iv[16];
+    int length;
+
+    for (int it = 0; ctx && it < num_iterations; it++) {
+        random_bytes(key, sizeof(key));
+        random_bytes(iv, sizeof(iv));
+        if (EVP_CipherInit_ex(ctx, EVP_aes_128_xts(), NULL, key, iv, !decrypt) != 1) {
+            break;
+        }
+
+        long long start = get_time_ns();
+        EVP_CipherUpdate(ctx, output, &length, input, BUFFER_SIZE);
+        long long elapsed = get_time_ns() - start;
+
+        if (elapsed < best) {
+            best = elapsed;
+        }
+    }
+
+    EVP_CIPHER_CTX_free(ctx);
+    memset(key, 0, sizeof(key));
+    return best == LLONG_MAX ? -1 : best;
 }
 
 // Benchmark XTS mode (using library implementation)
+// OpenSSL reads OPENSSL_ia32cap when libcrypto is loaded, before main(), so
+// XTS without AES-NI runs in a copy of this program started with the AES-NI
+// bit masked off (unless OPENSSL_ia32cap is set already).
 void benchmark_xts(int use_aes_ni) {
-    // TODO: Implement XTS mode benchmark using library (OpenSSL/Nettle)
-    // 1. Initialize XTS context with random keys
-    // 2. Allocate 4KB buffer
-    // 3. Run 100,000+ encryption operations
-    // 4. Measure time using clock_gettime()
-    // 5. Report minimum time (maximum throughput)
-    // 6. Repeat for decryption
+    if (!use_aes_ni && !getenv("OPENSSL_ia32cap")) {
+        char iterations[16];
+        snprintf(iterations, sizeof(iterations), "%d", num_iterations);
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) {
+            setenv("OPENSSL_ia32cap", OPENSSL_NO_AESNI, 1);
+            execl("/proc/self/exe", program, "--xts-only", iterations, (char *)NULL);
+            _exit(127);
+        }
+        int status;
+        if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            printf("  cannot run without AES-NI\n");
+        }
+        return;
+    }
+    if (use_aes_ni && !__builtin_cpu_supports("aes")) {
+        printf("  AES-NI not supported on this CPU\n");
+        return;
+    }
+
+    long long enc = time_xts(0);
+    long long dec = time_xts(1);
+    if (enc < 0 || dec < 0) {
+        printf("  XTS not available in this OpenSSL\n");
+        return;
+    }
+    report("encrypt", enc);
+    report("decrypt", dec);
+}
+
+// Minimum time of encrypting a CHAIN_SIZE-byte message held in fragments of
+// `fragment` bytes (0: one flat buffer): counter_mode_encryptv() on the
+// chain, or (flatten) copying it into a flat buffer, counter_mode_encrypt()
+// and copying the result back out
+static long long time_chain(size_t fragment, int flatten, uint8_t *in, uint8_t *out, uint8_t *flat) {
+    static struct iovec in_iov[CHAIN_SIZE / 16];
+    static struct iovec out_iov[CHAIN_SIZE / 16];
+    uint8_t key[KEY_SIZE];
+    uint8_t tweak[TWEAK_SIZE];
+    long long best = LLONG_MAX;
+    int n = 0;
+    taes_ctx ctx;
+
+    size_t size = fragment ? fragment : CHAIN_SIZE;
+    for (size_t pos = 0; pos < CHAIN_SIZE; pos += size, n++) {
+        size_t len = CHAIN_SIZE - pos < size ? CHAIN_SIZE - pos : size;
+        in_iov[n] = (struct iovec){in + pos, len};
+        out_iov[n] = (struct iovec){out + pos, len};
+    }
+    random_bytes(key, sizeof(key));
+    random_bytes(tweak, sizeof(tweak));
+    taes_init(&ctx, key, KEY_SIZE, tweak);
+
+    for (int it = 0; it < CHAIN_RUNS; it++) {
+        long long start = get_time_ns();
+        if (flatten) {
+            for (int i = 0, pos = 0; i < n; pos += (int)in_iov[i++].iov_len) {
+                memcpy(flat + pos, in_iov[i].iov_base, in_iov[i].iov_len);
+            }
+            counter_mode_encrypt(&ctx, flat, flat, CHAIN_SIZE);
+            for (int i = 0, pos = 0; i < n; pos += (int)out_iov[i++].iov_len) {
+                memcpy(out_iov[i].iov_base, flat + pos, out_iov[i].iov_len);
+            }
+        } else {
+            counter_mode_encryptv(&ctx, in_iov, n, out_iov, n);
+        }
+        long long elapsed = get_time_ns() - start;
+
+        if (elapsed < best) {
+            best = elapsed;
+        }
+    }
+
+    taes_cleanup(&ctx);
+    return best;
+}
+
+// Scatter-gather against flattening, from packet-sized fragments (not
+// whole blocks) to pages
+void benchmark_chains(void) {
+    static const size_t fragments[] = {64, 1448, 4096};
+    static uint8_t in[CHAIN_SIZE];
+    static uint8_t out[CHAIN_SIZE];
+    static uint8_t flat[CHAIN_SIZE];
+
+    random_bytes(in, sizeof(in));
+    printf("  %-10s %14s %14s\n", "fragment", "flatten", "encryptv");
+    printf("  %-10s %14s %9.1f MB/s\n", "flat", "", CHAIN_SIZE * 1000.0 / time_chain(0, 0, in, out, flat));
+    for (size_t f = 0; f < sizeof(fragments) / sizeof(fragments[0]); f++) {
+        long long flattened = time_chain(fragments[f], 1, in, out, flat);
+        long long chained = time_chain(fragments[f], 0, in, out, flat);
+        printf("  %-10zu %9.1f MB/s %9.1f MB/s\n", fragments[f], CHAIN_SIZE * 1000.0 / flattened,
+               CHAIN_SIZE * 1000.0 / chained);
+    }
+}
+
+// Minimum time of a SECTOR_RUN-byte run of consecutive sectors, starting at
+// a random sector number: OpenSSL XTS with one EVP call per sector (each
+// has its own IV), or T-AES with one taes_sector_encrypt() call per run
+static long long time_sectors(size_t sector_size, int xts, int decrypt, uint8_t *in, uint8_t *out) {
+    EVP_CIPHER_CTX *evp = EVP_CIPHER_CTX_new();
+    uint8_t key[2 * KEY_SIZE];
+    uint8_t tweak[TWEAK_SIZE];
+    long long best = LLONG_MAX;
+    size_t count = SECTOR_RUN / sector_size;
+    taes_ctx ctx;
+
+    random_bytes(key, sizeof(key));
+    random_bytes(tweak, sizeof(tweak));
+    if (!evp || EVP_CipherInit_ex(evp, EVP_aes_128_xts(), NULL, key, NULL, !decrypt) != 1) {
+        EVP_CIPHER_CTX_free(evp);
+        return -1;
+    }
+    if (decrypt) {
+        taes_init_decrypt(&ctx, key, KEY_SIZE, tweak);
+    } else {
+        taes_init(&ctx, key, KEY_SIZE, tweak);
+    }
+
+    for (int it = 0; it < SECTOR_RUNS; it++) {
+        uint64_t sector;
+        random_bytes((uint8_t *)&sector, sizeof(sector));
+        sector >>= 24;
+
+        long long start = get_time_ns();
+        if (xts) {
+            for (size_t s = 0; s < count; s++) {
+                uint8_t iv[16] = {0};
+                int length;
+                for (int i = 0; i < 8; i++) {
+                    iv[i] = (uint8_t)((sector + s) >> (8 * i));
+                }
+                EVP_CipherInit_ex(evp, NULL, NULL, NULL, iv, -1);
+                EVP_CipherUpdate(evp, out + s * sector_size, &length, in + s * sector_size, (int)sector_size);
+            }
+        } else if (decrypt) {
+            taes_sector_decrypt(&ctx, sector, sector_size, in, out, count);
+        } else {
+            taes_sector_encrypt(&ctx, sector, sector_size, in, out, count);
+        }
+        long long elapsed = get_time_ns() - start;
+
+        if (elapsed < best) {
+            best = elapsed;
+        }
+    }
+
+    EVP_CIPHER_CTX_free(evp);
+    taes_cleanup(&ctx);
+    memset(key, 0, sizeof(key));
+    return best;
+}
+
+// The disk workload both ways, for 512-byte and 4 KB sectors
+void benchmark_sectors(void) {
+    static const size_t sizes[] = {TAES_SECTOR_512, TAES_SECTOR_4K};
+    static uint8_t in[SECTOR_RUN];
+    static uint8_t out[SECTOR_RUN];
+
+    random_bytes(in, sizeof(in));
+    printf("  %6s %-8s %14s %14s %9s\n", "sector", "", "XTS", "T-AES", "speedup");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for (int decrypt = 0; decrypt < 2; decrypt++) {
+            long long xts = time_sectors(sizes[s], 1, decrypt, in, out);
+            long long taes = time_sectors(sizes[s], 0, decrypt, in, out);
+            if (xts < 0) {
+                printf("  XTS not available in this OpenSSL\n");
+                return;
+            }
+            printf("  %6zu %-8s %9.1f MB/s %9.1f MB/s %8.2fx\n", sizes[s], decrypt ? "decrypt" : "encrypt",
+                   SECTOR_RUN * 1000.0 / xts, SECTOR_RUN * 1000.0 / taes, (double)xts / taes);
+        }
+    }
 }
 
-int main(void) {
+int main(int argc, char *argv[]) {
+    program = argv[0];
+
+    // The copy started by benchmark_xts(0)
+    int xts_only = argc == 3 && strcmp(argv[1], "--xts-only") == 0;
+    if (xts_only) {
+        argv++;
+        argc--;
+    }
+
+    if (argc > 2) {
+        fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+    if (argc == 2) {
+        num_iterations = atoi(argv[1]);
+        if (num_iterations <= 0) {
+            fprintf(stderr, "Invalid iteration count\n");
+            return 1;
+        }
+    }
+
+    urandom = fopen("/dev/urandom", "rb");
+    if (!urandom) {
+        fprintf(stderr, "Cannot open /dev/urandom\n");
+        return 1;
+    }
+    random_bytes(input, sizeof(input));
+
+    if (xts_only) {
+        benchmark_xts(0);
+        fclose(urandom);
+        return 0;
+    }
+
     printf("T-AES Performance Benchmark\n");
     printf("Buffer size: %d bytes\n", BUFFER_SIZE);
-    printf("Iterations: %d\n\n", NUM_ITERATIONS);
+    printf("Key size: %d bits\n", KEY_SIZE * 8);
+    printf("Iterations: %d\n\n", num_iterations);
 
     // Benchmark XTS without AES-NI
     printf("XTS (library, no AES-NI):\n");
@@ -57,9 +914,61 @@ int main(void) {
     printf("\nT-AES counter mode (no AES-NI):\n");
     benchmark_taes(0);
 
+    // Timing variance of the backends usable without AES-NI
+    printf("\nTiming variance, fixed vs random key/tweak/data (median per 4KB call):\n");
+    report_spread("encrypt (T-table)", taes_init_ttable, counter_mode_encrypt_ttable);
+    report_spread("decrypt (T-table)", taes_init_decrypt_ttable, counter_mode_decrypt_ttable);
+    report_spread("encrypt (bitsliced)", taes_init_bitslice, counter_mode_encrypt_bitslice);
+    report_spread("decrypt (bitsliced)", taes_init_bitslice, counter_mode_decrypt_bitslice);
+
     // Benchmark T-AES with AES-NI
     printf("\nT-AES counter mode (with AES-NI):\n");
     benchmark_taes(1);
 
+    // Benchmark T-AES with VAES
+    printf("\nT-AES counter mode (VAES):\n");
+    benchmark_vaes();
+
+    // The public API, on whatever backend the dispatcher picked
+    printf("\nT-AES counter mode (public API, backend \"%s\"):\n", taes_backend_name());
+    report("encrypt", time_ctr(taes_init, counter_mode_encrypt));
+    report("decrypt", time_ctr(taes_init_decrypt, counter_mode_decrypt));
+
+    // Disk sectors: the workload XTS is built for
+    printf("\nSectors, %d KB runs of consecutive sectors (backend \"%s\"):\n", SECTOR_RUN / 1024,
+           taes_backend_name());
+    benchmark_sectors();
+
+    // Messages in fragments
+    printf("\nScatter-gather, %d KB message (backend \"%s\"):\n", CHAIN_SIZE / 1024, taes_backend_name());
+    benchmark_chains();
+
+    // Large buffers split over threads
+    printf("\nParallel counter mode, %d MB (backend \"%s\"):\n", PARALLEL_SIZE >> 20, taes_backend_name());
+    benchmark_parallel();
+
+    // Re-keying ciphertext without a plaintext pass through memory
+    printf("\nKey / tweak rotation, %d MB on one thread (backend \"%s\"):\n", PARALLEL_SIZE >> 20,
+           taes_backend_name());
+    benchmark_rotation();
+
+    // Many small objects, each with its own key and tweak
+    printf("\nMulti-buffer, %d objects with different keys (per object):\n", MB_OBJECTS);
+    benchmark_multi_buffer();
+
+    // Offloading jobs to a worker thread
+    printf("\nAsync queue, %d objects, 1 worker (per object, backend \"%s\"):\n", MB_OBJECTS,
+           taes_backend_name());
+    benchmark_async();
+
+    // Blocks with a tweak each, one key
+    printf("\nPer-block tweaks, %d blocks (per block):\n", BUFFER_SIZE / AES_BLOCK_SIZE);
+    benchmark_tweak_array();
+
+    // Key agility: the cost of switching keys
+    printf("\nKey setup (per key, key + tweak):\n");
+    benchmark_key_setup();
+
+    fclose(urandom);
     return 0;
 }
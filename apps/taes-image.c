@@ -0,0 +1,183 @@
+// In-place disk image encryption: encrypts a file or block device where it
+// lies, resumable from its journal after an interruption
+#define _POSIX_C_SOURCE 200809L
+#include "../include/taes.h"
+#include "../include/taes_image.h"
+#include "../include/taes_sector.h"
+#include "../include/taes_utils.h"
+#include <errno.h>
+#include <linux/magic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <time.h>
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// The journal must outlive a power cut, or the run it records cannot be
+// resumed. Returns 0, or -1 if journal_path (or the directory it would be
+// created in) is on tmpfs or ramfs, /dev included, unless the image is on
+// that same file system and goes with it.
+static int check_journal(const char *journal_path, const struct stat *image_st) {
+    char *dir = malloc(strlen(journal_path) + 2);
+    if (!dir) {
+        return -1;
+    }
+    strcpy(dir, journal_path);
+    struct stat st;
+    if (stat(journal_path, &st) != 0) {
+        char *slash = strrchr(dir, '/');
+        if (!slash) {
+            strcpy(dir, ".");
+        } else {
+            slash[slash == dir] = '\0';  // "/j" -> "/"
+        }
+    }
+    struct statfs fs;
+    int ret = 0;
+    if (statfs(dir, &fs) == 0 && (fs.f_type == TMPFS_MAGIC || fs.f_type == RAMFS_MAGIC) &&
+        (stat(dir, &st) != 0 || !S_ISREG(image_st->st_mode) || st.st_dev != image_st->st_dev)) {
+        fprintf(stderr, "Journal %s is on tmpfs and would be lost on reboot; give --journal FILE on a "
+                "disk\n", journal_path);
+        ret = -1;
+    }
+    free(dir);
+    return ret;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [--decrypt] [--sector 512|4096] [--threads N] [--journal FILE]\n", name);
+    fprintf(stderr, "       <key_size> <password> <tweak_password> <image>\n");
+    fprintf(stderr, "  key_size: 128, 192, or 256\n");
+    fprintf(stderr, "  image: File or block device, encrypted (or decrypted) in place\n");
+    fprintf(stderr, "  --sector: Sector size (default 4096); decrypt with the one used to encrypt\n");
+    fprintf(stderr, "  --threads: Windows in flight (default: one per CPU, at least 4)\n");
+    fprintf(stderr, "  --journal: Checkpoint journal (default IMAGE.taes-journal for a regular file;\n");
+    fprintf(stderr, "             required for a device); run again to resume\n");
+}
+
+int main(int argc, char *argv[]) {
+    taes_image_options options = {0};
+    const char *journal_path = NULL;
+    int opt = 1;
+    while (opt < argc && strncmp(argv[opt], "--", 2) == 0) {
+        if (strcmp(argv[opt], "--decrypt") == 0) {
+            options.flags |= TAES_IMAGE_DECRYPT;
+            opt++;
+        } else if (strcmp(argv[opt], "--sector") == 0 && opt + 1 < argc) {
+            options.sector_size = (size_t)atoi(argv[opt + 1]);
+            if (options.sector_size != TAES_SECTOR_512 && options.sector_size != TAES_SECTOR_4K) {
+                fprintf(stderr, "Invalid sector size. Must be 512 or 4096.\n");
+                return 1;
+            }
+            opt += 2;
+        } else if (strcmp(argv[opt], "--threads") == 0 && opt + 1 < argc) {
+            options.threads = atoi(argv[opt + 1]);
+            opt += 2;
+        } else if (strcmp(argv[opt], "--journal") == 0 && opt + 1 < argc) {
+            journal_path = argv[opt + 1];
+            opt += 2;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (argc - opt != 4) {
+        usage(argv[0]);
+        return 1;
+    }
+    const char *image_path = argv[opt + 3];
+
+    int key_bits = atoi(argv[opt]);
+    int key_size;
+    switch (key_bits) {
+        case 128: key_size = 16; break;
+        case 192: key_size = 24; break;
+        case 256: key_size = 32; break;
+        default:
+            fprintf(stderr, "Invalid key size. Must be 128, 192, or 256.\n");
+            return 1;
+    }
+
+    struct stat image_st;
+    if (stat(image_path, &image_st) != 0) {
+        perror(image_path);
+        return 1;
+    }
+    if (!journal_path && !S_ISREG(image_st.st_mode)) {
+        fprintf(stderr, "%s is not a regular file: give --journal FILE on a disk that survives a reboot\n",
+                image_path);
+        return 1;
+    }
+
+    char *default_journal = NULL;
+    if (!journal_path) {
+        default_journal = malloc(strlen(image_path) + sizeof(".taes-journal"));
+        if (!default_journal) {
+            return 1;
+        }
+        strcpy(default_journal, image_path);
+        strcat(default_journal, ".taes-journal");
+        journal_path = default_journal;
+    }
+    if (check_journal(journal_path, &image_st) != 0) {
+        free(default_journal);
+        return 1;
+    }
+
+    uint8_t key[32];
+    uint8_t tweak[TWEAK_SIZE];
+    taes_ctx enc;
+    taes_ctx dec;
+    if (derive_key_from_password(argv[opt + 1], key, key_size) != 0 ||
+        derive_tweak_from_password(argv[opt + 2], tweak) != 0) {
+        fprintf(stderr, "Key derivation failed\n");
+        free(default_journal);
+        return 1;
+    }
+    if (taes_init(&enc, key, key_size, tweak) != 0 || taes_init_decrypt(&dec, key, key_size, tweak) != 0) {
+        fprintf(stderr, "T-AES initialization failed\n");
+        free(default_journal);
+        return 1;
+    }
+    memset(key, 0, sizeof(key));
+    memset(tweak, 0, sizeof(tweak));
+
+    taes_image_stats stats;
+    double start = now_seconds();
+    int ret = taes_image_crypt(&enc, &dec, image_path, journal_path, &options, &stats);
+    double elapsed = now_seconds() - start;
+    const char *done = options.flags & TAES_IMAGE_DECRYPT ? "Decrypted" : "Encrypted";
+
+    if (ret == 0) {
+        if (stats.resumed_at > 0) {
+            fprintf(stderr, "Resumed at byte %llu\n", (unsigned long long)stats.resumed_at);
+        }
+        fprintf(stderr, "%s %.1f MB (%.1f MB of holes skipped) in %.2f s, %.1f MB/s\n", done,
+                stats.processed / 1e6, stats.skipped / 1e6, elapsed,
+                elapsed > 0 ? stats.processed / 1e6 / elapsed : 0.0);
+        fprintf(stderr, "Journal %s records the finished run; keep it to stop a second run\n",
+                journal_path);
+    } else if (ret == TAES_IMAGE_COMPLETE) {
+        fprintf(stderr, "%s: already %s (journal %s); remove the journal to run again\n", image_path,
+                options.flags & TAES_IMAGE_DECRYPT ? "decrypted" : "encrypted", journal_path);
+    } else if (ret == TAES_IMAGE_MISMATCH) {
+        fprintf(stderr, "%s: journal %s is for another image, key or sector size, or for an "
+                "unfinished run the other way\n", image_path, journal_path);
+    } else if (errno == EINVAL) {
+        fprintf(stderr, "%s: size is not a multiple of the sector size\n", image_path);
+    } else {
+        fprintf(stderr, "%s: %s (run again to resume)\n", image_path, strerror(errno));
+    }
+
+    taes_cleanup(&enc);
+    taes_cleanup(&dec);
+    free(default_journal);
+    return ret == 0 ? 0 : 1;
+}
@@ -0,0 +1,145 @@
+// Shard manifests: merge the lines written by encrypt --shard --manifest,
+// and verify a reassembled ciphertext against them (no key needed)
+#define _POSIX_C_SOURCE 200809L
+#include "../include/taes_shard.h"
+#include "../include/taes_pool.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Append the manifest lines of path to *shards; -1 after reporting an error
+static int read_manifest(const char *path, taes_shard **shards, size_t *count, size_t *capacity) {
+    FILE *f = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    char line[TAES_SHARD_LINE_MAX];
+    int ret = 0;
+    for (int number = 1; ret == 0 && fgets(line, sizeof(line), f); number++) {
+        if (line[strspn(line, " \t\r\n")] == '\0') {
+            continue;
+        }
+        if (*count == *capacity) {
+            size_t bigger = *capacity ? 2 * *capacity : 16;
+            taes_shard *grown = realloc(*shards, bigger * sizeof(taes_shard));
+            if (!grown) {
+                fprintf(stderr, "Out of memory\n");
+                ret = -1;
+                break;
+            }
+            *shards = grown;
+            *capacity = bigger;
+        }
+        if (taes_shard_parse(line, &(*shards)[*count]) != 0) {
+            fprintf(stderr, "%s:%d: not a shard manifest line\n", path, number);
+            ret = -1;
+        } else {
+            (*count)++;
+        }
+    }
+    if (ret == 0 && ferror(f)) {
+        perror(path);
+        ret = -1;
+    }
+    if (f != stdin) {
+        fclose(f);
+    }
+    return ret;
+}
+
+// The lines of every manifest, checked to be one message's complete set
+static taes_shard *read_set(char *const paths[], int npaths, size_t *count) {
+    taes_shard *shards = NULL;
+    size_t capacity = 0;
+    *count = 0;
+    for (int i = 0; i < npaths; i++) {
+        if (read_manifest(paths[i], &shards, count, &capacity) != 0) {
+            free(shards);
+            return NULL;
+        }
+    }
+    if (taes_shard_check_set(shards, *count) != 0) {
+        fprintf(stderr, "The manifests are not one message's shards 0 to N-1, each once (%zu lines)\n", *count);
+        free(shards);
+        return NULL;
+    }
+    return shards;
+}
+
+static int merge(const char *out_path, char *const paths[], int npaths) {
+    size_t count;
+    taes_shard *shards = read_set(paths, npaths, &count);
+    if (!shards) {
+        return 1;
+    }
+    FILE *out = strcmp(out_path, "-") == 0 ? stdout : fopen(out_path, "w");
+    int ok = out != NULL;
+    char line[TAES_SHARD_LINE_MAX];
+    for (size_t i = 0; ok && i < count; i++) {
+        taes_shard_format(&shards[i], line);
+        ok = fputs(line, out) != EOF;
+    }
+    if (out && out != stdout) {
+        ok = fclose(out) == 0 && ok;
+    } else if (out) {
+        ok = fflush(out) == 0 && ok;
+    }
+    if (!ok) {
+        perror(out_path);
+    } else {
+        fprintf(stderr, "Merged %zu shards of a %llu-byte message\n", count,
+                (unsigned long long)shards[0].total);
+    }
+    free(shards);
+    return ok ? 0 : 1;
+}
+
+static int verify(const char *manifest_path, const char *file_path) {
+    size_t count;
+    char *paths[] = {(char *)manifest_path};
+    taes_shard *shards = read_set(paths, 1, &count);
+    if (!shards) {
+        return 1;
+    }
+    int fd = open(file_path, O_RDONLY | O_CLOEXEC);
+    taes_pool *pool = fd >= 0 ? taes_pool_create(0) : NULL;
+    uint32_t bad = 0;
+    int ret = pool ? taes_shard_verify_fd(fd, shards, count, pool, &bad) : -1;
+    if (ret == 0) {
+        printf("%s: OK (%zu shards, %llu bytes)\n", file_path, count, (unsigned long long)shards[0].total);
+    } else if (ret == TAES_SHARD_MISMATCH && bad == count) {
+        printf("%s: FAILED: not %llu bytes long\n", file_path, (unsigned long long)shards[0].total);
+    } else if (ret == TAES_SHARD_MISMATCH) {
+        printf("%s: FAILED: shard %u (bytes %llu to %llu) differs\n", file_path, bad,
+               (unsigned long long)shards[bad].offset,
+               (unsigned long long)(shards[bad].offset + shards[bad].length));
+    } else {
+        fprintf(stderr, "%s: %s\n", file_path, strerror(errno));
+    }
+    taes_pool_destroy(pool);
+    if (fd >= 0) {
+        close(fd);
+    }
+    free(shards);
+    return ret == 0 ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc >= 4 && strcmp(argv[1], "merge") == 0) {
+        return merge(argv[2], argv + 3, argc - 3);
+    }
+    if (argc == 4 && strcmp(argv[1], "verify") == 0) {
+        return verify(argv[2], argv[3]);
+    }
+    fprintf(stderr, "Usage: %s merge <out_manifest> <shard_manifest>...\n", argv[0]);
+    fprintf(stderr, "       %s verify <manifest> <file>\n", argv[0]);
+    fprintf(stderr, "  merge: Check that the lines of encrypt --shard --manifest are all N shards of\n");
+    fprintf(stderr, "         one message, and write them in order (- for stdout)\n");
+    fprintf(stderr, "  verify: Check the length and every shard's SHA-256 of a reassembled ciphertext\n");
+    fprintf(stderr, "          (cat of the shards in order)\n");
+    return 1;
+}
@@ -0,0 +1,710 @@
+// Local encryption daemon
+// Keeps a context per (key size, password, tweak password) seen recently,
+// so clients skip PBKDF2 and key expansion, and runs the requests of all
+// clients through one asynchronous queue, whose workers batch them into
+// the multi-buffer kernels. One thread polls the socket: requests are read
+// and answered without blocking while the queue works, and contexts not
+// cached yet are derived by helper threads. Protocol: taesd.h.
+#define _GNU_SOURCE
+#include "../include/taes.h"
+#include "../include/taes_async.h"
+#include "../include/taes_utils.h"
+#include "../include/taesd.h"
+#include <openssl/evp.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_CLIENTS 256       // Also the queue depth, so taes_submit() never finds it full
+#define CACHE_SIZE 64         // Contexts kept warm
+#define LATENCY_SAMPLES 4096  // Latest request latencies kept for the percentiles
+
+// A warm context, found by the SHA-256 of the request's key size and secrets
+typedef struct {
+    uint8_t digest[32];
+    int valid;
+    int deriving;             // A helper thread is deriving ctx
+    int refs;                 // Requests in flight using it (not evicted meanwhile)
+    unsigned long last_used;
+    taes_ctx ctx;
+} cache_entry;
+
+enum { READING, DERIVING, RUNNING, WRITING };
+
+typedef struct {
+    int in_use;
+    int fd;                   // -1 once the peer is gone
+    int state;
+    taesd_request req;
+    size_t header_got;
+    uint8_t *body;            // Password, tweak password, then inline data
+    size_t body_len;
+    size_t body_got;
+    int shm_fd;               // memfd of a shared-memory request, or -1
+    uint8_t *shm;             // Its mapping
+    uint8_t *data;            // The request's data, in body or shm
+    cache_entry *entry;
+    taesd_response resp;
+    uint8_t *reply;           // Bytes following the response
+    size_t sent;              // Of response and reply
+    long long start;          // When the request had been received
+} client;
+
+static client clients[MAX_CLIENTS];
+static cache_entry cache[CACHE_SIZE];
+static unsigned long cache_clock;
+static taes_queue *queue;
+
+static long long started;
+static unsigned long long requests;
+static unsigned long long failures;
+static unsigned long long bytes_done;
+static long long latencies[LATENCY_SAMPLES];
+static unsigned long long latency_count;
+
+static volatile sig_atomic_t stop;
+
+static long long get_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void on_signal(int sig) {
+    (void)sig;
+    stop = 1;
+}
+
+// A context being derived by a helper thread, handed back through derive_pipe
+typedef struct {
+    cache_entry *entry;
+    int key_size;
+    int tweak;                // Nonzero: derive the tweak from tweak_password
+    char password[TAESD_SECRET_MAX + 1];
+    char tweak_password[TAESD_SECRET_MAX + 1];
+    int ok;
+    taes_ctx ctx;
+} derivation;
+
+static int derive_pipe[2] = {-1, -1};
+
+static void wipe_derivation(derivation *d) {
+    memset(d, 0, sizeof(*d));
+    free(d);
+}
+
+// PBKDF2 and key expansion, the cost the daemon saves its clients. Runs off
+// the event loop: ~100 ms here would stall every other client.
+static void *derive_thread(void *arg) {
+    derivation *d = arg;
+    uint8_t key[32];
+    uint8_t tweak[TWEAK_SIZE] = {0};
+
+    d->ok = derive_key_from_password(d->password, key, d->key_size) == 0 &&
+            (!d->tweak || derive_tweak_from_password(d->tweak_password, tweak) == 0) &&
+            taes_init_decrypt(&d->ctx, key, d->key_size, tweak) == 0;
+    memset(key, 0, sizeof(key));
+    memset(tweak, 0, sizeof(tweak));
+    memset(d->password, 0, sizeof(d->password));
+    memset(d->tweak_password, 0, sizeof(d->tweak_password));
+
+    if (write(derive_pipe[1], &d, sizeof(d)) != (ssize_t)sizeof(d)) {
+        wipe_derivation(d);  // The daemon is stopping
+    }
+    return NULL;
+}
+
+// Context for a request's key size and secrets: cached, being derived, or
+// handed to a helper thread now. NULL if none can be had.
+static cache_entry *lookup(const taesd_request *req, const uint8_t *secrets) {
+    uint8_t digest[32];
+    EVP_MD_CTX *md = EVP_MD_CTX_new();
+    int ok = md && EVP_DigestInit_ex(md, EVP_sha256(), NULL) == 1 &&
+             EVP_DigestUpdate(md, &req->key_bits, sizeof(req->key_bits)) == 1 &&
+             EVP_DigestUpdate(md, &req->password_len, sizeof(req->password_len)) == 1 &&
+             EVP_DigestUpdate(md, &req->tweak_len, sizeof(req->tweak_len)) == 1 &&
+             EVP_DigestUpdate(md, secrets, req->password_len + req->tweak_len) == 1 &&
+             EVP_DigestFinal_ex(md, digest, NULL) == 1;
+    EVP_MD_CTX_free(md);
+    if (!ok) {
+        return NULL;
+    }
+
+    cache_entry *victim = NULL;
+    for (int i = 0; i < CACHE_SIZE; i++) {
+        cache_entry *e = &cache[i];
+        if ((e->valid || e->deriving) && memcmp(e->digest, digest, sizeof(digest)) == 0) {
+            e->last_used = ++cache_clock;
+            return e;
+        }
+        if (e->refs == 0 && !e->deriving &&
+            (!victim || !e->valid || (victim->valid && e->last_used < victim->last_used))) {
+            victim = e;
+        }
+    }
+    if (!victim) {
+        return NULL;
+    }
+
+    // Derive as the CLIs do; the secrets become C strings for utils.c.
+    // Aligned for the taes_ctx in it (calloc() only aligns to 16); sizeof is
+    // a multiple of the alignment, as aligned_alloc() needs.
+    derivation *d = aligned_alloc(_Alignof(derivation), sizeof(*d));
+    if (!d) {
+        return NULL;
+    }
+    memset(d, 0, sizeof(*d));
+    d->entry = victim;
+    d->key_size = (int)req->key_bits / 8;
+    d->tweak = req->tweak_len != 0;
+    memcpy(d->password, secrets, req->password_len);
+    memcpy(d->tweak_password, secrets + req->password_len, req->tweak_len);
+
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int ret = pthread_create(&thread, &attr, derive_thread, d);
+    pthread_attr_destroy(&attr);
+    if (ret != 0) {
+        wipe_derivation(d);
+        return NULL;
+    }
+
+    taes_cleanup(&victim->ctx);
+    victim->valid = 0;
+    victim->deriving = 1;
+    memcpy(victim->digest, digest, sizeof(digest));
+    victim->last_used = ++cache_clock;
+    return victim;
+}
+
+// Back to waiting for the next request, with the last one's buffers wiped
+static void client_reset(client *c) {
+    if (c->body) {
+        memset(c->body, 0, c->body_len);
+        free(c->body);
+    }
+    if (c->reply && c->reply != c->data) {
+        free(c->reply);
+    }
+    if (c->shm) {
+        munmap(c->shm, c->req.length);
+    }
+    if (c->shm_fd >= 0) {
+        close(c->shm_fd);
+    }
+    c->body = NULL;
+    c->reply = NULL;
+    c->shm = NULL;
+    c->shm_fd = -1;
+    c->data = NULL;
+    c->entry = NULL;
+    c->header_got = 0;
+    c->body_len = 0;
+    c->body_got = 0;
+    c->sent = 0;
+    c->state = READING;
+}
+
+static void client_close(client *c) {
+    if (c->fd >= 0) {
+        close(c->fd);
+        c->fd = -1;
+    }
+    // The queue may still be working on the buffers
+    if (c->state != RUNNING && c->state != DERIVING) {
+        client_reset(c);
+        c->in_use = 0;
+    }
+}
+
+// The request is done: answer it
+static void finish(client *c, int status) {
+    int inline_data = status == 0 && c->req.op != TAESD_OP_STATS && !c->shm;
+
+    if (c->entry) {
+        c->entry->refs--;
+    }
+    requests++;
+    if (status != 0) {
+        failures++;
+    } else if (c->req.op != TAESD_OP_STATS) {
+        bytes_done += c->req.length;
+    }
+
+    c->resp = (taesd_response){status, 0, inline_data ? c->req.length : 0};
+    if (inline_data) {
+        c->reply = c->data;
+    }
+    c->sent = 0;
+    c->state = WRITING;
+}
+
+static int compare_ll(const void *a, const void *b) {
+    long long x = *(const long long *)a;
+    long long y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+// Answer a stats request: the text becomes the reply
+static void reply_stats(client *c) {
+    static long long sorted[LATENCY_SAMPLES];
+    size_t n = latency_count < LATENCY_SAMPLES ? (size_t)latency_count : LATENCY_SAMPLES;
+    double uptime = (get_time_ns() - started) / 1e9;
+    int cached = 0;
+
+    memcpy(sorted, latencies, n * sizeof(sorted[0]));
+    qsort(sorted, n, sizeof(sorted[0]), compare_ll);
+    for (int i = 0; i < CACHE_SIZE; i++) {
+        cached += cache[i].valid;
+    }
+
+    char *text = malloc(1024);
+    if (!text) {
+        finish(c, -1);
+        return;
+    }
+    int len = snprintf(text, 1024,
+                       "backend: %s\n"
+                       "uptime: %.1f s\n"
+                       "requests: %llu (%llu failed)\n"
+                       "bytes: %llu\n"
+                       "throughput: %.2f MB/s, %.1f requests/s\n"
+                       "latency: p50 %.1f us, p99 %.1f us (last %zu requests)\n"
+                       "cached contexts: %d of %d\n",
+                       taes_backend_name(), uptime, requests, failures, bytes_done,
+                       bytes_done / uptime / 1e6, requests / uptime,
+                       n ? sorted[n / 2] / 1e3 : 0.0, n ? sorted[n * 99 / 100] / 1e3 : 0.0, n,
+                       cached, CACHE_SIZE);
+    finish(c, 0);
+    c->reply = (uint8_t *)text;
+    c->resp.length = (uint64_t)len;
+}
+
+// The request's context is ready: run it, or hand it to the queue
+static void run(client *c) {
+    const taesd_request *req = &c->req;
+    int decrypt = req->op == TAESD_OP_DECRYPT;
+
+    if (!c->entry->valid) {
+        finish(c, -1);
+        return;
+    }
+    if (req->tweak_len == 0) {
+        // ECB: rare, and no better off in the queue
+        int status = decrypt ? ecb_decrypt(&c->entry->ctx, c->data, c->data, req->length)
+                             : ecb_encrypt(&c->entry->ctx, c->data, c->data, req->length);
+        finish(c, status);
+        return;
+    }
+
+    taes_async_job job = {&c->entry->ctx, c->data, c->data, req->length, decrypt, c};
+    if (taes_submit(queue, &job) != 0) {
+        finish(c, -1);
+        return;
+    }
+    c->state = RUNNING;
+}
+
+// The whole request has arrived: look up its context
+static void dispatch(client *c) {
+    const taesd_request *req = &c->req;
+
+    c->start = get_time_ns();
+    if (req->op == TAESD_OP_STATS) {
+        reply_stats(c);
+        return;
+    }
+
+    if (req->shm) {
+        // A memfd shorter than the request, or one its sender could still
+        // shrink, would fault the daemon (SIGBUS) when the mapping is used
+        struct stat st;
+        int seals = c->shm_fd >= 0 ? fcntl(c->shm_fd, F_GET_SEALS) : -1;
+        if (seals < 0 || !(seals & F_SEAL_SHRINK) || fstat(c->shm_fd, &st) != 0 ||
+            (uint64_t)st.st_size < req->length) {
+            finish(c, -1);
+            return;
+        }
+        c->shm = mmap(NULL, req->length, PROT_READ | PROT_WRITE, MAP_SHARED, c->shm_fd, 0);
+        if (c->shm == MAP_FAILED) {
+            c->shm = NULL;
+            finish(c, -1);
+            return;
+        }
+        c->data = c->shm;
+    } else {
+        c->data = c->body + req->password_len + req->tweak_len;
+    }
+
+    c->entry = lookup(req, c->body);
+    if (!c->entry) {
+        finish(c, -1);
+        return;
+    }
+    c->entry->refs++;
+    if (c->entry->deriving) {
+        c->state = DERIVING;  // run() once the context is ready
+        return;
+    }
+    run(c);
+}
+
+// Check a request header; allocate the body
+static int accept_header(client *c) {
+    const taesd_request *req = &c->req;
+
+    if (req->magic != TAESD_MAGIC || req->password_len > TAESD_SECRET_MAX || req->tweak_len > TAESD_SECRET_MAX) {
+        return -1;
+    }
+    if (req->op == TAESD_OP_STATS) {
+        c->body_len = 0;
+        return 0;
+    }
+    if ((req->op != TAESD_OP_ENCRYPT && req->op != TAESD_OP_DECRYPT) ||
+        (req->key_bits != 128 && req->key_bits != 192 && req->key_bits != 256) ||
+        (!req->shm && req->length > TAESD_INLINE_MAX) || req->length > SIZE_MAX / 2) {
+        return -1;
+    }
+
+    c->body_len = req->password_len + req->tweak_len + (req->shm ? 0 : req->length);
+    c->body = malloc(c->body_len ? c->body_len : 1);
+    return c->body ? 0 : -1;
+}
+
+static void on_readable(client *c) {
+    uint8_t *dst;
+    size_t want;
+    if (c->header_got < sizeof(c->req)) {
+        dst = (uint8_t *)&c->req + c->header_got;
+        want = sizeof(c->req) - c->header_got;
+    } else {
+        dst = c->body + c->body_got;
+        want = c->body_len - c->body_got;
+    }
+
+    char control[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = {dst, want};
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t n = recvmsg(c->fd, &msg, MSG_CMSG_CLOEXEC | MSG_DONTWAIT);
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+        return;
+    }
+    if (n <= 0) {
+        client_close(c);
+        return;
+    }
+
+    // A memfd comes with the header of a shared-memory request
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            int fd;
+            memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+            if (c->shm_fd < 0) {
+                c->shm_fd = fd;
+            } else {
+                close(fd);
+            }
+        }
+    }
+
+    if (c->header_got < sizeof(c->req)) {
+        c->header_got += (size_t)n;
+        if (c->header_got == sizeof(c->req) && accept_header(c) != 0) {
+            client_close(c);
+            return;
+        }
+    } else {
+        c->body_got += (size_t)n;
+    }
+
+    if (c->header_got == sizeof(c->req) && c->body_got == c->body_len) {
+        dispatch(c);
+    }
+}
+
+static void on_writable(client *c) {
+    struct iovec iov[2] = {
+        {(uint8_t *)&c->resp, sizeof(c->resp)},
+        {c->reply, c->resp.length},
+    };
+    size_t total = sizeof(c->resp) + c->resp.length;
+
+    // Skip what was sent already
+    int first = c->sent < sizeof(c->resp) ? 0 : 1;
+    size_t skip = first ? c->sent - sizeof(c->resp) : c->sent;
+    iov[first].iov_base = (uint8_t *)iov[first].iov_base + skip;
+    iov[first].iov_len -= skip;
+
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov[first];
+    msg.msg_iovlen = (size_t)(2 - first);
+    ssize_t n = sendmsg(c->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+        return;
+    }
+    if (n <= 0) {
+        client_close(c);
+        return;
+    }
+
+    c->sent += (size_t)n;
+    if (c->sent == total) {
+        latencies[latency_count++ % LATENCY_SAMPLES] = get_time_ns() - c->start;
+        client_reset(c);
+    }
+}
+
+// Collect the queue's completions
+static void on_completions(void) {
+    taes_async_completion done[32];
+    uint64_t count;
+    size_t n;
+
+    if (read(taes_queue_eventfd(queue), &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        return;
+    }
+    while ((n = taes_poll(queue, done, 32)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            client *c = done[i].user_data;
+            finish(c, done[i].status);
+            if (c->fd < 0) {
+                client_close(c);
+            }
+        }
+    }
+}
+
+// Install the contexts the helper threads derived; run the requests waiting
+static void on_derived(void) {
+    derivation *d;
+
+    while (read(derive_pipe[0], &d, sizeof(d)) == (ssize_t)sizeof(d)) {
+        cache_entry *e = d->entry;
+        e->ctx = d->ctx;
+        e->valid = d->ok;
+        e->deriving = 0;
+        wipe_derivation(d);
+
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            client *c = &clients[i];
+            if (c->in_use && c->state == DERIVING && c->entry == e) {
+                run(c);
+                if (c->fd < 0) {
+                    client_close(c);
+                }
+            }
+        }
+    }
+}
+
+static void on_accept(int listener) {
+    int fd = accept4(listener, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+    if (fd < 0) {
+        return;
+    }
+    // Only our own user: the cache holds its keys
+    struct ucred cred;
+    socklen_t cred_len = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) != 0 || cred.uid != geteuid()) {
+        close(fd);
+        return;
+    }
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        client *c = &clients[i];
+        if (!c->in_use) {
+            memset(c, 0, sizeof(*c));
+            c->in_use = 1;
+            c->fd = fd;
+            c->shm_fd = -1;
+            c->state = READING;
+            return;
+        }
+    }
+    close(fd);  // Full: the client sees the connection close
+}
+
+static int listen_on(const char *path) {
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);  // Checked by taesd_socket_path()
+
+    // A socket file nobody answers on is left over from an earlier run
+    int probe = taesd_connect(path);
+    if (probe >= 0) {
+        close(probe);
+        fprintf(stderr, "taesd is already running on %s\n", path);
+        return -1;
+    }
+    unlink(path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    // Owner only: requests carry passwords
+    mode_t old_mask = umask(077);
+    int ret = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_mask);
+    if (ret != 0 || listen(fd, 64) != 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int serve(const char *path, int threads) {
+    int listener = listen_on(path);
+    if (listener < 0) {
+        return 1;
+    }
+    queue = taes_queue_create(threads, MAX_CLIENTS);
+    if (!queue || pipe2(derive_pipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+        fprintf(stderr, "Cannot start the worker threads\n");
+        taes_queue_destroy(queue);
+        close(listener);
+        unlink(path);
+        return 1;
+    }
+
+    struct sigaction sa = {0};
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    started = get_time_ns();
+    fprintf(stderr, "taesd: listening on %s (backend %s)\n", path, taes_backend_name());
+
+    static struct pollfd fds[MAX_CLIENTS + 3];
+    static client *owners[MAX_CLIENTS + 3];
+    while (!stop) {
+        int nfds = 0;
+        fds[nfds++] = (struct pollfd){listener, POLLIN, 0};
+        fds[nfds++] = (struct pollfd){taes_queue_eventfd(queue), POLLIN, 0};
+        fds[nfds++] = (struct pollfd){derive_pipe[0], POLLIN, 0};
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            client *c = &clients[i];
+            if (c->in_use && c->fd >= 0 && (c->state == READING || c->state == WRITING)) {
+                owners[nfds] = c;
+                fds[nfds++] = (struct pollfd){c->fd, c->state == READING ? POLLIN : POLLOUT, 0};
+            }
+        }
+
+        if (poll(fds, (nfds_t)nfds, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll");
+            break;
+        }
+
+        if (fds[1].revents) {
+            on_completions();
+        }
+        if (fds[2].revents) {
+            on_derived();
+        }
+        for (int i = 3; i < nfds; i++) {
+            client *c = owners[i];
+            if (!fds[i].revents || c->fd != fds[i].fd) {
+                continue;
+            }
+            if (c->state == READING) {
+                on_readable(c);
+            } else if (c->state == WRITING) {
+                on_writable(c);
+            }
+        }
+        if (fds[0].revents) {
+            on_accept(listener);
+        }
+    }
+
+    // The queue finishes what it holds before the buffers go away
+    taes_queue_destroy(queue);
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (clients[i].in_use) {
+            clients[i].state = READING;
+            client_close(&clients[i]);
+        }
+    }
+    for (int i = 0; i < CACHE_SIZE; i++) {
+        taes_cleanup(&cache[i].ctx);
+    }
+    close(derive_pipe[0]);  // Helper threads still deriving fail to write and free their work
+    close(listener);
+    unlink(path);
+    fprintf(stderr, "taesd: stopped after %llu requests\n", requests);
+    return 0;
+}
+
+static int print_stats(const char *path) {
+    char text[1024];
+    int sock = taesd_connect(path);
+    if (sock < 0) {
+        fprintf(stderr, "Cannot connect to taesd at %s\n", path);
+        return 1;
+    }
+    int ret = taesd_stats(sock, text, sizeof(text));
+    close(sock);
+    if (ret != 0) {
+        fprintf(stderr, "Stats request failed\n");
+        return 1;
+    }
+    fputs(text, stdout);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = NULL;
+    char resolved[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    int threads = 0;
+    int stats = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            path = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            stats = 1;
+        } else {
+            fprintf(stderr, "Usage: %s [--socket PATH] [--threads N]\n", argv[0]);
+            fprintf(stderr, "       %s --stats [--socket PATH]\n", argv[0]);
+            fprintf(stderr, "  Serves encrypt/decrypt --daemon on a Unix socket\n");
+            fprintf(stderr, "  (default $TAESD_SOCKET, else $XDG_RUNTIME_DIR/%s)\n", TAESD_SOCKET_NAME);
+            return 1;
+        }
+    }
+    if (taesd_socket_path(path, resolved, sizeof(resolved)) != 0) {
+        fprintf(stderr, "No socket path: use --socket, or set TAESD_SOCKET or XDG_RUNTIME_DIR\n");
+        return 1;
+    }
+    if (threads < 0) {
+        fprintf(stderr, "Invalid thread count\n");
+        return 1;
+    }
+
+    return stats ? print_stats(resolved) : serve(resolved, threads);
+}
@@ -3,7 +3,9 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <sys/uio.h>
 #include "taes.h"
+#include "taes_pool.h"
 
 // Encrypt data using T-AES counter mode with incrementing tweaks
 // Each block uses: E(K, P[i], tweak + i)
@@ -16,4 +18,85 @@ int counter_mode_encrypt(const taes_ctx *ctx, const uint8_t *plaintext,
 int counter_mode_decrypt(const taes_ctx *ctx, const uint8_t *ciphertext,
                          uint8_t *plaintext, size_t length);
 
+// Decrypt bytes [off, off + len) of a counter-mode ciphertext of total_len
+// bytes without touching the rest: block i only depends on tweak + i, except
+// the last full block and the partial one (Ciphertext Stealing), which are
+// decrypted together when the range reaches them. ct is the whole
+// ciphertext; out receives len bytes. Returns -1 unless total_len > 16 and
+// the range lies within it.
+int counter_mode_decrypt_range(const taes_ctx *ctx, const uint8_t *ct, size_t total_len,
+                               size_t off, size_t len, uint8_t *out);
+
+// The ciphertext bytes such a range needs: [*span_off, *span_off + *span_len)
+// (whole blocks, plus the partial block if the stolen pair is involved).
+// Returns -1 for an invalid range.
+int counter_mode_range_span(size_t total_len, size_t off, size_t len, size_t *span_off,
+                            size_t *span_len);
+
+// counter_mode_decrypt_range() given only those bytes, e.g. pread() from a
+// file: span holds ciphertext bytes [*span_off, *span_off + *span_len)
+int counter_mode_decrypt_span(const taes_ctx *ctx, const uint8_t *span, size_t total_len,
+                              size_t off, size_t len, uint8_t *out);
+
+// Counter mode over chains of segments (scatter-gather), e.g. packet
+// fragments or page lists, without flattening them: the same output as
+// counter_mode_encrypt() / counter_mode_decrypt() on the concatenation.
+// The two chains may be split differently but must hold the same number of
+// bytes (more than 16); partial blocks and the tweak carry across segment
+// boundaries, and Ciphertext Stealing applies to the tail of the whole.
+// Runs of whole blocks go to the backend's kernel as large as the segments
+// allow; blocks that straddle segments are batched through a small buffer.
+// in and out may be the same chain. Returns -1 on invalid chains or lengths.
+int counter_mode_encryptv(const taes_ctx *ctx, const struct iovec *in, int nin, const struct iovec *out,
+                          int nout);
+int counter_mode_decryptv(const taes_ctx *ctx, const struct iovec *in, int nin, const struct iovec *out,
+                          int nout);
+
+// Counter mode on the threads of a pool (same output as the functions above)
+// The blocks are split into chunks of chunk_size bytes (0:
+// TAES_POOL_DEFAULT_CHUNK, rounded down to whole blocks), each starting at
+// its own offset of the tweak. pool NULL runs everything on the caller.
+int counter_mode_encrypt_parallel(taes_pool *pool, const taes_ctx *ctx, const uint8_t *plaintext,
+                                  uint8_t *ciphertext, size_t length, size_t chunk_size);
+int counter_mode_decrypt_parallel(taes_pool *pool, const taes_ctx *ctx, const uint8_t *ciphertext,
+                                  uint8_t *plaintext, size_t length, size_t chunk_size);
+
+// Re-encrypt a counter-mode ciphertext under another key and/or tweak in
+// one pass (key and tweak rotation): the output is counter_mode_encrypt(to,
+// counter_mode_decrypt(from, in)), with from from taes_init_decrypt(). Each
+// tile of TAES_TRANSCRYPT_TILE bytes is decrypted into a buffer that stays in
+// L1 and re-encrypted at once, so the plaintext never reaches memory and the
+// data is read and written once, not twice as by decrypt | encrypt. in and
+// out may be the same buffer. Returns -1 unless length > 16. Tiles under
+// 4 KB lose more to the kernels' per-call setup than they save.
+#define TAES_TRANSCRYPT_TILE (16 * 1024)
+int taes_transcrypt(const taes_ctx *from, const taes_ctx *to, const uint8_t *in, uint8_t *out,
+                    size_t length);
+
+// The same on the threads of a pool, in chunks as counter_mode_encrypt_parallel()
+int taes_transcrypt_parallel(taes_pool *pool, const taes_ctx *from, const taes_ctx *to, const uint8_t *in,
+                             uint8_t *out, size_t length, size_t chunk_size);
+
+// Counter mode on a specific backend (same output as the functions above)
+int counter_mode_encrypt_portable(const taes_ctx *ctx, const uint8_t *plaintext,
+                                  uint8_t *ciphertext, size_t length);
+int counter_mode_decrypt_portable(const taes_ctx *ctx, const uint8_t *ciphertext,
+                                  uint8_t *plaintext, size_t length);
+int counter_mode_encrypt_ttable(const taes_ctx *ctx, const uint8_t *plaintext,
+                                uint8_t *ciphertext, size_t length);
+int counter_mode_decrypt_ttable(const taes_ctx *ctx, const uint8_t *ciphertext,
+                                uint8_t *plaintext, size_t length);
+int counter_mode_encrypt_bitslice(const taes_ctx *ctx, const uint8_t *plaintext,
+                                  uint8_t *ciphertext, size_t length);
+int counter_mode_decrypt_bitslice(const taes_ctx *ctx, const uint8_t *ciphertext,
+                                  uint8_t *plaintext, size_t length);
+int counter_mode_encrypt_ni(const taes_ctx *ctx, const uint8_t *plaintext,
+                            uint8_t *ciphertext, size_t length);
+int counter_mode_decrypt_ni(const taes_ctx *ctx, const uint8_t *ciphertext,
+                            uint8_t *plaintext, size_t length);
+int counter_mode_encrypt_vaes(const taes_ctx *ctx, const uint8_t *plaintext,
+                              uint8_t *ciphertext, size_t length);
+int counter_mode_decrypt_vaes(const taes_ctx *ctx, const uint8_t *ciphertext,
+                              uint8_t *plaintext, size_t length);
+
 #endif // COUNTER_MODE_H
@@ -23,25 +23,131 @@
 #define AES_256_KEY_SIZE 32
 
 // T-AES context structure
+// round_keys and tweaked_round_key together fill exactly four 64-byte cache
+// lines, so the whole schedule used by a block sits in four line fills.
+// dec_round_keys and tweak fill the next four.
 typedef struct {
-    uint8_t round_keys[240];  // Maximum round keys for AES-256 (15 rounds * 16 bytes)
+    _Alignas(64) uint8_t round_keys[240];  // Maximum round keys for AES-256 (15 rounds * 16 bytes)
+    uint8_t tweaked_round_key[16];         // round_keys[tweak_round] + tweak (128-bit addition)
+    _Alignas(64) uint8_t dec_round_keys[240];  // InvMixColumns(round_keys[r]) for AES-NI decryption
     uint8_t tweak[TWEAK_SIZE];
     int key_size;             // Key size in bytes (16, 24, or 32)
     int num_rounds;           // Number of rounds (10, 12, or 14)
     int tweak_round;          // Which round key to modify (5, 6, or 7)
+    int has_dec_round_keys;   // Nonzero once dec_round_keys is filled (decryption context)
 } taes_ctx;
 
 // Initialize T-AES context with key and tweak
 // key_size: 16 (AES-128), 24 (AES-192), or 32 (AES-256)
 int taes_init(taes_ctx *ctx, const uint8_t *key, int key_size, const uint8_t *tweak);
 
+// Initialize a context mainly used for decryption: taes_init() plus, on the
+// AES-NI backends, the precomputed InvMixColumns schedule. Still encrypts.
+int taes_init_decrypt(taes_ctx *ctx, const uint8_t *key, int key_size, const uint8_t *tweak);
+
+// Initialize n contexts with keys of the same size (one key schedule per context)
+// tweaks: NULL for all-zero tweaks, otherwise one 16-byte tweak (or NULL) per context
+int taes_init_many(taes_ctx *const ctxs[], const uint8_t *const keys[], int key_size,
+                   const uint8_t *const tweaks[], size_t n);
+
+// Replace the tweak, updating only the tweaked round key (no key expansion)
+// tweak: 16 bytes, or NULL for the zero tweak
+void taes_set_tweak(taes_ctx *ctx, const uint8_t *tweak);
+
+// Add n to the tweak using 128-bit arithmetic (e.g. to step to block i + n)
+void taes_advance_tweak(taes_ctx *ctx, uint64_t n);
+
 // Encrypt a single block (16 bytes)
 void taes_encrypt_block(const taes_ctx *ctx, const uint8_t *plaintext, uint8_t *ciphertext);
 
 // Decrypt a single block (16 bytes)
 void taes_decrypt_block(const taes_ctx *ctx, const uint8_t *ciphertext, uint8_t *plaintext);
 
+// Encrypt nblocks independent blocks, block i under tweak tweaks[i] in place
+// of the context's tweak (tweaks: nblocks * 16 bytes, any values, e.g. row
+// IDs). Same result as taes_set_tweak() + taes_encrypt_block() per block,
+// with the blocks pipelined like counter mode. in and out may be equal.
+void taes_encrypt_blocks(const taes_ctx *ctx, const uint8_t *plaintext, uint8_t *ciphertext,
+                         const uint8_t *tweaks, size_t nblocks);
+
+// Decrypt nblocks independent blocks, block i under tweak tweaks[i]
+void taes_decrypt_blocks(const taes_ctx *ctx, const uint8_t *ciphertext, uint8_t *plaintext,
+                         const uint8_t *tweaks, size_t nblocks);
+
 // Clean up context (zero out sensitive data)
 void taes_cleanup(taes_ctx *ctx);
 
+// Backend selection
+// The functions above (and counter mode) run on the fastest backend the CPU
+// supports, chosen when the library loads: "vaes", "aesni", then the
+// constant-time "bitslice" on CPUs without AES-NI. "ttable" (faster, not
+// constant-time) and "portable" are only used when selected.
+// The TAES_BACKEND environment variable or taes_set_backend() forces one.
+// Contexts are interchangeable between backends, and taes_set_backend() may
+// run while other threads use the library: each call uses the backend that
+// was selected when it started.
+
+// Select a backend by name; returns -1 if unknown or not supported by the CPU
+int taes_set_backend(const char *name);
+
+// Name of the backend in use
+const char *taes_backend_name(void);
+
+// Portable backend (src/taes.c), usable on any CPU
+int taes_init_portable(taes_ctx *ctx, const uint8_t *key, int key_size, const uint8_t *tweak);
+int taes_init_many_portable(taes_ctx *const ctxs[], const uint8_t *const keys[], int key_size,
+                            const uint8_t *const tweaks[], size_t n);
+void taes_encrypt_block_portable(const taes_ctx *ctx, const uint8_t *plaintext, uint8_t *ciphertext);
+void taes_decrypt_block_portable(const taes_ctx *ctx, const uint8_t *ciphertext, uint8_t *plaintext);
+void taes_encrypt_blocks_portable(const taes_ctx *ctx, const uint8_t *plaintext, uint8_t *ciphertext,
+                                  const uint8_t *tweaks, size_t nblocks);
+void taes_decrypt_blocks_portable(const taes_ctx *ctx, const uint8_t *ciphertext, uint8_t *plaintext,
+                                  const uint8_t *tweaks, size_t nblocks);
+
+// T-table backend (src/taes_ttable.c): 32-bit table lookups, fast on any
+// CPU but not constant-time (lookups are indexed by secret data)
+int taes_ttable_available(void);
+int taes_init_ttable(taes_ctx *ctx, const uint8_t *key, int key_size, const uint8_t *tweak);
+int taes_init_decrypt_ttable(taes_ctx *ctx, const uint8_t *key, int key_size, const uint8_t *tweak);
+void taes_encrypt_block_ttable(const taes_ctx *ctx, const uint8_t *plaintext, uint8_t *ciphertext);
+void taes_decrypt_block_ttable(const taes_ctx *ctx, const uint8_t *ciphertext, uint8_t *plaintext);
+void taes_encrypt_blocks_ttable(const taes_ctx *ctx, const uint8_t *plaintext, uint8_t *ciphertext,
+                                const uint8_t *tweaks, size_t nblocks);
+void taes_decrypt_blocks_ttable(const taes_ctx *ctx, const uint8_t *ciphertext, uint8_t *plaintext,
+                                const uint8_t *tweaks, size_t nblocks);
+
+// Bitsliced backend (src/taes_bitslice.c): constant-time on any CPU, key
+// setup included, 8 blocks per pass; single blocks cost as much as a full pass
+int taes_init_bitslice(taes_ctx *ctx, const uint8_t *key, int key_size, const uint8_t *tweak);
+int taes_init_many_bitslice(taes_ctx *const ctxs[], const uint8_t *const keys[], int key_size,
+                            const uint8_t *const tweaks[], size_t n);
+void taes_encrypt_block_bitslice(const taes_ctx *ctx, const uint8_t *plaintext, uint8_t *ciphertext);
+void taes_decrypt_block_bitslice(const taes_ctx *ctx, const uint8_t *ciphertext, uint8_t *plaintext);
+void taes_encrypt_blocks_bitslice(const taes_ctx *ctx, const uint8_t *plaintext, uint8_t *ciphertext,
+                                  const uint8_t *tweaks, size_t nblocks);
+void taes_decrypt_blocks_bitslice(const taes_ctx *ctx, const uint8_t *ciphertext, uint8_t *plaintext,
+                                  const uint8_t *tweaks, size_t nblocks);
+
+// AES-NI backend (src/taes_ni.c); call only on CPUs with AES-NI
+int taes_init_ni(taes_ctx *ctx, const uint8_t *key, int key_size, const uint8_t *tweak);
+int taes_init_decrypt_ni(taes_ctx *ctx, const uint8_t *key, int key_size, const uint8_t *tweak);
+int taes_init_many_ni(taes_ctx *const ctxs[], const uint8_t *const keys[], int key_size,
+                      const uint8_t *const tweaks[], size_t n);
+void taes_encrypt_block_ni(const taes_ctx *ctx, const uint8_t *plaintext, uint8_t *ciphertext);
+void taes_decrypt_block_ni(const taes_ctx *ctx, const uint8_t *ciphertext, uint8_t *plaintext);
+void taes_encrypt_blocks_ni(const taes_ctx *ctx, const uint8_t *plaintext, uint8_t *ciphertext,
+                            const uint8_t *tweaks, size_t nblocks);
+void taes_decrypt_blocks_ni(const taes_ctx *ctx, const uint8_t *ciphertext, uint8_t *plaintext,
+                            const uint8_t *tweaks, size_t nblocks);
+void taes_cleanup_ni(taes_ctx *ctx);
+
+// VAES backend (src/taes_vaes.c): blocks per VAES instruction (4, 2, or 0
+// when the CPU has no VAES), and a cap on that width for benchmarking
+int taes_vaes_lanes(void);
+int taes_vaes_select(int max_lanes);
+void taes_encrypt_blocks_vaes(const taes_ctx *ctx, const uint8_t *plaintext, uint8_t *ciphertext,
+                              const uint8_t *tweaks, size_t nblocks);
+void taes_decrypt_blocks_vaes(const taes_ctx *ctx, const uint8_t *ciphertext, uint8_t *plaintext,
+                              const uint8_t *tweaks, size_t nblocks);
+
 #endif // TAES_H
@@ -0,0 +1,69 @@
+#ifndef TAES_ASYNC_H
+#define TAES_ASYNC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "taes.h"
+
+// Asynchronous counter mode
+// taes_submit() posts a job to a lock-free submission ring and returns at
+// once; the queue's worker threads run it with counter_mode_encrypt() /
+// counter_mode_decrypt() semantics (same output, same length rules) and post
+// {user_data, status} to a completion ring, which taes_poll() drains. The
+// eventfd of taes_queue_eventfd() becomes readable when completions arrive,
+// for callers that wait in an event loop.
+//
+// A worker takes up to TAES_ASYNC_BATCH queued jobs at a time. On AVX-512
+// VAES it runs the small ones together through the multi-buffer manager
+// (taes_mb.h), whatever their keys.
+//
+// Contexts and buffers must stay valid until the job's completion has been
+// polled. Completions come in any order.
+
+// Jobs in flight (submitted, completion not yet polled) with depth 0
+#define TAES_ASYNC_DEFAULT_DEPTH 256
+
+// taes_submit() result when depth jobs are in flight: poll, then retry
+#define TAES_ASYNC_FULL 1
+
+// Most jobs a worker takes at once, and the largest job it runs side by side
+#define TAES_ASYNC_BATCH 16
+#define TAES_ASYNC_SMALL 2048
+
+typedef struct taes_queue taes_queue;
+
+typedef struct {
+    const taes_ctx *ctx;      // Key and starting tweak
+    const uint8_t *in;
+    uint8_t *out;             // May equal in
+    size_t length;            // More than 16 bytes, as for counter_mode_encrypt()
+    int decrypt;              // 0: encrypt, nonzero: decrypt
+    void *user_data;          // Returned in the completion
+} taes_async_job;
+
+typedef struct {
+    void *user_data;
+    int status;               // 0, or -1 as counter_mode_encrypt() would return
+} taes_async_completion;
+
+// Start a queue with `threads` workers (0: one per online CPU) and room for
+// `depth` jobs in flight (0: TAES_ASYNC_DEFAULT_DEPTH). NULL on failure.
+taes_queue *taes_queue_create(int threads, size_t depth);
+
+// Finish every submitted job, stop the workers and free the queue.
+// Completions not polled yet are dropped. NULL is ignored.
+void taes_queue_destroy(taes_queue *queue);
+
+// Post a job (copied; the descriptor may be reused right away)
+// Returns 0, TAES_ASYNC_FULL, or -1 for an invalid job.
+int taes_submit(taes_queue *queue, const taes_async_job *job);
+
+// Move up to max completions to `completions` without blocking; returns how
+// many were moved
+size_t taes_poll(taes_queue *queue, taes_async_completion *completions, size_t max);
+
+// Nonblocking eventfd counting the completions added since it was last read
+// (read 8 bytes to reset it), or -1 if eventfd is unavailable
+int taes_queue_eventfd(const taes_queue *queue);
+
+#endif // TAES_ASYNC_H
@@ -0,0 +1,116 @@
+#ifndef TAES_CONTAINER_H
+#define TAES_CONTAINER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "taes.h"
+#include "taes_pool.h"
+
+// Chunked container format (encrypt --container)
+// A plain counter-mode ciphertext is one message: Ciphertext Stealing ties
+// its end together and nothing says where a reader may start. A container
+// cuts the plaintext into chunks that are complete counter-mode messages of
+// their own, so chunks are decrypted in parallel, a random read touches one
+// chunk, and an append adds chunks without touching the ones before.
+//
+// Layout (integers little-endian):
+//   header  64 bytes:
+//           "TAESCTR1", version (u32, 1), key bits (u32), KDF (u32,
+//           TAES_CONTAINER_KDF_PBKDF2_SHA256), KDF iterations (u32),
+//           salt (16 bytes), chunk size (u32), end (u64: 0, or the
+//           container's size while an append is unfinished), 12 zero bytes
+//   chunks  each a frame: length (u32), 4 zero bytes, then `length` bytes
+//           of ciphertext (17 to chunk size)
+//   end     a frame of length 0
+//   index   per chunk: file offset of its ciphertext (u64), length (u64)
+//   footer  32 bytes: index offset (u64), chunks (u64), plaintext length
+//           (u64), "TAESIDX1"
+// An append leaves the old end, index and footer in place and adds its
+// chunks, end, index and footer after them. The old end frame then has 1 in
+// its second word: a streamed reader skips the index (one entry per chunk
+// read so far) and footer that follow it, and reads on.
+//
+// Chunk k is counter_mode_encrypt() under the tweak T + k * 2^64 (k added
+// to the upper half of the context's tweak): chunks never share a tweak,
+// and a chunk of under 2^64 blocks never runs into the next one's. Every
+// chunk holds chunk size bytes except the last of a write; if that would
+// be 16 bytes or shorter, the chunk before it gives up 16 bytes.
+// The frames carry the layout for a streamed reader (a pipe); the index and
+// footer at the end let a reader with a file find any chunk at once.
+
+#define TAES_CONTAINER_HEADER_SIZE 64
+#define TAES_CONTAINER_FOOTER_SIZE 32
+#define TAES_CONTAINER_FRAME_SIZE 8
+#define TAES_CONTAINER_SALT_SIZE 16
+
+// Chunk size of new containers: a chunk per pool task, large enough that the
+// frame and index entry cost nothing
+#define TAES_CONTAINER_DEFAULT_CHUNK (1024 * 1024)
+#define TAES_CONTAINER_MIN_CHUNK 4096
+#define TAES_CONTAINER_MAX_CHUNK (64 * 1024 * 1024)
+
+// KDF: PBKDF2-HMAC-SHA256 of the passwords, salted with the header's salt
+#define TAES_CONTAINER_KDF_PBKDF2_SHA256 1
+
+// Result for a write of 16 bytes of plaintext or less (counter mode needs
+// more); nothing has been written
+#define TAES_CONTAINER_BAD_LENGTH 1
+
+// The header's parameters: what a reader needs to derive the key
+typedef struct {
+    uint32_t key_bits;        // 128, 192 or 256
+    uint32_t kdf;             // TAES_CONTAINER_KDF_*
+    uint32_t kdf_iterations;
+    uint8_t salt[TAES_CONTAINER_SALT_SIZE];
+    uint32_t chunk_size;      // 0 in taes_container_encrypt(): TAES_CONTAINER_DEFAULT_CHUNK
+} taes_container_params;
+
+// Write a whole container: the header, the plaintext read from in_fd until
+// end of file, the index. out_fd is written sequentially (a pipe works).
+// Chunks are encrypted on the pool's threads (NULL: the caller's), a batch
+// of a few per thread at a time. Returns 0, TAES_CONTAINER_BAD_LENGTH, or -1
+// with errno set.
+int taes_container_encrypt(const taes_ctx *ctx, const taes_container_params *params, int in_fd,
+                           int out_fd, taes_pool *pool);
+
+// Read the header from in_fd's current position (the stream is left at the
+// first chunk). Returns 0, or -1 with errno set (EBADMSG: not a container).
+int taes_container_read_params(int in_fd, taes_container_params *params);
+
+// Decrypt the chunks that follow the header read by
+// taes_container_read_params() to out_fd, in batches on the pool's threads.
+// ctx is from taes_init_decrypt(). Returns 0 or -1 with errno set (EBADMSG:
+// malformed or truncated container).
+int taes_container_decrypt(const taes_ctx *ctx, const taes_container_params *params, int in_fd,
+                           int out_fd, taes_pool *pool);
+
+// A container file opened for random access and appends
+typedef struct taes_container taes_container;
+
+// Read the header, footer and index of the container in fd (fd stays the
+// caller's and must stay open). Returns NULL with errno set on failure.
+taes_container *taes_container_open(int fd);
+
+void taes_container_close(taes_container *container);
+
+const taes_container_params *taes_container_get_params(const taes_container *container);
+
+// Plaintext length
+uint64_t taes_container_length(const taes_container *container);
+
+// Decrypt plaintext bytes [off, off + len) to out, reading (pread()) only
+// the chunks they fall in, and of those only the blocks the range needs.
+// Returns 0, or -1 with errno set (EINVAL: range past the end).
+int taes_container_read(const taes_container *container, const taes_ctx *ctx, uint64_t off,
+                        size_t len, uint8_t *out);
+
+// Append the plaintext read from in_fd until end of file as new chunks
+// (numbered on from the existing ones). fd must be open read-write. Nothing
+// a reader of the old container uses is overwritten before the new chunks,
+// index and footer are synced, so an append that fails or is cut short
+// leaves the old container, and the next one writes over what it left.
+// Returns 0, TAES_CONTAINER_BAD_LENGTH, or -1 with errno set.
+int taes_container_append(taes_container *container, const taes_ctx *ctx, int in_fd,
+                          taes_pool *pool);
+
+#endif // TAES_CONTAINER_H
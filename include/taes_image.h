@@ -0,0 +1,70 @@
+#ifndef TAES_IMAGE_H
+#define TAES_IMAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "taes.h"
+
+// In-place encryption of disk images and block devices (taes-image)
+// The image is encrypted sector by sector with taes_sector_encrypt(), so
+// every sector can be rewritten where it is. Work goes in batches of
+// windows: a pool of threads reads its windows (O_DIRECT where alignment
+// allows), hashes and encrypts them; the batch is recorded in the journal;
+// the threads write the windows back and the image is synced. Holes of
+// sparse files (SEEK_DATA / SEEK_HOLE) are skipped in both directions, so
+// they stay holes and read as zeros.
+//
+// The journal makes an interrupted run resumable. Two slots are written in
+// turn, each with a sequence number and a checksum, so a torn journal write
+// leaves the previous slot valid. A slot says that everything before its
+// position is done except the windows of the batch in flight, and holds a
+// 64-bit hash of every sector of that batch as it was before the run. On
+// resume, each of those sectors either still has its old hash (it is
+// processed now) or takes that hash when processed backwards (it had been
+// written already): nothing is processed twice. A sector torn by the
+// interruption (some 512-byte pieces written, some not) is found by trying
+// each mix of old and written pieces against the hash, for sectors of up to
+// 4 KB. Only a sector that no mix explains (changed by something else, or
+// torn finer than 512 bytes) makes the run TAES_IMAGE_MISMATCH.
+
+// Bytes per window (one read, encryption and write by one thread) and
+// windows per batch (the most written between two journal records) with
+// 0 in taes_image_options
+#define TAES_IMAGE_DEFAULT_WINDOW (4 * 1024 * 1024)
+#define TAES_IMAGE_DEFAULT_BATCH 16
+
+// Flags
+#define TAES_IMAGE_DECRYPT 1
+
+// Results besides 0 and -1 (errno set)
+#define TAES_IMAGE_COMPLETE 1   // The journal records this run as finished already
+#define TAES_IMAGE_MISMATCH 2   // The journal is for another image, key, sector size or an
+                                // unfinished run the other way, or a sector matches neither side
+
+typedef struct {
+    int flags;                // TAES_IMAGE_*
+    size_t sector_size;       // Multiple of 16 (0: TAES_SECTOR_4K)
+    int threads;              // 0: one per online CPU, at least 4 (reads and writes in flight)
+    size_t window;            // Multiple of sector_size (0: TAES_IMAGE_DEFAULT_WINDOW)
+    int batch;                // Windows per batch (0: TAES_IMAGE_DEFAULT_BATCH, at least threads)
+} taes_image_options;
+
+typedef struct {
+    uint64_t size;            // Image bytes
+    uint64_t processed;       // Bytes encrypted or decrypted by this run
+    uint64_t skipped;         // Bytes of holes left as they are
+    uint64_t resumed_at;      // Position the run resumed from (0: a fresh run)
+} taes_image_stats;
+
+// Encrypt (or with TAES_IMAGE_DECRYPT decrypt) the file or block device at
+// image_path in place, journaling to journal_path (created if missing; a
+// finished journal of the other direction is started over). enc is from
+// taes_init() and dec from taes_init_decrypt(), with the same key and
+// tweak. The size must be a multiple of the sector size. options and stats
+// may be NULL. Returns 0, TAES_IMAGE_COMPLETE, TAES_IMAGE_MISMATCH or -1
+// with errno set.
+int taes_image_crypt(const taes_ctx *enc, const taes_ctx *dec, const char *image_path,
+                     const char *journal_path, const taes_image_options *options,
+                     taes_image_stats *stats);
+
+#endif // TAES_IMAGE_H
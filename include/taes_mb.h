@@ -0,0 +1,77 @@
+#ifndef TAES_MB_H
+#define TAES_MB_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "taes.h"
+
+// Multi-buffer counter mode
+// Encrypts or decrypts many independent buffers, each with its own context
+// (key and starting tweak), by running blocks of all of them through the AES
+// pipeline side by side: 8 streams on AES-NI, 16 on AVX-512 VAES. Each
+// buffer gets exactly the output of counter_mode_encrypt() /
+// counter_mode_decrypt(), Ciphertext Stealing tail included.
+//
+// taes_mb_init() a manager, taes_mb_submit() the jobs, then taes_mb_flush().
+// Jobs complete in any order, some already during taes_mb_submit() once all
+// lanes are busy; job->status stays TAES_MB_PENDING until then. Contexts and
+// buffers must stay valid until their job has completed.
+
+// Most streams a manager runs at once
+#define TAES_MB_MAX_LANES 16
+
+// job->status of a job that has not completed yet
+#define TAES_MB_PENDING 1
+
+// Longest pass while some lanes are free (their blocks go to mgr->scratch)
+#define TAES_MB_SCRATCH_BLOCKS 16
+
+typedef struct {
+    const taes_ctx *ctx;      // Key and starting tweak of this buffer
+    const uint8_t *in;
+    uint8_t *out;             // May equal in
+    size_t length;            // More than 16 bytes, as for counter_mode_encrypt()
+    int decrypt;              // 0: encrypt, nonzero: decrypt
+    int status;               // TAES_MB_PENDING, then 0 (done) or -1 (invalid job)
+} taes_mb_job;
+
+// State of one lane (internal)
+typedef struct {
+    taes_mb_job *job;         // NULL when the lane is free
+    const uint8_t *in;        // Next input block
+    uint8_t *out;             // Next output block
+    size_t blocks;            // Blocks left in the current segment
+    uint64_t index;           // Block number (tweak offset) of the next block
+    int segment;              // 0: whole blocks, 1 and 2: the two stolen blocks
+    _Alignas(16) uint8_t tweaked_key[16];  // Tweaked round key of the next block
+    uint8_t stolen[AES_BLOCK_SIZE];        // Ciphertext Stealing scratch
+    uint8_t padded[AES_BLOCK_SIZE];
+} taes_mb_lane;
+
+// Multi-buffer manager (fields are internal)
+// All jobs in the lanes share a direction and a key size; submitting a job
+// that differs first completes the ones in flight.
+typedef struct {
+    _Alignas(64) uint8_t keys[15][TAES_MB_MAX_LANES][16];  // Round keys by round, then lane
+    taes_mb_lane lane[TAES_MB_MAX_LANES];
+    _Alignas(64) uint8_t scratch[TAES_MB_SCRATCH_BLOCKS * AES_BLOCK_SIZE];  // In and out of free lanes
+    const void *backend;      // Backend selected when the manager was initialized
+    const void *kernel;       // Its multi-buffer kernels, NULL to run jobs one by one
+    int lanes;                // Streams per pass
+    int active;               // Lanes holding a job
+    int decrypt;              // Direction of the jobs in the lanes
+    int num_rounds;           // Key size of the jobs in the lanes
+    int tweak_round;
+} taes_mb_mgr;
+
+// Initialize a manager for the backend currently selected
+void taes_mb_init(taes_mb_mgr *mgr);
+
+// Queue a job. Returns -1 (and sets job->status to -1) for an invalid job.
+// When every lane is busy, runs the lanes until one of them is free.
+int taes_mb_submit(taes_mb_mgr *mgr, taes_mb_job *job);
+
+// Complete every submitted job; returns the number of jobs completed
+int taes_mb_flush(taes_mb_mgr *mgr);
+
+#endif // TAES_MB_H
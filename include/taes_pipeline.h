@@ -0,0 +1,59 @@
+#ifndef TAES_PIPELINE_H
+#define TAES_PIPELINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "taes.h"
+
+// Pipelined file-descriptor filter, for the encrypt/decrypt CLIs
+// Three stages overlap, so throughput is set by the slowest one instead of
+// their sum: a reader thread fills large buffers from in_fd, cipher workers
+// process them in place (counter mode: each buffer at its own tweak offset,
+// as counter_mode_encrypt_parallel() cuts a message), and the calling thread
+// writes them to out_fd in order. Buffers cycle through a ring of
+// workers + 3, so memory use does not depend on the input size.
+//
+// The output equals counter_mode_encrypt() / counter_mode_decrypt() (or ECB,
+// see utils.c) on the whole input. A buffer is only ciphered once 16 more
+// bytes have been read past it, so the stolen pair of Ciphertext Stealing
+// (the last full block and the partial one, 16 to 31 bytes) is always held
+// back whole, in the last buffer, until end of file shows where it is.
+
+// Bytes per buffer with buffer_size 0: a buffer stays in L2 from read()
+// through the cipher to write() (1 MB buffers were 15% slower)
+#define TAES_PIPELINE_DEFAULT_BUFFER (256 * 1024)
+
+// Flags
+#define TAES_PIPELINE_DECRYPT 1   // ctx from taes_init_decrypt()
+#define TAES_PIPELINE_ECB 2       // Whole blocks under the context's tweak, no counter
+
+// taes_pipeline() result for input counter mode or ECB cannot take (16
+// bytes or shorter, or not whole blocks); the output up to the bad part has
+// been written
+#define TAES_PIPELINE_BAD_LENGTH 1
+
+// Filter in_fd to out_fd until end of file, with `workers` cipher threads
+// (0: one per online CPU) and buffers of buffer_size bytes (0:
+// TAES_PIPELINE_DEFAULT_BUFFER, rounded down to whole blocks, at least 4 KB).
+// Returns 0, TAES_PIPELINE_BAD_LENGTH, or -1 with errno set (read, write or
+// thread failure).
+int taes_pipeline(const taes_ctx *ctx, int flags, int in_fd, int out_fd, int workers,
+                  size_t buffer_size);
+
+// taes_pipeline() without the copies, where the descriptors allow it. A
+// regular input file is mmapped (read sequentially, the next window
+// prefetched) and ciphered straight into: the mapping of a regular output
+// file opened read-write at offset 0, or a buffer for write() (pipes too). Other inputs go through taes_pipeline(). Length errors
+// are reported before any output. Counter mode runs on a taes_pool of
+// `workers` threads (0: one per online CPU). Same results as taes_pipeline().
+int taes_crypt_fd(const taes_ctx *ctx, int flags, int in_fd, int out_fd, int workers);
+
+// Key or tweak rotation as a filter: re-encrypt a counter-mode ciphertext
+// from `from` (a taes_init_decrypt() context) to `to` with taes_transcrypt(),
+// through taes_pipeline() or taes_crypt_fd()'s routes. Same results as
+// decrypt | encrypt, in one pass.
+int taes_transcrypt_pipeline(const taes_ctx *from, const taes_ctx *to, int in_fd, int out_fd, int workers,
+                             size_t buffer_size);
+int taes_transcrypt_fd(const taes_ctx *from, const taes_ctx *to, int in_fd, int out_fd, int workers);
+
+#endif // TAES_PIPELINE_H
@@ -0,0 +1,34 @@
+#ifndef TAES_POOL_H
+#define TAES_POOL_H
+
+#include <stddef.h>
+
+// Persistent thread pool with work stealing
+// taes_pool_run() splits tasks 0..ntasks-1 into one contiguous range per
+// thread; a thread that runs out takes the upper half of another thread's
+// remaining range. The calling thread works as one of the pool's threads, so a
+// pool of n threads starts n - 1 of its own. One run at a time per pool;
+// concurrent callers wait for each other.
+
+// Chunk size of counter_mode_encrypt_parallel() when given 0
+#define TAES_POOL_DEFAULT_CHUNK (256 * 1024)
+
+typedef struct taes_pool taes_pool;
+
+typedef void (*taes_task_fn)(void *arg, size_t task);
+
+// Start a pool of `threads` threads (0: one per online CPU)
+// Returns NULL if the threads cannot be started.
+taes_pool *taes_pool_create(int threads);
+
+// Stop the threads and free the pool (NULL is ignored)
+void taes_pool_destroy(taes_pool *pool);
+
+// Number of threads, the caller included
+int taes_pool_threads(const taes_pool *pool);
+
+// Run fn(arg, task) for every task in 0..ntasks-1, each exactly once, and
+// return when all of them have finished
+void taes_pool_run(taes_pool *pool, size_t ntasks, taes_task_fn fn, void *arg);
+
+#endif // TAES_POOL_H
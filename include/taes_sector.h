@@ -0,0 +1,33 @@
+#ifndef TAES_SECTOR_H
+#define TAES_SECTOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "taes.h"
+
+// Sector-oriented disk encryption (T-AES where XTS is used today)
+// Block j of sector s is encrypted under the tweak T + s * (sector_size / 16)
+// + j: the disk is one long counter-mode message of whole blocks, so a run
+// of consecutive sectors is a single call into the backend's counter-mode
+// kernel, with blocks in flight across sector boundaries. A sector's
+// ciphertext depends only on its number and contents. As with XTS, there is
+// no expansion and no per-write nonce: the same data written to the same
+// sector gives the same ciphertext. Sectors are whole blocks, so Ciphertext
+// Stealing never applies.
+
+// Common sector sizes
+#define TAES_SECTOR_512 512
+#define TAES_SECTOR_4K 4096
+
+// Encrypt `count` consecutive sectors of sector_size bytes (a multiple of
+// 16), the first being sector number sector_no. in and out may be the same
+// buffer. Returns -1 for a bad sector size, or if the run ends past the
+// last sector the 64-bit block numbering can address.
+int taes_sector_encrypt(const taes_ctx *ctx, uint64_t sector_no, size_t sector_size,
+                        const uint8_t *in, uint8_t *out, size_t count);
+
+// Decrypt sectors (ctx from taes_init_decrypt(), as for counter_mode_decrypt())
+int taes_sector_decrypt(const taes_ctx *ctx, uint64_t sector_no, size_t sector_size,
+                        const uint8_t *in, uint8_t *out, size_t count);
+
+#endif // TAES_SECTOR_H
@@ -0,0 +1,81 @@
+#ifndef TAES_SHARD_H
+#define TAES_SHARD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "taes.h"
+#include "taes_pool.h"
+
+// Sharded counter mode (encrypt --shard k/N)
+// Block i of a counter-mode message only depends on tweak + i, except the
+// stolen pair at the end. Cut at block boundaries, a message is encrypted
+// in shards on different machines: shard k, starting at block b, is counter
+// mode under tweak + b, and the shards' outputs concatenated in order are
+// the single-pass ciphertext. The last shard always holds the stolen pair,
+// so Ciphertext Stealing happens where it would in one pass.
+//
+// Each shard comes with a manifest line carrying its place in the message
+// and the digest of its ciphertext. The lines of all shards (merged by
+// taes-shard merge) let taes-shard verify check a reassembled file without
+// the key. The digest is a hash list: the SHA-256 of the SHA-256 digests of
+// the shard's 1 MB leaves, so the leaves are hashed on all of a pool's
+// threads (one SHA-256 stream runs at about 1 GB/s, far below the cipher).
+
+#define TAES_SHARD_DIGEST_SIZE 32
+#define TAES_SHARD_LEAF (1024 * 1024)
+
+// Flags
+#define TAES_SHARD_DECRYPT 1      // ctx from taes_init_decrypt(); the input is ciphertext
+#define TAES_SHARD_DIGEST 2       // Compute the digest (for the manifest)
+
+// Result of taes_shard_verify_fd() for a file that does not match
+#define TAES_SHARD_MISMATCH 1
+
+// Longest manifest line, with its newline and terminator
+#define TAES_SHARD_LINE_MAX 192
+
+typedef struct {
+    uint32_t index;           // k, 0 to count - 1
+    uint32_t count;           // N
+    uint64_t total;           // Message bytes
+    uint64_t offset;          // The shard's first byte in the message (whole blocks before it)
+    uint64_t length;          // 0 if there are more shards than blocks
+    uint8_t digest[TAES_SHARD_DIGEST_SIZE];   // Of the shard's ciphertext
+} taes_shard;
+
+// Shard `index` of `count` of a message of `total` bytes: the whole blocks
+// are split as evenly as they go, and the last shard ends with the partial
+// block, if any, and the full block before it. The digest is zeroed.
+// Returns -1 unless total > 16 and index < count.
+int taes_shard_range(uint64_t total, uint32_t index, uint32_t count, taes_shard *shard);
+
+// Encrypt (TAES_SHARD_DECRYPT: decrypt) the shard: shard->length bytes read
+// with pread() from in_fd at in_offset (shard->offset for the whole message,
+// 0 for the shard alone) are written to out_fd, in pieces ciphered on the
+// pool's threads (NULL: the caller's). With TAES_SHARD_DIGEST, sets
+// shard->digest from the ciphertext, the output's or the input's. Returns
+// 0, or -1 with errno set (EIO: in_fd ends before the shard does).
+int taes_shard_crypt_fd(const taes_ctx *ctx, int flags, int in_fd, uint64_t in_offset,
+                        taes_shard *shard, int out_fd, taes_pool *pool);
+
+// The shard's manifest line, newline included:
+//   taes-shard 1 <index> <count> <total> <offset> <length> <digest in hex>
+void taes_shard_format(const taes_shard *shard, char line[TAES_SHARD_LINE_MAX]);
+
+// Parse a manifest line (trailing newline optional). Returns -1 if it is
+// malformed or its range is not the one taes_shard_range() gives.
+int taes_shard_parse(const char *line, taes_shard *shard);
+
+// Sort shards by index and check that they are one message's complete set:
+// the same total and count, every index once. Returns 0, or -1 with errno
+// EBADMSG.
+int taes_shard_check_set(taes_shard *shards, size_t count);
+
+// Check a reassembled file against a complete, sorted set: its length and
+// every shard's digest (leaves hashed on the pool's threads). Returns 0,
+// TAES_SHARD_MISMATCH with *bad the first bad shard's index (count for a
+// wrong length), or -1 with errno set.
+int taes_shard_verify_fd(int fd, const taes_shard *shards, size_t count, taes_pool *pool,
+                         uint32_t *bad);
+
+#endif // TAES_SHARD_H
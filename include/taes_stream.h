@@ -0,0 +1,49 @@
+#ifndef TAES_STREAM_H
+#define TAES_STREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "taes.h"
+
+// Streaming counter mode
+// Feeds a message in pieces of any size and produces exactly the output of
+// counter_mode_encrypt() / counter_mode_decrypt() on the whole message.
+// Ciphertext Stealing changes the last full block and the tail, so
+// taes_stream_update() holds back the last 16 to 31 bytes it has seen (fewer
+// only while the message is shorter than 32 bytes); taes_stream_final()
+// processes them. Memory use does not depend on the message length.
+//
+// taes_stream_init(&s, &ctx, 0);
+// while (more input) {
+//     taes_stream_update(&s, in, n, out, &written);   // out: n + 16 bytes
+//     ...write `written` bytes...
+// }
+// taes_stream_final(&s, out, &written);              // out: 32 bytes
+
+// Most bytes held back between calls, and the most taes_stream_final() writes
+#define TAES_STREAM_HELD_MAX (2 * AES_BLOCK_SIZE)
+
+typedef struct {
+    const taes_ctx *ctx;      // Must stay valid until taes_stream_final()
+    int decrypt;
+    uint64_t next_block;      // Tweak offset of the next block written
+    uint64_t total;           // Bytes passed to taes_stream_update() so far
+    size_t held;
+    uint8_t buf[TAES_STREAM_HELD_MAX];
+} taes_stream;
+
+// Start a message; decrypt 0 encrypts, nonzero decrypts (ctx from
+// taes_init_decrypt() then, as for counter_mode_decrypt())
+int taes_stream_init(taes_stream *stream, const taes_ctx *ctx, int decrypt);
+
+// Process `length` more bytes. Writes a multiple of 16 bytes, at most
+// length + 15, to out (*written says how many). in and out must not overlap.
+int taes_stream_update(taes_stream *stream, const uint8_t *in, size_t length, uint8_t *out,
+                       size_t *written);
+
+// Finish the message: writes the held-back bytes (at most
+// TAES_STREAM_HELD_MAX) and wipes the stream. Returns -1, writing nothing,
+// if the whole message was 16 bytes or shorter, as counter mode would.
+int taes_stream_final(taes_stream *stream, uint8_t *out, size_t *written);
+
+#endif // TAES_STREAM_H
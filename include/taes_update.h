@@ -0,0 +1,50 @@
+#ifndef TAES_UPDATE_H
+#define TAES_UPDATE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "taes.h"
+
+// Incremental re-encryption (encrypt --update)
+// Counter-mode ciphertext block i depends only on plaintext block i and
+// tweak + i, except the stolen pair at the end (the last full block and the
+// partial one). When a file changes, its ciphertext is brought up to date
+// in place by rewriting the blocks whose plaintext changed, plus:
+//   - every block that was part of the old stolen pair or past the old end,
+//   - the new stolen pair, unless the length and the pair's plaintext are
+//     unchanged,
+// and truncating or extending the file to the new length. Dirty blocks a
+// page or less apart are rewritten as one run (the clean blocks between
+// them get their old ciphertext again), so writes stay few and large.
+// Rewrites are idempotent and the file is truncated last, so after an
+// interrupted update, running it again with the same inputs finishes it.
+
+// Clean blocks between two dirty runs that are rewritten with them (4 KB)
+#define TAES_UPDATE_MERGE_GAP 256
+
+// Result for a new plaintext of 16 bytes or less (counter mode needs more);
+// nothing has been written
+#define TAES_UPDATE_BAD_LENGTH 1
+
+typedef struct {
+    uint64_t blocks;          // Blocks of the new ciphertext (a partial block counts as one)
+    uint64_t dirty;           // Blocks found changed (or past the old end or in a stolen pair)
+    uint64_t written;         // Blocks rewritten, merged runs included
+} taes_update_stats;
+
+// Update ct_fd, the counter-mode ciphertext of the plaintext in old_fd, to
+// that of new_fd, comparing the two plaintexts block by block (pread(), in
+// pieces). stats may be NULL. Returns 0, TAES_UPDATE_BAD_LENGTH, or -1 with
+// errno set (EINVAL: ct_fd is shorter than old_fd, and is not the new
+// length either, so it is not old_fd's ciphertext).
+int taes_update_fd(const taes_ctx *ctx, int old_fd, int new_fd, int ct_fd, taes_update_stats *stats);
+
+// The same, told which blocks changed instead of reading the old plaintext,
+// which was old_length bytes long: bit i of dirty (dirty[i / 8] >> (i % 8)
+// & 1) is set if plaintext block i changed, for blocks 0 to nblocks - 1;
+// blocks from nblocks on count as changed. Only the changed blocks of new_fd
+// are read.
+int taes_update_blocks_fd(const taes_ctx *ctx, uint64_t old_length, const uint8_t *dirty,
+                          uint64_t nblocks, int new_fd, int ct_fd, taes_update_stats *stats);
+
+#endif // TAES_UPDATE_H
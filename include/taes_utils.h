@@ -0,0 +1,33 @@
+#ifndef TAES_UTILS_H
+#define TAES_UTILS_H
+
+#include "taes.h"
+#include "taes_container.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Key derivation and the ECB mode shared by the CLIs and the library (utils.c)
+
+// PBKDF2-HMAC-SHA256 with the fixed salt of the CLIs: the same password
+// always gives the same key / tweak. Return 0, or -1.
+int derive_key_from_password(const char *password, uint8_t *key, int key_size);
+int derive_tweak_from_password(const char *password, uint8_t *tweak);
+
+// The same with salt (salt_len bytes, e.g. a container header's random salt)
+// after the fixed one, and iterations rounds
+int derive_key_with_salt(const char *password, const uint8_t *salt, size_t salt_len, int iterations,
+                         uint8_t *key, int key_size);
+int derive_tweak_with_salt(const char *password, const uint8_t *salt, size_t salt_len, int iterations,
+                           uint8_t *tweak);
+
+// Context for a container: key and tweak from the passwords with the KDF
+// parameters of its header; decrypt: taes_init_decrypt(). Returns 0, or -1.
+int container_context(taes_ctx *ctx, const taes_container_params *params, const char *password,
+                      const char *tweak_password, int decrypt);
+
+// ECB mode of the CLIs (no tweak password): every block on its own under the
+// context's tweak. length must be a multiple of 16. Return 0, or -1.
+int ecb_encrypt(const taes_ctx *ctx, const uint8_t *in, uint8_t *out, size_t length);
+int ecb_decrypt(const taes_ctx *ctx, const uint8_t *in, uint8_t *out, size_t length);
+
+#endif // TAES_UTILS_H
@@ -0,0 +1,71 @@
+#ifndef TAESD_H
+#define TAESD_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Client side of taesd, the local encryption daemon (apps/taesd.c)
+// The daemon keeps contexts of recently used passwords, so a client skips
+// PBKDF2 and key expansion, and runs the requests of all clients through one
+// asynchronous queue (taes_async.h), which batches them.
+//
+// A connection carries any number of requests, one at a time: a
+// taesd_request, the password and tweak password, then the data. Larger
+// payloads than TAESD_INLINE_MAX travel in a memfd passed with the request
+// header (SCM_RIGHTS) and are processed in place; the memfd must be sealed
+// against shrinking (F_SEAL_SHRINK) and hold the whole payload. The daemon
+// answers with a taesd_response, followed by the data (inline requests) or
+// the stats text.
+//
+// Requests carry passwords, so both ends check the other's uid
+// (SO_PEERCRED): the daemon only serves its own user, and a client only
+// talks to a daemon running as itself.
+
+// Socket name in $XDG_RUNTIME_DIR when neither the caller nor $TAESD_SOCKET
+// names a path
+#define TAESD_SOCKET_NAME "taesd.sock"
+
+#define TAESD_MAGIC 0x53454154u   // "TAES"
+
+#define TAESD_OP_ENCRYPT 1
+#define TAESD_OP_DECRYPT 2
+#define TAESD_OP_STATS 3          // Response data: stats as text
+
+#define TAESD_INLINE_MAX (64 * 1024)   // Largest payload sent over the socket
+#define TAESD_SECRET_MAX 1024          // Longest password or tweak password
+
+typedef struct {
+    uint32_t magic;
+    uint32_t op;
+    uint32_t key_bits;        // 128, 192 or 256
+    uint32_t password_len;
+    uint32_t tweak_len;       // 0: ECB mode, as the CLIs without a tweak password
+    uint32_t shm;             // Nonzero: the data is in the memfd sent with this header
+    uint64_t length;          // Data bytes
+} taesd_request;
+
+typedef struct {
+    int32_t status;           // 0, or -1 if the request failed
+    uint32_t reserved;
+    uint64_t length;          // Bytes that follow (0 for memfd requests)
+} taesd_response;
+
+// The socket path: path, else $TAESD_SOCKET, else
+// $XDG_RUNTIME_DIR/TAESD_SOCKET_NAME. Returns 0, or -1 if none is set or the
+// path does not fit in size bytes.
+int taesd_socket_path(const char *path, char *buf, size_t size);
+
+// Connect to the daemon at taesd_socket_path(path). Returns the socket, or
+// -1 (errno EPERM if the daemon runs as another user).
+int taesd_connect(const char *path);
+
+// Encrypt or decrypt `length` bytes in place, with the same result as the
+// CLIs: counter mode if tweak_password is given, ECB otherwise.
+// Returns 0, or -1 (daemon unreachable or request refused).
+int taesd_crypt(int sock, int decrypt, int key_bits, const char *password, const char *tweak_password,
+                uint8_t *data, size_t length);
+
+// Fetch the daemon's statistics as text (NUL-terminated, truncated to size)
+int taesd_stats(int sock, char *text, size_t size);
+
+#endif // TAESD_H
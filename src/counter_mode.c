@@ -1,19 +1,73 @@
 // T-AES counter mode with incrementing tweaks and Ciphertext Stealing
 #include "../include/counter_mode.h"
+#include "taes_backend.h"
+#include "../include/taes_pool.h"
 #include <string.h>
 
-// Helper: Add 1 to a 128-bit tweak (little-endian)
-static void increment_tweak(uint8_t *tweak) {
-    for (int i = 0; i < TWEAK_SIZE; i++) {
-        if (++tweak[i] != 0) {
-            break;
-        }
+// Encrypt nblocks consecutive blocks, block j using tweak + first + j
+void ctr_encrypt_blocks_portable(const taes_ctx *ctx, uint64_t first, const uint8_t *in,
+                                 uint8_t *out, size_t nblocks) {
+    taes_ctx block_ctx = *ctx;
+    taes_advance_tweak(&block_ctx, first);
+    for (size_t i = 0; i < nblocks; i++) {
+        taes_encrypt_block_portable(&block_ctx, in + i * AES_BLOCK_SIZE, out + i * AES_BLOCK_SIZE);
+        taes_advance_tweak(&block_ctx, 1);
     }
+    taes_cleanup(&block_ctx);
 }
 
-// Encrypt using counter mode with incrementing tweaks
-int counter_mode_encrypt(const taes_ctx *ctx, const uint8_t *plaintext,
-                         uint8_t *ciphertext, size_t length) {
+// Decrypt nblocks consecutive blocks, block j using tweak + first + j
+void ctr_decrypt_blocks_portable(const taes_ctx *ctx, uint64_t first, const uint8_t *in,
+                                 uint8_t *out, size_t nblocks) {
+    taes_ctx block_ctx = *ctx;
+    taes_advance_tweak(&block_ctx, first);
+    for (size_t i = 0; i < nblocks; i++) {
+        taes_decrypt_block_portable(&block_ctx, in + i * AES_BLOCK_SIZE, out + i * AES_BLOCK_SIZE);
+        taes_advance_tweak(&block_ctx, 1);
+    }
+    taes_cleanup(&block_ctx);
+}
+
+// Ciphertext Stealing for the last full block and the tail:
+// X = E(K, P[n-2], tweak + n-2)
+// C[n-2] = E(K, P[n-1] || tail of X, tweak + n-1), C[n-1] = head of X
+static void encrypt_stolen_pair(const taes_ctx *ctx, const uint8_t *plaintext, uint8_t *ciphertext,
+                                size_t full_blocks, size_t tail, taes_blocks_fn encrypt_blocks) {
+    size_t last_full = full_blocks - 1;
+    uint8_t stolen[AES_BLOCK_SIZE];
+    uint8_t padded[AES_BLOCK_SIZE];
+
+    encrypt_blocks(ctx, last_full, plaintext + last_full * AES_BLOCK_SIZE, stolen, 1);
+    memcpy(padded, plaintext + full_blocks * AES_BLOCK_SIZE, tail);
+    memcpy(padded + tail, stolen + tail, AES_BLOCK_SIZE - tail);
+    encrypt_blocks(ctx, full_blocks, padded, ciphertext + last_full * AES_BLOCK_SIZE, 1);
+    memcpy(ciphertext + full_blocks * AES_BLOCK_SIZE, stolen, tail);
+
+    memset(stolen, 0, sizeof(stolen));
+    memset(padded, 0, sizeof(padded));
+}
+
+// Reverse the stealing: C[n-2] decrypts under tweak + n-1 to
+// P[n-1] || tail of X, and head of X comes from C[n-1]
+static void decrypt_stolen_pair(const taes_ctx *ctx, const uint8_t *ciphertext, uint8_t *plaintext,
+                                size_t full_blocks, size_t tail, taes_blocks_fn decrypt_blocks) {
+    size_t last_full = full_blocks - 1;
+    uint8_t padded[AES_BLOCK_SIZE];
+    uint8_t stolen[AES_BLOCK_SIZE];
+
+    decrypt_blocks(ctx, full_blocks, ciphertext + last_full * AES_BLOCK_SIZE, padded, 1);
+    memcpy(stolen, ciphertext + full_blocks * AES_BLOCK_SIZE, tail);
+    memcpy(stolen + tail, padded + tail, AES_BLOCK_SIZE - tail);
+    decrypt_blocks(ctx, last_full, stolen, plaintext + last_full * AES_BLOCK_SIZE, 1);
+    memcpy(plaintext + full_blocks * AES_BLOCK_SIZE, padded, tail);
+
+    memset(stolen, 0, sizeof(stolen));
+    memset(padded, 0, sizeof(padded));
+}
+
+// Counter mode with incrementing tweaks over any backend's block function
+int ctr_encrypt_cts(const taes_ctx *ctx, const uint8_t *plaintext, uint8_t *ciphertext,
+                    size_t length, taes_blocks_fn encrypt_blocks) {
     if (!ctx || !plaintext || !ciphertext) {
         return -1;
     }
@@ -23,22 +77,22 @@ int counter_mode_encrypt(const taes_ctx *ctx, const uint8_t *plaintext,
         return -1;
     }
 
-    // TODO: Implement counter mode encryption
-    // 1. For each complete block:
-    //    - Encrypt: C[i] = E(K, P[i], tweak + i)
-    //    - Increment tweak
-    // 2. For partial last block (if any), use Ciphertext Stealing:
-    //    - Encrypt penultimate block
-    //    - Use output to pad last partial block
-    //    - Encrypt padded block
-    //    - Swap and truncate
+    size_t full_blocks = length / AES_BLOCK_SIZE;
+    size_t tail = length % AES_BLOCK_SIZE;
+
+    if (tail == 0) {
+        encrypt_blocks(ctx, 0, plaintext, ciphertext, full_blocks);
+        return 0;
+    }
 
+    // Every block before the stolen pair: C[i] = E(K, P[i], tweak + i)
+    encrypt_blocks(ctx, 0, plaintext, ciphertext, full_blocks - 1);
+    encrypt_stolen_pair(ctx, plaintext, ciphertext, full_blocks, tail, encrypt_blocks);
     return 0;
 }
 
-// Decrypt using counter mode with incrementing tweaks
-int counter_mode_decrypt(const taes_ctx *ctx, const uint8_t *ciphertext,
-                         uint8_t *plaintext, size_t length) {
+int ctr_decrypt_cts(const taes_ctx *ctx, const uint8_t *ciphertext, uint8_t *plaintext,
+                    size_t length, taes_blocks_fn decrypt_blocks) {
     if (!ctx || !ciphertext || !plaintext) {
         return -1;
     }
@@ -48,13 +102,410 @@ int counter_mode_decrypt(const taes_ctx *ctx, const uint8_t *ciphertext,
         return -1;
     }
 
-    // TODO: Implement counter mode decryption
-    // 1. For each complete block:
-    //    - Decrypt: P[i] = D(K, C[i], tweak + i)
-    //    - Increment tweak
-    // 2. For partial last block (if any), use Ciphertext Stealing:
-    //    - Reverse the stealing process
-    //    - Decrypt penultimate and last blocks
+    size_t full_blocks = length / AES_BLOCK_SIZE;
+    size_t tail = length % AES_BLOCK_SIZE;
+
+    if (tail == 0) {
+        decrypt_blocks(ctx, 0, ciphertext, plaintext, full_blocks);
+        return 0;
+    }
 
+    // Every block before the stolen pair: P[i] = D(K, C[i], tweak + i)
+    decrypt_blocks(ctx, 0, ciphertext, plaintext, full_blocks - 1);
+    decrypt_stolen_pair(ctx, ciphertext, plaintext, full_blocks, tail, decrypt_blocks);
     return 0;
 }
+
+// Encrypt using counter mode with incrementing tweaks (selected backend)
+int counter_mode_encrypt(const taes_ctx *ctx, const uint8_t *plaintext,
+                         uint8_t *ciphertext, size_t length) {
+    return ctr_encrypt_cts(ctx, plaintext, ciphertext, length, taes_get_backend()->ctr_encrypt_blocks);
+}
+
+// Decrypt using counter mode with incrementing tweaks (selected backend)
+int counter_mode_decrypt(const taes_ctx *ctx, const uint8_t *ciphertext,
+                         uint8_t *plaintext, size_t length) {
+    return ctr_decrypt_cts(ctx, ciphertext, plaintext, length, taes_get_backend()->ctr_decrypt_blocks);
+}
+
+// Counter mode on the portable backend, whatever backend is selected
+int counter_mode_encrypt_portable(const taes_ctx *ctx, const uint8_t *plaintext,
+                                  uint8_t *ciphertext, size_t length) {
+    return ctr_encrypt_cts(ctx, plaintext, ciphertext, length, ctr_encrypt_blocks_portable);
+}
+
+int counter_mode_decrypt_portable(const taes_ctx *ctx, const uint8_t *ciphertext,
+                                  uint8_t *plaintext, size_t length) {
+    return ctr_decrypt_cts(ctx, ciphertext, plaintext, length, ctr_decrypt_blocks_portable);
+}
+
+// Random access: with F full blocks and a tail, bytes before block F-1 are
+// ordinary blocks; from block F-1 on they are the stolen pair, which only
+// decrypts as a whole. Without a tail every block is ordinary.
+static size_t stolen_pair_start(size_t total_len) {
+    return total_len % AES_BLOCK_SIZE ? (total_len / AES_BLOCK_SIZE - 1) * AES_BLOCK_SIZE : total_len;
+}
+
+int counter_mode_range_span(size_t total_len, size_t off, size_t len, size_t *span_off,
+                            size_t *span_len) {
+    if (!span_off || !span_len || total_len <= AES_BLOCK_SIZE || off > total_len || len > total_len - off) {
+        return -1;
+    }
+
+    size_t start = off / AES_BLOCK_SIZE * AES_BLOCK_SIZE;
+    size_t end = (off + len + AES_BLOCK_SIZE - 1) / AES_BLOCK_SIZE * AES_BLOCK_SIZE;
+    size_t pair = stolen_pair_start(total_len);
+    if (len == 0) {
+        end = start;
+    } else if (off + len > pair) {
+        start = start < pair ? start : pair;
+        end = total_len;
+    }
+    *span_off = start;
+    *span_len = end - start;
+    return 0;
+}
+
+int counter_mode_decrypt_span(const taes_ctx *ctx, const uint8_t *span, size_t total_len,
+                              size_t off, size_t len, uint8_t *out) {
+    size_t span_off;
+    size_t span_len;
+    if (!ctx || counter_mode_range_span(total_len, off, len, &span_off, &span_len) != 0) {
+        return -1;
+    }
+    if (len == 0) {
+        return 0;
+    }
+    if (!span || !out) {
+        return -1;
+    }
+
+    taes_blocks_fn fn = taes_get_backend()->ctr_decrypt_blocks;
+    size_t pair = stolen_pair_start(total_len);
+    size_t end = off + len;
+    size_t ordinary_end = end < pair ? end : pair;
+    size_t pos = off;
+    uint8_t block[AES_BLOCK_SIZE];
+
+    // Ordinary blocks: whole ones straight to out, partial ones through block
+    while (pos < ordinary_end) {
+        size_t index = pos / AES_BLOCK_SIZE;
+        size_t skip = pos % AES_BLOCK_SIZE;
+        const uint8_t *in = span + index * AES_BLOCK_SIZE - span_off;
+        if (skip == 0 && ordinary_end - pos >= AES_BLOCK_SIZE) {
+            size_t nblocks = (ordinary_end - pos) / AES_BLOCK_SIZE;
+            fn(ctx, index, in, out + (pos - off), nblocks);
+            pos += nblocks * AES_BLOCK_SIZE;
+        } else {
+            size_t n = AES_BLOCK_SIZE - skip < ordinary_end - pos ? AES_BLOCK_SIZE - skip : ordinary_end - pos;
+            fn(ctx, index, in, block, 1);
+            memcpy(out + (pos - off), block + skip, n);
+            pos += n;
+        }
+    }
+
+    // The stolen pair: both blocks, under tweaks F-1 and F
+    if (pos < end) {
+        uint8_t plain[2 * AES_BLOCK_SIZE];
+        size_t pair_len = total_len - pair;
+        taes_ctx pair_ctx = *ctx;
+        taes_advance_tweak(&pair_ctx, pair / AES_BLOCK_SIZE);
+        ctr_decrypt_cts(&pair_ctx, span + (pair - span_off), plain, pair_len, fn);
+        memcpy(out + (pos - off), plain + (pos - pair), end - pos);
+        taes_cleanup(&pair_ctx);
+        memset(plain, 0, sizeof(plain));
+    }
+    memset(block, 0, sizeof(block));
+    return 0;
+}
+
+int counter_mode_decrypt_range(const taes_ctx *ctx, const uint8_t *ct, size_t total_len,
+                               size_t off, size_t len, uint8_t *out) {
+    size_t span_off;
+    size_t span_len;
+    if (!ct || counter_mode_range_span(total_len, off, len, &span_off, &span_len) != 0) {
+        return -1;
+    }
+    return counter_mode_decrypt_span(ctx, ct + span_off, total_len, off, len, out);
+}
+
+// Scatter-gather counter mode. Two cursors walk the input and output
+// chains. Where both have a contiguous run at a block boundary, the blocks
+// of that run go to the block function in one call; where either chain
+// breaks within SG_BOUNCE bytes, up to SG_BOUNCE bytes are gathered from the
+// input chain, processed in one call and scattered to the output chain, so
+// fragments shorter than a block still reach the kernel in batches. The
+// stolen pair (at most 31 bytes) is gathered and handled as a message of
+// its own at its tweak offset, as in counter_mode_decrypt_span().
+#define SG_BOUNCE (64 * AES_BLOCK_SIZE)
+
+typedef struct {
+    const struct iovec *iov;
+    int n;
+    int i;                    // Current segment
+    size_t off;               // Offset in it
+} sg_cursor;
+
+// Contiguous bytes at the cursor (0 at the end of the chain)
+static size_t sg_run(sg_cursor *c) {
+    while (c->i < c->n && c->off == c->iov[c->i].iov_len) {
+        c->i++;
+        c->off = 0;
+    }
+    return c->i < c->n ? c->iov[c->i].iov_len - c->off : 0;
+}
+
+static uint8_t *sg_ptr(const sg_cursor *c) {
+    return (uint8_t *)c->iov[c->i].iov_base + c->off;
+}
+
+// Copy length bytes out of / into the chain at the cursor (the chains'
+// lengths were checked, so they do not run out). The cursor lives in locals:
+// through memcpy()'s byte pointers it could otherwise change under the loop.
+static void sg_gather(sg_cursor *c, uint8_t *dst, size_t length) {
+    const struct iovec *iov = c->iov;
+    int i = c->i;
+    size_t off = c->off;
+    while (length > 0) {
+        const struct iovec *v = &iov[i];
+        size_t n = v->iov_len - off < length ? v->iov_len - off : length;
+        memcpy(dst, (const uint8_t *)v->iov_base + off, n);
+        dst += n;
+        length -= n;
+        off += n;
+        if (off == v->iov_len) {
+            i++;
+            off = 0;
+        }
+    }
+    c->i = i;
+    c->off = off;
+}
+
+static void sg_scatter(sg_cursor *c, const uint8_t *src, size_t length) {
+    const struct iovec *iov = c->iov;
+    int i = c->i;
+    size_t off = c->off;
+    while (length > 0) {
+        const struct iovec *v = &iov[i];
+        size_t n = v->iov_len - off < length ? v->iov_len - off : length;
+        memcpy((uint8_t *)v->iov_base + off, src, n);
+        src += n;
+        length -= n;
+        off += n;
+        if (off == v->iov_len) {
+            i++;
+            off = 0;
+        }
+    }
+    c->i = i;
+    c->off = off;
+}
+
+// Total length of a chain; SIZE_MAX if it is invalid
+static size_t sg_total(const struct iovec *iov, int n) {
+    size_t total = 0;
+    if (n < 0 || (n > 0 && !iov)) {
+        return SIZE_MAX;
+    }
+    for (int i = 0; i < n; i++) {
+        if ((!iov[i].iov_base && iov[i].iov_len > 0) || iov[i].iov_len > SIZE_MAX - 1 - total) {
+            return SIZE_MAX;
+        }
+        total += iov[i].iov_len;
+    }
+    return total;
+}
+
+static int ctr_sg(const taes_ctx *ctx, const struct iovec *in, int nin, const struct iovec *out, int nout,
+                  int decrypt) {
+    const taes_backend *backend = taes_get_backend();
+    taes_blocks_fn fn = decrypt ? backend->ctr_decrypt_blocks : backend->ctr_encrypt_blocks;
+    size_t total = sg_total(in, nin);
+
+    if (!ctx || total == SIZE_MAX || total != sg_total(out, nout) || total <= AES_BLOCK_SIZE) {
+        return -1;
+    }
+
+    sg_cursor src = {in, nin, 0, 0};
+    sg_cursor dst = {out, nout, 0, 0};
+    uint8_t bounce[SG_BOUNCE];
+    size_t pair = stolen_pair_start(total);
+    size_t pos = 0;
+    while (pos < pair) {
+        size_t run = sg_run(&src) < sg_run(&dst) ? sg_run(&src) : sg_run(&dst);
+        if (run > pair - pos) {
+            run = pair - pos;
+        }
+        if (run >= SG_BOUNCE) {
+            size_t nblocks = run / AES_BLOCK_SIZE;
+            fn(ctx, pos / AES_BLOCK_SIZE, sg_ptr(&src), sg_ptr(&dst), nblocks);
+            src.off += nblocks * AES_BLOCK_SIZE;
+            dst.off += nblocks * AES_BLOCK_SIZE;
+            pos += nblocks * AES_BLOCK_SIZE;
+        } else {
+            size_t n = pair - pos < SG_BOUNCE ? pair - pos : SG_BOUNCE;
+            sg_gather(&src, bounce, n);
+            fn(ctx, pos / AES_BLOCK_SIZE, bounce, bounce, n / AES_BLOCK_SIZE);
+            sg_scatter(&dst, bounce, n);
+            pos += n;
+        }
+    }
+
+    // The stolen pair: the last full block and the tail, at their offset
+    if (pair < total) {
+        taes_ctx pair_ctx = *ctx;
+        taes_advance_tweak(&pair_ctx, pair / AES_BLOCK_SIZE);
+        sg_gather(&src, bounce, total - pair);
+        if (decrypt) {
+            ctr_decrypt_cts(&pair_ctx, bounce, bounce, total - pair, fn);
+        } else {
+            ctr_encrypt_cts(&pair_ctx, bounce, bounce, total - pair, fn);
+        }
+        sg_scatter(&dst, bounce, total - pair);
+        taes_cleanup(&pair_ctx);
+    }
+    memset(bounce, 0, sizeof(bounce));
+    return 0;
+}
+
+int counter_mode_encryptv(const taes_ctx *ctx, const struct iovec *in, int nin, const struct iovec *out,
+                          int nout) {
+    return ctr_sg(ctx, in, nin, out, nout, 0);
+}
+
+int counter_mode_decryptv(const taes_ctx *ctx, const struct iovec *in, int nin, const struct iovec *out,
+                          int nout) {
+    return ctr_sg(ctx, in, nin, out, nout, 1);
+}
+
+// Parallel counter mode: the blocks before the stolen pair are cut into
+// chunks, chunk c starting at block c * chunk_blocks. Its first tweak is
+// tweak + c * chunk_blocks (the block functions add `first` as a 128-bit
+// value), so each chunk is independent and the output is the serial one.
+typedef struct {
+    const taes_ctx *ctx;
+    const uint8_t *in;
+    uint8_t *out;
+    size_t nblocks;
+    size_t chunk_blocks;
+    taes_blocks_fn fn;
+} ctr_chunks;
+
+static void ctr_chunk(void *arg, size_t chunk) {
+    const ctr_chunks *job = arg;
+    size_t first = chunk * job->chunk_blocks;
+    size_t n = job->nblocks - first < job->chunk_blocks ? job->nblocks - first : job->chunk_blocks;
+    job->fn(job->ctx, first, job->in + first * AES_BLOCK_SIZE, job->out + first * AES_BLOCK_SIZE, n);
+}
+
+static int ctr_parallel(taes_pool *pool, const taes_ctx *ctx, const uint8_t *in, uint8_t *out,
+                        size_t length, size_t chunk_size, int decrypt) {
+    const taes_backend *backend = taes_get_backend();
+    taes_blocks_fn fn = decrypt ? backend->ctr_decrypt_blocks : backend->ctr_encrypt_blocks;
+
+    if (!ctx || !in || !out || length <= AES_BLOCK_SIZE) {
+        return -1;
+    }
+
+    size_t full_blocks = length / AES_BLOCK_SIZE;
+    size_t tail = length % AES_BLOCK_SIZE;
+    size_t chunk_blocks = (chunk_size ? chunk_size : TAES_POOL_DEFAULT_CHUNK) / AES_BLOCK_SIZE;
+    if (chunk_blocks == 0) {
+        chunk_blocks = 1;
+    }
+
+    ctr_chunks job = {ctx, in, out, tail ? full_blocks - 1 : full_blocks, chunk_blocks, fn};
+    taes_pool_run(pool, (job.nblocks + chunk_blocks - 1) / chunk_blocks, ctr_chunk, &job);
+
+    // The stolen pair depends on the last chunk's input only, so it runs
+    // after the chunks on the calling thread
+    if (tail) {
+        if (decrypt) {
+            decrypt_stolen_pair(ctx, in, out, full_blocks, tail, fn);
+        } else {
+            encrypt_stolen_pair(ctx, in, out, full_blocks, tail, fn);
+        }
+    }
+    return 0;
+}
+
+int counter_mode_encrypt_parallel(taes_pool *pool, const taes_ctx *ctx, const uint8_t *plaintext,
+                                  uint8_t *ciphertext, size_t length, size_t chunk_size) {
+    return ctr_parallel(pool, ctx, plaintext, ciphertext, length, chunk_size, 0);
+}
+
+int counter_mode_decrypt_parallel(taes_pool *pool, const taes_ctx *ctx, const uint8_t *ciphertext,
+                                  uint8_t *plaintext, size_t length, size_t chunk_size) {
+    return ctr_parallel(pool, ctx, ciphertext, plaintext, length, chunk_size, 1);
+}
+
+// Transcryption: blocks before the stolen pair go through a tile on the
+// stack, decrypted under `from` and re-encrypted under `to` while the tile
+// is in L1, so only the two ciphertexts cross the memory bus. The stolen
+// pair is decrypted and re-encrypted whole: its blocks mix under each key.
+#define TRANSCRYPT_TILE_BLOCKS (TAES_TRANSCRYPT_TILE / AES_BLOCK_SIZE)
+
+typedef struct {
+    const taes_ctx *from;
+    const taes_ctx *to;
+    const uint8_t *in;
+    uint8_t *out;
+    size_t nblocks;
+    size_t chunk_blocks;
+} transcrypt_chunks;
+
+static void transcrypt_blocks(const taes_ctx *from, const taes_ctx *to, uint64_t first, const uint8_t *in,
+                              uint8_t *out, size_t nblocks) {
+    const taes_backend *backend = taes_get_backend();
+    uint8_t tile[TAES_TRANSCRYPT_TILE];
+    for (size_t done = 0; done < nblocks;) {
+        size_t n = nblocks - done < TRANSCRYPT_TILE_BLOCKS ? nblocks - done : TRANSCRYPT_TILE_BLOCKS;
+        backend->ctr_decrypt_blocks(from, first + done, in + done * AES_BLOCK_SIZE, tile, n);
+        backend->ctr_encrypt_blocks(to, first + done, tile, out + done * AES_BLOCK_SIZE, n);
+        done += n;
+    }
+    memset(tile, 0, sizeof(tile));
+}
+
+static void transcrypt_chunk(void *arg, size_t chunk) {
+    const transcrypt_chunks *job = arg;
+    size_t first = chunk * job->chunk_blocks;
+    size_t n = job->nblocks - first < job->chunk_blocks ? job->nblocks - first : job->chunk_blocks;
+    transcrypt_blocks(job->from, job->to, first, job->in + first * AES_BLOCK_SIZE,
+                      job->out + first * AES_BLOCK_SIZE, n);
+}
+
+int taes_transcrypt_parallel(taes_pool *pool, const taes_ctx *from, const taes_ctx *to, const uint8_t *in,
+                             uint8_t *out, size_t length, size_t chunk_size) {
+    if (!from || !to || !in || !out || length <= AES_BLOCK_SIZE) {
+        return -1;
+    }
+
+    size_t pair = stolen_pair_start(length);
+    size_t chunk_blocks = (chunk_size ? chunk_size : TAES_POOL_DEFAULT_CHUNK) / AES_BLOCK_SIZE;
+    if (chunk_blocks == 0) {
+        chunk_blocks = 1;
+    }
+    transcrypt_chunks job = {from, to, in, out, pair / AES_BLOCK_SIZE, chunk_blocks};
+    taes_pool_run(pool, (job.nblocks + chunk_blocks - 1) / chunk_blocks, transcrypt_chunk, &job);
+
+    if (pair < length) {
+        const taes_backend *backend = taes_get_backend();
+        uint8_t plain[2 * AES_BLOCK_SIZE];
+        taes_ctx pair_from = *from;
+        taes_ctx pair_to = *to;
+        taes_advance_tweak(&pair_from, pair / AES_BLOCK_SIZE);
+        taes_advance_tweak(&pair_to, pair / AES_BLOCK_SIZE);
+        ctr_decrypt_cts(&pair_from, in + pair, plain, length - pair, backend->ctr_decrypt_blocks);
+        ctr_encrypt_cts(&pair_to, plain, out + pair, length - pair, backend->ctr_encrypt_blocks);
+        taes_cleanup(&pair_from);
+        taes_cleanup(&pair_to);
+        memset(plain, 0, sizeof(plain));
+    }
+    return 0;
+}
+
+int taes_transcrypt(const taes_ctx *from, const taes_ctx *to, const uint8_t *in, uint8_t *out, size_t length) {
+    return taes_transcrypt_parallel(NULL, from, to, in, out, length, SIZE_MAX);
+}
@@ -1,5 +1,6 @@
 // T-AES implementation using standard C and lookup tables
 #include "../include/taes.h"
+#include "taes_backend.h"
 #include <string.h>
 #include <stdio.h>
 
@@ -124,26 +125,34 @@ static void add_round_key(const taes_ctx *ctx, const uint8_t *state, uint8_t *ou
     }
 }
 
-static void add_tweak(const taes_ctx *ctx, uint8_t *round_key) {
-    
-    unsigned __int128 tweak = 0;
+// Read 16 bytes as a little-endian 128-bit integer
+static unsigned __int128 load_le128(const uint8_t *bytes) {
+    unsigned __int128 value = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    memcpy(&value, bytes, 16);
+#else
     for (int i = 0; i < 16; i++) {
-        tweak |= ((unsigned __int128)ctx->tweak[i]) << (i * 8);
+        value |= ((unsigned __int128)bytes[i]) << (i * 8);
     }
+#endif
+    return value;
+}
 
-    // Read round key as a 128-bit little-endian integer
-    unsigned __int128 rk = 0;
+// Write a 128-bit integer back as 16 little-endian bytes
+static void store_le128(uint8_t *bytes, unsigned __int128 value) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    memcpy(bytes, &value, 16);
+#else
     for (int i = 0; i < 16; i++) {
-        rk |= ((unsigned __int128)round_key[i]) << (i * 8);
+        bytes[i] = (value >> (i * 8)) & 0xFF;
     }
+#endif
+}
 
-    // Perform 128-bit arithmetic addition
-    unsigned __int128 modified_rk = rk + tweak;
-
-    // Write back the modified round key as little-endian bytes
-    for (int i = 0; i < 16; i++) {
-        round_key[i] = (modified_rk >> (i * 8)) & 0xFF;
-    }
+// Recompute the tweaked round key: RK[tweak_round] + tweak (128-bit arithmetic addition)
+static void update_tweaked_round_key(taes_ctx *ctx) {
+    unsigned __int128 rk = load_le128(&ctx->round_keys[ctx->tweak_round * 16]);
+    store_le128(ctx->tweaked_round_key, rk + load_le128(ctx->tweak));
 }
 
 uint8_t gmul2(uint8_t a) {
@@ -270,7 +279,7 @@ static void inv_shift_rows(uint8_t *state) {
 
 
 // Initialize T-AES context
-int taes_init(taes_ctx *ctx, const uint8_t *key, int key_size, const uint8_t *tweak) {
+int taes_init_portable(taes_ctx *ctx, const uint8_t *key, int key_size, const uint8_t *tweak) {
     if (!ctx || !key) {
         return -1;
     }
@@ -281,6 +290,7 @@ int taes_init(taes_ctx *ctx, const uint8_t *key, int key_size, const uint8_t *tw
     }
 
     ctx->key_size = key_size;
+    ctx->has_dec_round_keys = 0;
 
     // Set number of rounds based on key size
     switch (key_size) {
@@ -291,120 +301,172 @@ int taes_init(taes_ctx *ctx, const uint8_t *key, int key_size, const uint8_t *tw
 
     key_expansion(key, ctx->round_keys, key_size, ctx->num_rounds);
     
-    // Store tweak
+    // Store tweak and precompute the tweaked round key
+    taes_set_tweak(ctx, tweak);
+
+    return 0;
+}
+
+// Initialize several contexts that share a key size
+int taes_init_many_portable(taes_ctx *const ctxs[], const uint8_t *const keys[], int key_size,
+                            const uint8_t *const tweaks[], size_t n) {
+    if (!ctxs || !keys) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        if (taes_init_portable(ctxs[i], keys[i], key_size, tweaks ? tweaks[i] : NULL) != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// Replace the tweak without re-running key expansion
+void taes_set_tweak(taes_ctx *ctx, const uint8_t *tweak) {
     if (tweak) {
         memcpy(ctx->tweak, tweak, TWEAK_SIZE);
     } else {
         memset(ctx->tweak, 0, TWEAK_SIZE);
     }
+    update_tweaked_round_key(ctx);
+}
 
-    return 0;
+// Add n to the tweak. (RK + T) + n == RK + (T + n) mod 2^128, so the tweaked
+// round key is advanced by the same amount instead of being recomputed.
+void taes_advance_tweak(taes_ctx *ctx, uint64_t n) {
+    store_le128(ctx->tweak, load_le128(ctx->tweak) + n);
+    store_le128(ctx->tweaked_round_key, load_le128(ctx->tweaked_round_key) + n);
 }
 
-// Encrypt a single block
-void taes_encrypt_block(const taes_ctx *ctx, const uint8_t *plaintext, uint8_t *ciphertext) {
-    uint8_t round = 0;
+// Block cipher for one key size. Callers pass nr and tr as constants, so
+// the round loop is fully unrolled and the tweak round is fixed at compile
+// time: no loop counter and no round == tweak_round test per round.
+// tk is the tweaked round key (ctx->tweaked_round_key, or one per block).
+static inline __attribute__((always_inline))
+void encrypt_block_rounds(const taes_ctx *ctx, const uint8_t *tk, const uint8_t *plaintext,
+                          uint8_t *ciphertext, const int nr, const int tr) {
     // 1. Initial AddRoundKey
-    // printf("round [%d].input ", round);
-    // print_state(plaintext);
+    add_round_key(ctx, plaintext, ciphertext, 0);
 
-    // printf("round [%d].k_sch ", round);
-    // print_state(&ctx->round_keys[0]);
-    
-    add_round_key(ctx, plaintext, ciphertext, round);
-    
-    // 2. Rounds 1 to (num_rounds - 1):
-    for (round = 1; round < ctx->num_rounds; round++) {
-        // printf("round [%d].start ", round);
-        // print_state(ciphertext);
-        
-        //    - SubBytes
+    // 2. Rounds 1 to (nr - 1): SubBytes, ShiftRows, MixColumns, AddRoundKey
+    //    (the precomputed tweaked round key at round tr)
+    TAES_UNROLL
+    for (int round = 1; round < nr; round++) {
         sub_bytes(ciphertext);
-        // printf("round [%d].s_box ", round);
-        // print_state(ciphertext);
-
-        //    - ShiftRows
         shift_rows(ciphertext);
-        // printf("round [%d].s_row ", round);
-        // print_state(ciphertext);
-
-        //    - MixColumns
         mix_columns(ciphertext);
-        // printf("round [%d].m_col ", round);
-        // print_state(ciphertext);
-
-        //    - AddRoundKey (apply tweak modification at tweak_round)
-        if (round == ctx->tweak_round) {
-            // Apply tweak modification to a copy of the round key
-            uint8_t modified_key[16];
-            memcpy(modified_key, &ctx->round_keys[round * 16], 16);
-            add_tweak(ctx, modified_key);
-            // printf("round [%d].k_sch ", round);
-            // print_state(modified_key);
-            // XOR state with tweaked round key
+        if (round == tr) {
             for (int i = 0; i < 16; i++) {
-                ciphertext[i] ^= modified_key[i];
+                ciphertext[i] ^= tk[i];
             }
         } else {
-            // printf("round [%d].k_sch ", round);
-            // print_state(&ctx->round_keys[round * 16]);
             add_round_key(ctx, ciphertext, ciphertext, round);
         }
     }
-    
-    // 3. Final round:
-    //    - SubBytes
+
+    // 3. Final round: SubBytes, ShiftRows, AddRoundKey
     sub_bytes(ciphertext);
-    // printf("round [%d].s_box ", round);
-    // print_state(ciphertext);
-    //    - ShiftRows
     shift_rows(ciphertext);
-    // printf("round [%d].s_row ", round);
-    // print_state(ciphertext);
-    //    - AddRoundKey
-    add_round_key(ctx, ciphertext, ciphertext, round);
-    // printf("round [%d].k_sch ", round);
-    // print_state(&ctx->round_keys[round * 16]);
+    add_round_key(ctx, ciphertext, ciphertext, nr);
 }
 
-// Decrypt a single block
-void taes_decrypt_block(const taes_ctx *ctx, const uint8_t *ciphertext, uint8_t *plaintext) {
+static inline __attribute__((always_inline))
+void decrypt_block_rounds(const taes_ctx *ctx, const uint8_t *tk, const uint8_t *ciphertext,
+                          uint8_t *plaintext, const int nr, const int tr) {
     // 1. Initial AddRoundKey
-    uint8_t round = ctx->num_rounds;
-    add_round_key(ctx, ciphertext, plaintext, round);
+    add_round_key(ctx, ciphertext, plaintext, nr);
 
-    // 2. Rounds (num_rounds - 1) to 1:
-    for (round = ctx->num_rounds - 1; round >= 1; round--) {
-        //    - InvShiftRows
+    // 2. Rounds (nr - 1) to 1: InvShiftRows, InvSubBytes, AddRoundKey (the
+    //    tweaked round key at round tr), InvMixColumns
+    TAES_UNROLL
+    for (int round = nr - 1; round >= 1; round--) {
         inv_shift_rows(plaintext);
-        //    - InvSubBytes
         inv_sub_bytes(plaintext);
-        //    - AddRoundKey (apply tweak modification at tweak_round)
-        if (round == ctx->tweak_round) {
-            // Apply tweak modification to a copy of the round key
-            uint8_t modified_key[16];
-            memcpy(modified_key, &ctx->round_keys[round * 16], 16);
-            add_tweak(ctx, modified_key);
-            // XOR state with tweaked round key
+        if (round == tr) {
             for (int i = 0; i < 16; i++) {
-                plaintext[i] ^= modified_key[i];
+                plaintext[i] ^= tk[i];
             }
         } else {
             add_round_key(ctx, plaintext, plaintext, round);
         }
-        //    - InvMixColumns
         inv_mix_columns(plaintext);
     }
 
-    // 3. Final round:
-    //    - InvShiftRows
+    // 3. Final round: InvShiftRows, InvSubBytes, AddRoundKey
     inv_shift_rows(plaintext);
-    //    - InvSubBytes
     inv_sub_bytes(plaintext);
-    //    - AddRoundKey
     add_round_key(ctx, plaintext, plaintext, 0);
 }
 
+// Encrypt a single block with the variant for the context's key size
+// (AES-128/192/256: 10/12/14 rounds, tweak at RK5/6/7)
+void taes_encrypt_block_portable(const taes_ctx *ctx, const uint8_t *plaintext, uint8_t *ciphertext) {
+    switch (ctx->num_rounds) {
+        case 10: encrypt_block_rounds(ctx, ctx->tweaked_round_key, plaintext, ciphertext, 10, 5); break;
+        case 12: encrypt_block_rounds(ctx, ctx->tweaked_round_key, plaintext, ciphertext, 12, 6); break;
+        default: encrypt_block_rounds(ctx, ctx->tweaked_round_key, plaintext, ciphertext, 14, 7); break;
+    }
+}
+
+// Decrypt a single block
+void taes_decrypt_block_portable(const taes_ctx *ctx, const uint8_t *ciphertext, uint8_t *plaintext) {
+    switch (ctx->num_rounds) {
+        case 10: decrypt_block_rounds(ctx, ctx->tweaked_round_key, ciphertext, plaintext, 10, 5); break;
+        case 12: decrypt_block_rounds(ctx, ctx->tweaked_round_key, ciphertext, plaintext, 12, 6); break;
+        default: decrypt_block_rounds(ctx, ctx->tweaked_round_key, ciphertext, plaintext, 14, 7); break;
+    }
+}
+
+// Blocks with a tweak each: block i is encrypted under RK + tweaks[i] in
+// place of the context's tweak
+static inline __attribute__((always_inline))
+void encrypt_blocks_rounds(const taes_ctx *ctx, const uint8_t *plaintext, uint8_t *ciphertext,
+                           const uint8_t *tweaks, size_t nblocks, const int nr, const int tr) {
+    unsigned __int128 rk = load_le128(&ctx->round_keys[tr * 16]);
+    uint8_t tk[16];
+
+    for (size_t i = 0; i < nblocks; i++) {
+        store_le128(tk, rk + load_le128(tweaks + i * TWEAK_SIZE));
+        encrypt_block_rounds(ctx, tk, plaintext + i * AES_BLOCK_SIZE, ciphertext + i * AES_BLOCK_SIZE, nr, tr);
+    }
+    memset(tk, 0, sizeof(tk));
+}
+
+static inline __attribute__((always_inline))
+void decrypt_blocks_rounds(const taes_ctx *ctx, const uint8_t *ciphertext, uint8_t *plaintext,
+                           const uint8_t *tweaks, size_t nblocks, const int nr, const int tr) {
+    unsigned __int128 rk = load_le128(&ctx->round_keys[tr * 16]);
+    uint8_t tk[16];
+
+    for (size_t i = 0; i < nblocks; i++) {
+        store_le128(tk, rk + load_le128(tweaks + i * TWEAK_SIZE));
+        decrypt_block_rounds(ctx, tk, ciphertext + i * AES_BLOCK_SIZE, plaintext + i * AES_BLOCK_SIZE, nr, tr);
+    }
+    memset(tk, 0, sizeof(tk));
+}
+
+// Encrypt nblocks blocks, block i with tweak tweaks[i] (16 bytes each)
+void taes_encrypt_blocks_portable(const taes_ctx *ctx, const uint8_t *plaintext, uint8_t *ciphertext,
+                                  const uint8_t *tweaks, size_t nblocks) {
+    switch (ctx->num_rounds) {
+        case 10: encrypt_blocks_rounds(ctx, plaintext, ciphertext, tweaks, nblocks, 10, 5); break;
+        case 12: encrypt_blocks_rounds(ctx, plaintext, ciphertext, tweaks, nblocks, 12, 6); break;
+        default: encrypt_blocks_rounds(ctx, plaintext, ciphertext, tweaks, nblocks, 14, 7); break;
+    }
+}
+
+// Decrypt nblocks blocks, block i with tweak tweaks[i]
+void taes_decrypt_blocks_portable(const taes_ctx *ctx, const uint8_t *ciphertext, uint8_t *plaintext,
+                                  const uint8_t *tweaks, size_t nblocks) {
+    switch (ctx->num_rounds) {
+        case 10: decrypt_blocks_rounds(ctx, ciphertext, plaintext, tweaks, nblocks, 10, 5); break;
+        case 12: decrypt_blocks_rounds(ctx, ciphertext, plaintext, tweaks, nblocks, 12, 6); break;
+        default: decrypt_blocks_rounds(ctx, ciphertext, plaintext, tweaks, nblocks, 14, 7); break;
+    }
+}
+
 // Clean up context
 void taes_cleanup(taes_ctx *ctx) {
     if (ctx) {
@@ -0,0 +1,368 @@
+// Asynchronous counter mode (see taes_async.h)
+// Both rings are bounded multi-producer/multi-consumer queues: every cell
+// has a sequence number telling producers and consumers whose turn it is, so
+// pushing and popping take one compare-and-swap on the ring's tail or head
+// and no locks. Submitters, workers and pollers may all be several threads.
+//
+// The rings hold a power of two >= depth cells and taes_submit() keeps at
+// most depth jobs in flight, so neither ring can hold more jobs than it has
+// cells. A push can still find its cell busy for a moment, while a popper
+// that claimed it is copying the job out; it then yields and retries.
+// Idle workers sleep on a semaphore posted once per submitted job.
+#define _POSIX_C_SOURCE 200809L
+#include "../include/taes_async.h"
+#include "../include/counter_mode.h"
+#include "../include/taes_mb.h"
+#include "taes_backend.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+// Bytes after which a worker stops adding jobs to a batch
+#define BATCH_BYTES (64 * 1024)
+
+typedef struct {
+    atomic_size_t seq;
+    taes_async_job job;       // Submission ring: the job
+    int status;               // Completion ring: job.user_data and this
+} ring_cell;
+
+typedef struct {
+    ring_cell *cells;
+    size_t mask;
+    _Alignas(64) atomic_size_t head;   // Next cell to pop
+    _Alignas(64) atomic_size_t tail;   // Next cell to push
+} ring;
+
+struct taes_queue {
+    ring submitted;
+    ring completed;
+    _Alignas(64) atomic_size_t in_flight;
+    size_t depth;
+    sem_t work;               // One post per submitted job, one per worker to stop
+    atomic_int shutdown;
+    int efd;
+    int threads;
+    int started;
+    pthread_t *tids;
+};
+
+// Zeroed memory for a type with _Alignas(64) members (the rings' head and
+// tail on their own cache lines, the workers' taes_mb_mgr): calloc() only
+// aligns to 16. sizeof is a multiple of the alignment, as aligned_alloc()
+// needs.
+static void *zalloc_aligned(size_t alignment, size_t size) {
+    void *p = aligned_alloc(alignment, size);
+    if (p) {
+        memset(p, 0, size);
+    }
+    return p;
+}
+
+static int ring_init(ring *r, size_t cells) {
+    r->cells = calloc(cells, sizeof(*r->cells));
+    if (!r->cells) {
+        return -1;
+    }
+    for (size_t i = 0; i < cells; i++) {
+        atomic_init(&r->cells[i].seq, i);
+    }
+    r->mask = cells - 1;
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    return 0;
+}
+
+// Returns 0, or -1 if the ring is full
+static int ring_push(ring *r, const taes_async_job *job, int status) {
+    size_t pos = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    ring_cell *cell;
+
+    for (;;) {
+        cell = &r->cells[pos & r->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&r->tail, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return -1;
+        } else {
+            pos = atomic_load_explicit(&r->tail, memory_order_relaxed);
+        }
+    }
+
+    cell->job = *job;
+    cell->status = status;
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+    return 0;
+}
+
+// Push a job that is known to fit: wait out poppers still reading the cell
+static void ring_push_wait(ring *r, const taes_async_job *job, int status) {
+    while (ring_push(r, job, status) != 0) {
+        sched_yield();
+    }
+}
+
+// Returns 0, or -1 if no cell is ready: the ring is empty, or the next cell
+// is claimed by a push that hasn't finished writing it
+static int ring_pop(ring *r, taes_async_job *job, int *status) {
+    size_t pos = atomic_load_explicit(&r->head, memory_order_relaxed);
+    ring_cell *cell;
+
+    for (;;) {
+        cell = &r->cells[pos & r->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&r->head, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return -1;
+        } else {
+            pos = atomic_load_explicit(&r->head, memory_order_relaxed);
+        }
+    }
+
+    *job = cell->job;
+    *status = cell->status;
+    atomic_store_explicit(&cell->seq, pos + r->mask + 1, memory_order_release);
+    return 0;
+}
+
+// Signal n new completions (one write per batch, not per job)
+static void notify(taes_queue *queue, uint64_t n) {
+    if (queue->efd >= 0) {
+        ssize_t ret = write(queue->efd, &n, sizeof(n));
+        (void)ret;  // Only fails if the counter would overflow, then it is readable anyway
+    }
+}
+
+// Take the job whose semaphore post we consumed. Returns 0 when stopping.
+static int take_job(taes_queue *queue, taes_async_job *job) {
+    int status;
+    while (ring_pop(&queue->submitted, job, &status) != 0) {
+        // Stop posts only come after every job, so an empty ring means stop.
+        // Otherwise our job's cell is still being written.
+        if (atomic_load(&queue->shutdown)) {
+            return 0;
+        }
+        sched_yield();
+    }
+    return 1;
+}
+
+// Run the small jobs of a batch side by side, all other jobs one by one.
+// Only the 16-lane VAES kernel beats one job at a time on jobs of this size;
+// with 8 AES-NI lanes the single-stream pipeline is as full and cheaper.
+static void run_batch(taes_queue *queue, taes_mb_mgr *mgr, taes_async_job *jobs, size_t n) {
+    taes_mb_job mb[TAES_ASYNC_BATCH];
+    int side_by_side[TAES_ASYNC_BATCH];
+    size_t small = 0;
+
+    // The manager is set up again only when the backend changes
+    if (mgr->backend != taes_get_backend()) {
+        taes_mb_init(mgr);
+    }
+    for (size_t i = 0; i < n; i++) {
+        side_by_side[i] = mgr->lanes >= TAES_MB_MAX_LANES && jobs[i].length <= TAES_ASYNC_SMALL;
+        small += side_by_side[i];
+    }
+
+    if (small >= 2) {
+        for (size_t i = 0; i < n; i++) {
+            taes_async_job *job = &jobs[i];
+            if (side_by_side[i]) {
+                mb[i] = (taes_mb_job){job->ctx, job->in, job->out, job->length, job->decrypt, 0};
+                taes_mb_submit(mgr, &mb[i]);
+            }
+        }
+        taes_mb_flush(mgr);
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        taes_async_job *job = &jobs[i];
+        int status;
+        if (small >= 2 && side_by_side[i]) {
+            status = mb[i].status;
+        } else if (job->decrypt) {
+            status = counter_mode_decrypt(job->ctx, job->in, job->out, job->length);
+        } else {
+            status = counter_mode_encrypt(job->ctx, job->in, job->out, job->length);
+        }
+        ring_push_wait(&queue->completed, job, status);
+    }
+    notify(queue, n);
+}
+
+typedef struct {
+    taes_queue *queue;
+    taes_mb_mgr mgr;
+} worker;
+
+static void *worker_main(void *p) {
+    worker *w = p;
+    taes_queue *queue = w->queue;
+    taes_async_job jobs[TAES_ASYNC_BATCH];
+
+    for (;;) {
+        // Out of jobs: let submitters run once before sleeping, so the
+        // next wakeup finds a batch rather than a single job
+        if (sem_trywait(&queue->work) != 0) {
+            sched_yield();
+            while (sem_wait(&queue->work) != 0 && errno == EINTR) {
+            }
+        }
+        if (!take_job(queue, &jobs[0])) {
+            break;
+        }
+
+        // Take what else is queued. The completions of a batch are posted
+        // together, so the bytes bound how long the first job waits.
+        size_t n = 1;
+        size_t bytes = jobs[0].length;
+        while (n < TAES_ASYNC_BATCH && bytes < BATCH_BYTES && sem_trywait(&queue->work) == 0) {
+            if (!take_job(queue, &jobs[n])) {
+                // A stop post: leave it for the next wait
+                sem_post(&queue->work);
+                break;
+            }
+            bytes += jobs[n++].length;
+        }
+        run_batch(queue, &w->mgr, jobs, n);
+    }
+
+    // Don't leave round keys behind in the manager
+    taes_mb_flush(&w->mgr);
+    free(w);
+    return NULL;
+}
+
+taes_queue *taes_queue_create(int threads, size_t depth) {
+    if (threads < 0) {
+        return NULL;
+    }
+    if (threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int)cpus : 1;
+    }
+    if (depth == 0) {
+        depth = TAES_ASYNC_DEFAULT_DEPTH;
+    }
+    size_t cells = 1;
+    while (cells < depth) {
+        cells *= 2;
+    }
+
+    taes_queue *queue = zalloc_aligned(_Alignof(taes_queue), sizeof(*queue));
+    if (!queue) {
+        return NULL;
+    }
+    queue->depth = depth;
+    queue->threads = threads;
+    atomic_init(&queue->in_flight, 0);
+    atomic_init(&queue->shutdown, 0);
+    queue->efd = -1;
+    queue->tids = calloc((size_t)threads, sizeof(*queue->tids));
+    if (!queue->tids || ring_init(&queue->submitted, cells) != 0 || ring_init(&queue->completed, cells) != 0 ||
+        sem_init(&queue->work, 0, 0) != 0) {
+        free(queue->tids);
+        free(queue->submitted.cells);
+        free(queue->completed.cells);
+        free(queue);
+        return NULL;
+    }
+    queue->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    for (int i = 0; i < threads; i++) {
+        worker *w = zalloc_aligned(_Alignof(worker), sizeof(*w));
+        if (!w) {
+            taes_queue_destroy(queue);
+            return NULL;
+        }
+        w->queue = queue;
+        if (pthread_create(&queue->tids[i], NULL, worker_main, w) != 0) {
+            free(w);
+            taes_queue_destroy(queue);
+            return NULL;
+        }
+        queue->started++;
+    }
+    return queue;
+}
+
+void taes_queue_destroy(taes_queue *queue) {
+    if (!queue) {
+        return;
+    }
+
+    // Workers stop once the submission ring is empty, i.e. after every job
+    atomic_store(&queue->shutdown, 1);
+    for (int i = 0; i < queue->started; i++) {
+        sem_post(&queue->work);
+    }
+    for (int i = 0; i < queue->started; i++) {
+        pthread_join(queue->tids[i], NULL);
+    }
+
+    if (queue->efd >= 0) {
+        close(queue->efd);
+    }
+    sem_destroy(&queue->work);
+    free(queue->submitted.cells);
+    free(queue->completed.cells);
+    free(queue->tids);
+    free(queue);
+}
+
+int taes_submit(taes_queue *queue, const taes_async_job *job) {
+    if (!queue || !job) {
+        return -1;
+    }
+
+    // Same requirements as counter_mode_encrypt()
+    if (!job->ctx || !job->in || !job->out || job->length <= AES_BLOCK_SIZE) {
+        return -1;
+    }
+
+    if (atomic_fetch_add(&queue->in_flight, 1) >= queue->depth) {
+        atomic_fetch_sub(&queue->in_flight, 1);
+        return TAES_ASYNC_FULL;
+    }
+    ring_push_wait(&queue->submitted, job, 0);
+    sem_post(&queue->work);
+    return 0;
+}
+
+size_t taes_poll(taes_queue *queue, taes_async_completion *completions, size_t max) {
+    if (!queue || !completions) {
+        return 0;
+    }
+
+    size_t n = 0;
+    taes_async_job job;
+    int status;
+    while (n < max && ring_pop(&queue->completed, &job, &status) == 0) {
+        // Free the job's place as soon as its cell is
+        atomic_fetch_sub(&queue->in_flight, 1);
+        completions[n].user_data = job.user_data;
+        completions[n].status = status;
+        n++;
+    }
+    return n;
+}
+
+int taes_queue_eventfd(const taes_queue *queue) {
+    return queue ? queue->efd : -1;
+}
@@ -0,0 +1,92 @@
+// Internal backend interface
+// Each implementation (portable C, T-table, bitsliced, AES-NI, VAES) is described by one
+// taes_backend table; the public API calls through the table selected in
+// taes_dispatch.c.
+#ifndef TAES_BACKEND_H
+#define TAES_BACKEND_H
+
+#include "../include/taes.h"
+#include "../include/taes_mb.h"
+
+// Fully unroll the round loop that follows. Block functions are inlined per
+// key size (AES-128/192/256: 10/12/14 rounds, tweak at RK5/6/7) with the
+// round counts as constants, so every round of a variant is straight-line
+// code and the tweaked round key is injected at a fixed place.
+#define TAES_UNROLL _Pragma("GCC unroll 14")
+
+// Process nblocks consecutive whole blocks, block j using tweak + first + j
+typedef void (*taes_blocks_fn)(const taes_ctx *ctx, uint64_t first, const uint8_t *in,
+                               uint8_t *out, size_t nblocks);
+
+// Process nblocks independent blocks, block j using tweak tweaks[j]
+typedef void (*taes_tweaks_fn)(const taes_ctx *ctx, const uint8_t *in, uint8_t *out,
+                               const uint8_t *tweaks, size_t nblocks);
+
+// Multi-buffer kernels, driven by taes_mb.c. encrypt/decrypt run nblocks
+// blocks of every lane holding a job (free lanes compute into mgr->scratch) and
+// advance those lanes' in and out. Tweaked keys are stepped with 64-bit
+// adds: taes_mb.c splits passes so no lane's low half wraps inside one, and
+// sets each lane's tweaked_key before every pass. load_keys copies a
+// context's round keys (the InvMixColumns schedule for decryption) into a
+// lane's column of mgr->keys.
+typedef struct {
+    int lanes;                // Streams per pass
+    void (*load_keys)(taes_mb_mgr *mgr, int lane, const taes_ctx *ctx, int decrypt);
+    void (*encrypt)(taes_mb_mgr *mgr, size_t nblocks);
+    void (*decrypt)(taes_mb_mgr *mgr, size_t nblocks);
+} taes_mb_kernel;
+
+typedef struct {
+    const char *name;         // Name accepted by taes_set_backend() and TAES_BACKEND
+    int (*available)(void);   // Nonzero if the CPU can run this backend
+    int (*init)(taes_ctx *ctx, const uint8_t *key, int key_size, const uint8_t *tweak);
+    int (*init_decrypt)(taes_ctx *ctx, const uint8_t *key, int key_size, const uint8_t *tweak);
+    int (*init_many)(taes_ctx *const ctxs[], const uint8_t *const keys[], int key_size,
+                     const uint8_t *const tweaks[], size_t n);
+    void (*encrypt_block)(const taes_ctx *ctx, const uint8_t *plaintext, uint8_t *ciphertext);
+    void (*decrypt_block)(const taes_ctx *ctx, const uint8_t *ciphertext, uint8_t *plaintext);
+    taes_tweaks_fn encrypt_blocks;
+    taes_tweaks_fn decrypt_blocks;
+    taes_blocks_fn ctr_encrypt_blocks;
+    taes_blocks_fn ctr_decrypt_blocks;
+    const taes_mb_kernel *(*mb_kernel)(void);  // NULL: multi-buffer jobs run one by one
+} taes_backend;
+
+// Backend used by the public API
+const taes_backend *taes_get_backend(void);
+
+// Counter mode with Ciphertext Stealing on top of a block function (counter_mode.c)
+int ctr_encrypt_cts(const taes_ctx *ctx, const uint8_t *plaintext, uint8_t *ciphertext,
+                    size_t length, taes_blocks_fn encrypt_blocks);
+int ctr_decrypt_cts(const taes_ctx *ctx, const uint8_t *ciphertext, uint8_t *plaintext,
+                    size_t length, taes_blocks_fn decrypt_blocks);
+
+// Counter-mode block kernels
+void ctr_encrypt_blocks_portable(const taes_ctx *ctx, uint64_t first, const uint8_t *in,
+                                 uint8_t *out, size_t nblocks);
+void ctr_decrypt_blocks_portable(const taes_ctx *ctx, uint64_t first, const uint8_t *in,
+                                 uint8_t *out, size_t nblocks);
+void ctr_encrypt_blocks_ttable(const taes_ctx *ctx, uint64_t first, const uint8_t *in,
+                               uint8_t *out, size_t nblocks);
+void ctr_decrypt_blocks_ttable(const taes_ctx *ctx, uint64_t first, const uint8_t *in,
+                               uint8_t *out, size_t nblocks);
+void ctr_encrypt_blocks_bitslice(const taes_ctx *ctx, uint64_t first, const uint8_t *in,
+                                 uint8_t *out, size_t nblocks);
+void ctr_decrypt_blocks_bitslice(const taes_ctx *ctx, uint64_t first, const uint8_t *in,
+                                 uint8_t *out, size_t nblocks);
+void ctr_encrypt_blocks_ni(const taes_ctx *ctx, uint64_t first, const uint8_t *in,
+                           uint8_t *out, size_t nblocks);
+void ctr_decrypt_blocks_ni(const taes_ctx *ctx, uint64_t first, const uint8_t *in,
+                           uint8_t *out, size_t nblocks);
+void ctr_encrypt_blocks_vaes(const taes_ctx *ctx, uint64_t first, const uint8_t *in,
+                             uint8_t *out, size_t nblocks);
+void ctr_decrypt_blocks_vaes(const taes_ctx *ctx, uint64_t first, const uint8_t *in,
+                             uint8_t *out, size_t nblocks);
+
+// Multi-buffer kernels: 8 lanes of AES-NI, 16 lanes of AVX-512 VAES (or the
+// AES-NI ones on CPUs with AVX2-only VAES)
+const taes_mb_kernel *taes_mb_kernel_ni(void);
+const taes_mb_kernel *taes_mb_kernel_vaes(void);
+void mb_load_keys_ni(taes_mb_mgr *mgr, int lane, const taes_ctx *ctx, int decrypt);
+
+#endif // TAES_BACKEND_H
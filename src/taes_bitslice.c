@@ -0,0 +1,676 @@
+// T-AES implementation using bitslicing (constant-time)
+// The state of BS_BLOCKS blocks is stored as eight bit planes: plane b holds
+// bit b of every state byte of every block. SubBytes is then a Boolean
+// circuit (Boyar-Peralta, 113 gates) evaluated on whole words, and
+// ShiftRows / MixColumns are shifts and rotations within a plane. There are
+// no table lookups and no branches on secret data, so the time taken does
+// not depend on the key, the tweak or the data.
+//
+// The plane layout is the 64-bit one of BearSSL's aes_ct64: one uint64_t
+// plane covers four blocks. A bs_word holds BS_LANES such planes side by
+// side (a GCC vector), so two lanes process 8 blocks per pass in SSE2
+// registers on x86-64, and plain uint64_t arithmetic elsewhere.
+//
+// Round keys are bitsliced the same way as data. Because every block slot
+// has its own key bits, each block of a batch gets its own tweaked round
+// key: slot j carries round_keys[tweak_round] + tweak + j. Key expansion
+// runs its SubWord steps through the same circuit, so no table is indexed
+// by key bytes during setup either.
+#include "../include/taes.h"
+#include "../include/counter_mode.h"
+#include "taes_backend.h"
+#include <string.h>
+
+#define BS_LANES 2
+#define BS_BLOCKS (4 * BS_LANES)
+
+typedef uint64_t bs_word __attribute__((vector_size(8 * BS_LANES)));
+
+// Read 4 bytes as a little-endian word
+static inline uint32_t load_le32(const uint8_t *bytes) {
+    return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) |
+           ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+static inline void store_le32(uint8_t *bytes, uint32_t w) {
+    bytes[0] = (uint8_t)w;
+    bytes[1] = (uint8_t)(w >> 8);
+    bytes[2] = (uint8_t)(w >> 16);
+    bytes[3] = (uint8_t)(w >> 24);
+}
+
+// Zero key-dependent stack state; the barrier keeps the compiler from
+// dropping the memset() as a dead store
+static inline void bs_wipe(void *p, size_t n) {
+    memset(p, 0, n);
+    __asm__ __volatile__("" : : "r"(p) : "memory");
+}
+
+// SubBytes on all planes: the Boyar-Peralta circuit ("A new combinational
+// logic minimization technique with applications to cryptology", 2009).
+// x0 is the most significant bit, x7 the least.
+static inline void bs_sbox(bs_word *q) {
+    bs_word x0, x1, x2, x3, x4, x5, x6, x7;
+    bs_word y1, y2, y3, y4, y5, y6, y7, y8, y9, y10, y11;
+    bs_word y12, y13, y14, y15, y16, y17, y18, y19, y20, y21;
+    bs_word z0, z1, z2, z3, z4, z5, z6, z7, z8, z9, z10, z11;
+    bs_word z12, z13, z14, z15, z16, z17;
+    bs_word t0, t1, t2, t3, t4, t5, t6, t7, t8, t9, t10, t11, t12;
+    bs_word t13, t14, t15, t16, t17, t18, t19, t20, t21, t22, t23;
+    bs_word t24, t25, t26, t27, t28, t29, t30, t31, t32, t33, t34;
+    bs_word t35, t36, t37, t38, t39, t40, t41, t42, t43, t44, t45;
+    bs_word t46, t47, t48, t49, t50, t51, t52, t53, t54, t55, t56;
+    bs_word t57, t58, t59, t60, t61, t62, t63, t64, t65, t66, t67;
+    bs_word s0, s1, s2, s3, s4, s5, s6, s7;
+
+    x0 = q[7];
+    x1 = q[6];
+    x2 = q[5];
+    x3 = q[4];
+    x4 = q[3];
+    x5 = q[2];
+    x6 = q[1];
+    x7 = q[0];
+
+    // Top linear transformation
+    y14 = x3 ^ x5;
+    y13 = x0 ^ x6;
+    y9 = x0 ^ x3;
+    y8 = x0 ^ x5;
+    t0 = x1 ^ x2;
+    y1 = t0 ^ x7;
+    y4 = y1 ^ x3;
+    y12 = y13 ^ y14;
+    y2 = y1 ^ x0;
+    y5 = y1 ^ x6;
+    y3 = y5 ^ y8;
+    t1 = x4 ^ y12;
+    y15 = t1 ^ x5;
+    y20 = t1 ^ x1;
+    y6 = y15 ^ x7;
+    y10 = y15 ^ t0;
+    y11 = y20 ^ y9;
+    y7 = x7 ^ y11;
+    y17 = y10 ^ y11;
+    y19 = y10 ^ y8;
+    y16 = t0 ^ y11;
+    y21 = y13 ^ y16;
+    y18 = x0 ^ y16;
+
+    // Non-linear section (inversion in GF(2^8))
+    t2 = y12 & y15;
+    t3 = y3 & y6;
+    t4 = t3 ^ t2;
+    t5 = y4 & x7;
+    t6 = t5 ^ t2;
+    t7 = y13 & y16;
+    t8 = y5 & y1;
+    t9 = t8 ^ t7;
+    t10 = y2 & y7;
+    t11 = t10 ^ t7;
+    t12 = y9 & y11;
+    t13 = y14 & y17;
+    t14 = t13 ^ t12;
+    t15 = y8 & y10;
+    t16 = t15 ^ t12;
+    t17 = t4 ^ t14;
+    t18 = t6 ^ t16;
+    t19 = t9 ^ t14;
+    t20 = t11 ^ t16;
+    t21 = t17 ^ y20;
+    t22 = t18 ^ y19;
+    t23 = t19 ^ y21;
+    t24 = t20 ^ y18;
+
+    t25 = t21 ^ t22;
+    t26 = t21 & t23;
+    t27 = t24 ^ t26;
+    t28 = t25 & t27;
+    t29 = t28 ^ t22;
+    t30 = t23 ^ t24;
+    t31 = t22 ^ t26;
+    t32 = t31 & t30;
+    t33 = t32 ^ t24;
+    t34 = t23 ^ t33;
+    t35 = t27 ^ t33;
+    t36 = t24 & t35;
+    t37 = t36 ^ t34;
+    t38 = t27 ^ t36;
+    t39 = t29 & t38;
+    t40 = t25 ^ t39;
+
+    t41 = t40 ^ t37;
+    t42 = t29 ^ t33;
+    t43 = t29 ^ t40;
+    t44 = t33 ^ t37;
+    t45 = t42 ^ t41;
+    z0 = t44 & y15;
+    z1 = t37 & y6;
+    z2 = t33 & x7;
+    z3 = t43 & y16;
+    z4 = t40 & y1;
+    z5 = t29 & y7;
+    z6 = t42 & y11;
+    z7 = t45 & y17;
+    z8 = t41 & y10;
+    z9 = t44 & y12;
+    z10 = t37 & y3;
+    z11 = t33 & y4;
+    z12 = t43 & y13;
+    z13 = t40 & y5;
+    z14 = t29 & y2;
+    z15 = t42 & y9;
+    z16 = t45 & y14;
+    z17 = t41 & y8;
+
+    // Bottom linear transformation (affine map of the S-box)
+    t46 = z15 ^ z16;
+    t47 = z10 ^ z11;
+    t48 = z5 ^ z13;
+    t49 = z9 ^ z10;
+    t50 = z2 ^ z12;
+    t51 = z2 ^ z5;
+    t52 = z7 ^ z8;
+    t53 = z0 ^ z3;
+    t54 = z6 ^ z7;
+    t55 = z16 ^ z17;
+    t56 = z12 ^ t48;
+    t57 = t50 ^ t53;
+    t58 = z4 ^ t46;
+    t59 = z3 ^ t54;
+    t60 = t46 ^ t57;
+    t61 = z14 ^ t57;
+    t62 = t52 ^ t58;
+    t63 = t49 ^ t58;
+    t64 = z4 ^ t59;
+    t65 = t61 ^ t62;
+    t66 = z1 ^ t63;
+    s0 = t59 ^ t63;
+    s6 = t56 ^ ~t62;
+    s7 = t48 ^ ~t60;
+    t67 = t64 ^ t65;
+    s3 = t53 ^ t66;
+    s4 = t51 ^ t66;
+    s5 = t47 ^ t65;
+    s1 = t64 ^ ~s3;
+    s2 = t55 ^ ~t67;
+
+    q[7] = s0;
+    q[6] = s1;
+    q[5] = s2;
+    q[4] = s3;
+    q[3] = s4;
+    q[2] = s5;
+    q[1] = s6;
+    q[0] = s7;
+}
+
+// Inverse of the S-box affine map (including the 0x63 constant)
+static inline void bs_inv_affine(bs_word *q) {
+    bs_word q0 = ~q[0], q1 = ~q[1], q2 = q[2], q3 = q[3];
+    bs_word q4 = q[4], q5 = ~q[5], q6 = ~q[6], q7 = q[7];
+
+    q[7] = q1 ^ q4 ^ q6;
+    q[6] = q0 ^ q3 ^ q5;
+    q[5] = q7 ^ q2 ^ q4;
+    q[4] = q6 ^ q1 ^ q3;
+    q[3] = q5 ^ q0 ^ q2;
+    q[2] = q4 ^ q7 ^ q1;
+    q[1] = q3 ^ q6 ^ q0;
+    q[0] = q2 ^ q5 ^ q7;
+}
+
+// InvSubBytes: undo the affine map, invert (the S-box circuit inverts and
+// applies the affine map), then undo the affine map again
+static inline void bs_inv_sbox(bs_word *q) {
+    bs_inv_affine(q);
+    bs_sbox(q);
+    bs_inv_affine(q);
+}
+
+// Transpose bits between the eight words so that each word holds one bit
+// plane (the transform is its own inverse)
+static inline void bs_ortho(bs_word *q) {
+#define SWAPN(cl, ch, s, x, y) do {                    \
+        bs_word a = (x), b = (y);                      \
+        (x) = (a & (cl)) | ((b & (cl)) << (s));        \
+        (y) = ((a & (ch)) >> (s)) | (b & (ch));        \
+    } while (0)
+#define SWAP2(x, y) SWAPN(0x5555555555555555ULL, 0xAAAAAAAAAAAAAAAAULL, 1, x, y)
+#define SWAP4(x, y) SWAPN(0x3333333333333333ULL, 0xCCCCCCCCCCCCCCCCULL, 2, x, y)
+#define SWAP8(x, y) SWAPN(0x0F0F0F0F0F0F0F0FULL, 0xF0F0F0F0F0F0F0F0ULL, 4, x, y)
+
+    SWAP2(q[0], q[1]);
+    SWAP2(q[2], q[3]);
+    SWAP2(q[4], q[5]);
+    SWAP2(q[6], q[7]);
+
+    SWAP4(q[0], q[2]);
+    SWAP4(q[1], q[3]);
+    SWAP4(q[4], q[6]);
+    SWAP4(q[5], q[7]);
+
+    SWAP8(q[0], q[4]);
+    SWAP8(q[1], q[5]);
+    SWAP8(q[2], q[6]);
+    SWAP8(q[3], q[7]);
+
+#undef SWAP8
+#undef SWAP4
+#undef SWAP2
+#undef SWAPN
+}
+
+// Spread the four column words of one block slot over two words, so that
+// after bs_ortho() the 16 bytes of the block land in 16-bit groups ordered
+// for ShiftRows
+static inline void bs_interleave_in(bs_word *q0, bs_word *q1,
+                                    bs_word x0, bs_word x1, bs_word x2, bs_word x3) {
+    x0 |= x0 << 16;
+    x1 |= x1 << 16;
+    x2 |= x2 << 16;
+    x3 |= x3 << 16;
+    x0 &= 0x0000FFFF0000FFFFULL;
+    x1 &= 0x0000FFFF0000FFFFULL;
+    x2 &= 0x0000FFFF0000FFFFULL;
+    x3 &= 0x0000FFFF0000FFFFULL;
+    x0 |= x0 << 8;
+    x1 |= x1 << 8;
+    x2 |= x2 << 8;
+    x3 |= x3 << 8;
+    x0 &= 0x00FF00FF00FF00FFULL;
+    x1 &= 0x00FF00FF00FF00FFULL;
+    x2 &= 0x00FF00FF00FF00FFULL;
+    x3 &= 0x00FF00FF00FF00FFULL;
+    *q0 = x0 | (x2 << 8);
+    *q1 = x1 | (x3 << 8);
+}
+
+static inline void bs_interleave_out(bs_word w[4], bs_word q0, bs_word q1) {
+    bs_word x0 = q0 & 0x00FF00FF00FF00FFULL;
+    bs_word x1 = q1 & 0x00FF00FF00FF00FFULL;
+    bs_word x2 = (q0 >> 8) & 0x00FF00FF00FF00FFULL;
+    bs_word x3 = (q1 >> 8) & 0x00FF00FF00FF00FFULL;
+    x0 |= x0 >> 8;
+    x1 |= x1 >> 8;
+    x2 |= x2 >> 8;
+    x3 |= x3 >> 8;
+    x0 &= 0x0000FFFF0000FFFFULL;
+    x1 &= 0x0000FFFF0000FFFFULL;
+    x2 &= 0x0000FFFF0000FFFFULL;
+    x3 &= 0x0000FFFF0000FFFFULL;
+    w[0] = (x0 | (x0 >> 16)) & 0xFFFFFFFFULL;
+    w[1] = (x1 | (x1 >> 16)) & 0xFFFFFFFFULL;
+    w[2] = (x2 | (x2 >> 16)) & 0xFFFFFFFFULL;
+    w[3] = (x3 | (x3 >> 16)) & 0xFFFFFFFFULL;
+}
+
+// Bitslice BS_BLOCKS blocks given as column words; block b goes to lane
+// b / 4, slot b % 4
+static inline void bs_load(bs_word q[8], const uint32_t w[BS_BLOCKS][4]) {
+    for (int slot = 0; slot < 4; slot++) {
+        bs_word x[4];
+        for (int c = 0; c < 4; c++) {
+            for (int lane = 0; lane < BS_LANES; lane++) {
+                x[c][lane] = w[4 * lane + slot][c];
+            }
+        }
+        bs_interleave_in(&q[slot], &q[slot + 4], x[0], x[1], x[2], x[3]);
+    }
+    bs_ortho(q);
+}
+
+static inline void bs_store(uint32_t w[BS_BLOCKS][4], bs_word q[8]) {
+    bs_ortho(q);
+    for (int slot = 0; slot < 4; slot++) {
+        bs_word x[4];
+        bs_interleave_out(x, q[slot], q[slot + 4]);
+        for (int c = 0; c < 4; c++) {
+            for (int lane = 0; lane < BS_LANES; lane++) {
+                w[4 * lane + slot][c] = (uint32_t)x[c][lane];
+            }
+        }
+    }
+}
+
+static inline void bs_add_round_key(bs_word *q, const bs_word *k) {
+    for (int i = 0; i < 8; i++) {
+        q[i] ^= k[i];
+    }
+}
+
+static inline void bs_shift_rows(bs_word *q) {
+    for (int i = 0; i < 8; i++) {
+        bs_word x = q[i];
+        q[i] = (x & 0x000000000000FFFFULL)
+             | ((x & 0x00000000FFF00000ULL) >> 4)
+             | ((x & 0x00000000000F0000ULL) << 12)
+             | ((x & 0x0000FF0000000000ULL) >> 8)
+             | ((x & 0x000000FF00000000ULL) << 8)
+             | ((x & 0xF000000000000000ULL) >> 12)
+             | ((x & 0x0FFF000000000000ULL) << 4);
+    }
+}
+
+static inline void bs_inv_shift_rows(bs_word *q) {
+    for (int i = 0; i < 8; i++) {
+        bs_word x = q[i];
+        q[i] = (x & 0x000000000000FFFFULL)
+             | ((x & 0x000000000FFF0000ULL) << 4)
+             | ((x & 0x00000000F0000000ULL) >> 12)
+             | ((x & 0x000000FF00000000ULL) << 8)
+             | ((x & 0x0000FF0000000000ULL) >> 8)
+             | ((x & 0x000F000000000000ULL) << 12)
+             | ((x & 0xFFF0000000000000ULL) >> 4);
+    }
+}
+
+// Rotate each 64-bit plane by one row (16 bits) and by two rows (32 bits)
+#define ROT16(x) (((x) >> 16) | ((x) << 48))
+#define ROT32(x) (((x) >> 32) | ((x) << 32))
+
+static inline void bs_mix_columns(bs_word *q) {
+    bs_word q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+    bs_word q4 = q[4], q5 = q[5], q6 = q[6], q7 = q[7];
+    bs_word r0 = ROT16(q0), r1 = ROT16(q1), r2 = ROT16(q2), r3 = ROT16(q3);
+    bs_word r4 = ROT16(q4), r5 = ROT16(q5), r6 = ROT16(q6), r7 = ROT16(q7);
+
+    q[0] = q7 ^ r7 ^ r0 ^ ROT32(q0 ^ r0);
+    q[1] = q0 ^ r0 ^ q7 ^ r7 ^ r1 ^ ROT32(q1 ^ r1);
+    q[2] = q1 ^ r1 ^ r2 ^ ROT32(q2 ^ r2);
+    q[3] = q2 ^ r2 ^ q7 ^ r7 ^ r3 ^ ROT32(q3 ^ r3);
+    q[4] = q3 ^ r3 ^ q7 ^ r7 ^ r4 ^ ROT32(q4 ^ r4);
+    q[5] = q4 ^ r4 ^ r5 ^ ROT32(q5 ^ r5);
+    q[6] = q5 ^ r5 ^ r6 ^ ROT32(q6 ^ r6);
+    q[7] = q6 ^ r6 ^ r7 ^ ROT32(q7 ^ r7);
+}
+
+static inline void bs_inv_mix_columns(bs_word *q) {
+    bs_word q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+    bs_word q4 = q[4], q5 = q[5], q6 = q[6], q7 = q[7];
+    bs_word r0 = ROT16(q0), r1 = ROT16(q1), r2 = ROT16(q2), r3 = ROT16(q3);
+    bs_word r4 = ROT16(q4), r5 = ROT16(q5), r6 = ROT16(q6), r7 = ROT16(q7);
+
+    q[0] = q5 ^ q6 ^ q7 ^ r0 ^ r5 ^ r7 ^ ROT32(q0 ^ q5 ^ q6 ^ r0 ^ r5);
+    q[1] = q0 ^ q5 ^ r0 ^ r1 ^ r5 ^ r6 ^ r7 ^ ROT32(q1 ^ q5 ^ q7 ^ r1 ^ r5 ^ r6);
+    q[2] = q0 ^ q1 ^ q6 ^ r1 ^ r2 ^ r6 ^ r7 ^ ROT32(q0 ^ q2 ^ q6 ^ r2 ^ r6 ^ r7);
+    q[3] = q0 ^ q1 ^ q2 ^ q5 ^ q6 ^ r0 ^ r2 ^ r3 ^ r5
+         ^ ROT32(q0 ^ q1 ^ q3 ^ q5 ^ q6 ^ q7 ^ r0 ^ r3 ^ r5 ^ r7);
+    q[4] = q1 ^ q2 ^ q3 ^ q5 ^ r1 ^ r3 ^ r4 ^ r5 ^ r6 ^ r7
+         ^ ROT32(q1 ^ q2 ^ q4 ^ q5 ^ q7 ^ r1 ^ r4 ^ r5 ^ r6);
+    q[5] = q2 ^ q3 ^ q4 ^ q6 ^ r2 ^ r4 ^ r5 ^ r6 ^ r7
+         ^ ROT32(q2 ^ q3 ^ q5 ^ q6 ^ r2 ^ r5 ^ r6 ^ r7);
+    q[6] = q3 ^ q4 ^ q5 ^ q7 ^ r3 ^ r5 ^ r6 ^ r7 ^ ROT32(q3 ^ q4 ^ q6 ^ q7 ^ r3 ^ r6 ^ r7);
+    q[7] = q4 ^ q5 ^ q6 ^ r4 ^ r6 ^ r7 ^ ROT32(q4 ^ q5 ^ q7 ^ r4 ^ r7);
+}
+
+static inline void bs_enc_round(bs_word *q, const bs_word *k) {
+    bs_sbox(q);
+    bs_shift_rows(q);
+    bs_mix_columns(q);
+    bs_add_round_key(q, k);
+}
+
+static inline void bs_dec_round(bs_word *q, const bs_word *k) {
+    bs_inv_shift_rows(q);
+    bs_inv_sbox(q);
+    bs_add_round_key(q, k);
+    bs_inv_mix_columns(q);
+}
+
+// Encrypt one batch; sk holds the bitsliced round keys, tk the bitsliced
+// tweaked round key (one per block slot)
+static void bs_encrypt(bs_word q[8], const bs_word sk[][8], const bs_word tk[8], int nr, int tr) {
+    bs_add_round_key(q, sk[0]);
+    for (int round = 1; round < tr; round++) {
+        bs_enc_round(q, sk[round]);
+    }
+    bs_enc_round(q, tk);
+    for (int round = tr + 1; round < nr; round++) {
+        bs_enc_round(q, sk[round]);
+    }
+    bs_sbox(q);
+    bs_shift_rows(q);
+    bs_add_round_key(q, sk[nr]);
+}
+
+// Decrypt one batch with the straightforward inverse cipher, which adds the
+// round keys before InvMixColumns, so no InvMixColumns'd schedule is needed
+static void bs_decrypt(bs_word q[8], const bs_word sk[][8], const bs_word tk[8], int nr, int tr) {
+    bs_add_round_key(q, sk[nr]);
+    for (int round = nr - 1; round > tr; round--) {
+        bs_dec_round(q, sk[round]);
+    }
+    bs_dec_round(q, tk);
+    for (int round = tr - 1; round >= 1; round--) {
+        bs_dec_round(q, sk[round]);
+    }
+    bs_inv_shift_rows(q);
+    bs_inv_sbox(q);
+    bs_add_round_key(q, sk[0]);
+}
+
+// Bitslice every round key, the same key in all block slots
+static void bs_key_schedule(const taes_ctx *ctx, bs_word sk[15][8]) {
+    for (int round = 0; round <= ctx->num_rounds; round++) {
+        uint32_t w[BS_BLOCKS][4];
+        for (int c = 0; c < 4; c++) {
+            w[0][c] = load_le32(ctx->round_keys + 16 * round + 4 * c);
+        }
+        for (int b = 1; b < BS_BLOCKS; b++) {
+            memcpy(w[b], w[0], sizeof(w[0]));
+        }
+        bs_load(sk[round], w);
+        bs_wipe(w, sizeof(w));
+    }
+}
+
+// Read 16 bytes as a little-endian 128-bit integer
+static inline unsigned __int128 load_le128(const uint8_t *bytes) {
+    unsigned __int128 value = 0;
+    for (int i = 15; i >= 0; i--) {
+        value = (value << 8) | bytes[i];
+    }
+    return value;
+}
+
+// Bitsliced tweaked round keys of the blocks of one batch: tk + j, or
+// tk + tweaks[j] when the blocks have tweaks of their own (tk is then the
+// untweaked round key)
+static void bs_tweak_keys(bs_word tk[8], unsigned __int128 first, const uint8_t *tweaks, size_t n) {
+    uint32_t w[BS_BLOCKS][4];
+    for (int b = 0; b < BS_BLOCKS; b++) {
+        unsigned __int128 k = first;
+        if (!tweaks) {
+            k += (unsigned)b;
+        } else if ((size_t)b < n) {
+            k += load_le128(tweaks + b * TWEAK_SIZE);
+        }
+        w[b][0] = (uint32_t)k;
+        w[b][1] = (uint32_t)(k >> 32);
+        w[b][2] = (uint32_t)(k >> 64);
+        w[b][3] = (uint32_t)(k >> 96);
+    }
+    bs_load(tk, w);
+    bs_wipe(w, sizeof(w));
+}
+
+
+typedef void (*bs_cipher_fn)(bs_word q[8], const bs_word sk[][8], const bs_word tk[8], int nr, int tr);
+
+// Run nblocks blocks through the cipher BS_BLOCKS at a time, block j using
+// tweak + first + j, or tweaks[j] if tweaks is not NULL; a short last batch
+// is zero-padded
+static void bs_blocks(const taes_ctx *ctx, uint64_t first, const uint8_t *tweaks,
+                      const uint8_t *in, uint8_t *out, size_t nblocks, bs_cipher_fn cipher) {
+    bs_word sk[15][8];
+    bs_word tk[8];
+    bs_word q[8];
+    uint32_t w[BS_BLOCKS][4];
+    unsigned __int128 next = tweaks ? load_le128(ctx->round_keys + 16 * ctx->tweak_round)
+                                    : load_le128(ctx->tweaked_round_key) + first;
+
+    bs_key_schedule(ctx, sk);
+
+    while (nblocks > 0) {
+        size_t n = nblocks < BS_BLOCKS ? nblocks : BS_BLOCKS;
+
+        memset(w, 0, sizeof(w));
+        for (size_t b = 0; b < n; b++) {
+            for (int c = 0; c < 4; c++) {
+                w[b][c] = load_le32(in + 16 * b + 4 * c);
+            }
+        }
+
+        bs_load(q, w);
+        bs_tweak_keys(tk, next, tweaks, n);
+        cipher(q, (const bs_word (*)[8])sk, tk, ctx->num_rounds, ctx->tweak_round);
+        bs_store(w, q);
+
+        for (size_t b = 0; b < n; b++) {
+            for (int c = 0; c < 4; c++) {
+                store_le32(out + 16 * b + 4 * c, w[b][c]);
+            }
+        }
+
+        in += n * AES_BLOCK_SIZE;
+        out += n * AES_BLOCK_SIZE;
+        nblocks -= n;
+        if (tweaks) {
+            tweaks += n * TWEAK_SIZE;
+        } else {
+            next += n;
+        }
+    }
+
+    bs_wipe(sk, sizeof(sk));
+    bs_wipe(tk, sizeof(tk));
+    bs_wipe(q, sizeof(q));
+    bs_wipe(w, sizeof(w));
+}
+
+// SubWord: the S-box circuit on the four bytes of one word (one slot of a
+// batch, the other slots zero)
+static uint32_t bs_sub_word(uint32_t word) {
+    uint32_t w[BS_BLOCKS][4] = {{0}};
+    bs_word q[8];
+    w[0][0] = word;
+    bs_load(q, w);
+    bs_sbox(q);
+    bs_store(w, q);
+    word = w[0][0];
+    bs_wipe(q, sizeof(q));
+    bs_wipe(w, sizeof(w));
+    return word;
+}
+
+// AES key expansion as in taes.c, with SubWord through the circuit; the
+// Rcon index only depends on the word position
+static void bs_key_expansion(const uint8_t *key, uint8_t *round_keys, int key_size, int num_rounds) {
+    static const uint8_t rcon[11] = {
+        0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36
+    };
+    int nk = key_size / 4;
+    uint32_t w[60];
+
+    // Big-endian words, byte 0 in the top bits
+    for (int i = 0; i < nk; i++) {
+        w[i] = ((uint32_t)key[4*i] << 24) | ((uint32_t)key[4*i+1] << 16) |
+               ((uint32_t)key[4*i+2] << 8) | ((uint32_t)key[4*i+3]);
+    }
+    for (int i = nk; i < 4 * (num_rounds + 1); i++) {
+        uint32_t temp = w[i-1];
+        if (i % nk == 0) {
+            temp = bs_sub_word((temp << 8) | (temp >> 24)) ^ ((uint32_t)rcon[i/nk] << 24);
+        } else if (nk > 6 && i % nk == 4) {
+            temp = bs_sub_word(temp);
+        }
+        w[i] = w[i-nk] ^ temp;
+    }
+    for (int i = 0; i < 4 * (num_rounds + 1); i++) {
+        round_keys[4*i]     = (uint8_t)(w[i] >> 24);
+        round_keys[4*i + 1] = (uint8_t)(w[i] >> 16);
+        round_keys[4*i + 2] = (uint8_t)(w[i] >> 8);
+        round_keys[4*i + 3] = (uint8_t)w[i];
+    }
+    bs_wipe(w, sizeof(w));
+}
+
+// Initialize context: the same round keys as taes_init_portable(), expanded
+// without table lookups. The tweaked round key is a 128-bit addition
+// (taes_set_tweak()), which has no data-dependent timing either.
+int taes_init_bitslice(taes_ctx *ctx, const uint8_t *key, int key_size, const uint8_t *tweak) {
+    if (!ctx || !key) {
+        return -1;
+    }
+    switch (key_size) {
+        case 16: ctx->num_rounds = 10; ctx->tweak_round = 5; break;
+        case 24: ctx->num_rounds = 12; ctx->tweak_round = 6; break;
+        case 32: ctx->num_rounds = 14; ctx->tweak_round = 7; break;
+        default: return -1;
+    }
+    ctx->key_size = key_size;
+    ctx->has_dec_round_keys = 0;
+    bs_key_expansion(key, ctx->round_keys, key_size, ctx->num_rounds);
+    taes_set_tweak(ctx, tweak);
+    return 0;
+}
+
+// Initialize several contexts that share a key size
+int taes_init_many_bitslice(taes_ctx *const ctxs[], const uint8_t *const keys[], int key_size,
+                            const uint8_t *const tweaks[], size_t n) {
+    if (!ctxs || !keys) {
+        return -1;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (taes_init_bitslice(ctxs[i], keys[i], key_size, tweaks ? tweaks[i] : NULL) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Encrypt a single block (one slot of a batch; costs as much as a full batch)
+void taes_encrypt_block_bitslice(const taes_ctx *ctx, const uint8_t *plaintext, uint8_t *ciphertext) {
+    bs_blocks(ctx, 0, NULL, plaintext, ciphertext, 1, bs_encrypt);
+}
+
+// Decrypt a single block
+void taes_decrypt_block_bitslice(const taes_ctx *ctx, const uint8_t *ciphertext, uint8_t *plaintext) {
+    bs_blocks(ctx, 0, NULL, ciphertext, plaintext, 1, bs_decrypt);
+}
+
+// Encrypt nblocks consecutive blocks, block j using tweak + first + j
+void ctr_encrypt_blocks_bitslice(const taes_ctx *ctx, uint64_t first, const uint8_t *in,
+                                 uint8_t *out, size_t nblocks) {
+    bs_blocks(ctx, first, NULL, in, out, nblocks, bs_encrypt);
+}
+
+// Decrypt nblocks consecutive blocks, block j using tweak + first + j
+void ctr_decrypt_blocks_bitslice(const taes_ctx *ctx, uint64_t first, const uint8_t *in,
+                                 uint8_t *out, size_t nblocks) {
+    bs_blocks(ctx, first, NULL, in, out, nblocks, bs_decrypt);
+}
+
+// Encrypt nblocks blocks, block i with tweak tweaks[i] (16 bytes each)
+void taes_encrypt_blocks_bitslice(const taes_ctx *ctx, const uint8_t *plaintext, uint8_t *ciphertext,
+                                  const uint8_t *tweaks, size_t nblocks) {
+    bs_blocks(ctx, 0, tweaks, plaintext, ciphertext, nblocks, bs_encrypt);
+}
+
+// Decrypt nblocks blocks, block i with tweak tweaks[i]
+void taes_decrypt_blocks_bitslice(const taes_ctx *ctx, const uint8_t *ciphertext, uint8_t *plaintext,
+                                  const uint8_t *tweaks, size_t nblocks) {
+    bs_blocks(ctx, 0, tweaks, ciphertext, plaintext, nblocks, bs_decrypt);
+}
+
+// Counter mode on the bitsliced backend (same output as counter_mode_encrypt())
+int counter_mode_encrypt_bitslice(const taes_ctx *ctx, const uint8_t *plaintext,
+                                  uint8_t *ciphertext, size_t length) {
+    return ctr_encrypt_cts(ctx, plaintext, ciphertext, length, ctr_encrypt_blocks_bitslice);
+}
+
+int counter_mode_decrypt_bitslice(const taes_ctx *ctx, const uint8_t *ciphertext,
+                                  uint8_t *plaintext, size_t length) {
+    return ctr_decrypt_cts(ctx, ciphertext, plaintext, length, ctr_decrypt_blocks_bitslice);
+}
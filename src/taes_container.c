@@ -0,0 +1,639 @@
+// Chunked container format (see taes_container.h)
+// Writers and the streamed reader work in batches of a few chunks per pool
+// thread: read the batch, cipher its chunks as one pool run (a chunk per
+// task), write it. Random reads go through the index kept in memory by
+// taes_container_open(): a binary search finds the chunk, and
+// counter_mode_decrypt_span() needs only the blocks of the range.
+// An append never overwrites what a reader of the old container needs: it
+// marks the old end in the header, writes after the old footer, and only
+// then links the new chunks in (taes_container_append()).
+#define _POSIX_C_SOURCE 200809L
+#include "../include/taes_container.h"
+#include "../include/counter_mode.h"
+#include "taes_io.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char header_magic[8] = {'T', 'A', 'E', 'S', 'C', 'T', 'R', '1'};
+static const char footer_magic[8] = {'T', 'A', 'E', 'S', 'I', 'D', 'X', '1'};
+
+#define VERSION 1
+#define INDEX_ENTRY_SIZE 16
+
+// Header field: the container's end while an append is in progress
+#define HEADER_END_OFFSET 44
+
+// Second word of a length-0 frame: the end, or an old end that the
+// appended chunks continue after
+#define FRAME_END 0
+#define FRAME_CONTINUE 1
+
+// Chunks per pool thread in a batch
+#define BATCH_PER_THREAD 2
+
+typedef struct {
+    uint64_t offset;          // File offset of the ciphertext (after its frame)
+    uint64_t length;
+    uint64_t plain_offset;    // Offset of its plaintext in the whole (not stored)
+} entry;
+
+struct taes_container {
+    int fd;
+    taes_container_params params;
+    entry *entries;
+    uint64_t count;
+    uint64_t capacity;
+    uint64_t length;          // Plaintext bytes
+    uint64_t end;             // File offset of the end frame
+};
+
+// One pool run: chunk j of the batch is data[start[j]..], len[j] bytes,
+// number first_chunk + j
+typedef struct {
+    const taes_ctx *ctx;
+    int decrypt;
+    uint8_t *data;
+    size_t *start;
+    size_t *len;
+    uint64_t first_chunk;
+} batch;
+
+// One frame and its chunk (at most chunk bytes) to data; *length 0 is the
+// end frame, or with *more set an old end that more chunks follow. A short
+// or out-of-range frame is a malformed container.
+static int read_frame(int fd, size_t chunk, uint8_t *data, size_t *length, int *more) {
+    uint8_t frame[TAES_CONTAINER_FRAME_SIZE];
+    ssize_t got = read_full(fd, frame, sizeof(frame));
+    if (got < 0) {
+        return -1;
+    }
+    *length = load_le32(frame);
+    uint32_t kind = load_le32(frame + 4);
+    *more = kind == FRAME_CONTINUE;
+    if ((size_t)got != sizeof(frame) || (*length != 0 && (*length <= AES_BLOCK_SIZE || *length > chunk)) ||
+        (kind != FRAME_END && (kind != FRAME_CONTINUE || *length != 0))) {
+        errno = EBADMSG;
+        return -1;
+    }
+    got = read_full(fd, data, *length);
+    if (got < 0) {
+        return -1;
+    }
+    if ((size_t)got != *length) {
+        errno = EBADMSG;
+        return -1;
+    }
+    return 0;
+}
+
+// Read past the old index of `chunks` entries and footer that follow a
+// continue frame; the footer must be the one of those chunks
+static int skip_old_tail(int fd, uint64_t chunks) {
+    uint8_t buf[4096];
+    for (uint64_t left = chunks * INDEX_ENTRY_SIZE; left > 0;) {
+        size_t n = left < sizeof(buf) ? (size_t)left : sizeof(buf);
+        ssize_t got = read_full(fd, buf, n);
+        if (got < 0) {
+            return -1;
+        }
+        if ((size_t)got != n) {
+            errno = EBADMSG;
+            return -1;
+        }
+        left -= n;
+    }
+    ssize_t got = read_full(fd, buf, TAES_CONTAINER_FOOTER_SIZE);
+    if (got < 0) {
+        return -1;
+    }
+    if (got != TAES_CONTAINER_FOOTER_SIZE || load_le64(buf + 8) != chunks ||
+        memcmp(buf + 24, footer_magic, sizeof(footer_magic)) != 0) {
+        errno = EBADMSG;
+        return -1;
+    }
+    return 0;
+}
+
+// The context of chunk k: its tweak plus k * 2^64
+static void chunk_context(taes_ctx *chunk, const taes_ctx *ctx, uint64_t k) {
+    uint8_t tweak[TWEAK_SIZE];
+    *chunk = *ctx;
+    memcpy(tweak, ctx->tweak, TWEAK_SIZE);
+    store_le64(tweak + 8, load_le64(tweak + 8) + k);
+    taes_set_tweak(chunk, tweak);
+    memset(tweak, 0, sizeof(tweak));
+}
+
+static void crypt_chunk(void *arg, size_t j) {
+    const batch *b = arg;
+    taes_ctx ctx;
+    chunk_context(&ctx, b->ctx, b->first_chunk + j);
+    uint8_t *data = b->data + b->start[j];
+    if (b->decrypt) {
+        counter_mode_decrypt(&ctx, data, data, b->len[j]);
+    } else {
+        counter_mode_encrypt(&ctx, data, data, b->len[j]);
+    }
+    taes_cleanup(&ctx);
+}
+
+static void encode_header(uint8_t *out, const taes_container_params *params) {
+    memset(out, 0, TAES_CONTAINER_HEADER_SIZE);
+    memcpy(out, header_magic, sizeof(header_magic));
+    store_le32(out + 8, VERSION);
+    store_le32(out + 12, params->key_bits);
+    store_le32(out + 16, params->kdf);
+    store_le32(out + 20, params->kdf_iterations);
+    memcpy(out + 24, params->salt, TAES_CONTAINER_SALT_SIZE);
+    store_le32(out + 40, params->chunk_size);
+}
+
+static int valid_params(const taes_container_params *params) {
+    return (params->key_bits == 128 || params->key_bits == 192 || params->key_bits == 256) &&
+           params->kdf == TAES_CONTAINER_KDF_PBKDF2_SHA256 && params->kdf_iterations > 0 &&
+           params->chunk_size >= TAES_CONTAINER_MIN_CHUNK && params->chunk_size <= TAES_CONTAINER_MAX_CHUNK;
+}
+
+static int decode_header(const uint8_t *in, taes_container_params *params) {
+    if (memcmp(in, header_magic, sizeof(header_magic)) != 0 || load_le32(in + 8) != VERSION) {
+        errno = EBADMSG;
+        return -1;
+    }
+    params->key_bits = load_le32(in + 12);
+    params->kdf = load_le32(in + 16);
+    params->kdf_iterations = load_le32(in + 20);
+    memcpy(params->salt, in + 24, TAES_CONTAINER_SALT_SIZE);
+    params->chunk_size = load_le32(in + 40);
+    if (!valid_params(params)) {
+        errno = EBADMSG;
+        return -1;
+    }
+    return 0;
+}
+
+static int add_entry(taes_container *c, uint64_t offset, uint64_t length) {
+    if (c->count == c->capacity) {
+        uint64_t capacity = c->capacity ? 2 * c->capacity : 64;
+        entry *bigger = realloc(c->entries, capacity * sizeof(*bigger));
+        if (!bigger) {
+            errno = ENOMEM;
+            return -1;
+        }
+        c->entries = bigger;
+        c->capacity = capacity;
+    }
+    entry *e = &c->entries[c->count++];
+    e->offset = offset;
+    e->length = length;
+    e->plain_offset = c->length;
+    c->length += length;
+    return 0;
+}
+
+static int batch_chunks(const taes_pool *pool) {
+    return BATCH_PER_THREAD * (pool ? taes_pool_threads(pool) : 1);
+}
+
+// Encrypt in_fd until end of file as chunks numbered from c->count, written
+// to out_fd from file offset c->end on. prefix (the header) goes first, once
+// the input is known to be long enough.
+static int add_chunks(taes_container *c, const taes_ctx *ctx, int in_fd, int out_fd, taes_pool *pool,
+                      const uint8_t *prefix, size_t prefix_len) {
+    size_t chunk = c->params.chunk_size;
+    size_t nchunks = (size_t)batch_chunks(pool);
+
+    // A batch is read ahead by 17 bytes, so the input's last chunk always
+    // has more than 16 bytes to give its own batch (see below)
+    size_t ahead = AES_BLOCK_SIZE + 1;
+    size_t alloc_size = (nchunks * chunk + ahead + 63) / 64 * 64;
+    uint8_t *data = aligned_alloc(64, alloc_size);
+    size_t *start = calloc(2 * (nchunks + 1), sizeof(*start));
+    if (!data || !start) {
+        free(data);
+        free(start);
+        errno = ENOMEM;
+        return -1;
+    }
+    batch b = {ctx, 0, data, start, start + nchunks + 1, 0};
+
+    int ret = 0;
+    int first = 1;
+    size_t have = 0;
+    for (int eof = 0; ret == 0 && !eof; first = 0) {
+        ssize_t got = read_full(in_fd, data + have, nchunks * chunk + ahead - have);
+        if (got < 0) {
+            ret = -1;
+            break;
+        }
+        have += (size_t)got;
+        eof = have < nchunks * chunk + ahead;
+
+        // The batch's chunks. At end of file a last chunk of 16 bytes or
+        // less takes 16 from the one before.
+        size_t n = nchunks;
+        if (eof) {
+            if (have <= AES_BLOCK_SIZE) {
+                // Only at the start: later batches get the 17 read ahead
+                ret = have == 0 && !prefix ? 0 : TAES_CONTAINER_BAD_LENGTH;
+                break;
+            }
+            n = (have + chunk - 1) / chunk;  // nchunks + 1 if the read-ahead was short
+        }
+        for (size_t j = 0; j < n; j++) {
+            b.start[j] = j * chunk;
+            b.len[j] = j + 1 < n || !eof ? chunk : have - j * chunk;
+        }
+        if (eof && n > 1 && b.len[n - 1] <= AES_BLOCK_SIZE) {
+            b.len[n - 2] -= AES_BLOCK_SIZE;
+            b.start[n - 1] -= AES_BLOCK_SIZE;
+            b.len[n - 1] += AES_BLOCK_SIZE;
+        }
+
+        b.first_chunk = c->count;
+        taes_pool_run(pool, n, crypt_chunk, &b);
+
+        if (first && prefix && write_all(out_fd, prefix, prefix_len) != 0) {
+            ret = -1;
+            break;
+        }
+        for (size_t j = 0; ret == 0 && j < n; j++) {
+            uint8_t frame[TAES_CONTAINER_FRAME_SIZE] = {0};
+            store_le32(frame, (uint32_t)b.len[j]);
+            if (write_all(out_fd, frame, sizeof(frame)) != 0 ||
+                write_all(out_fd, data + b.start[j], b.len[j]) != 0 ||
+                add_entry(c, c->end + sizeof(frame), b.len[j]) != 0) {
+                ret = -1;
+                break;
+            }
+            c->end += sizeof(frame) + b.len[j];
+        }
+
+        // The read-ahead starts the next batch
+        if (!eof) {
+            have -= nchunks * chunk;
+            memmove(data, data + nchunks * chunk, have);
+        }
+    }
+
+    memset(data, 0, alloc_size);
+    free(data);
+    free(start);
+    return ret;
+}
+
+// The end frame, index and footer after the last chunk (at c->end)
+static int write_index(const taes_container *c, int out_fd) {
+    size_t size = TAES_CONTAINER_FRAME_SIZE + (size_t)c->count * INDEX_ENTRY_SIZE + TAES_CONTAINER_FOOTER_SIZE;
+    uint8_t *buf = calloc(1, size);
+    if (!buf) {
+        errno = ENOMEM;
+        return -1;
+    }
+    uint8_t *p = buf + TAES_CONTAINER_FRAME_SIZE;
+    for (uint64_t k = 0; k < c->count; k++, p += INDEX_ENTRY_SIZE) {
+        store_le64(p, c->entries[k].offset);
+        store_le64(p + 8, c->entries[k].length);
+    }
+    store_le64(p, c->end + TAES_CONTAINER_FRAME_SIZE);
+    store_le64(p + 8, c->count);
+    store_le64(p + 16, c->length);
+    memcpy(p + 24, footer_magic, sizeof(footer_magic));
+
+    int ret = write_all(out_fd, buf, size);
+    free(buf);
+    return ret;
+}
+
+int taes_container_encrypt(const taes_ctx *ctx, const taes_container_params *params, int in_fd,
+                           int out_fd, taes_pool *pool) {
+    if (!ctx || !params) {
+        errno = EINVAL;
+        return -1;
+    }
+    taes_container c = {0};
+    c.fd = out_fd;
+    c.params = *params;
+    if (c.params.chunk_size == 0) {
+        c.params.chunk_size = TAES_CONTAINER_DEFAULT_CHUNK;
+    }
+    if (!valid_params(&c.params) || (uint32_t)ctx->key_size * 8 != c.params.key_bits) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    uint8_t header[TAES_CONTAINER_HEADER_SIZE];
+    encode_header(header, &c.params);
+    c.end = TAES_CONTAINER_HEADER_SIZE;
+    int ret = add_chunks(&c, ctx, in_fd, out_fd, pool, header, sizeof(header));
+    if (ret == 0) {
+        ret = write_index(&c, out_fd);
+    }
+    free(c.entries);
+    return ret;
+}
+
+int taes_container_read_params(int in_fd, taes_container_params *params) {
+    uint8_t header[TAES_CONTAINER_HEADER_SIZE];
+    ssize_t got = read_full(in_fd, header, sizeof(header));
+    if (got < 0) {
+        return -1;
+    }
+    if ((size_t)got < sizeof(header)) {
+        errno = EBADMSG;
+        return -1;
+    }
+    return decode_header(header, params);
+}
+
+int taes_container_decrypt(const taes_ctx *ctx, const taes_container_params *params, int in_fd,
+                           int out_fd, taes_pool *pool) {
+    if (!ctx || !params || !valid_params(params)) {
+        errno = EINVAL;
+        return -1;
+    }
+    size_t chunk = params->chunk_size;
+    size_t nchunks = (size_t)batch_chunks(pool);
+    size_t alloc_size = nchunks * chunk;
+    uint8_t *data = aligned_alloc(64, alloc_size);
+    size_t *start = calloc(2 * nchunks, sizeof(*start));
+    if (!data || !start) {
+        free(data);
+        free(start);
+        errno = ENOMEM;
+        return -1;
+    }
+    batch b = {ctx, 1, data, start, start + nchunks, 0};
+
+    int ret = 0;
+    for (int end = 0; ret == 0 && !end;) {
+        // Frames up to a batch, or to the end frame; an append's chunks
+        // follow the old index and footer
+        size_t n = 0;
+        while (ret == 0 && n < nchunks) {
+            size_t length = 0;
+            int more = 0;
+            ret = read_frame(in_fd, chunk, data + n * chunk, &length, &more);
+            if (ret == 0 && more) {
+                ret = skip_old_tail(in_fd, b.first_chunk + n);
+                continue;
+            }
+            if (ret == 0 && length == 0) {
+                end = 1;
+                break;
+            }
+            b.start[n] = n * chunk;
+            b.len[n++] = length;
+        }
+        if (ret != 0) {
+            break;
+        }
+
+        taes_pool_run(pool, n, crypt_chunk, &b);
+        for (size_t j = 0; ret == 0 && j < n; j++) {
+            ret = write_all(out_fd, data + b.start[j], b.len[j]);
+        }
+        b.first_chunk += n;
+    }
+
+    memset(data, 0, alloc_size);
+    free(data);
+    free(start);
+    return ret;
+}
+
+taes_container *taes_container_open(int fd) {
+    struct stat st;
+    uint8_t header[TAES_CONTAINER_HEADER_SIZE];
+    uint8_t footer[TAES_CONTAINER_FOOTER_SIZE];
+    taes_container *c = calloc(1, sizeof(*c));
+    if (!c) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    c->fd = fd;
+
+    // Header, then the footer at the end of the file, or at the end in the
+    // header if an append did not finish. A file too short for the header
+    // is not a container, rather than a short read (EIO).
+    uint64_t size = 0;
+    int ok = fstat(fd, &st) == 0;
+    if (ok && (uint64_t)st.st_size < sizeof(header)) {
+        errno = EBADMSG;
+        ok = 0;
+    }
+    ok = ok && pread_exact(fd, header, sizeof(header), 0) == 0 && decode_header(header, &c->params) == 0;
+    if (ok) {
+        uint64_t end = load_le64(header + HEADER_END_OFFSET);
+        size = end ? end : (uint64_t)st.st_size;
+        if (size < TAES_CONTAINER_HEADER_SIZE + TAES_CONTAINER_FRAME_SIZE + TAES_CONTAINER_FOOTER_SIZE ||
+            size > (uint64_t)st.st_size) {
+            errno = EBADMSG;
+            ok = 0;
+        }
+    }
+    ok = ok && pread_exact(fd, footer, sizeof(footer), size - sizeof(footer)) == 0;
+
+    // The index must fill the space between the end frame and the footer
+    uint64_t index_offset = 0;
+    uint64_t count = 0;
+    if (ok) {
+        index_offset = load_le64(footer);
+        count = load_le64(footer + 8);
+        uint64_t room = size - TAES_CONTAINER_FOOTER_SIZE;
+        if (memcmp(footer + 24, footer_magic, sizeof(footer_magic)) != 0 ||
+            index_offset < TAES_CONTAINER_HEADER_SIZE + TAES_CONTAINER_FRAME_SIZE || index_offset > room ||
+            count != (room - index_offset) / INDEX_ENTRY_SIZE ||
+            (room - index_offset) % INDEX_ENTRY_SIZE != 0) {
+            errno = EBADMSG;
+            ok = 0;
+        }
+    }
+    uint8_t *index = NULL;
+    if (ok && count > 0) {
+        index = malloc((size_t)count * INDEX_ENTRY_SIZE);
+        if (!index) {
+            errno = ENOMEM;
+            ok = 0;
+        }
+    }
+    ok = ok && (count == 0 || pread_exact(fd, index, (size_t)count * INDEX_ENTRY_SIZE, index_offset) == 0);
+
+    // Chunks follow each other, each after its frame, up to the end frame.
+    // An append's first chunk follows a continue frame, the old index and
+    // footer instead.
+    c->end = TAES_CONTAINER_HEADER_SIZE;
+    for (uint64_t k = 0; ok && k < count; k++) {
+        uint64_t offset = load_le64(index + k * INDEX_ENTRY_SIZE);
+        uint64_t length = load_le64(index + k * INDEX_ENTRY_SIZE + 8);
+        uint64_t old_tail = TAES_CONTAINER_FRAME_SIZE + k * INDEX_ENTRY_SIZE + TAES_CONTAINER_FOOTER_SIZE;
+        if (offset == c->end + old_tail + TAES_CONTAINER_FRAME_SIZE) {
+            uint8_t frame[TAES_CONTAINER_FRAME_SIZE];
+            ok = pread_exact(fd, frame, sizeof(frame), c->end) == 0;
+            if (ok && (load_le32(frame) != 0 || load_le32(frame + 4) != FRAME_CONTINUE)) {
+                errno = EBADMSG;
+                ok = 0;
+            }
+            if (!ok) {
+                break;
+            }
+        } else if (offset != c->end + TAES_CONTAINER_FRAME_SIZE) {
+            errno = EBADMSG;
+            ok = 0;
+            break;
+        }
+        if (length <= AES_BLOCK_SIZE || length > c->params.chunk_size) {
+            errno = EBADMSG;
+            ok = 0;
+        } else {
+            ok = add_entry(c, offset, length) == 0;
+            c->end = offset + length;
+        }
+    }
+    if (ok && (c->end + TAES_CONTAINER_FRAME_SIZE != index_offset || c->length != load_le64(footer + 16))) {
+        errno = EBADMSG;
+        ok = 0;
+    }
+    free(index);
+
+    if (!ok) {
+        int saved = errno;
+        taes_container_close(c);
+        errno = saved;
+        return NULL;
+    }
+    return c;
+}
+
+void taes_container_close(taes_container *container) {
+    if (container) {
+        free(container->entries);
+        free(container);
+    }
+}
+
+const taes_container_params *taes_container_get_params(const taes_container *container) {
+    return &container->params;
+}
+
+uint64_t taes_container_length(const taes_container *container) {
+    return container->length;
+}
+
+int taes_container_read(const taes_container *container, const taes_ctx *ctx, uint64_t off,
+                        size_t len, uint8_t *out) {
+    const taes_container *c = container;
+    if (!c || !ctx || (!out && len > 0) || off > c->length || len > c->length - off) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (len == 0) {
+        return 0;
+    }
+
+    // Last chunk starting at or before off
+    uint64_t lo = 0;
+    uint64_t hi = c->count - 1;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo + 1) / 2;
+        if (c->entries[mid].plain_offset <= off) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+
+    uint8_t *span = malloc(c->params.chunk_size);
+    if (!span) {
+        errno = ENOMEM;
+        return -1;
+    }
+    int ret = 0;
+    for (uint64_t k = lo; ret == 0 && len > 0; k++) {
+        const entry *e = &c->entries[k];
+        size_t local = (size_t)(off - e->plain_offset);
+        size_t n = e->length - local < len ? (size_t)e->length - local : len;
+        size_t span_off;
+        size_t span_len;
+        counter_mode_range_span((size_t)e->length, local, n, &span_off, &span_len);
+        ret = pread_exact(c->fd, span, span_len, e->offset + span_off);
+        if (ret == 0) {
+            taes_ctx chunk;
+            chunk_context(&chunk, ctx, k);
+            counter_mode_decrypt_span(&chunk, span, (size_t)e->length, local, n, out);
+            taes_cleanup(&chunk);
+        }
+        off += n;
+        out += n;
+        len -= n;
+    }
+    free(span);
+    return ret;
+}
+
+// pwrite() 8 bytes at offset
+static int pwrite_le64(int fd, uint64_t offset, uint64_t v) {
+    uint8_t buf[8];
+    store_le64(buf, v);
+    return pwrite_all(fd, buf, sizeof(buf), offset);
+}
+
+// The frame at offset: FRAME_END or FRAME_CONTINUE
+static int write_end_frame(int fd, uint64_t offset, uint32_t kind) {
+    return pwrite_le64(fd, offset, (uint64_t)kind << 32);
+}
+
+// An append runs in four synced steps. Readers see the old container until
+// the last one, and a crash anywhere leaves it whole:
+//   1. the header names the old end (bytes after it are ignored) and the
+//      end frame is made an end again (a crash after step 3 left it
+//      continuing into chunks that are about to be overwritten)
+//   2. new chunks, end frame, index and footer after the old footer
+//   3. the old end frame becomes a continue frame, for streamed readers
+//   4. the header's end goes back to 0: the new footer at end of file counts
+int taes_container_append(taes_container *container, const taes_ctx *ctx, int in_fd,
+                          taes_pool *pool) {
+    taes_container *c = container;
+    if (!c || !ctx || (uint32_t)ctx->key_size * 8 != c->params.key_bits) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    uint64_t count = c->count;
+    uint64_t length = c->length;
+    uint64_t old_end = c->end;
+    uint64_t old_size =
+        old_end + TAES_CONTAINER_FRAME_SIZE + count * INDEX_ENTRY_SIZE + TAES_CONTAINER_FOOTER_SIZE;
+    if (pwrite_le64(c->fd, HEADER_END_OFFSET, old_size) != 0 ||
+        write_end_frame(c->fd, old_end, FRAME_END) != 0 || fdatasync(c->fd) != 0 ||
+        lseek(c->fd, (off_t)old_size, SEEK_SET) < 0) {
+        return -1;
+    }
+
+    c->end = old_size;
+    int ret = add_chunks(c, ctx, in_fd, c->fd, pool, NULL, 0);
+    int added = ret == 0 && c->count > count;
+    if (added) {
+        if (write_index(c, c->fd) != 0 || ftruncate(c->fd, lseek(c->fd, 0, SEEK_CUR)) != 0 ||
+            fdatasync(c->fd) != 0 || write_end_frame(c->fd, old_end, FRAME_CONTINUE) != 0 ||
+            fdatasync(c->fd) != 0) {
+            ret = -1;
+        }
+    } else if (ret >= 0 && ftruncate(c->fd, (off_t)old_size) != 0) {
+        // Nothing added: drop what a crashed append may have left
+        ret = -1;
+    }
+    // The header keeps naming the old end after a failure
+    if (ret >= 0 && (pwrite_le64(c->fd, HEADER_END_OFFSET, 0) != 0 || fdatasync(c->fd) != 0)) {
+        ret = -1;
+    }
+    if (ret != 0 || !added) {
+        // Still the old container: forget the new chunks
+        c->count = count;
+        c->length = length;
+        c->end = old_end;
+    }
+    return ret;
+}
@@ -0,0 +1,187 @@
+// Runtime backend selection for the public T-AES API
+// One library holds every backend; the best one the CPU supports is picked
+// from CPUID when the library loads, so the same binary runs on any x86-64
+// host. TAES_BACKEND=<name> or taes_set_backend() overrides the choice.
+#include "../include/taes.h"
+#include "taes_backend.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int portable_available(void) {
+    return 1;
+}
+
+static int ni_available(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("aes") && __builtin_cpu_supports("ssse3");
+}
+
+static int vaes_available(void) {
+    return taes_vaes_lanes() > 0;
+}
+
+static const taes_backend backend_portable = {
+    "portable", portable_available,
+    taes_init_portable, taes_init_portable, taes_init_many_portable,
+    taes_encrypt_block_portable, taes_decrypt_block_portable,
+    taes_encrypt_blocks_portable, taes_decrypt_blocks_portable,
+    ctr_encrypt_blocks_portable, ctr_decrypt_blocks_portable,
+    NULL,
+};
+
+static const taes_backend backend_ttable = {
+    "ttable", taes_ttable_available,
+    taes_init_ttable, taes_init_decrypt_ttable, taes_init_many_portable,
+    taes_encrypt_block_ttable, taes_decrypt_block_ttable,
+    taes_encrypt_blocks_ttable, taes_decrypt_blocks_ttable,
+    ctr_encrypt_blocks_ttable, ctr_decrypt_blocks_ttable,
+    NULL,
+};
+
+static const taes_backend backend_bitslice = {
+    "bitslice", portable_available,
+    taes_init_bitslice, taes_init_bitslice, taes_init_many_bitslice,
+    taes_encrypt_block_bitslice, taes_decrypt_block_bitslice,
+    taes_encrypt_blocks_bitslice, taes_decrypt_blocks_bitslice,
+    ctr_encrypt_blocks_bitslice, ctr_decrypt_blocks_bitslice,
+    NULL,
+};
+
+static const taes_backend backend_ni = {
+    "aesni", ni_available,
+    taes_init_ni, taes_init_decrypt_ni, taes_init_many_ni,
+    taes_encrypt_block_ni, taes_decrypt_block_ni,
+    taes_encrypt_blocks_ni, taes_decrypt_blocks_ni,
+    ctr_encrypt_blocks_ni, ctr_decrypt_blocks_ni,
+    taes_mb_kernel_ni,
+};
+
+// Single blocks and key setup are the AES-NI ones; block arrays, counter
+// mode and the multi-buffer kernels are wider
+static const taes_backend backend_vaes = {
+    "vaes", vaes_available,
+    taes_init_ni, taes_init_decrypt_ni, taes_init_many_ni,
+    taes_encrypt_block_ni, taes_decrypt_block_ni,
+    taes_encrypt_blocks_vaes, taes_decrypt_blocks_vaes,
+    ctr_encrypt_blocks_vaes, ctr_decrypt_blocks_vaes,
+    taes_mb_kernel_vaes,
+};
+
+// Most preferred first. Without AES-NI the constant-time bitsliced backend
+// wins; the table-based ones are only used when selected by name.
+static const taes_backend *const backends[] = {
+    &backend_vaes,
+    &backend_ni,
+    &backend_bitslice,
+    &backend_ttable,
+    &backend_portable,
+};
+
+#define NUM_BACKENDS (sizeof(backends) / sizeof(backends[0]))
+
+// The backend in use. Pool, queue and daemon threads read it on every call
+// while taes_set_backend() may change it; the backends are static, so
+// relaxed order is enough.
+static _Atomic(const taes_backend *) active;
+static pthread_once_t dispatch_once = PTHREAD_ONCE_INIT;
+
+// The usable backend called name, or NULL
+static const taes_backend *find_backend(const char *name) {
+    for (size_t i = 0; i < NUM_BACKENDS; i++) {
+        if (strcmp(backends[i]->name, name) == 0) {
+            return backends[i]->available() ? backends[i] : NULL;
+        }
+    }
+    return NULL;
+}
+
+// Pick the backend, once: TAES_BACKEND if set and usable, otherwise the
+// first available one in order of preference
+static void choose_backend(void) {
+    const char *name = getenv("TAES_BACKEND");
+    if (name && *name) {
+        const taes_backend *backend = find_backend(name);
+        if (backend) {
+            atomic_store_explicit(&active, backend, memory_order_relaxed);
+            return;
+        }
+        fprintf(stderr, "taes: TAES_BACKEND=%s is unknown or unsupported, ignoring\n", name);
+    }
+
+    for (size_t i = 0; i < NUM_BACKENDS; i++) {
+        if (backends[i]->available()) {
+            atomic_store_explicit(&active, backends[i], memory_order_relaxed);
+            return;
+        }
+    }
+}
+
+// At load time, so the TAES_BACKEND warning comes first
+__attribute__((constructor))
+static void taes_dispatch_init(void) {
+    pthread_once(&dispatch_once, choose_backend);
+}
+
+const taes_backend *taes_get_backend(void) {
+    // Constructors of other libraries may call in before ours has run
+    const taes_backend *backend = atomic_load_explicit(&active, memory_order_relaxed);
+    if (!backend) {
+        pthread_once(&dispatch_once, choose_backend);
+        backend = atomic_load_explicit(&active, memory_order_relaxed);
+    }
+    return backend;
+}
+
+int taes_set_backend(const char *name) {
+    if (!name) {
+        return -1;
+    }
+    const taes_backend *backend = find_backend(name);
+    if (!backend) {
+        return -1;
+    }
+    // After the first choice, which must not overwrite this one
+    pthread_once(&dispatch_once, choose_backend);
+    atomic_store_explicit(&active, backend, memory_order_relaxed);
+    return 0;
+}
+
+const char *taes_backend_name(void) {
+    return taes_get_backend()->name;
+}
+
+// Public API: forward to the selected backend
+
+int taes_init(taes_ctx *ctx, const uint8_t *key, int key_size, const uint8_t *tweak) {
+    return taes_get_backend()->init(ctx, key, key_size, tweak);
+}
+
+int taes_init_decrypt(taes_ctx *ctx, const uint8_t *key, int key_size, const uint8_t *tweak) {
+    return taes_get_backend()->init_decrypt(ctx, key, key_size, tweak);
+}
+
+int taes_init_many(taes_ctx *const ctxs[], const uint8_t *const keys[], int key_size,
+                   const uint8_t *const tweaks[], size_t n) {
+    return taes_get_backend()->init_many(ctxs, keys, key_size, tweaks, n);
+}
+
+void taes_encrypt_block(const taes_ctx *ctx, const uint8_t *plaintext, uint8_t *ciphertext) {
+    taes_get_backend()->encrypt_block(ctx, plaintext, ciphertext);
+}
+
+void taes_decrypt_block(const taes_ctx *ctx, const uint8_t *ciphertext, uint8_t *plaintext) {
+    taes_get_backend()->decrypt_block(ctx, ciphertext, plaintext);
+}
+
+void taes_encrypt_blocks(const taes_ctx *ctx, const uint8_t *plaintext, uint8_t *ciphertext,
+                         const uint8_t *tweaks, size_t nblocks) {
+    taes_get_backend()->encrypt_blocks(ctx, plaintext, ciphertext, tweaks, nblocks);
+}
+
+void taes_decrypt_blocks(const taes_ctx *ctx, const uint8_t *ciphertext, uint8_t *plaintext,
+                         const uint8_t *tweaks, size_t nblocks) {
+    taes_get_backend()->decrypt_blocks(ctx, ciphertext, plaintext, tweaks, nblocks);
+}
@@ -0,0 +1,671 @@
+// In-place image encryption (see taes_image.h)
+// A run is a loop of batches. Each batch takes the next data windows after
+// the journal's position (SEEK_DATA / SEEK_HOLE), reads and ciphers them on
+// the pool (a window per task), records them with the hashes of their old
+// sectors in the journal, writes them on the pool and syncs the image. A
+// journal slot that names windows is the only state with sectors that may
+// be half done, and resuming from it sorts them out sector by sector.
+#define _GNU_SOURCE
+#include "../include/taes_image.h"
+#include "../include/taes_sector.h"
+#include "../include/taes_pool.h"
+#include "taes_io.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char journal_magic[8] = {'T', 'A', 'E', 'S', 'J', 'N', 'L', '1'};
+
+#define VERSION 1
+
+// Alignment of O_DIRECT buffers, offsets and lengths (the largest logical
+// block size in use); anything else goes through the page cache
+#define DIRECT_ALIGN 4096
+
+// Journal layout: a header block, then two slots of slot_size bytes
+//   header  "TAESJNL1", version (u32), sector size (u32), image size (u64),
+//           key check (16 bytes), window (u64), batch (u32), 4 zero bytes,
+//           slot size (u64), checksum of the bytes before it (u64)
+//   slot    checksum of the rest of the slot record (u64), sequence (u64),
+//           position (u64), flags (u32), state (u32), record length (u64),
+//           windows (u32), 4 zero bytes, per window offset and length
+//           (u64 each), then a hash (u64) per sector of the windows
+// Slot i holds the records with sequence numbers of parity i.
+#define HEADER_SIZE 4096
+#define HEADER_USED 72
+#define SLOT_FIXED 48
+
+#define STATE_RUNNING 0
+#define STATE_COMPLETE 1
+
+#define HASH_MUL 0x9fb21c651e98df25ULL
+
+// A power cut can tear a sector write at the device's atomic unit, at least
+// 512 bytes. Sectors of up to TORN_MAX_PIECES such pieces are pieced back
+// together on resume (2^pieces hashes, 256 for 4 KB).
+#define TORN_PIECE 512
+#define TORN_MAX_PIECES 8
+
+typedef struct {
+    uint64_t offset;
+    size_t length;
+    uint8_t *data;            // window bytes, DIRECT_ALIGN-aligned
+    uint64_t *hashes;         // per sector, of its contents before the run
+    int error;                // errno of a failed read or write, else 0
+    int mismatch;             // Recovery: a sector that matches neither side
+} window;
+
+typedef struct {
+    const taes_ctx *enc;
+    const taes_ctx *dec;
+    int decrypt;
+    int recovering;           // Windows from the journal: sort sectors out
+    int fd;                   // Image, through the page cache
+    int direct_fd;            // Image with O_DIRECT, or -1
+    size_t sector_size;
+    window *windows;
+    size_t count;
+} batch;
+
+typedef struct {
+    int fd;
+    uint64_t size;
+    uint32_t sector_size;
+    uint8_t check[AES_BLOCK_SIZE];
+    uint64_t window;
+    uint32_t batch;
+    uint64_t slot_size;
+    uint64_t seq;             // Sequence number of the latest record
+    uint8_t *slot;            // slot_size bytes
+} journal;
+
+// 64-bit hash of n bytes (n a multiple of 8). Not cryptographic: it only has
+// to tell a sector's old contents from its new ones, at memory speed, so
+// four independent multiply-xorshift lanes take a word each in turn.
+static uint64_t hash_bytes(const uint8_t *p, size_t n) {
+    uint64_t lane[4] = {0x243f6a8885a308d3ULL, 0x13198a2e03707344ULL,
+                        0xa4093822299f31d0ULL, 0x082efa98ec4e6c89ULL};
+    size_t words = n / 8;
+    size_t i = 0;
+    for (; i + 4 <= words; i += 4) {
+        for (int j = 0; j < 4; j++) {
+            uint64_t w;
+            memcpy(&w, p + 8 * (i + j), 8);
+            lane[j] = (lane[j] ^ w) * HASH_MUL;
+            lane[j] ^= lane[j] >> 29;
+        }
+    }
+    for (; i < words; i++) {
+        uint64_t w;
+        memcpy(&w, p + 8 * i, 8);
+        lane[i & 3] = (lane[i & 3] ^ w) * HASH_MUL;
+        lane[i & 3] ^= lane[i & 3] >> 29;
+    }
+    uint64_t h = n;
+    for (int j = 0; j < 4; j++) {
+        h = (h ^ lane[j]) * HASH_MUL;
+        h ^= h >> 32;
+    }
+    return h;
+}
+
+// Ciphertext of a zero block under the key and a tweak no sector uses (top
+// bit flipped): a resumed run must use the key that started it
+static void key_check(const taes_ctx *enc, uint8_t check[AES_BLOCK_SIZE]) {
+    static const uint8_t zero[AES_BLOCK_SIZE] = {0};
+    uint8_t tweak[TWEAK_SIZE];
+    taes_ctx ctx = *enc;
+    memcpy(tweak, enc->tweak, TWEAK_SIZE);
+    tweak[TWEAK_SIZE - 1] ^= 0x80;
+    taes_set_tweak(&ctx, tweak);
+    taes_encrypt_block(&ctx, zero, check);
+    taes_cleanup(&ctx);
+    memset(tweak, 0, sizeof(tweak));
+}
+
+// Cipher `count` sectors the way of the run (forward) or back
+static void crypt_sectors(const batch *b, int forward, uint64_t offset, uint8_t *data, size_t count) {
+    uint64_t sector_no = offset / b->sector_size;
+    if (forward != b->decrypt) {
+        taes_sector_encrypt(b->enc, sector_no, b->sector_size, data, data, count);
+    } else {
+        taes_sector_decrypt(b->dec, sector_no, b->sector_size, data, data, count);
+    }
+}
+
+// pread()/pwrite() all of length bytes, with O_DIRECT when the range allows
+// it (the page cache if the file system refuses)
+static int image_io(const batch *b, int writing, uint8_t *data, size_t length, uint64_t offset) {
+    int fd = b->fd;
+    if (b->direct_fd >= 0 && offset % DIRECT_ALIGN == 0 && length % DIRECT_ALIGN == 0) {
+        fd = b->direct_fd;
+    }
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = writing ? pwrite(fd, data + done, length - done, (off_t)(offset + done))
+                            : pread(fd, data + done, length - done, (off_t)(offset + done));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && errno == EINVAL && fd == b->direct_fd) {
+            fd = b->fd;
+            continue;
+        }
+        if (n <= 0) {
+            if (n == 0) {
+                errno = EIO;          // The image shrank under the run
+            }
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    return 0;
+}
+
+// A sector matching neither side, torn by an interrupted write: every
+// 16-byte block is ciphered on its own, so each piece is either old (as in
+// sector) or written (as in back, sector ciphered back). Finds the mix of
+// pieces with the old hash and leaves the processed sector in sector;
+// returns 0, or -1 if no mix has it. mix: sector_size bytes of scratch.
+static int untear(const batch *b, uint64_t offset, uint8_t *sector, const uint8_t *back, uint8_t *mix,
+                  uint64_t hash) {
+    size_t pieces = b->sector_size / TORN_PIECE;
+    if (b->sector_size % TORN_PIECE != 0 || pieces < 2 || pieces > TORN_MAX_PIECES) {
+        return -1;
+    }
+    // Masks 0 and all ones (nothing or everything written) were tried already
+    for (uint32_t mask = 1; mask + 1 < (1u << pieces); mask++) {
+        for (size_t i = 0; i < pieces; i++) {
+            const uint8_t *from = (mask >> i) & 1 ? back : sector;
+            memcpy(mix + i * TORN_PIECE, from + i * TORN_PIECE, TORN_PIECE);
+        }
+        if (hash_bytes(mix, b->sector_size) == hash) {
+            crypt_sectors(b, 1, offset, mix, 1);
+            memcpy(sector, mix, b->sector_size);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Read a window and cipher it. A new window gets the hashes of its sectors;
+// a window from the journal is checked against them: a sector with its old
+// hash is ciphered, one that takes it when ciphered back was written before
+// the interruption and stays as it is, and one torn in between is untorn.
+static void read_window(void *arg, size_t task) {
+    const batch *b = arg;
+    window *w = &b->windows[task];
+    size_t sectors = w->length / b->sector_size;
+    if (image_io(b, 0, w->data, w->length, w->offset) != 0) {
+        w->error = errno;
+        return;
+    }
+    if (!b->recovering) {
+        for (size_t s = 0; s < sectors; s++) {
+            w->hashes[s] = hash_bytes(w->data + s * b->sector_size, b->sector_size);
+        }
+        crypt_sectors(b, 1, w->offset, w->data, sectors);
+        return;
+    }
+    uint8_t *back = malloc(2 * b->sector_size);
+    if (!back) {
+        w->error = ENOMEM;
+        return;
+    }
+    for (size_t s = 0; s < sectors; s++) {
+        uint8_t *sector = w->data + s * b->sector_size;
+        uint64_t offset = w->offset + s * b->sector_size;
+        if (hash_bytes(sector, b->sector_size) == w->hashes[s]) {
+            crypt_sectors(b, 1, offset, sector, 1);
+            continue;
+        }
+        memcpy(back, sector, b->sector_size);
+        crypt_sectors(b, 0, offset, back, 1);
+        if (hash_bytes(back, b->sector_size) != w->hashes[s] &&
+            untear(b, offset, sector, back, back + b->sector_size, w->hashes[s]) != 0) {
+            w->mismatch = 1;
+        }
+    }
+    memset(back, 0, 2 * b->sector_size);
+    free(back);
+}
+
+static void write_window(void *arg, size_t task) {
+    const batch *b = arg;
+    window *w = &b->windows[task];
+    if (image_io(b, 1, w->data, w->length, w->offset) != 0) {
+        w->error = errno;
+    }
+}
+
+// Run fn over the batch's windows; -1 with the first window's errno if any
+// failed, TAES_IMAGE_MISMATCH if a recovered sector matched neither side
+static int run_windows(taes_pool *pool, batch *b, taes_task_fn fn) {
+    for (size_t i = 0; i < b->count; i++) {
+        b->windows[i].error = 0;
+        b->windows[i].mismatch = 0;
+    }
+    taes_pool_run(pool, b->count, fn, b);
+    int mismatch = 0;
+    for (size_t i = 0; i < b->count; i++) {
+        if (b->windows[i].error) {
+            errno = b->windows[i].error;
+            return -1;
+        }
+        mismatch |= b->windows[i].mismatch;
+    }
+    return mismatch ? TAES_IMAGE_MISMATCH : 0;
+}
+
+// The next window of data at or after *pos: at most `window` bytes, never
+// across a hole. Returns its length (0: no data left) and moves *pos past
+// it; the hole bytes jumped over are added to *skipped.
+static size_t next_window(int fd, uint64_t size, size_t sector_size, size_t window, uint64_t *pos,
+                          uint64_t *offset, uint64_t *skipped) {
+    if (*pos >= size) {
+        return 0;
+    }
+    off_t data = lseek(fd, (off_t)*pos, SEEK_DATA);
+    if (data < 0) {
+        // ENXIO: only a hole is left; anything else: no hole support, all data
+        data = errno == ENXIO ? (off_t)size : (off_t)*pos;
+    }
+    uint64_t start = (uint64_t)data / sector_size * sector_size;
+    if (start < *pos) {
+        start = *pos;
+    }
+    if (start >= size) {
+        *skipped += size - *pos;
+        *pos = size;
+        return 0;
+    }
+    off_t hole = lseek(fd, (off_t)start, SEEK_HOLE);
+    uint64_t end = hole < 0 ? size : ((uint64_t)hole + sector_size - 1) / sector_size * sector_size;
+    if (end > size || end <= start) {
+        end = size;
+    }
+    if (end - start > window) {
+        end = start + window;
+    }
+    *skipped += start - *pos;
+    *offset = start;
+    *pos = end;
+    return (size_t)(end - start);
+}
+
+static uint64_t slot_size(uint64_t window, uint32_t batch, uint32_t sector_size) {
+    uint64_t size = SLOT_FIXED + (uint64_t)batch * 16 + (uint64_t)batch * (window / sector_size) * 8;
+    return (size + DIRECT_ALIGN - 1) / DIRECT_ALIGN * DIRECT_ALIGN;
+}
+
+// Record a state in the slot after the latest one and sync the journal
+static int journal_record(journal *j, uint64_t position, int flags, uint32_t state, const batch *b) {
+    uint8_t *p = j->slot;
+    size_t length = SLOT_FIXED;
+    memset(p, 0, SLOT_FIXED);
+    store_le64(p + 8, j->seq + 1);
+    store_le64(p + 16, position);
+    store_le32(p + 24, (uint32_t)flags);
+    store_le32(p + 28, state);
+    store_le32(p + 40, b ? (uint32_t)b->count : 0);
+    for (size_t i = 0; b && i < b->count; i++) {
+        store_le64(p + length, b->windows[i].offset);
+        store_le64(p + length + 8, b->windows[i].length);
+        length += 16;
+    }
+    for (size_t i = 0; b && i < b->count; i++) {
+        for (size_t s = 0; s < b->windows[i].length / j->sector_size; s++) {
+            store_le64(p + length, b->windows[i].hashes[s]);
+            length += 8;
+        }
+    }
+    store_le64(p + 32, length);
+    store_le64(p, hash_bytes(p + 8, length - 8));
+    uint64_t offset = HEADER_SIZE + ((j->seq + 1) & 1) * j->slot_size;
+    if (pwrite_all(j->fd, p, length, offset) != 0 || fdatasync(j->fd) != 0) {
+        return -1;
+    }
+    j->seq++;
+    return 0;
+}
+
+// Start a journal: header and a first record at position 0
+static int journal_create(journal *j, int flags) {
+    uint8_t header[HEADER_SIZE] = {0};
+    memcpy(header, journal_magic, sizeof(journal_magic));
+    store_le32(header + 8, VERSION);
+    store_le32(header + 12, j->sector_size);
+    store_le64(header + 16, j->size);
+    memcpy(header + 24, j->check, AES_BLOCK_SIZE);
+    store_le64(header + 40, j->window);
+    store_le32(header + 48, j->batch);
+    store_le64(header + 56, j->slot_size);
+    store_le64(header + HEADER_USED - 8, hash_bytes(header, HEADER_USED - 8));
+    if (ftruncate(j->fd, 0) != 0 || pwrite_all(j->fd, header, sizeof(header), 0) != 0) {
+        return -1;
+    }
+    j->slot = malloc(j->slot_size);
+    if (!j->slot) {
+        return -1;
+    }
+    j->seq = 0;
+    return journal_record(j, 0, flags, STATE_RUNNING, NULL);
+}
+
+// The valid slot record with the highest sequence number, to j->slot;
+// returns its length, or 0 if neither slot is valid
+static uint64_t journal_latest(journal *j) {
+    uint64_t best = 0;
+    uint64_t best_seq = 0;
+    uint8_t *p = j->slot;
+    for (int i = 0; i < 2; i++) {
+        uint64_t offset = HEADER_SIZE + (uint64_t)i * j->slot_size;
+        ssize_t got = pread_full(j->fd, p, j->slot_size, offset);
+        if (got < SLOT_FIXED) {
+            continue;
+        }
+        uint64_t length = load_le64(p + 32);
+        if (length < SLOT_FIXED || length > (uint64_t)got ||
+            hash_bytes(p + 8, length - 8) != load_le64(p)) {
+            continue;
+        }
+        if (best == 0 || load_le64(p + 8) > best_seq) {
+            best = length;
+            best_seq = load_le64(p + 8);
+        }
+    }
+    if (best == 0) {
+        return 0;
+    }
+    // Reload the winner
+    if (pread_full(j->fd, p, j->slot_size, HEADER_SIZE + (best_seq & 1) * j->slot_size) < (ssize_t)best) {
+        return 0;
+    }
+    j->seq = best_seq;
+    return best;
+}
+
+// Read an existing journal's header and latest record. Returns 0,
+// TAES_IMAGE_MISMATCH if it is not a journal of this image and key, or -1.
+static int journal_open(journal *j, uint64_t *length) {
+    uint8_t header[HEADER_USED];
+    ssize_t got = pread_full(j->fd, header, sizeof(header), 0);
+    if (got < 0) {
+        return -1;
+    }
+    if (got < HEADER_USED || memcmp(header, journal_magic, sizeof(journal_magic)) != 0 ||
+        load_le32(header + 8) != VERSION ||
+        hash_bytes(header, HEADER_USED - 8) != load_le64(header + HEADER_USED - 8) ||
+        load_le32(header + 12) != j->sector_size || load_le64(header + 16) != j->size ||
+        memcmp(header + 24, j->check, AES_BLOCK_SIZE) != 0) {
+        return TAES_IMAGE_MISMATCH;
+    }
+    j->window = load_le64(header + 40);
+    j->batch = load_le32(header + 48);
+    j->slot_size = load_le64(header + 56);
+    if (j->window == 0 || j->window % j->sector_size != 0 || j->batch == 0 ||
+        j->slot_size != slot_size(j->window, j->batch, j->sector_size)) {
+        return TAES_IMAGE_MISMATCH;
+    }
+    j->slot = malloc(j->slot_size);
+    if (!j->slot) {
+        return -1;
+    }
+    *length = journal_latest(j);
+    return *length == 0 ? TAES_IMAGE_MISMATCH : 0;
+}
+
+// Load the windows of the record in j->slot into b, with their hashes;
+// TAES_IMAGE_MISMATCH if the record does not fit the journal's geometry
+static int load_windows(const journal *j, uint64_t length, batch *b) {
+    const uint8_t *p = j->slot;
+    uint32_t count = load_le32(p + 40);
+    size_t at = SLOT_FIXED + (size_t)count * 16;
+    if (count > j->batch || at > length) {
+        return TAES_IMAGE_MISMATCH;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        window *w = &b->windows[i];
+        w->offset = load_le64(p + SLOT_FIXED + 16 * i);
+        w->length = (size_t)load_le64(p + SLOT_FIXED + 16 * i + 8);
+        if (w->length == 0 || w->length > j->window || w->length % j->sector_size != 0 ||
+            w->offset % j->sector_size != 0 || w->offset > j->size - w->length ||
+            at + w->length / j->sector_size * 8 > length) {
+            return TAES_IMAGE_MISMATCH;
+        }
+        for (size_t s = 0; s < w->length / j->sector_size; s++) {
+            w->hashes[s] = load_le64(p + at);
+            at += 8;
+        }
+    }
+    b->count = count;
+    return 0;
+}
+
+typedef struct {
+    batch b;
+    journal j;
+    taes_pool *pool;
+    uint8_t *buffers;
+    uint64_t *hashes;
+    int flags;
+    int threads;
+    taes_image_stats stats;
+} image_run;
+
+// Window buffers and hash arrays for j's geometry
+static int alloc_batch(image_run *r) {
+    size_t sectors = r->j.window / r->j.sector_size;
+    r->b.windows = calloc(r->j.batch, sizeof(window));
+    r->hashes = calloc((size_t)r->j.batch * sectors, sizeof(uint64_t));
+    if (!r->b.windows || !r->hashes ||
+        posix_memalign((void **)&r->buffers, DIRECT_ALIGN, (size_t)r->j.batch * r->j.window) != 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+    for (uint32_t i = 0; i < r->j.batch; i++) {
+        r->b.windows[i].data = r->buffers + (size_t)i * r->j.window;
+        r->b.windows[i].hashes = r->hashes + (size_t)i * sectors;
+    }
+    return 0;
+}
+
+// Write the batch ciphered by run_windows(read_window) and sync the image
+static int write_batch(image_run *r) {
+    int rc = run_windows(r->pool, &r->b, write_window);
+    if (rc != 0) {
+        return rc;
+    }
+    if (fdatasync(r->b.fd) != 0) {
+        return -1;
+    }
+    for (size_t i = 0; i < r->b.count; i++) {
+        r->stats.processed += r->b.windows[i].length;
+    }
+    return 0;
+}
+
+// Open or create the journal and finish a batch left in flight. Returns 0
+// with the position to go on from, or TAES_IMAGE_COMPLETE,
+// TAES_IMAGE_MISMATCH or -1.
+static int start_run(image_run *r, uint64_t *position) {
+    uint64_t length = 0;
+    *position = 0;
+    int rc = journal_open(&r->j, &length);
+    if (rc == TAES_IMAGE_MISMATCH && r->j.slot == NULL) {
+        // Not a journal: only an empty file may become one
+        struct stat st;
+        if (fstat(r->j.fd, &st) != 0) {
+            return -1;
+        }
+        if (st.st_size != 0) {
+            return TAES_IMAGE_MISMATCH;
+        }
+        r->j.slot_size = slot_size(r->j.window, r->j.batch, r->j.sector_size);
+        if (journal_create(&r->j, r->flags) != 0) {
+            return -1;
+        }
+        return alloc_batch(r);
+    }
+    if (rc != 0) {
+        return rc;
+    }
+    const uint8_t *p = r->j.slot;
+    int flags = (int)load_le32(p + 24);
+    uint32_t state = load_le32(p + 28);
+    if (flags != r->flags) {
+        if (state != STATE_COMPLETE) {
+            return TAES_IMAGE_MISMATCH;
+        }
+        // The other direction finished: start over this way
+        if (journal_record(&r->j, 0, r->flags, STATE_RUNNING, NULL) != 0) {
+            return -1;
+        }
+        return alloc_batch(r);
+    }
+    if (state == STATE_COMPLETE) {
+        return TAES_IMAGE_COMPLETE;
+    }
+    *position = load_le64(p + 16);
+    if (*position > r->j.size || *position % r->j.sector_size != 0) {
+        return TAES_IMAGE_MISMATCH;
+    }
+    if (alloc_batch(r) != 0) {
+        return -1;
+    }
+    rc = load_windows(&r->j, length, &r->b);
+    if (rc != 0 || r->b.count == 0) {
+        r->stats.resumed_at = *position;
+        return rc;
+    }
+    // Finish the batch that was in flight; its record stays the latest
+    // until the next batch's, so another interruption resumes the same way
+    r->stats.resumed_at = r->b.windows[0].offset;
+    r->b.recovering = 1;
+    rc = run_windows(r->pool, &r->b, read_window);
+    r->b.recovering = 0;
+    return rc != 0 ? rc : write_batch(r);
+}
+
+static int run_image(image_run *r) {
+    uint64_t position;
+    int rc = start_run(r, &position);
+    if (rc != 0) {
+        return rc;
+    }
+    for (;;) {
+        batch *b = &r->b;
+        b->count = 0;
+        while (b->count < r->j.batch) {
+            window *w = &b->windows[b->count];
+            w->length = next_window(b->fd, r->j.size, r->j.sector_size, r->j.window, &position,
+                                    &w->offset, &r->stats.skipped);
+            if (w->length == 0) {
+                break;
+            }
+            b->count++;
+        }
+        if (b->count == 0) {
+            break;
+        }
+        rc = run_windows(r->pool, b, read_window);
+        if (rc == 0) {
+            rc = journal_record(&r->j, position, r->flags, STATE_RUNNING, b);
+        }
+        if (rc == 0) {
+            rc = write_batch(r);
+        }
+        if (rc != 0) {
+            return rc;
+        }
+    }
+    return journal_record(&r->j, r->j.size, r->flags, STATE_COMPLETE, NULL);
+}
+
+int taes_image_crypt(const taes_ctx *enc, const taes_ctx *dec, const char *image_path,
+                     const char *journal_path, const taes_image_options *options,
+                     taes_image_stats *stats) {
+    taes_image_options opt = {0};
+    if (options) {
+        opt = *options;
+    }
+    if (opt.sector_size == 0) {
+        opt.sector_size = TAES_SECTOR_4K;
+    }
+    if (opt.threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        opt.threads = cpus > 4 ? (int)cpus : 4;
+    }
+    if (opt.window == 0) {
+        opt.window = TAES_IMAGE_DEFAULT_WINDOW;
+    }
+    if (opt.batch <= 0) {
+        opt.batch = TAES_IMAGE_DEFAULT_BATCH > opt.threads ? TAES_IMAGE_DEFAULT_BATCH : opt.threads;
+    }
+    if (!enc || !dec || !image_path || !journal_path || opt.sector_size % AES_BLOCK_SIZE != 0 ||
+        opt.sector_size > UINT32_MAX || opt.window % opt.sector_size != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    image_run r;
+    memset(&r, 0, sizeof(r));
+    r.flags = opt.flags & TAES_IMAGE_DECRYPT;
+    r.b.enc = enc;
+    r.b.dec = dec;
+    r.b.decrypt = r.flags & TAES_IMAGE_DECRYPT;
+    r.b.sector_size = opt.sector_size;
+    r.b.direct_fd = -1;
+    r.j.fd = -1;
+    r.j.sector_size = (uint32_t)opt.sector_size;
+    r.j.window = opt.window;
+    r.j.batch = (uint32_t)opt.batch;
+    key_check(enc, r.j.check);
+
+    int rc = -1;
+    r.b.fd = open(image_path, O_RDWR | O_CLOEXEC);
+    if (r.b.fd >= 0) {
+        // Without O_DIRECT support every window goes through the page cache
+        r.b.direct_fd = open(image_path, O_RDWR | O_DIRECT | O_CLOEXEC);
+        off_t end = lseek(r.b.fd, 0, SEEK_END);
+        r.j.size = end < 0 ? 0 : (uint64_t)end;
+        if (end >= 0 && r.j.size % opt.sector_size != 0) {
+            errno = EINVAL;
+        } else if (end >= 0) {
+            r.j.fd = open(journal_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+            r.pool = r.j.fd >= 0 ? taes_pool_create(opt.threads) : NULL;
+            if (r.pool) {
+                r.stats.size = r.j.size;
+                rc = run_image(&r);
+            }
+        }
+    }
+
+    int saved = errno;
+    taes_pool_destroy(r.pool);
+    if (r.buffers) {
+        memset(r.buffers, 0, (size_t)r.j.batch * r.j.window);
+    }
+    free(r.buffers);
+    free(r.hashes);
+    free(r.b.windows);
+    free(r.j.slot);
+    if (r.j.fd >= 0) {
+        close(r.j.fd);
+    }
+    if (r.b.direct_fd >= 0) {
+        close(r.b.direct_fd);
+    }
+    if (r.b.fd >= 0) {
+        close(r.b.fd);
+    }
+    memset(r.j.check, 0, sizeof(r.j.check));
+    if (stats) {
+        *stats = r.stats;
+    }
+    errno = saved;
+    return rc;
+}
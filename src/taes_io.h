@@ -0,0 +1,124 @@
+// Internal I/O and byte-order helpers
+// File formats (containers, image journals, shard sets) store integers
+// little-endian, and every module reads and writes whole buffers through
+// these loops, which retry after EINTR and short transfers. Including files
+// define _POSIX_C_SOURCE (or _GNU_SOURCE) first, for pread() and pwrite().
+#ifndef TAES_IO_H
+#define TAES_IO_H
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+static inline void store_le32(uint8_t *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        p[i] = (uint8_t)(v >> (8 * i));
+    }
+}
+
+static inline void store_le64(uint8_t *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) {
+        p[i] = (uint8_t)(v >> (8 * i));
+    }
+}
+
+static inline uint32_t load_le32(const uint8_t *p) {
+    uint32_t v = 0;
+    for (int i = 3; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+static inline uint64_t load_le64(const uint8_t *p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+// write() / pwrite() all length bytes; return 0, or -1 with errno set
+static inline int write_all(int fd, const uint8_t *data, size_t length) {
+    while (length > 0) {
+        ssize_t n = write(fd, data, length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        data += n;
+        length -= (size_t)n;
+    }
+    return 0;
+}
+
+static inline int pwrite_all(int fd, const uint8_t *data, size_t length, uint64_t offset) {
+    while (length > 0) {
+        ssize_t n = pwrite(fd, data, length, (off_t)offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        data += n;
+        length -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    return 0;
+}
+
+// read() / pread() up to length bytes, fewer only at end of file; return
+// the count or -1
+static inline ssize_t read_full(int fd, uint8_t *data, size_t length) {
+    size_t have = 0;
+    while (have < length) {
+        ssize_t n = read(fd, data + have, length - have);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        have += (size_t)n;
+    }
+    return (ssize_t)have;
+}
+
+static inline ssize_t pread_full(int fd, uint8_t *data, size_t length, uint64_t offset) {
+    size_t have = 0;
+    while (have < length) {
+        ssize_t n = pread(fd, data + have, length - have, (off_t)(offset + have));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        have += (size_t)n;
+    }
+    return (ssize_t)have;
+}
+
+// pread() exactly length bytes; return 0, or -1 with errno set (EIO if the
+// file ends first)
+static inline int pread_exact(int fd, uint8_t *data, size_t length, uint64_t offset) {
+    ssize_t got = pread_full(fd, data, length, offset);
+    if (got >= 0 && (size_t)got < length) {
+        errno = EIO;
+        return -1;
+    }
+    return got < 0 ? -1 : 0;
+}
+
+#endif // TAES_IO_H
@@ -0,0 +1,228 @@
+// Copy-free route for taes_crypt_fd() and taes_transcrypt_fd() (see taes_pipeline.h)
+// A regular input file is mapped and walked in windows. Every window but the
+// last is followed by at least 16 more bytes, so its blocks are ordinary ones
+// at its tweak offset; the last window is a complete counter-mode message at
+// its offset, as in taes_pipeline.c. The cipher reads the input mapping and
+// writes straight to the output:
+//   - a regular output file opened read-write at offset 0: its mapping,
+//     pre-sized with ftruncate() and fallocate()
+//   - anything else, pipes included: a buffer and write(). vmsplice()
+//     would hand the pipe references to our pages, and a reader that splices
+//     the pipe onward can hold them long after the pipe has drained, so a
+//     reused buffer could change output already "written". Gifting fresh
+//     pages instead cost more in page faults than the copy it saves.
+// The input mapping is read sequentially, with the next window prefetched
+// (MADV_WILLNEED) while the current one is ciphered, and windows that are
+// done are dropped from the mappings so a 100 GB file does not fill memory.
+#define _GNU_SOURCE
+#include "../include/taes_pipeline.h"
+#include "../include/counter_mode.h"
+#include "../include/taes_pool.h"
+#include "../include/taes_utils.h"
+#include "taes_io.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Window between mapped files; inputs up to POPULATE_MAX are faulted in at
+// once (MAP_POPULATE)
+#define MAP_WINDOW (8 * 1024 * 1024)
+#define POPULATE_MAX (64 * 1024 * 1024)
+
+// Window for write() outputs
+#define COPY_WINDOW (256 * 1024)
+
+typedef struct {
+    const taes_ctx *ctx;
+    const taes_ctx *to;       // Transcryption: ctx decrypts, to re-encrypts
+    int flags;
+    taes_pool *pool;
+} cipher;
+
+// madvise() a range that need not start on a page
+static void advise(const uint8_t *start, size_t length, int advice) {
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t from = (uintptr_t)start & ~(page - 1);
+    madvise((void *)from, (uintptr_t)start + length - from, advice);
+}
+
+// Bytes of the window at pos: a whole window if 16 bytes follow it, else
+// everything left
+static size_t window_at(size_t total, size_t pos, size_t window) {
+    size_t left = total - pos;
+    return left >= window + AES_BLOCK_SIZE ? window : left;
+}
+
+// One window, block 0 at tweak offset first_block (the checks on the whole
+// length were done before)
+static void crypt_window(const cipher *c, const uint8_t *in, uint8_t *out, size_t length,
+                         uint64_t first_block) {
+    int decrypt = c->flags & TAES_PIPELINE_DECRYPT;
+
+    if (c->flags & TAES_PIPELINE_ECB) {
+        if (decrypt) {
+            ecb_decrypt(c->ctx, in, out, length);
+        } else {
+            ecb_encrypt(c->ctx, in, out, length);
+        }
+        return;
+    }
+
+    taes_ctx ctx = *c->ctx;
+    taes_advance_tweak(&ctx, first_block);
+    if (c->to) {
+        taes_ctx to = *c->to;
+        taes_advance_tweak(&to, first_block);
+        if (length == AES_BLOCK_SIZE) {
+            taes_decrypt_block(&ctx, in, out);
+            taes_encrypt_block(&to, out, out);
+        } else {
+            taes_transcrypt_parallel(c->pool, &ctx, &to, in, out, length, 0);
+        }
+        taes_cleanup(&to);
+    } else if (length == AES_BLOCK_SIZE) {
+        // The last window's single block
+        if (decrypt) {
+            taes_decrypt_block(&ctx, in, out);
+        } else {
+            taes_encrypt_block(&ctx, in, out);
+        }
+    } else if (decrypt) {
+        counter_mode_decrypt_parallel(c->pool, &ctx, in, out, length, 0);
+    } else {
+        counter_mode_encrypt_parallel(c->pool, &ctx, in, out, length, 0);
+    }
+    taes_cleanup(&ctx);
+}
+
+// Input mapping to output mapping
+static int to_mapped_file(const cipher *c, const uint8_t *in, size_t total, int out_fd) {
+    if (ftruncate(out_fd, (off_t)total) != 0) {
+        return -1;
+    }
+    fallocate(out_fd, 0, 0, (off_t)total);  // Best effort: fewer faults allocating blocks
+    uint8_t *out = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, out_fd, 0);
+    if (out == MAP_FAILED) {
+        return -1;
+    }
+    madvise(out, total, MADV_SEQUENTIAL);
+
+    for (size_t pos = 0; pos < total;) {
+        size_t length = window_at(total, pos, MAP_WINDOW);
+        if (pos + length < total) {
+            advise(in + pos + length, window_at(total, pos + length, MAP_WINDOW), MADV_WILLNEED);
+        }
+        crypt_window(c, in + pos, out + pos, length, pos / AES_BLOCK_SIZE);
+
+        // Written back by the kernel from the page cache
+        advise(in + pos, length, MADV_DONTNEED);
+        advise(out + pos, length, MADV_DONTNEED);
+        pos += length;
+    }
+    return munmap(out, total);
+}
+
+// Input mapping through a buffer to write()
+static int to_stream(const cipher *c, const uint8_t *in, size_t total, int out_fd) {
+    // window + 16: the last window may be that long
+    size_t buffer_size = COPY_WINDOW + AES_BLOCK_SIZE;
+    uint8_t *buf = malloc(buffer_size);
+    if (!buf) {
+        return -1;
+    }
+
+    int ret = 0;
+    for (size_t pos = 0; ret == 0 && pos < total;) {
+        size_t length = window_at(total, pos, COPY_WINDOW);
+        if (pos + length < total) {
+            advise(in + pos + length, window_at(total, pos + length, COPY_WINDOW), MADV_WILLNEED);
+        }
+        crypt_window(c, in + pos, buf, length, pos / AES_BLOCK_SIZE);
+        ret = write_all(out_fd, buf, length);
+        advise(in + pos, length, MADV_DONTNEED);
+        pos += length;
+    }
+
+    memset(buf, 0, buffer_size);
+    free(buf);
+    return ret;
+}
+
+static int crypt_fd(const taes_ctx *ctx, const taes_ctx *to, int flags, int in_fd, int out_fd, int workers) {
+    struct stat in_st;
+    struct stat out_st;
+    if (!ctx || workers < 0 || fstat(in_fd, &in_st) != 0 || fstat(out_fd, &out_st) != 0) {
+        if (!ctx || workers < 0) {
+            errno = EINVAL;
+        }
+        return -1;
+    }
+
+    off_t in_off = lseek(in_fd, 0, SEEK_CUR);
+    if (!S_ISREG(in_st.st_mode) || in_off < 0 || in_off > in_st.st_size) {
+        return to ? taes_transcrypt_pipeline(ctx, to, in_fd, out_fd, workers, 0)
+                  : taes_pipeline(ctx, flags, in_fd, out_fd, workers, 0);
+    }
+
+    // The same length checks as the one-shot calls, before any output
+    size_t total = (size_t)(in_st.st_size - in_off);
+    if ((flags & TAES_PIPELINE_ECB) ? total % AES_BLOCK_SIZE != 0 : total <= AES_BLOCK_SIZE) {
+        return TAES_PIPELINE_BAD_LENGTH;
+    }
+
+    int out_flags = fcntl(out_fd, F_GETFL);
+    int mapped_out = S_ISREG(out_st.st_mode) && out_flags >= 0 && (out_flags & O_ACCMODE) == O_RDWR &&
+                     !(out_flags & O_APPEND) && lseek(out_fd, 0, SEEK_CUR) == 0;
+    if (total == 0) {
+        return mapped_out ? ftruncate(out_fd, 0) : 0;
+    }
+
+    // The whole file (mappings start on a page), from in_off on
+    size_t map_length = (size_t)in_st.st_size;
+    int populate = total <= POPULATE_MAX ? MAP_POPULATE : 0;
+    uint8_t *map = mmap(NULL, map_length, PROT_READ, MAP_SHARED | populate, in_fd, 0);
+    if (map == MAP_FAILED) {
+        return to ? taes_transcrypt_pipeline(ctx, to, in_fd, out_fd, workers, 0)
+                  : taes_pipeline(ctx, flags, in_fd, out_fd, workers, 0);
+    }
+    madvise(map, map_length, MADV_SEQUENTIAL);
+
+    cipher c = {ctx, to, flags, NULL};
+    if (!(flags & TAES_PIPELINE_ECB)) {
+        c.pool = taes_pool_create(workers);
+        if (!c.pool) {
+            munmap(map, map_length);
+            errno = EAGAIN;
+            return -1;
+        }
+    }
+
+    int ret = mapped_out ? to_mapped_file(&c, map + in_off, total, out_fd)
+                         : to_stream(&c, map + in_off, total, out_fd);
+    int saved = errno;
+    taes_pool_destroy(c.pool);
+    munmap(map, map_length);
+
+    // Like read(), leave the input consumed
+    if (ret == 0) {
+        lseek(in_fd, 0, SEEK_END);
+    }
+    errno = saved;
+    return ret;
+}
+
+int taes_crypt_fd(const taes_ctx *ctx, int flags, int in_fd, int out_fd, int workers) {
+    return crypt_fd(ctx, NULL, flags, in_fd, out_fd, workers);
+}
+
+int taes_transcrypt_fd(const taes_ctx *from, const taes_ctx *to, int in_fd, int out_fd, int workers) {
+    if (!to) {
+        errno = EINVAL;
+        return -1;
+    }
+    return crypt_fd(from, to, 0, in_fd, out_fd, workers);
+}
@@ -0,0 +1,241 @@
+// Multi-buffer counter mode: independent jobs share the AES pipeline
+// Every lane holds one job. A pass runs the same number of blocks of every
+// lane through the backend's multi-buffer kernel (n = the fewest blocks any
+// lane has left in its current segment), then lanes whose segment ended move
+// on: to the next segment, or to completion, freeing the lane.
+//
+// A job is up to three segments, processed in order with the tweak offset of
+// each block set explicitly, which reproduces ctr_encrypt_cts() /
+// ctr_decrypt_cts() exactly:
+//   0: the whole blocks before the stolen pair (all of them if length is a
+//      multiple of 16)
+//   1: encrypt P[n-2] into lane->stolen / decrypt C[n-2] under tweak + n-1
+//      into lane->padded
+//   2: the block built from the partial block and the scratch, written to
+//      block n-2 of the output
+// The partial output block is copied from the scratch on completion.
+#include "../include/taes_mb.h"
+#include "../include/counter_mode.h"
+#include "taes_backend.h"
+#include <string.h>
+
+// Tweaked round key of block `index` of a context: RK + tweak + index.
+// Lanes only exist with the x86 kernels, so the 128-bit little-endian value
+// is added in two native 64-bit halves.
+static void lane_tweak_key(taes_mb_lane *lane, const taes_ctx *ctx, uint64_t index) {
+    uint64_t half[2];
+    memcpy(half, ctx->tweaked_round_key, sizeof(half));
+    half[0] += index;
+    half[1] += half[0] < index;
+    memcpy(lane->tweaked_key, half, sizeof(half));
+}
+
+// Point a lane at one segment of its job
+static void lane_segment(taes_mb_lane *lane, int segment, const uint8_t *in, uint8_t *out,
+                         uint64_t index, size_t blocks) {
+    lane->segment = segment;
+    lane->in = in;
+    lane->out = out;
+    lane->index = index;
+    lane->blocks = blocks;
+    lane_tweak_key(lane, lane->job->ctx, index);
+}
+
+// Move a lane whose segment is finished on to the next segment with blocks
+// left, or complete its job. Returns 1 if the job completed.
+static int lane_advance(taes_mb_mgr *mgr, int l) {
+    taes_mb_lane *lane = &mgr->lane[l];
+    taes_mb_job *job = lane->job;
+    size_t full_blocks = job->length / AES_BLOCK_SIZE;
+    size_t tail = job->length % AES_BLOCK_SIZE;
+    size_t last_full = full_blocks - 1;
+
+    while (lane->blocks == 0) {
+        if (tail == 0 || lane->segment == 2) {
+            // Done: the partial block is the head of the scratch block
+            if (tail) {
+                memcpy(job->out + full_blocks * AES_BLOCK_SIZE, job->decrypt ? lane->padded : lane->stolen, tail);
+                memset(lane->stolen, 0, sizeof(lane->stolen));
+                memset(lane->padded, 0, sizeof(lane->padded));
+            }
+            job->status = 0;
+            lane->job = NULL;
+            mgr->active--;
+            return 1;
+        }
+
+        const uint8_t *partial = job->in + full_blocks * AES_BLOCK_SIZE;
+        if (lane->segment == 0) {
+            if (job->decrypt) {
+                lane_segment(lane, 1, job->in + last_full * AES_BLOCK_SIZE, lane->padded, full_blocks, 1);
+            } else {
+                lane_segment(lane, 1, job->in + last_full * AES_BLOCK_SIZE, lane->stolen, last_full, 1);
+            }
+        } else if (job->decrypt) {
+            memcpy(lane->stolen, partial, tail);
+            memcpy(lane->stolen + tail, lane->padded + tail, AES_BLOCK_SIZE - tail);
+            lane_segment(lane, 2, lane->stolen, job->out + last_full * AES_BLOCK_SIZE, last_full, 1);
+        } else {
+            memcpy(lane->padded, partial, tail);
+            memcpy(lane->padded + tail, lane->stolen + tail, AES_BLOCK_SIZE - tail);
+            lane_segment(lane, 2, lane->padded, job->out + last_full * AES_BLOCK_SIZE, full_blocks, 1);
+        }
+    }
+    return 0;
+}
+
+// Put a job into a free lane
+static void lane_start(taes_mb_mgr *mgr, int l, taes_mb_job *job) {
+    const taes_mb_kernel *kernel = mgr->kernel;
+    taes_mb_lane *lane = &mgr->lane[l];
+    size_t full_blocks = job->length / AES_BLOCK_SIZE;
+    size_t bulk = job->length % AES_BLOCK_SIZE ? full_blocks - 1 : full_blocks;
+
+    kernel->load_keys(mgr, l, job->ctx, job->decrypt);
+    lane->job = job;
+    mgr->active++;
+    lane_segment(lane, 0, job->in, job->out, 0, bulk);
+    lane_advance(mgr, l);
+}
+
+// One pass over all lanes; returns the number of jobs completed
+static int run_pass(taes_mb_mgr *mgr) {
+    const taes_mb_kernel *kernel = mgr->kernel;
+    size_t n = SIZE_MAX;
+
+    for (int l = 0; l < mgr->lanes; l++) {
+        taes_mb_lane *lane = &mgr->lane[l];
+        if (lane->job) {
+            // Stop where the low half of a tweaked key wraps (the kernels
+            // step tweaked keys with 64-bit adds)
+            uint64_t lo;
+            memcpy(&lo, lane->tweaked_key, sizeof(lo));
+            if (lo != 0 && 0 - lo < n) {
+                n = (size_t)(0 - lo);
+            }
+            if (lane->blocks < n) {
+                n = lane->blocks;
+            }
+        }
+    }
+
+    // Free lanes compute into mgr->scratch
+    if (mgr->active < mgr->lanes && n > TAES_MB_SCRATCH_BLOCKS) {
+        n = TAES_MB_SCRATCH_BLOCKS;
+    }
+
+    if (mgr->decrypt) {
+        kernel->decrypt(mgr, n);
+    } else {
+        kernel->encrypt(mgr, n);
+    }
+
+    int completed = 0;
+    for (int l = 0; l < mgr->lanes; l++) {
+        taes_mb_lane *lane = &mgr->lane[l];
+        if (lane->job) {
+            lane->blocks -= n;
+            lane->index += n;
+            if (lane->blocks == 0) {
+                completed += lane_advance(mgr, l);
+            } else {
+                lane_tweak_key(lane, lane->job->ctx, lane->index);
+            }
+        }
+    }
+    return completed;
+}
+
+// Finish a lane's job on the single-stream kernels, which keep a whole
+// pipeline's worth of blocks of one stream in flight
+static void run_alone(taes_mb_mgr *mgr, int l) {
+    const taes_backend *backend = mgr->backend;
+    taes_mb_lane *lane = &mgr->lane[l];
+    taes_blocks_fn fn = mgr->decrypt ? backend->ctr_decrypt_blocks : backend->ctr_encrypt_blocks;
+
+    while (lane->job) {
+        fn(lane->job->ctx, lane->index, lane->in, lane->out, lane->blocks);
+        lane->blocks = 0;
+        lane_advance(mgr, l);
+    }
+}
+
+void taes_mb_init(taes_mb_mgr *mgr) {
+    const taes_backend *backend = taes_get_backend();
+
+    memset(mgr, 0, sizeof(*mgr));
+    mgr->backend = backend;
+    mgr->kernel = backend->mb_kernel ? backend->mb_kernel() : NULL;
+    mgr->lanes = mgr->kernel ? ((const taes_mb_kernel *)mgr->kernel)->lanes : 0;
+}
+
+int taes_mb_submit(taes_mb_mgr *mgr, taes_mb_job *job) {
+    if (!mgr || !job) {
+        return -1;
+    }
+
+    // Same requirements as counter_mode_encrypt()
+    if (!job->ctx || !job->in || !job->out || job->length <= AES_BLOCK_SIZE) {
+        job->status = -1;
+        return -1;
+    }
+
+    // No multi-buffer kernel: run the job right away
+    if (mgr->lanes == 0) {
+        const taes_backend *backend = mgr->backend;
+        job->status = job->decrypt
+            ? ctr_decrypt_cts(job->ctx, job->in, job->out, job->length, backend->ctr_decrypt_blocks)
+            : ctr_encrypt_cts(job->ctx, job->in, job->out, job->length, backend->ctr_encrypt_blocks);
+        return 0;
+    }
+
+    // The lanes run one direction and key size at a time
+    int decrypt = job->decrypt != 0;
+    if (mgr->active > 0 && (decrypt != mgr->decrypt || job->ctx->num_rounds != mgr->num_rounds)) {
+        taes_mb_flush(mgr);
+    }
+    mgr->decrypt = decrypt;
+    mgr->num_rounds = job->ctx->num_rounds;
+    mgr->tweak_round = job->ctx->tweak_round;
+
+    // All lanes busy: run passes until one is free
+    while (mgr->active == mgr->lanes) {
+        run_pass(mgr);
+    }
+
+    job->status = TAES_MB_PENDING;
+    for (int l = 0; l < mgr->lanes; l++) {
+        if (!mgr->lane[l].job) {
+            lane_start(mgr, l, job);
+            break;
+        }
+    }
+    return 0;
+}
+
+int taes_mb_flush(taes_mb_mgr *mgr) {
+    if (!mgr) {
+        return -1;
+    }
+
+    int completed = 0;
+    while (mgr->active > 0) {
+        // Nothing more is coming: once fewer than half of the lanes are
+        // busy, the rest of each job runs faster on its own
+        if (2 * mgr->active < mgr->lanes) {
+            for (int l = 0; l < mgr->lanes; l++) {
+                if (mgr->lane[l].job) {
+                    run_alone(mgr, l);
+                    completed++;
+                }
+            }
+            break;
+        }
+        completed += run_pass(mgr);
+    }
+
+    // Don't leave round keys (or blocks computed with them) behind
+    memset(mgr->keys, 0, sizeof(mgr->keys));
+    memset(mgr->scratch, 0, sizeof(mgr->scratch));
+    return completed;
+}
@@ -1,21 +1,186 @@
 // T-AES implementation using Intel AES-NI instructions
 #include "../include/taes.h"
+#include "../include/counter_mode.h"
+#include "taes_backend.h"
 #include <string.h>
 #include <wmmintrin.h>
 #include <emmintrin.h>
+#include <tmmintrin.h>
 
-// Initialize T-AES context (same as standard implementation)
-int taes_init_ni(taes_ctx *ctx, const uint8_t *key, int key_size, const uint8_t *tweak) {
-    if (!ctx || !key) {
-        return -1;
+// Blocks kept in flight by the counter-mode kernels. AESENC has a latency of
+// several cycles but can issue every cycle, so one block at a time leaves the
+// unit mostly idle; eight independent blocks cover the latency.
+#define NI_PARALLEL_BLOCKS 8
+
+// Apply one AES-NI round instruction with the same key to all eight blocks
+#define NI_ROUND8(op, key) do {                                    \
+        b0 = op(b0, key); b1 = op(b1, key); b2 = op(b2, key); b3 = op(b3, key); \
+        b4 = op(b4, key); b5 = op(b5, key); b6 = op(b6, key); b7 = op(b7, key); \
+    } while (0)
+
+// 128-bit arithmetic addition of two little-endian values
+static inline __m128i add128(__m128i a, __m128i b) {
+    __m128i sum = _mm_add_epi64(a, b);
+    // Carry out of each 64-bit lane: (a & b) | ((a | b) & ~sum), in bit 63
+    __m128i carry = _mm_or_si128(_mm_and_si128(a, b),
+                                 _mm_andnot_si128(sum, _mm_or_si128(a, b)));
+    carry = _mm_srli_epi64(carry, 63);
+    // Propagate the low lane's carry into the high lane (the top carry is dropped, mod 2^128)
+    return _mm_add_epi64(sum, _mm_slli_si128(carry, 8));
+}
+
+// Add a 64-bit offset to a 128-bit little-endian value
+static inline __m128i add128_u64(__m128i a, uint64_t n) {
+    return add128(a, _mm_set_epi64x(0, (long long)n));
+}
+
+// Key schedules expanded side by side by taes_init_many_ni(). Each
+// expansion step depends on the previous round key, so a single schedule
+// is a serial chain; interleaving independent keys hides that latency.
+#define NI_KEY_LANES 4
+
+// Loop over the lanes of an interleaved key expansion (fully unrolled)
+#define FOR_EACH_LANE(l) _Pragma("GCC unroll 4") for (int l = 0; l < lanes; l++)
+
+// AESKEYGENASSIST(x, rcon) rebuilt from PSHUFB + AESENCLAST.
+// AESKEYGENASSIST is microcoded on many cores (several ns per instruction
+// regardless of interleaving); AESENCLAST is fully pipelined. The shuffle
+// places the bytes so that AESENCLAST's ShiftRows lands them where
+// AESKEYGENASSIST's SubWord/RotWord would, then SubBytes and the Rcon XOR
+// produce the identical result.
+static inline __m128i keygen_assist_fast(__m128i x, int rcon) {
+    const __m128i shuffle = _mm_setr_epi8(4, 14, 14, 4, 5, 5, 15, 15, 12, 6, 6, 12, 13, 13, 7, 7);
+    return _mm_aesenclast_si128(_mm_shuffle_epi8(x, shuffle), _mm_setr_epi32(0, rcon, 0, rcon));
+}
+
+// Key-generation assist used by the expansion: the instruction itself, or
+// the pipelined equivalent for the interleaved batch path
+#define KEYGEN_ASSIST(x, rcon) \
+    (fast ? keygen_assist_fast(x, rcon) : _mm_aeskeygenassist_si128(x, rcon))
+
+// AES-128 expansion step: next round key from the previous one and its AESKEYGENASSIST output
+static inline __m128i expand128_step(__m128i key, __m128i assist) {
+    assist = _mm_shuffle_epi32(assist, _MM_SHUFFLE(3, 3, 3, 3));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    return _mm_xor_si128(key, assist);
+}
+
+// AES-192 expansion step: advances the 4-word (lo) and 2-word (hi) halves of the key window
+static inline void expand192_step(__m128i *lo, __m128i *hi, __m128i assist) {
+    assist = _mm_shuffle_epi32(assist, _MM_SHUFFLE(1, 1, 1, 1));
+    __m128i t = _mm_xor_si128(*lo, _mm_slli_si128(*lo, 4));
+    t = _mm_xor_si128(t, _mm_slli_si128(t, 8));
+    *lo = _mm_xor_si128(t, assist);
+    *hi = _mm_xor_si128(*hi, _mm_slli_si128(*hi, 4));
+    *hi = _mm_xor_si128(*hi, _mm_shuffle_epi32(*lo, _MM_SHUFFLE(3, 3, 3, 3)));
+}
+
+// High 64 bits of a followed by the low 64 bits of b
+static inline __m128i join_hi_lo64(__m128i a, __m128i b) {
+    return _mm_castpd_si128(_mm_shuffle_pd(_mm_castsi128_pd(a), _mm_castsi128_pd(b), 1));
+}
+
+// AES-256 expansion step for odd round keys (SubWord only, no RotWord/Rcon).
+// Even round keys use the AES-128 step on the previous odd key's assist.
+static inline __m128i expand256_odd(__m128i key, __m128i assist) {
+    assist = _mm_shuffle_epi32(assist, _MM_SHUFFLE(2, 2, 2, 2));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    return _mm_xor_si128(key, assist);
+}
+
+// Expand `lanes` AES-128 keys into rk[0..lanes-1], interleaving the schedules
+static inline __attribute__((always_inline))
+void expand_key128(__m128i *const rk[], const uint8_t *const keys[], const int lanes, const int fast) {
+    __m128i k[NI_KEY_LANES];
+    FOR_EACH_LANE(l) {
+        k[l] = _mm_loadu_si128((const __m128i *)keys[l]);
+        _mm_storeu_si128(&rk[l][0], k[l]);
+    }
+#define STEP128(i, rcon) FOR_EACH_LANE(l) {                                \
+        k[l] = expand128_step(k[l], KEYGEN_ASSIST(k[l], rcon));               \
+        _mm_storeu_si128(&rk[l][i], k[l]);                                  \
     }
+    STEP128(1, 0x01) STEP128(2, 0x02) STEP128(3, 0x04) STEP128(4, 0x08) STEP128(5, 0x10)
+    STEP128(6, 0x20) STEP128(7, 0x40) STEP128(8, 0x80) STEP128(9, 0x1b) STEP128(10, 0x36)
+#undef STEP128
+}
 
-    // Validate key size
-    if (key_size != 16 && key_size != 24 && key_size != 32) {
-        return -1;
+// Expand `lanes` AES-192 keys. Every step yields six words, so round keys
+// straddle steps and are stitched together from 64-bit halves.
+static inline __attribute__((always_inline))
+void expand_key192(__m128i *const rk[], const uint8_t *const keys[], const int lanes, const int fast) {
+    __m128i lo[NI_KEY_LANES], hi[NI_KEY_LANES], prev_hi[NI_KEY_LANES];
+    FOR_EACH_LANE(l) {
+        lo[l] = _mm_loadu_si128((const __m128i *)keys[l]);
+        hi[l] = _mm_loadl_epi64((const __m128i *)(keys[l] + 16));
+        _mm_storeu_si128(&rk[l][0], lo[l]);
+    }
+    // Odd steps emit words 4-5 of the previous window plus 0-3 of the new
+    // one as two round keys; even steps start on a round-key boundary.
+#define STEP192_A(i, rcon) FOR_EACH_LANE(l) {                               \
+        prev_hi[l] = hi[l];                                                  \
+        expand192_step(&lo[l], &hi[l], KEYGEN_ASSIST(hi[l], rcon));          \
+        _mm_storeu_si128(&rk[l][i], _mm_unpacklo_epi64(prev_hi[l], lo[l]));         \
+        _mm_storeu_si128(&rk[l][i + 1], join_hi_lo64(lo[l], hi[l]));           \
     }
+#define STEP192_B(i, rcon) FOR_EACH_LANE(l) {                               \
+        expand192_step(&lo[l], &hi[l], KEYGEN_ASSIST(hi[l], rcon));          \
+        _mm_storeu_si128(&rk[l][i], lo[l]);                                  \
+    }
+    STEP192_A(1, 0x01) STEP192_B(3, 0x02)
+    STEP192_A(4, 0x04) STEP192_B(6, 0x08)
+    STEP192_A(7, 0x10) STEP192_B(9, 0x20)
+    STEP192_A(10, 0x40) STEP192_B(12, 0x80)
+#undef STEP192_A
+#undef STEP192_B
+}
+
+// Expand `lanes` AES-256 keys, interleaving the schedules
+static inline __attribute__((always_inline))
+void expand_key256(__m128i *const rk[], const uint8_t *const keys[], const int lanes, const int fast) {
+    __m128i even[NI_KEY_LANES], odd[NI_KEY_LANES];
+    FOR_EACH_LANE(l) {
+        even[l] = _mm_loadu_si128((const __m128i *)keys[l]);
+        odd[l] = _mm_loadu_si128((const __m128i *)(keys[l] + 16));
+        _mm_storeu_si128(&rk[l][0], even[l]);
+        _mm_storeu_si128(&rk[l][1], odd[l]);
+    }
+#define STEP256(i, rcon) FOR_EACH_LANE(l) {                                      \
+        even[l] = expand128_step(even[l], KEYGEN_ASSIST(odd[l], rcon));         \
+        _mm_storeu_si128(&rk[l][i], even[l]);                                    \
+    }                                                                            \
+    if ((i) < 14) FOR_EACH_LANE(l) {                                             \
+        odd[l] = expand256_odd(odd[l], KEYGEN_ASSIST(even[l], 0x00));          \
+        _mm_storeu_si128(&rk[l][(i) + 1], odd[l]);                               \
+    }
+    STEP256(2, 0x01) STEP256(4, 0x02) STEP256(6, 0x04) STEP256(8, 0x08)
+    STEP256(10, 0x10) STEP256(12, 0x20) STEP256(14, 0x40)
+#undef STEP256
+}
+
+// Expand `lanes` keys of the same size into the given contexts
+static inline __attribute__((always_inline))
+void expand_keys(taes_ctx *const ctxs[], const uint8_t *const keys[], int key_size,
+                 const int lanes, const int fast) {
+    __m128i *rk[NI_KEY_LANES];
+    FOR_EACH_LANE(l) {
+        rk[l] = (__m128i *)ctxs[l]->round_keys;
+    }
+    switch (key_size) {
+        case 16: expand_key128(rk, keys, lanes, fast); break;
+        case 24: expand_key192(rk, keys, lanes, fast); break;
+        case 32: expand_key256(rk, keys, lanes, fast); break;
+    }
+}
 
+// Set key size parameters (rounds and tweak round) for a context
+static void set_key_params(taes_ctx *ctx, int key_size) {
     ctx->key_size = key_size;
+    ctx->has_dec_round_keys = 0;
 
     // Set number of rounds based on key size
     switch (key_size) {
@@ -23,34 +188,688 @@ int taes_init_ni(taes_ctx *ctx, const uint8_t *key, int key_size, const uint8_t
         case 24: ctx->num_rounds = 12; ctx->tweak_round = 6; break;
         case 32: ctx->num_rounds = 14; ctx->tweak_round = 7; break;
     }
+}
 
-    // TODO: Perform key expansion using AES-NI key generation assist
-
-    // Store tweak
+// Store the tweak and precompute RK[tweak_round] + tweak
+static void set_tweak_ni(taes_ctx *ctx, const uint8_t *tweak) {
     if (tweak) {
         memcpy(ctx->tweak, tweak, TWEAK_SIZE);
     } else {
         memset(ctx->tweak, 0, TWEAK_SIZE);
     }
+    __m128i rk = _mm_loadu_si128((const __m128i *)&ctx->round_keys[ctx->tweak_round * 16]);
+    __m128i tk = add128(rk, _mm_loadu_si128((const __m128i *)ctx->tweak));
+    _mm_storeu_si128((__m128i *)ctx->tweaked_round_key, tk);
+}
+
+// Initialize T-AES context using AESKEYGENASSIST key expansion
+int taes_init_ni(taes_ctx *ctx, const uint8_t *key, int key_size, const uint8_t *tweak) {
+    if (!ctx || !key) {
+        return -1;
+    }
+
+    // Validate key size
+    if (key_size != 16 && key_size != 24 && key_size != 32) {
+        return -1;
+    }
+
+    set_key_params(ctx, key_size);
+    expand_keys(&ctx, &key, key_size, 1, 0);
+    set_tweak_ni(ctx, tweak);
 
     return 0;
 }
 
+// Initialize n contexts at once, NI_KEY_LANES key schedules interleaved
+// tweaks: NULL for all-zero tweaks, otherwise one tweak per context
+int taes_init_many_ni(taes_ctx *const ctxs[], const uint8_t *const keys[], int key_size,
+                      const uint8_t *const tweaks[], size_t n) {
+    if (!ctxs || !keys) {
+        return -1;
+    }
+
+    // Validate key size
+    if (key_size != 16 && key_size != 24 && key_size != 32) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        if (!ctxs[i] || !keys[i]) {
+            return -1;
+        }
+        set_key_params(ctxs[i], key_size);
+    }
+
+    size_t i = 0;
+    for (; i + NI_KEY_LANES <= n; i += NI_KEY_LANES) {
+        expand_keys(ctxs + i, keys + i, key_size, NI_KEY_LANES, 1);
+    }
+    for (; i < n; i++) {
+        expand_keys(ctxs + i, keys + i, key_size, 1, 1);
+    }
+
+    for (i = 0; i < n; i++) {
+        set_tweak_ni(ctxs[i], tweaks ? tweaks[i] : NULL);
+    }
+
+    return 0;
+}
+
+// Precompute the equivalent inverse cipher schedule: InvMixColumns of every
+// middle round key, done once instead of on every decryption call. The tweak
+// round's entry is untweaked; the tweak is added before InvMixColumns, so the
+// tweaked key is transformed per block (one _mm_aesimc_si128()).
+static void prepare_dec_round_keys(taes_ctx *ctx) {
+    const __m128i *rk = (const __m128i *)ctx->round_keys;
+    __m128i *dk = (__m128i *)ctx->dec_round_keys;
+
+    _mm_storeu_si128(&dk[0], _mm_loadu_si128(&rk[0]));
+    for (int round = 1; round < ctx->num_rounds; round++) {
+        _mm_storeu_si128(&dk[round], _mm_aesimc_si128(_mm_loadu_si128(&rk[round])));
+    }
+    _mm_storeu_si128(&dk[ctx->num_rounds], _mm_loadu_si128(&rk[ctx->num_rounds]));
+    ctx->has_dec_round_keys = 1;
+}
+
+// Initialize a decryption context: taes_init_ni() plus the precomputed
+// InvMixColumns schedule. The context can still be used for encryption.
+int taes_init_decrypt_ni(taes_ctx *ctx, const uint8_t *key, int key_size, const uint8_t *tweak) {
+    if (taes_init_ni(ctx, key, key_size, tweak) != 0) {
+        return -1;
+    }
+
+    prepare_dec_round_keys(ctx);
+    return 0;
+}
+
+// Load the InvMixColumns schedule: the precomputed one of a decryption
+// context, otherwise derived into dk_buf
+static inline const __m128i *load_dec_round_keys(const taes_ctx *ctx, __m128i dk_buf[15]) {
+    if (ctx->has_dec_round_keys) {
+        return (const __m128i *)ctx->dec_round_keys;
+    }
+
+    const __m128i *rk = (const __m128i *)ctx->round_keys;
+    for (int round = 1; round < ctx->num_rounds; round++) {
+        dk_buf[round] = _mm_aesimc_si128(_mm_loadu_si128(&rk[round]));
+    }
+    return dk_buf;
+}
+
+// Tweaked round keys tk + 0..7 of one batch. The low 64 bits almost never
+// wrap inside a batch, so the carry-propagating add128() is only needed then.
+static inline void batch_tweak_keys(__m128i tk, __m128i keys[NI_PARALLEL_BLOCKS]) {
+    if ((uint64_t)_mm_cvtsi128_si64(tk) <= UINT64_MAX - (NI_PARALLEL_BLOCKS - 1)) {
+        for (int j = 0; j < NI_PARALLEL_BLOCKS; j++) {
+            keys[j] = _mm_add_epi64(tk, _mm_set_epi64x(0, j));
+        }
+    } else {
+        for (int j = 0; j < NI_PARALLEL_BLOCKS; j++) {
+            keys[j] = add128_u64(tk, (uint64_t)j);
+        }
+    }
+}
+
+// Encrypt a single block for one key size (nr, tr constant: fully unrolled)
+static inline __attribute__((always_inline))
+void encrypt_block_rounds_ni(const taes_ctx *ctx, const uint8_t *plaintext, uint8_t *ciphertext,
+                             const int nr, const int tr) {
+    const __m128i *rk = (const __m128i *)ctx->round_keys;
+    __m128i state = _mm_xor_si128(_mm_loadu_si128((const __m128i *)plaintext),
+                                  _mm_loadu_si128(&rk[0]));
+
+    TAES_UNROLL
+    for (int round = 1; round < nr; round++) {
+        __m128i key = (round == tr)
+                          ? _mm_loadu_si128((const __m128i *)ctx->tweaked_round_key)
+                          : _mm_loadu_si128(&rk[round]);
+        state = _mm_aesenc_si128(state, key);
+    }
+
+    state = _mm_aesenclast_si128(state, _mm_loadu_si128(&rk[nr]));
+    _mm_storeu_si128((__m128i *)ciphertext, state);
+}
+
+// Decrypt a single block for one key size (equivalent inverse cipher)
+// The tweak is added to the round key before _mm_aesimc_si128(), as in encryption
+static inline __attribute__((always_inline))
+void decrypt_block_rounds_ni(const taes_ctx *ctx, const uint8_t *ciphertext, uint8_t *plaintext,
+                             const int nr, const int tr) {
+    const __m128i *rk = (const __m128i *)ctx->round_keys;
+    __m128i dk_buf[15];
+    const __m128i *dk = load_dec_round_keys(ctx, dk_buf);
+    __m128i state = _mm_xor_si128(_mm_loadu_si128((const __m128i *)ciphertext),
+                                  _mm_loadu_si128(&rk[nr]));
+
+    TAES_UNROLL
+    for (int round = nr - 1; round >= 1; round--) {
+        __m128i key = (round == tr)
+                          ? _mm_aesimc_si128(_mm_loadu_si128((const __m128i *)ctx->tweaked_round_key))
+                          : _mm_loadu_si128(&dk[round]);
+        state = _mm_aesdec_si128(state, key);
+    }
+
+    state = _mm_aesdeclast_si128(state, _mm_loadu_si128(&rk[0]));
+    _mm_storeu_si128((__m128i *)plaintext, state);
+}
+
 // Encrypt a single block using AES-NI
 void taes_encrypt_block_ni(const taes_ctx *ctx, const uint8_t *plaintext, uint8_t *ciphertext) {
-    // TODO: Implement T-AES encryption using AES-NI intrinsics
-    // Use _mm_aesenc_si128() for encryption rounds
-    // Use _mm_aesenclast_si128() for final round
-    // Apply tweak modification at the appropriate round using arithmetic addition
+    switch (ctx->num_rounds) {
+        case 10: encrypt_block_rounds_ni(ctx, plaintext, ciphertext, 10, 5); break;
+        case 12: encrypt_block_rounds_ni(ctx, plaintext, ciphertext, 12, 6); break;
+        default: encrypt_block_rounds_ni(ctx, plaintext, ciphertext, 14, 7); break;
+    }
 }
 
 // Decrypt a single block using AES-NI
 void taes_decrypt_block_ni(const taes_ctx *ctx, const uint8_t *ciphertext, uint8_t *plaintext) {
-    // TODO: Implement T-AES decryption using AES-NI intrinsics
-    // Use _mm_aesdec_si128() for decryption rounds
-    // Use _mm_aesdeclast_si128() for final round
-    // Use _mm_aesimc_si128() for inverse MixColumns
-    // Apply tweak modification at the appropriate round using arithmetic subtraction
+    switch (ctx->num_rounds) {
+        case 10: decrypt_block_rounds_ni(ctx, ciphertext, plaintext, 10, 5); break;
+        case 12: decrypt_block_rounds_ni(ctx, ciphertext, plaintext, 12, 6); break;
+        default: decrypt_block_rounds_ni(ctx, ciphertext, plaintext, 14, 7); break;
+    }
+}
+
+// Encrypt eight blocks, block j using the tweaked round key tks[j]
+static inline __attribute__((always_inline))
+void encrypt8_ni(const uint8_t *in, uint8_t *out, const __m128i *rk,
+                 const __m128i tks[NI_PARALLEL_BLOCKS], int nr, int tr) {
+    const __m128i *src = (const __m128i *)in;
+    __m128i *dst = (__m128i *)out;
+    __m128i rk0 = _mm_loadu_si128(&rk[0]);
+
+    __m128i b0 = _mm_xor_si128(_mm_loadu_si128(src + 0), rk0);
+    __m128i b1 = _mm_xor_si128(_mm_loadu_si128(src + 1), rk0);
+    __m128i b2 = _mm_xor_si128(_mm_loadu_si128(src + 2), rk0);
+    __m128i b3 = _mm_xor_si128(_mm_loadu_si128(src + 3), rk0);
+    __m128i b4 = _mm_xor_si128(_mm_loadu_si128(src + 4), rk0);
+    __m128i b5 = _mm_xor_si128(_mm_loadu_si128(src + 5), rk0);
+    __m128i b6 = _mm_xor_si128(_mm_loadu_si128(src + 6), rk0);
+    __m128i b7 = _mm_xor_si128(_mm_loadu_si128(src + 7), rk0);
+
+    TAES_UNROLL
+    for (int round = 1; round < tr; round++) {
+        __m128i key = _mm_loadu_si128(&rk[round]);
+        NI_ROUND8(_mm_aesenc_si128, key);
+    }
+
+    b0 = _mm_aesenc_si128(b0, tks[0]);
+    b1 = _mm_aesenc_si128(b1, tks[1]);
+    b2 = _mm_aesenc_si128(b2, tks[2]);
+    b3 = _mm_aesenc_si128(b3, tks[3]);
+    b4 = _mm_aesenc_si128(b4, tks[4]);
+    b5 = _mm_aesenc_si128(b5, tks[5]);
+    b6 = _mm_aesenc_si128(b6, tks[6]);
+    b7 = _mm_aesenc_si128(b7, tks[7]);
+
+    TAES_UNROLL
+    for (int round = tr + 1; round < nr; round++) {
+        __m128i key = _mm_loadu_si128(&rk[round]);
+        NI_ROUND8(_mm_aesenc_si128, key);
+    }
+    __m128i rk_last = _mm_loadu_si128(&rk[nr]);
+    NI_ROUND8(_mm_aesenclast_si128, rk_last);
+
+    _mm_storeu_si128(dst + 0, b0);
+    _mm_storeu_si128(dst + 1, b1);
+    _mm_storeu_si128(dst + 2, b2);
+    _mm_storeu_si128(dst + 3, b3);
+    _mm_storeu_si128(dst + 4, b4);
+    _mm_storeu_si128(dst + 5, b5);
+    _mm_storeu_si128(dst + 6, b6);
+    _mm_storeu_si128(dst + 7, b7);
+}
+
+// Encrypt nblocks consecutive blocks for one key size, block j using
+// tweak + first + j
+static inline __attribute__((always_inline))
+void ctr_encrypt_blocks_rounds_ni(const taes_ctx *ctx, uint64_t first, const uint8_t *in,
+                                  uint8_t *out, size_t nblocks, const int nr, const int tr) {
+    const __m128i *rk = (const __m128i *)ctx->round_keys;
+    __m128i rk0 = _mm_loadu_si128(&rk[0]);
+    __m128i rk_last = _mm_loadu_si128(&rk[nr]);
+
+    // Tweaked round key of the next block: (RK + tweak) + first
+    __m128i tk = add128_u64(_mm_loadu_si128((const __m128i *)ctx->tweaked_round_key), first);
+
+    size_t i = 0;
+    for (; i + NI_PARALLEL_BLOCKS <= nblocks; i += NI_PARALLEL_BLOCKS) {
+        // Tweak round: each block has its own key, tk + j
+        __m128i tks[NI_PARALLEL_BLOCKS];
+        batch_tweak_keys(tk, tks);
+        tk = add128_u64(tk, NI_PARALLEL_BLOCKS);
+        encrypt8_ni(in + i * AES_BLOCK_SIZE, out + i * AES_BLOCK_SIZE, rk, tks, nr, tr);
+    }
+
+    // Remaining blocks one at a time
+    for (; i < nblocks; i++) {
+        __m128i state = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(in + i * AES_BLOCK_SIZE)), rk0);
+        TAES_UNROLL
+        for (int round = 1; round < nr; round++) {
+            state = _mm_aesenc_si128(state, round == tr ? tk : _mm_loadu_si128(&rk[round]));
+        }
+        state = _mm_aesenclast_si128(state, rk_last);
+        _mm_storeu_si128((__m128i *)(out + i * AES_BLOCK_SIZE), state);
+        tk = add128_u64(tk, 1);
+    }
+}
+
+// Encrypt nblocks consecutive blocks, block j using tweak + first + j
+// (also used by taes_vaes.c for the blocks that don't fill a vector batch)
+void ctr_encrypt_blocks_ni(const taes_ctx *ctx, uint64_t first, const uint8_t *in,
+                           uint8_t *out, size_t nblocks) {
+    switch (ctx->num_rounds) {
+        case 10: ctr_encrypt_blocks_rounds_ni(ctx, first, in, out, nblocks, 10, 5); break;
+        case 12: ctr_encrypt_blocks_rounds_ni(ctx, first, in, out, nblocks, 12, 6); break;
+        default: ctr_encrypt_blocks_rounds_ni(ctx, first, in, out, nblocks, 14, 7); break;
+    }
+}
+
+// Decrypt eight blocks with the equivalent inverse cipher, block j using the
+// InvMixColumns-transformed tweaked round key tks[j]
+static inline __attribute__((always_inline))
+void decrypt8_ni(const uint8_t *in, uint8_t *out, const __m128i *dk, __m128i rk0, __m128i rk_last,
+                 const __m128i tks[NI_PARALLEL_BLOCKS], int nr, int tr) {
+    const __m128i *src = (const __m128i *)in;
+    __m128i *dst = (__m128i *)out;
+
+    __m128i b0 = _mm_xor_si128(_mm_loadu_si128(src + 0), rk_last);
+    __m128i b1 = _mm_xor_si128(_mm_loadu_si128(src + 1), rk_last);
+    __m128i b2 = _mm_xor_si128(_mm_loadu_si128(src + 2), rk_last);
+    __m128i b3 = _mm_xor_si128(_mm_loadu_si128(src + 3), rk_last);
+    __m128i b4 = _mm_xor_si128(_mm_loadu_si128(src + 4), rk_last);
+    __m128i b5 = _mm_xor_si128(_mm_loadu_si128(src + 5), rk_last);
+    __m128i b6 = _mm_xor_si128(_mm_loadu_si128(src + 6), rk_last);
+    __m128i b7 = _mm_xor_si128(_mm_loadu_si128(src + 7), rk_last);
+
+    TAES_UNROLL
+    for (int round = nr - 1; round > tr; round--) {
+        __m128i key = _mm_loadu_si128(&dk[round]);
+        NI_ROUND8(_mm_aesdec_si128, key);
+    }
+
+    b0 = _mm_aesdec_si128(b0, tks[0]);
+    b1 = _mm_aesdec_si128(b1, tks[1]);
+    b2 = _mm_aesdec_si128(b2, tks[2]);
+    b3 = _mm_aesdec_si128(b3, tks[3]);
+    b4 = _mm_aesdec_si128(b4, tks[4]);
+    b5 = _mm_aesdec_si128(b5, tks[5]);
+    b6 = _mm_aesdec_si128(b6, tks[6]);
+    b7 = _mm_aesdec_si128(b7, tks[7]);
+
+    TAES_UNROLL
+    for (int round = tr - 1; round >= 1; round--) {
+        __m128i key = _mm_loadu_si128(&dk[round]);
+        NI_ROUND8(_mm_aesdec_si128, key);
+    }
+    NI_ROUND8(_mm_aesdeclast_si128, rk0);
+
+    _mm_storeu_si128(dst + 0, b0);
+    _mm_storeu_si128(dst + 1, b1);
+    _mm_storeu_si128(dst + 2, b2);
+    _mm_storeu_si128(dst + 3, b3);
+    _mm_storeu_si128(dst + 4, b4);
+    _mm_storeu_si128(dst + 5, b5);
+    _mm_storeu_si128(dst + 6, b6);
+    _mm_storeu_si128(dst + 7, b7);
+}
+
+// Decrypt fewer than eight blocks as one batch through a stack buffer, so
+// they still run side by side instead of one latency chain after another
+static inline __attribute__((always_inline))
+void decrypt_partial_ni(const uint8_t *in, uint8_t *out, size_t nblocks, const __m128i *dk,
+                               __m128i rk0, __m128i rk_last, __m128i tk, int nr, int tr) {
+    uint8_t buf[NI_PARALLEL_BLOCKS * AES_BLOCK_SIZE] = {0};
+    __m128i tks[NI_PARALLEL_BLOCKS];
+
+    for (int j = 0; j < NI_PARALLEL_BLOCKS; j++) {
+        tks[j] = _mm_aesimc_si128(add128_u64(tk, (uint64_t)j));
+    }
+    memcpy(buf, in, nblocks * AES_BLOCK_SIZE);
+    decrypt8_ni(buf, buf, dk, rk0, rk_last, tks, nr, tr);
+    memcpy(out, buf, nblocks * AES_BLOCK_SIZE);
+    memset(buf, 0, sizeof(buf));
+}
+
+// Decrypt nblocks consecutive blocks, block j using tweak + first + j
+//
+// The tweak is added to the round key before InvMixColumns, so the tweak
+// round's key must be transformed per block, and an AESIMC costs about two
+// AESDECs. Full batches are therefore aligned so that their first tweaked
+// key tk is a multiple of 8: then tk + j == tk ^ j for j < 8, and since
+// InvMixColumns is linear over XOR, imc(tk + j) = imc(tk) ^ imc(j). The
+// imc(j) are constants, leaving one AESIMC per batch of eight blocks.
+static inline __attribute__((always_inline))
+void ctr_decrypt_blocks_rounds_ni(const taes_ctx *ctx, uint64_t first, const uint8_t *in,
+                                  uint8_t *out, size_t nblocks, const int nr, const int tr) {
+    const __m128i *rk = (const __m128i *)ctx->round_keys;
+    __m128i rk0 = _mm_loadu_si128(&rk[0]);
+    __m128i rk_last = _mm_loadu_si128(&rk[nr]);
+
+    // InvMixColumns-transformed keys for every untweaked middle round
+    __m128i dk_buf[15];
+    const __m128i *dk = load_dec_round_keys(ctx, dk_buf);
+
+    __m128i tk = add128_u64(_mm_loadu_si128((const __m128i *)ctx->tweaked_round_key), first);
+
+    // Blocks before tk reaches a multiple of 8
+    size_t head = (size_t)(-(uint32_t)_mm_cvtsi128_si32(tk) & (NI_PARALLEL_BLOCKS - 1));
+    if (head > nblocks) {
+        head = nblocks;
+    }
+    if (head > 0) {
+        decrypt_partial_ni(in, out, head, dk, rk0, rk_last, tk, nr, tr);
+        tk = add128_u64(tk, head);
+    }
+
+    // imc(j) for the in-batch offsets
+    __m128i imc_offset[NI_PARALLEL_BLOCKS];
+    for (int j = 0; j < NI_PARALLEL_BLOCKS; j++) {
+        imc_offset[j] = _mm_aesimc_si128(_mm_cvtsi32_si128(j));
+    }
+
+    size_t i = head;
+    for (; i + NI_PARALLEL_BLOCKS <= nblocks; i += NI_PARALLEL_BLOCKS) {
+        __m128i tks[NI_PARALLEL_BLOCKS];
+        __m128i tk_imc = _mm_aesimc_si128(tk);
+        for (int j = 0; j < NI_PARALLEL_BLOCKS; j++) {
+            tks[j] = _mm_xor_si128(tk_imc, imc_offset[j]);
+        }
+        tk = add128_u64(tk, NI_PARALLEL_BLOCKS);
+
+        decrypt8_ni(in + i * AES_BLOCK_SIZE, out + i * AES_BLOCK_SIZE, dk, rk0, rk_last, tks, nr, tr);
+    }
+
+    if (i < nblocks) {
+        decrypt_partial_ni(in + i * AES_BLOCK_SIZE, out + i * AES_BLOCK_SIZE, nblocks - i,
+                           dk, rk0, rk_last, tk, nr, tr);
+    }
+}
+
+// Decrypt nblocks consecutive blocks, block j using tweak + first + j
+void ctr_decrypt_blocks_ni(const taes_ctx *ctx, uint64_t first, const uint8_t *in,
+                           uint8_t *out, size_t nblocks) {
+    switch (ctx->num_rounds) {
+        case 10: ctr_decrypt_blocks_rounds_ni(ctx, first, in, out, nblocks, 10, 5); break;
+        case 12: ctr_decrypt_blocks_rounds_ni(ctx, first, in, out, nblocks, 12, 6); break;
+        default: ctr_decrypt_blocks_rounds_ni(ctx, first, in, out, nblocks, 14, 7); break;
+    }
+}
+
+// Tweaked round keys RK + tweaks[j] of a batch of n <= 8 blocks; slots past
+// n get the untweaked key (their blocks are padding)
+static inline void tweak_array_keys(__m128i rk_tr, const uint8_t *tweaks, size_t n,
+                                    __m128i keys[NI_PARALLEL_BLOCKS]) {
+    for (size_t j = 0; j < NI_PARALLEL_BLOCKS; j++) {
+        keys[j] = j < n ? add128(rk_tr, _mm_loadu_si128((const __m128i *)(tweaks + j * TWEAK_SIZE))) : rk_tr;
+    }
+}
+
+// Blocks with a tweak each, eight in flight as in counter mode; a short last
+// batch goes through a stack buffer
+static inline __attribute__((always_inline))
+void encrypt_blocks_rounds_ni(const taes_ctx *ctx, const uint8_t *in, uint8_t *out,
+                              const uint8_t *tweaks, size_t nblocks, const int nr, const int tr) {
+    const __m128i *rk = (const __m128i *)ctx->round_keys;
+    __m128i rk_tr = _mm_loadu_si128(&rk[tr]);
+    __m128i tks[NI_PARALLEL_BLOCKS];
+
+    size_t i = 0;
+    for (; i + NI_PARALLEL_BLOCKS <= nblocks; i += NI_PARALLEL_BLOCKS) {
+        tweak_array_keys(rk_tr, tweaks + i * TWEAK_SIZE, NI_PARALLEL_BLOCKS, tks);
+        encrypt8_ni(in + i * AES_BLOCK_SIZE, out + i * AES_BLOCK_SIZE, rk, tks, nr, tr);
+    }
+
+    if (i < nblocks) {
+        uint8_t buf[NI_PARALLEL_BLOCKS * AES_BLOCK_SIZE] = {0};
+        size_t n = nblocks - i;
+        tweak_array_keys(rk_tr, tweaks + i * TWEAK_SIZE, n, tks);
+        memcpy(buf, in + i * AES_BLOCK_SIZE, n * AES_BLOCK_SIZE);
+        encrypt8_ni(buf, buf, rk, tks, nr, tr);
+        memcpy(out + i * AES_BLOCK_SIZE, buf, n * AES_BLOCK_SIZE);
+        memset(buf, 0, sizeof(buf));
+    }
+}
+
+// Unlike counter mode, unrelated tweaks leave no shortcut for the
+// InvMixColumns of the tweaked keys: one AESIMC per block
+static inline __attribute__((always_inline))
+void decrypt_blocks_rounds_ni(const taes_ctx *ctx, const uint8_t *in, uint8_t *out,
+                              const uint8_t *tweaks, size_t nblocks, const int nr, const int tr) {
+    const __m128i *rk = (const __m128i *)ctx->round_keys;
+    __m128i rk0 = _mm_loadu_si128(&rk[0]);
+    __m128i rk_last = _mm_loadu_si128(&rk[nr]);
+    __m128i rk_tr = _mm_loadu_si128(&rk[tr]);
+    __m128i dk_buf[15];
+    const __m128i *dk = load_dec_round_keys(ctx, dk_buf);
+    __m128i tks[NI_PARALLEL_BLOCKS];
+
+    size_t i = 0;
+    for (; i + NI_PARALLEL_BLOCKS <= nblocks; i += NI_PARALLEL_BLOCKS) {
+        tweak_array_keys(rk_tr, tweaks + i * TWEAK_SIZE, NI_PARALLEL_BLOCKS, tks);
+        for (int j = 0; j < NI_PARALLEL_BLOCKS; j++) {
+            tks[j] = _mm_aesimc_si128(tks[j]);
+        }
+        decrypt8_ni(in + i * AES_BLOCK_SIZE, out + i * AES_BLOCK_SIZE, dk, rk0, rk_last, tks, nr, tr);
+    }
+
+    if (i < nblocks) {
+        uint8_t buf[NI_PARALLEL_BLOCKS * AES_BLOCK_SIZE] = {0};
+        size_t n = nblocks - i;
+        tweak_array_keys(rk_tr, tweaks + i * TWEAK_SIZE, n, tks);
+        for (int j = 0; j < NI_PARALLEL_BLOCKS; j++) {
+            tks[j] = _mm_aesimc_si128(tks[j]);
+        }
+        memcpy(buf, in + i * AES_BLOCK_SIZE, n * AES_BLOCK_SIZE);
+        decrypt8_ni(buf, buf, dk, rk0, rk_last, tks, nr, tr);
+        memcpy(out + i * AES_BLOCK_SIZE, buf, n * AES_BLOCK_SIZE);
+        memset(buf, 0, sizeof(buf));
+    }
+}
+
+// Encrypt nblocks blocks, block i with tweak tweaks[i] (16 bytes each)
+// (also used by taes_vaes.c for the blocks that don't fill a vector batch)
+void taes_encrypt_blocks_ni(const taes_ctx *ctx, const uint8_t *plaintext, uint8_t *ciphertext,
+                            const uint8_t *tweaks, size_t nblocks) {
+    switch (ctx->num_rounds) {
+        case 10: encrypt_blocks_rounds_ni(ctx, plaintext, ciphertext, tweaks, nblocks, 10, 5); break;
+        case 12: encrypt_blocks_rounds_ni(ctx, plaintext, ciphertext, tweaks, nblocks, 12, 6); break;
+        default: encrypt_blocks_rounds_ni(ctx, plaintext, ciphertext, tweaks, nblocks, 14, 7); break;
+    }
+}
+
+// Decrypt nblocks blocks, block i with tweak tweaks[i]
+void taes_decrypt_blocks_ni(const taes_ctx *ctx, const uint8_t *ciphertext, uint8_t *plaintext,
+                            const uint8_t *tweaks, size_t nblocks) {
+    switch (ctx->num_rounds) {
+        case 10: decrypt_blocks_rounds_ni(ctx, ciphertext, plaintext, tweaks, nblocks, 10, 5); break;
+        case 12: decrypt_blocks_rounds_ni(ctx, ciphertext, plaintext, tweaks, nblocks, 12, 6); break;
+        default: decrypt_blocks_rounds_ni(ctx, ciphertext, plaintext, tweaks, nblocks, 14, 7); break;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Multi-buffer kernels: one block of each of eight streams in flight
+// ---------------------------------------------------------------------------
+
+#define MB_NI_LANES 8
+
+// Round key r of lane l, as loaded by mb_load_keys_ni()
+#define MB_KEY(r, l) _mm_load_si128((const __m128i *)mgr->keys[r][l])
+
+// Copy a context's round keys into lane l of mgr->keys. For decryption the
+// middle rounds get the InvMixColumns schedule (derived if the context has
+// none), as in ctr_decrypt_blocks_ni().
+void mb_load_keys_ni(taes_mb_mgr *mgr, int lane, const taes_ctx *ctx, int decrypt) {
+    const __m128i *rk = (const __m128i *)ctx->round_keys;
+    const int nr = ctx->num_rounds;
+
+    if (!decrypt) {
+        for (int round = 0; round <= nr; round++) {
+            _mm_store_si128((__m128i *)mgr->keys[round][lane], _mm_loadu_si128(&rk[round]));
+        }
+        return;
+    }
+
+    __m128i dk_buf[15];
+    const __m128i *dk = load_dec_round_keys(ctx, dk_buf);
+    _mm_store_si128((__m128i *)mgr->keys[0][lane], _mm_loadu_si128(&rk[0]));
+    for (int round = 1; round < nr; round++) {
+        _mm_store_si128((__m128i *)mgr->keys[round][lane], _mm_loadu_si128(&dk[round]));
+    }
+    _mm_store_si128((__m128i *)mgr->keys[nr][lane], _mm_loadu_si128(&rk[nr]));
+}
+
+// Block pointers of the lanes for one kernel call. Free lanes read and write
+// mgr->scratch (passes are short while any lane is free), so the kernel needs
+// no per-lane branches.
+static inline void mb_lane_pointers(taes_mb_mgr *mgr, int lanes, const uint8_t **src, uint8_t **dst) {
+    for (int l = 0; l < lanes; l++) {
+        taes_mb_lane *lane = &mgr->lane[l];
+        src[l] = lane->job ? lane->in : mgr->scratch;
+        dst[l] = lane->job ? lane->out : mgr->scratch;
+    }
+}
+
+// Advance the busy lanes' pointers past nblocks blocks
+static inline void mb_lanes_done(taes_mb_mgr *mgr, int lanes, size_t nblocks) {
+    for (int l = 0; l < lanes; l++) {
+        taes_mb_lane *lane = &mgr->lane[l];
+        if (lane->job) {
+            lane->in += nblocks * AES_BLOCK_SIZE;
+            lane->out += nblocks * AES_BLOCK_SIZE;
+        }
+    }
+}
+
+// Loop over the eight lanes (fully unrolled)
+#define FOR_EACH_MB_LANE(l) _Pragma("GCC unroll 8") for (int l = 0; l < MB_NI_LANES; l++)
+
+static inline __attribute__((always_inline))
+void mb_encrypt_rounds_ni(taes_mb_mgr *mgr, size_t nblocks, const int nr, const int tr) {
+    const uint8_t *src[MB_NI_LANES];
+    uint8_t *dst[MB_NI_LANES];
+    __m128i tk[MB_NI_LANES];
+    const __m128i one = _mm_set_epi64x(0, 1);
+
+    mb_lane_pointers(mgr, MB_NI_LANES, src, dst);
+    FOR_EACH_MB_LANE(l) tk[l] = _mm_load_si128((const __m128i *)mgr->lane[l].tweaked_key);
+
+    for (size_t i = 0; i < nblocks; i++) {
+        __m128i b[MB_NI_LANES];
+
+        FOR_EACH_MB_LANE(l) {
+            b[l] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(src[l] + i * AES_BLOCK_SIZE)), MB_KEY(0, l));
+        }
+        TAES_UNROLL
+        for (int round = 1; round < tr; round++) {
+            FOR_EACH_MB_LANE(l) b[l] = _mm_aesenc_si128(b[l], MB_KEY(round, l));
+        }
+        FOR_EACH_MB_LANE(l) {
+            b[l] = _mm_aesenc_si128(b[l], tk[l]);
+            tk[l] = _mm_add_epi64(tk[l], one);
+        }
+        TAES_UNROLL
+        for (int round = tr + 1; round < nr; round++) {
+            FOR_EACH_MB_LANE(l) b[l] = _mm_aesenc_si128(b[l], MB_KEY(round, l));
+        }
+        FOR_EACH_MB_LANE(l) {
+            _mm_storeu_si128((__m128i *)(dst[l] + i * AES_BLOCK_SIZE), _mm_aesenclast_si128(b[l], MB_KEY(nr, l)));
+        }
+    }
+
+    mb_lanes_done(mgr, MB_NI_LANES, nblocks);
+}
+
+// Each lane keeps imc(tk & ~7) and the offset j = tk & 7, so the tweak
+// round's key imc(tk) = imc(tk & ~7) ^ imc(j) costs one AESIMC per 8 blocks
+// of a lane (see ctr_decrypt_blocks_ni())
+static inline __attribute__((always_inline))
+void mb_decrypt_rounds_ni(taes_mb_mgr *mgr, size_t nblocks, const int nr, const int tr) {
+    const uint8_t *src[MB_NI_LANES];
+    uint8_t *dst[MB_NI_LANES];
+    __m128i tk[MB_NI_LANES], base[MB_NI_LANES], imc_offset[NI_PARALLEL_BLOCKS];
+    unsigned j[MB_NI_LANES];
+    const __m128i one = _mm_set_epi64x(0, 1);
+
+    for (int k = 0; k < NI_PARALLEL_BLOCKS; k++) {
+        imc_offset[k] = _mm_aesimc_si128(_mm_cvtsi32_si128(k));
+    }
+
+    mb_lane_pointers(mgr, MB_NI_LANES, src, dst);
+    FOR_EACH_MB_LANE(l) {
+        tk[l] = _mm_load_si128((const __m128i *)mgr->lane[l].tweaked_key);
+        j[l] = (unsigned)_mm_cvtsi128_si32(tk[l]) & 7;
+        base[l] = _mm_aesimc_si128(_mm_andnot_si128(_mm_cvtsi32_si128(7), tk[l]));
+    }
+
+    for (size_t i = 0; i < nblocks; i++) {
+        __m128i b[MB_NI_LANES];
+
+        FOR_EACH_MB_LANE(l) {
+            b[l] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(src[l] + i * AES_BLOCK_SIZE)), MB_KEY(nr, l));
+        }
+        TAES_UNROLL
+        for (int round = nr - 1; round > tr; round--) {
+            FOR_EACH_MB_LANE(l) b[l] = _mm_aesdec_si128(b[l], MB_KEY(round, l));
+        }
+        FOR_EACH_MB_LANE(l) {
+            b[l] = _mm_aesdec_si128(b[l], _mm_xor_si128(base[l], imc_offset[j[l]]));
+            tk[l] = _mm_add_epi64(tk[l], one);
+            j[l] = (j[l] + 1) & 7;
+            if (j[l] == 0) {
+                base[l] = _mm_aesimc_si128(tk[l]);
+            }
+        }
+        TAES_UNROLL
+        for (int round = tr - 1; round >= 1; round--) {
+            FOR_EACH_MB_LANE(l) b[l] = _mm_aesdec_si128(b[l], MB_KEY(round, l));
+        }
+        FOR_EACH_MB_LANE(l) {
+            _mm_storeu_si128((__m128i *)(dst[l] + i * AES_BLOCK_SIZE), _mm_aesdeclast_si128(b[l], MB_KEY(0, l)));
+        }
+    }
+
+    mb_lanes_done(mgr, MB_NI_LANES, nblocks);
+}
+
+static void mb_encrypt_ni(taes_mb_mgr *mgr, size_t nblocks) {
+    switch (mgr->num_rounds) {
+        case 10: mb_encrypt_rounds_ni(mgr, nblocks, 10, 5); break;
+        case 12: mb_encrypt_rounds_ni(mgr, nblocks, 12, 6); break;
+        default: mb_encrypt_rounds_ni(mgr, nblocks, 14, 7); break;
+    }
+}
+
+static void mb_decrypt_ni(taes_mb_mgr *mgr, size_t nblocks) {
+    switch (mgr->num_rounds) {
+        case 10: mb_decrypt_rounds_ni(mgr, nblocks, 10, 5); break;
+        case 12: mb_decrypt_rounds_ni(mgr, nblocks, 12, 6); break;
+        default: mb_decrypt_rounds_ni(mgr, nblocks, 14, 7); break;
+    }
+}
+
+static const taes_mb_kernel mb_kernel_ni = {
+    MB_NI_LANES, mb_load_keys_ni, mb_encrypt_ni, mb_decrypt_ni,
+};
+
+const taes_mb_kernel *taes_mb_kernel_ni(void) {
+    return &mb_kernel_ni;
+}
+
+// Encrypt using counter mode with incrementing tweaks (AES-NI, 8 blocks in flight)
+// Same output as counter_mode_encrypt()
+int counter_mode_encrypt_ni(const taes_ctx *ctx, const uint8_t *plaintext,
+                            uint8_t *ciphertext, size_t length) {
+    return ctr_encrypt_cts(ctx, plaintext, ciphertext, length, ctr_encrypt_blocks_ni);
+}
+
+// Decrypt using counter mode with incrementing tweaks (AES-NI, 8 blocks in flight)
+// Same output as counter_mode_decrypt()
+int counter_mode_decrypt_ni(const taes_ctx *ctx, const uint8_t *ciphertext,
+                            uint8_t *plaintext, size_t length) {
+    return ctr_decrypt_cts(ctx, ciphertext, plaintext, length, ctr_decrypt_blocks_ni);
 }
 
 // Clean up context (same as standard implementation)
@@ -0,0 +1,357 @@
+// Pipelined file-descriptor filter (see taes_pipeline.h)
+// Buffer n of the input lives in slot n % nslots and moves FREE -> FILLED
+// (reader) -> CLAIMED -> DONE (a worker) -> FREE (writer). The reader fills
+// slots in order, workers claim them in order and the writer drains them in
+// order, so each stage only waits on one slot. A slot stops being FILLED as
+// soon as a worker takes it: while one worker is slow on buffer n, the
+// others can claim their way round the ring back to its slot. Buffers are
+// large, so one mutex and three condition variables cost nothing next to
+// the work per buffer.
+//
+// Every buffer but the last holds exactly buffer_size bytes, read ahead by
+// 16: those 16 bytes start the next buffer. A block is only changed by
+// Ciphertext Stealing if fewer than 16 bytes follow it, so every block of a
+// full buffer is an ordinary one at tweak offset first_block + j, and the
+// last buffer (at least 16 bytes unless the input is shorter) is a complete
+// counter-mode message of its own at its tweak offset.
+#define _POSIX_C_SOURCE 200809L
+#include "../include/taes_pipeline.h"
+#include "../include/counter_mode.h"
+#include "../include/taes_utils.h"
+#include "taes_io.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MIN_BUFFER 4096
+
+enum { FREE, FILLED, CLAIMED, DONE };
+
+typedef struct {
+    uint8_t *data;            // buffer_size + AES_BLOCK_SIZE bytes, 64-byte aligned
+    size_t length;
+    uint64_t first_block;     // Tweak offset of data[0]
+    int last;                 // Ends the input
+    int state;
+    int status;               // 0, or TAES_PIPELINE_BAD_LENGTH
+} slot;
+
+typedef struct {
+    const taes_ctx *ctx;
+    const taes_ctx *to;       // Transcryption: ctx decrypts, to re-encrypts
+    int flags;
+    int in_fd;
+    size_t buffer_size;
+    slot *slots;
+    size_t nslots;
+
+    pthread_mutex_t lock;
+    pthread_cond_t filled;    // Workers wait for the next slot to claim
+    pthread_cond_t done;      // The writer waits for the next slot to write
+    pthread_cond_t freed;     // The reader waits for the next slot to fill
+    uint64_t next_claim;      // Buffer the next worker takes
+    uint64_t end;             // Buffers in the input, once the reader knows (else UINT64_MAX)
+    int stop;                 // Error: every stage gives up
+    int read_errno;
+} pipeline;
+
+static slot *slot_of(pipeline *p, uint64_t n) {
+    return &p->slots[n % p->nslots];
+}
+
+static void fail(pipeline *p) {
+    pthread_mutex_lock(&p->lock);
+    p->stop = 1;
+    pthread_cond_broadcast(&p->filled);
+    pthread_cond_broadcast(&p->done);
+    pthread_cond_broadcast(&p->freed);
+    pthread_mutex_unlock(&p->lock);
+}
+
+// Fill buffer after buffer until end of file
+static void *reader(void *arg) {
+    pipeline *p = arg;
+    uint8_t ahead[AES_BLOCK_SIZE];
+    size_t ahead_len = 0;
+    uint64_t first_block = 0;
+
+    for (uint64_t n = 0;; n++) {
+        slot *s = slot_of(p, n);
+        pthread_mutex_lock(&p->lock);
+        while (s->state != FREE && !p->stop) {
+            pthread_cond_wait(&p->freed, &p->lock);
+        }
+        int stop = p->stop;
+        pthread_mutex_unlock(&p->lock);
+        if (stop) {
+            break;
+        }
+
+        // The read-ahead block, then up to buffer_size + 16 bytes in all
+        memcpy(s->data, ahead, ahead_len);
+        size_t have = ahead_len;
+        size_t want = p->buffer_size + AES_BLOCK_SIZE;
+        int eof = 0;
+        while (have < want) {
+            ssize_t got = read(p->in_fd, s->data + have, want - have);
+            if (got < 0 && errno == EINTR) {
+                continue;
+            }
+            if (got < 0) {
+                p->read_errno = errno;
+                fail(p);
+                break;
+            }
+            if (got == 0) {
+                eof = 1;
+                break;
+            }
+            have += (size_t)got;
+        }
+        if (p->read_errno) {
+            break;
+        }
+
+        s->first_block = first_block;
+        s->last = eof;
+        if (eof) {
+            s->length = have;
+        } else {
+            s->length = p->buffer_size;
+            ahead_len = AES_BLOCK_SIZE;
+            memcpy(ahead, s->data + p->buffer_size, ahead_len);
+            first_block += p->buffer_size / AES_BLOCK_SIZE;
+        }
+
+        pthread_mutex_lock(&p->lock);
+        s->state = FILLED;
+        if (eof) {
+            p->end = n + 1;
+        }
+        pthread_cond_broadcast(&p->filled);
+        pthread_mutex_unlock(&p->lock);
+        if (eof) {
+            break;
+        }
+    }
+    memset(ahead, 0, sizeof(ahead));
+    return NULL;
+}
+
+// Process one buffer in place
+static int process(const pipeline *p, slot *s) {
+    int decrypt = p->flags & TAES_PIPELINE_DECRYPT;
+
+    if (p->flags & TAES_PIPELINE_ECB) {
+        if (s->length % AES_BLOCK_SIZE != 0) {
+            return TAES_PIPELINE_BAD_LENGTH;
+        }
+        if (decrypt) {
+            ecb_decrypt(p->ctx, s->data, s->data, s->length);
+        } else {
+            ecb_encrypt(p->ctx, s->data, s->data, s->length);
+        }
+        return 0;
+    }
+
+    // Counter mode requires more than one block for Ciphertext Stealing
+    if (s->first_block == 0 && s->length <= AES_BLOCK_SIZE) {
+        return TAES_PIPELINE_BAD_LENGTH;
+    }
+
+    taes_ctx ctx = *p->ctx;
+    taes_advance_tweak(&ctx, s->first_block);
+    if (p->to) {
+        taes_ctx to = *p->to;
+        taes_advance_tweak(&to, s->first_block);
+        if (s->length == AES_BLOCK_SIZE) {
+            taes_decrypt_block(&ctx, s->data, s->data);
+            taes_encrypt_block(&to, s->data, s->data);
+        } else {
+            taes_transcrypt(&ctx, &to, s->data, s->data, s->length);
+        }
+        taes_cleanup(&to);
+    } else if (s->length == AES_BLOCK_SIZE) {
+        // The last buffer's read-ahead block and nothing after it
+        if (decrypt) {
+            taes_decrypt_block(&ctx, s->data, s->data);
+        } else {
+            taes_encrypt_block(&ctx, s->data, s->data);
+        }
+    } else if (decrypt) {
+        counter_mode_decrypt(&ctx, s->data, s->data, s->length);
+    } else {
+        counter_mode_encrypt(&ctx, s->data, s->data, s->length);
+    }
+    taes_cleanup(&ctx);
+    return 0;
+}
+
+static void *worker(void *arg) {
+    pipeline *p = arg;
+
+    for (;;) {
+        pthread_mutex_lock(&p->lock);
+        while (!p->stop && p->next_claim < p->end && slot_of(p, p->next_claim)->state != FILLED) {
+            pthread_cond_wait(&p->filled, &p->lock);
+        }
+        if (p->stop || p->next_claim >= p->end) {
+            pthread_mutex_unlock(&p->lock);
+            return NULL;
+        }
+        slot *s = slot_of(p, p->next_claim++);
+        s->state = CLAIMED;
+        pthread_mutex_unlock(&p->lock);
+
+        s->status = process(p, s);
+
+        pthread_mutex_lock(&p->lock);
+        s->state = DONE;
+        pthread_cond_broadcast(&p->done);
+        pthread_mutex_unlock(&p->lock);
+    }
+}
+
+// Write buffer after buffer, in order; returns taes_pipeline()'s result
+static int writer(pipeline *p, int out_fd) {
+    for (uint64_t n = 0;; n++) {
+        slot *s = slot_of(p, n);
+        pthread_mutex_lock(&p->lock);
+        while (!p->stop && n < p->end && s->state != DONE) {
+            pthread_cond_wait(&p->done, &p->lock);
+        }
+        int stop = p->stop;
+        int finished = n >= p->end;
+        pthread_mutex_unlock(&p->lock);
+        if (stop) {
+            errno = p->read_errno;
+            return -1;
+        }
+        if (finished) {
+            return 0;
+        }
+
+        if (s->status != 0) {
+            fail(p);
+            return s->status;
+        }
+        if (write_all(out_fd, s->data, s->length) != 0) {
+            int saved = errno;
+            fail(p);
+            errno = saved;
+            return -1;
+        }
+
+        pthread_mutex_lock(&p->lock);
+        s->state = FREE;
+        pthread_cond_signal(&p->freed);
+        pthread_mutex_unlock(&p->lock);
+    }
+}
+
+// Buffers are wiped: they hold plaintext
+static void free_slots(slot *slots, size_t nslots, size_t alloc_size) {
+    for (size_t i = 0; slots && i < nslots; i++) {
+        if (slots[i].data) {
+            memset(slots[i].data, 0, alloc_size);
+            free(slots[i].data);
+        }
+    }
+    free(slots);
+}
+
+static slot *alloc_slots(size_t nslots, size_t alloc_size) {
+    slot *slots = calloc(nslots, sizeof(*slots));
+    for (size_t i = 0; slots && i < nslots; i++) {
+        slots[i].data = aligned_alloc(64, alloc_size);
+        if (!slots[i].data) {
+            free_slots(slots, nslots, alloc_size);
+            return NULL;
+        }
+    }
+    return slots;
+}
+
+static int run(const taes_ctx *ctx, const taes_ctx *to, int flags, int in_fd, int out_fd, int workers,
+               size_t buffer_size) {
+    if (!ctx || in_fd < 0 || out_fd < 0 || workers < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (workers == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cpus > 0 ? (int)cpus : 1;
+    }
+    buffer_size = (buffer_size ? buffer_size : TAES_PIPELINE_DEFAULT_BUFFER) / AES_BLOCK_SIZE * AES_BLOCK_SIZE;
+    if (buffer_size < MIN_BUFFER) {
+        buffer_size = MIN_BUFFER;
+    }
+
+    // One buffer being read, one per worker, one being written, one spare
+    pipeline p = {0};
+    p.ctx = ctx;
+    p.to = to;
+    p.flags = flags;
+    p.in_fd = in_fd;
+    p.buffer_size = buffer_size;
+    p.nslots = (size_t)workers + 3;
+    p.end = UINT64_MAX;
+    size_t alloc_size = (buffer_size + AES_BLOCK_SIZE + 63) / 64 * 64;
+    pthread_t *tids = calloc((size_t)workers + 1, sizeof(*tids));
+    p.slots = alloc_slots(p.nslots, alloc_size);
+    if (!tids || !p.slots) {
+        free(tids);
+        free_slots(p.slots, p.nslots, alloc_size);
+        errno = ENOMEM;
+        return -1;
+    }
+    pthread_mutex_init(&p.lock, NULL);
+    pthread_cond_init(&p.filled, NULL);
+    pthread_cond_init(&p.done, NULL);
+    pthread_cond_init(&p.freed, NULL);
+
+    // The reader, then the workers; this thread writes
+    int ret = -1;
+    int err = pthread_create(&tids[0], NULL, reader, &p);
+    int started = err == 0;
+    while (err == 0 && started < workers + 1) {
+        err = pthread_create(&tids[started], NULL, worker, &p);
+        started += err == 0;
+    }
+    if (err == 0) {
+        ret = writer(&p, out_fd);
+        err = errno;
+    } else {
+        fail(&p);
+    }
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    pthread_mutex_destroy(&p.lock);
+    pthread_cond_destroy(&p.filled);
+    pthread_cond_destroy(&p.done);
+    pthread_cond_destroy(&p.freed);
+    free_slots(p.slots, p.nslots, alloc_size);
+    free(tids);
+    if (ret == -1) {
+        errno = err;
+    }
+    return ret;
+}
+
+int taes_pipeline(const taes_ctx *ctx, int flags, int in_fd, int out_fd, int workers,
+                  size_t buffer_size) {
+    return run(ctx, NULL, flags, in_fd, out_fd, workers, buffer_size);
+}
+
+int taes_transcrypt_pipeline(const taes_ctx *from, const taes_ctx *to, int in_fd, int out_fd, int workers,
+                             size_t buffer_size) {
+    if (!to) {
+        errno = EINVAL;
+        return -1;
+    }
+    return run(from, to, 0, in_fd, out_fd, workers, buffer_size);
+}
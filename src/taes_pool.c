@@ -0,0 +1,235 @@
+// Persistent work-stealing thread pool (see taes_pool.h)
+// Each thread owns a range [next, end) of task numbers under its own lock:
+// the owner takes tasks from the bottom, a thief takes the upper half at
+// once. Tasks are large (whole chunks of a buffer), so a lock per take costs
+// nothing measurable and keeps the stealing simple.
+#define _POSIX_C_SOURCE 200809L
+#include "../include/taes_pool.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct {
+    _Alignas(64) pthread_mutex_t lock;
+    size_t next;              // Next task of this thread's range
+    size_t end;               // End of the range
+} taes_pool_worker;
+
+struct taes_pool {
+    int threads;              // Threads including the caller of taes_pool_run()
+    taes_pool_worker *workers;  // One per thread; workers[0] is the caller
+    pthread_t *tids;          // The threads - 1 started by taes_pool_create()
+    int started;
+
+    pthread_mutex_t run_lock;   // Held for a whole taes_pool_run()
+    pthread_mutex_t lock;       // Protects everything below
+    pthread_cond_t start;       // A run started, or shutdown
+    pthread_cond_t done;        // The last busy thread finished
+    unsigned long generation;   // Number of runs started
+    int busy;                   // Pool threads still working on the run
+    int shutdown;
+    taes_task_fn fn;
+    void *arg;
+};
+
+typedef struct {
+    taes_pool *pool;
+    int id;
+} taes_pool_thread;
+
+// Take the next task of thread `id`, stealing when its range is empty.
+// Returns 0 when no thread has tasks left.
+static int take_task(taes_pool *pool, int id, size_t *task) {
+    taes_pool_worker *self = &pool->workers[id];
+
+    pthread_mutex_lock(&self->lock);
+    if (self->next < self->end) {
+        *task = self->next++;
+        pthread_mutex_unlock(&self->lock);
+        return 1;
+    }
+    pthread_mutex_unlock(&self->lock);
+
+    // Steal the upper half of the first nonempty range after our own
+    for (int i = 1; i < pool->threads; i++) {
+        taes_pool_worker *victim = &pool->workers[(id + i) % pool->threads];
+        pthread_mutex_lock(&victim->lock);
+        size_t left = victim->end - victim->next;
+        if (left == 0) {
+            pthread_mutex_unlock(&victim->lock);
+            continue;
+        }
+        size_t end = victim->end;
+        size_t begin = end - (left + 1) / 2;
+        victim->end = begin;
+        pthread_mutex_unlock(&victim->lock);
+
+        // Run the first stolen task now, the rest is ours to be stolen from
+        pthread_mutex_lock(&self->lock);
+        self->next = begin + 1;
+        self->end = end;
+        pthread_mutex_unlock(&self->lock);
+        *task = begin;
+        return 1;
+    }
+    return 0;
+}
+
+static void work(taes_pool *pool, int id) {
+    size_t task;
+    while (take_task(pool, id, &task)) {
+        pool->fn(pool->arg, task);
+    }
+}
+
+static void *thread_main(void *p) {
+    taes_pool_thread *t = p;
+    taes_pool *pool = t->pool;
+    int id = t->id;
+    unsigned long seen = 0;
+    free(t);
+
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->generation == seen && !pool->shutdown) {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        if (pool->shutdown) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        work(pool, id);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->busy == 0) {
+            pthread_cond_signal(&pool->done);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+taes_pool *taes_pool_create(int threads) {
+    if (threads < 0) {
+        return NULL;
+    }
+    if (threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int)cpus : 1;
+    }
+
+    taes_pool *pool = calloc(1, sizeof(*pool));
+    if (!pool) {
+        return NULL;
+    }
+    pool->threads = threads;
+    // Own cache lines per worker: calloc() only aligns to 16. sizeof is a
+    // multiple of the 64-byte alignment, as aligned_alloc() needs.
+    size_t workers_size = (size_t)threads * sizeof(*pool->workers);
+    pool->workers = aligned_alloc(_Alignof(taes_pool_worker), workers_size);
+    if (pool->workers) {
+        memset(pool->workers, 0, workers_size);
+    }
+    pool->tids = calloc((size_t)threads, sizeof(*pool->tids));
+    if (!pool->workers || !pool->tids) {
+        free(pool->workers);
+        free(pool->tids);
+        free(pool);
+        return NULL;
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_mutex_init(&pool->workers[i].lock, NULL);
+    }
+    pthread_mutex_init(&pool->run_lock, NULL);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (int i = 1; i < threads; i++) {
+        taes_pool_thread *t = malloc(sizeof(*t));
+        if (!t) {
+            taes_pool_destroy(pool);
+            return NULL;
+        }
+        t->pool = pool;
+        t->id = i;
+        if (pthread_create(&pool->tids[i - 1], NULL, thread_main, t) != 0) {
+            free(t);
+            taes_pool_destroy(pool);
+            return NULL;
+        }
+        pool->started++;
+    }
+    return pool;
+}
+
+void taes_pool_destroy(taes_pool *pool) {
+    if (!pool) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->started; i++) {
+        pthread_join(pool->tids[i], NULL);
+    }
+
+    for (int i = 0; i < pool->threads; i++) {
+        pthread_mutex_destroy(&pool->workers[i].lock);
+    }
+    pthread_mutex_destroy(&pool->run_lock);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    free(pool->workers);
+    free(pool->tids);
+    free(pool);
+}
+
+int taes_pool_threads(const taes_pool *pool) {
+    return pool ? pool->threads : 1;
+}
+
+void taes_pool_run(taes_pool *pool, size_t ntasks, taes_task_fn fn, void *arg) {
+    // Nothing to share: run on the caller
+    if (!pool || pool->threads == 1 || ntasks < 2) {
+        for (size_t i = 0; i < ntasks; i++) {
+            fn(arg, i);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&pool->run_lock);
+
+    // The pool threads are idle here, so the ranges can be set without their
+    // locks; starting the run under pool->lock publishes them
+    int threads = pool->threads;
+    for (int i = 0; i < threads; i++) {
+        pool->workers[i].next = ntasks * (size_t)i / (size_t)threads;
+        pool->workers[i].end = ntasks * (size_t)(i + 1) / (size_t)threads;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->arg = arg;
+    pool->busy = threads - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    work(pool, 0);
+
+    // The run is over once every thread has stopped looking for tasks
+    pthread_mutex_lock(&pool->lock);
+    while (pool->busy > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    pthread_mutex_unlock(&pool->run_lock);
+}
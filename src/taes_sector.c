@@ -0,0 +1,42 @@
+// Sector-oriented disk encryption (see taes_sector.h)
+#include "../include/taes_sector.h"
+#include "taes_backend.h"
+
+// Tweak offset of the run's first block; -1 if the arguments are invalid or
+// the run's blocks do not fit the 64-bit block numbering
+static int first_block(const taes_ctx *ctx, uint64_t sector_no, size_t sector_size, const uint8_t *in,
+                       const uint8_t *out, size_t count, uint64_t *first) {
+    if (!ctx || (count > 0 && (!in || !out)) || sector_size == 0 || sector_size % AES_BLOCK_SIZE != 0) {
+        return -1;
+    }
+    uint64_t per_sector = sector_size / AES_BLOCK_SIZE;
+    if (count > UINT64_MAX / per_sector || sector_no > (UINT64_MAX - count * per_sector) / per_sector) {
+        return -1;
+    }
+    *first = sector_no * per_sector;
+    return 0;
+}
+
+int taes_sector_encrypt(const taes_ctx *ctx, uint64_t sector_no, size_t sector_size,
+                        const uint8_t *in, uint8_t *out, size_t count) {
+    uint64_t first;
+    if (first_block(ctx, sector_no, sector_size, in, out, count, &first) != 0) {
+        return -1;
+    }
+    if (count > 0) {
+        taes_get_backend()->ctr_encrypt_blocks(ctx, first, in, out, count * (sector_size / AES_BLOCK_SIZE));
+    }
+    return 0;
+}
+
+int taes_sector_decrypt(const taes_ctx *ctx, uint64_t sector_no, size_t sector_size,
+                        const uint8_t *in, uint8_t *out, size_t count) {
+    uint64_t first;
+    if (first_block(ctx, sector_no, sector_size, in, out, count, &first) != 0) {
+        return -1;
+    }
+    if (count > 0) {
+        taes_get_backend()->ctr_decrypt_blocks(ctx, first, in, out, count * (sector_size / AES_BLOCK_SIZE));
+    }
+    return 0;
+}
@@ -0,0 +1,289 @@
+// Sharded counter mode (see taes_shard.h)
+// A shard is read, ciphered and written in pieces of SHARD_PIECE bytes, each
+// counter_mode_encrypt_parallel() under the tweak advanced to its first
+// block; only the last piece of the last shard can end in a partial block,
+// and it is kept long enough for Ciphertext Stealing. Pieces are whole
+// leaves, so a piece's leaves are hashed as one more pool run.
+#define _POSIX_C_SOURCE 200809L
+#include "../include/taes_shard.h"
+#include "../include/counter_mode.h"
+#include "../include/taes_sector.h"
+#include "taes_io.h"
+#include <errno.h>
+#include <openssl/evp.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define VERSION 1
+
+// Bytes per piece: many pool chunks, and little memory per shard
+#define SHARD_PIECE (4 * TAES_SHARD_LEAF)
+
+// Leaves of the longest piece (the last one, with up to two more blocks)
+#define PIECE_LEAVES (SHARD_PIECE / TAES_SHARD_LEAF + 1)
+
+// First block of shard k of n: floor(k * blocks / n) without overflow
+static uint64_t shard_start(uint64_t blocks, uint32_t k, uint32_t n) {
+    return blocks / n * k + blocks % n * k / n;
+}
+
+int taes_shard_range(uint64_t total, uint32_t index, uint32_t count, taes_shard *shard) {
+    if (!shard || total <= AES_BLOCK_SIZE || index >= count) {
+        return -1;
+    }
+    // floor((n - 1) * blocks / n) < blocks: the last shard has a full block
+    // and the tail, the stolen pair
+    uint64_t blocks = total / AES_BLOCK_SIZE;
+    uint64_t start = shard_start(blocks, index, count) * AES_BLOCK_SIZE;
+    uint64_t end = index + 1 == count ? total : shard_start(blocks, index + 1, count) * AES_BLOCK_SIZE;
+    memset(shard, 0, sizeof(*shard));
+    shard->index = index;
+    shard->count = count;
+    shard->total = total;
+    shard->offset = start;
+    shard->length = end - start;
+    return 0;
+}
+
+// Cipher a piece starting at block first of the message in place. Pieces
+// of a single block are whole blocks of a shard, not a message of their own.
+static void crypt_piece(const taes_ctx *ctx, int decrypt, uint64_t first, uint8_t *data, size_t length,
+                        taes_pool *pool) {
+    if (length == AES_BLOCK_SIZE) {
+        if (decrypt) {
+            taes_sector_decrypt(ctx, first, AES_BLOCK_SIZE, data, data, 1);
+        } else {
+            taes_sector_encrypt(ctx, first, AES_BLOCK_SIZE, data, data, 1);
+        }
+        return;
+    }
+    taes_ctx piece = *ctx;
+    taes_advance_tweak(&piece, first);
+    if (decrypt) {
+        counter_mode_decrypt_parallel(pool, &piece, data, data, length, 0);
+    } else {
+        counter_mode_encrypt_parallel(pool, &piece, data, data, length, 0);
+    }
+    taes_cleanup(&piece);
+}
+
+// One pool run: the SHA-256 of each leaf of data (the last may be short)
+typedef struct {
+    const uint8_t *data;
+    size_t length;
+    uint8_t (*leaves)[TAES_SHARD_DIGEST_SIZE];
+} leaf_job;
+
+static void hash_leaf(void *arg, size_t i) {
+    const leaf_job *job = arg;
+    size_t start = i * TAES_SHARD_LEAF;
+    size_t n = job->length - start < TAES_SHARD_LEAF ? job->length - start : TAES_SHARD_LEAF;
+    EVP_Digest(job->data + start, n, job->leaves[i], NULL, EVP_sha256(), NULL);
+}
+
+// Add the digests of the leaves of data (at most PIECE_LEAVES) to the list
+static void hash_leaves(EVP_MD_CTX *list, const uint8_t *data, size_t length, taes_pool *pool) {
+    uint8_t leaves[PIECE_LEAVES][TAES_SHARD_DIGEST_SIZE];
+    size_t count = (length + TAES_SHARD_LEAF - 1) / TAES_SHARD_LEAF;
+    leaf_job job = {data, length, leaves};
+    taes_pool_run(pool, count, hash_leaf, &job);
+    EVP_DigestUpdate(list, leaves, count * TAES_SHARD_DIGEST_SIZE);
+}
+
+int taes_shard_crypt_fd(const taes_ctx *ctx, int flags, int in_fd, uint64_t in_offset,
+                        taes_shard *shard, int out_fd, taes_pool *pool) {
+    taes_shard expected;
+    if (!ctx || !shard ||
+        taes_shard_range(shard->total, shard->index, shard->count, &expected) != 0 ||
+        expected.offset != shard->offset || expected.length != shard->length) {
+        errno = EINVAL;
+        return -1;
+    }
+    int decrypt = flags & TAES_SHARD_DECRYPT;
+    uint8_t *buf = malloc(SHARD_PIECE + 2 * AES_BLOCK_SIZE);
+    EVP_MD_CTX *list = (flags & TAES_SHARD_DIGEST) ? EVP_MD_CTX_new() : NULL;
+    if (!buf || ((flags & TAES_SHARD_DIGEST) && (!list || EVP_DigestInit_ex(list, EVP_sha256(), NULL) != 1))) {
+        free(buf);
+        EVP_MD_CTX_free(list);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    int ret = 0;
+    uint64_t done = 0;
+    while (ret == 0 && done < shard->length) {
+        // A piece leaves either nothing or more than two blocks: the tail
+        // always has its stolen pair
+        uint64_t left = shard->length - done;
+        size_t n = left <= SHARD_PIECE + 2 * AES_BLOCK_SIZE ? (size_t)left : SHARD_PIECE;
+        ret = pread_exact(in_fd, buf, n, in_offset + done);
+        if (ret == 0 && list && decrypt) {
+            hash_leaves(list, buf, n, pool);
+        }
+        if (ret == 0) {
+            crypt_piece(ctx, decrypt, (shard->offset + done) / AES_BLOCK_SIZE, buf, n, pool);
+            if (list && !decrypt) {
+                hash_leaves(list, buf, n, pool);
+            }
+            ret = write_all(out_fd, buf, n);
+        }
+        done += n;
+    }
+    if (ret == 0 && list) {
+        EVP_DigestFinal_ex(list, shard->digest, NULL);
+    }
+
+    int saved = errno;
+    memset(buf, 0, SHARD_PIECE + 2 * AES_BLOCK_SIZE);
+    free(buf);
+    EVP_MD_CTX_free(list);
+    errno = saved;
+    return ret;
+}
+
+void taes_shard_format(const taes_shard *shard, char line[TAES_SHARD_LINE_MAX]) {
+    char hex[2 * TAES_SHARD_DIGEST_SIZE + 1];
+    for (int i = 0; i < TAES_SHARD_DIGEST_SIZE; i++) {
+        snprintf(hex + 2 * i, 3, "%02x", shard->digest[i]);
+    }
+    snprintf(line, TAES_SHARD_LINE_MAX, "taes-shard %d %u %u %llu %llu %llu %s\n", VERSION, shard->index,
+             shard->count, (unsigned long long)shard->total, (unsigned long long)shard->offset,
+             (unsigned long long)shard->length, hex);
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+int taes_shard_parse(const char *line, taes_shard *shard) {
+    int version;
+    unsigned index;
+    unsigned count;
+    unsigned long long total;
+    unsigned long long offset;
+    unsigned long long length;
+    char hex[2 * TAES_SHARD_DIGEST_SIZE + 1];
+    int end = 0;
+    if (!line || !shard ||
+        sscanf(line, "taes-shard %d %u %u %llu %llu %llu %64s%n", &version, &index, &count, &total, &offset,
+               &length, hex, &end) != 7 ||
+        version != VERSION || strlen(hex) != 2 * TAES_SHARD_DIGEST_SIZE ||
+        strspn(line + end, " \t\r\n") != strlen(line + end)) {
+        return -1;
+    }
+    taes_shard parsed;
+    if (taes_shard_range(total, index, count, &parsed) != 0 || parsed.offset != offset ||
+        parsed.length != length) {
+        return -1;
+    }
+    for (int i = 0; i < TAES_SHARD_DIGEST_SIZE; i++) {
+        int hi = hex_value(hex[2 * i]);
+        int lo = hex_value(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0) {
+            return -1;
+        }
+        parsed.digest[i] = (uint8_t)(hi << 4 | lo);
+    }
+    *shard = parsed;
+    return 0;
+}
+
+static int by_index(const void *a, const void *b) {
+    const taes_shard *x = a;
+    const taes_shard *y = b;
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+int taes_shard_check_set(taes_shard *shards, size_t count) {
+    if (!shards || count == 0 || count != shards[0].count) {
+        errno = EBADMSG;
+        return -1;
+    }
+    qsort(shards, count, sizeof(taes_shard), by_index);
+    for (size_t i = 0; i < count; i++) {
+        if (shards[i].index != i || shards[i].count != shards[0].count || shards[i].total != shards[0].total) {
+            errno = EBADMSG;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// One pool run: leaf i of a shard of the file is read and hashed
+typedef struct {
+    int fd;
+    const taes_shard *shard;
+    uint8_t (*leaves)[TAES_SHARD_DIGEST_SIZE];
+    atomic_int *error;        // errno of a failed read, else 0
+} verify_job;
+
+static void verify_leaf(void *arg, size_t i) {
+    const verify_job *job = arg;
+    uint64_t start = (uint64_t)i * TAES_SHARD_LEAF;
+    size_t n = job->shard->length - start < TAES_SHARD_LEAF ? (size_t)(job->shard->length - start)
+                                                            : TAES_SHARD_LEAF;
+    uint8_t *buf = malloc(n);
+    if (!buf || pread_exact(job->fd, buf, n, job->shard->offset + start) != 0) {
+        atomic_store(job->error, buf ? errno : ENOMEM);
+    } else {
+        EVP_Digest(buf, n, job->leaves[i], NULL, EVP_sha256(), NULL);
+    }
+    free(buf);
+}
+
+// The digest of a shard as read from fd; -1 with errno set
+static int shard_digest(int fd, const taes_shard *shard, taes_pool *pool,
+                        uint8_t digest[TAES_SHARD_DIGEST_SIZE]) {
+    size_t count = (size_t)((shard->length + TAES_SHARD_LEAF - 1) / TAES_SHARD_LEAF);
+    uint8_t (*leaves)[TAES_SHARD_DIGEST_SIZE] = malloc(count ? count * TAES_SHARD_DIGEST_SIZE : 1);
+    atomic_int failed = 0;
+    if (!leaves) {
+        return -1;
+    }
+    verify_job job = {fd, shard, leaves, &failed};
+    taes_pool_run(pool, count, verify_leaf, &job);
+    int error = atomic_load(&failed);
+    if (error == 0 && EVP_Digest(leaves, count * TAES_SHARD_DIGEST_SIZE, digest, NULL, EVP_sha256(), NULL) != 1) {
+        error = ENOMEM;
+    }
+    free(leaves);
+    errno = error;
+    return error ? -1 : 0;
+}
+
+int taes_shard_verify_fd(int fd, const taes_shard *shards, size_t count, taes_pool *pool,
+                         uint32_t *bad) {
+    struct stat st;
+    if (!shards || count == 0 || !bad) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (fstat(fd, &st) != 0) {
+        return -1;
+    }
+    if ((uint64_t)st.st_size != shards[0].total) {
+        *bad = (uint32_t)count;
+        return TAES_SHARD_MISMATCH;
+    }
+    for (size_t i = 0; i < count; i++) {
+        uint8_t digest[TAES_SHARD_DIGEST_SIZE];
+        if (shard_digest(fd, &shards[i], pool, digest) != 0) {
+            return -1;
+        }
+        if (memcmp(digest, shards[i].digest, TAES_SHARD_DIGEST_SIZE) != 0) {
+            *bad = (uint32_t)i;
+            return TAES_SHARD_MISMATCH;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,109 @@
+// Streaming counter mode
+// A block can be written once 32 bytes from its start have been seen: then
+// it is neither the last full block before a partial one nor that partial
+// block, the two Ciphertext Stealing rewrites. Every other block is
+// processed under tweak + its index, so update() runs the backend's block
+// function with first = next_block and final() runs ctr_*_cts() on the held
+// bytes, starting from a context advanced to next_block.
+#include "../include/taes_stream.h"
+#include "taes_backend.h"
+#include <string.h>
+
+int taes_stream_init(taes_stream *stream, const taes_ctx *ctx, int decrypt) {
+    if (!stream || !ctx) {
+        return -1;
+    }
+    memset(stream, 0, sizeof(*stream));
+    stream->ctx = ctx;
+    stream->decrypt = decrypt != 0;
+    return 0;
+}
+
+int taes_stream_update(taes_stream *stream, const uint8_t *in, size_t length, uint8_t *out,
+                       size_t *written) {
+    if (!stream || !stream->ctx || !written || (length > 0 && (!in || !out))) {
+        return -1;
+    }
+    *written = 0;
+    if (length == 0) {
+        return 0;  // in may be NULL, and memcpy() must not see it
+    }
+
+    // Short of 32 bytes: nothing can be written yet
+    size_t available = stream->held + length;
+    if (available < TAES_STREAM_HELD_MAX) {
+        memcpy(stream->buf + stream->held, in, length);
+        stream->held = available;
+        stream->total += length;
+        return 0;
+    }
+
+    const taes_backend *backend = taes_get_backend();
+    taes_blocks_fn fn = stream->decrypt ? backend->ctr_decrypt_blocks : backend->ctr_encrypt_blocks;
+    size_t nblocks = (available - AES_BLOCK_SIZE) / AES_BLOCK_SIZE;  // Keeps 16 to 31 bytes
+    stream->total += length;
+
+    // Blocks starting in the held bytes (at most two), completed from in
+    while (nblocks > 0 && stream->held > 0) {
+        if (stream->held < AES_BLOCK_SIZE) {
+            size_t fill = AES_BLOCK_SIZE - stream->held;
+            memcpy(stream->buf + stream->held, in, fill);
+            in += fill;
+            length -= fill;
+            stream->held = AES_BLOCK_SIZE;
+        }
+        fn(stream->ctx, stream->next_block++, stream->buf, out, 1);
+        out += AES_BLOCK_SIZE;
+        *written += AES_BLOCK_SIZE;
+        nblocks--;
+
+        stream->held -= AES_BLOCK_SIZE;
+        memmove(stream->buf, stream->buf + AES_BLOCK_SIZE, stream->held);
+    }
+
+    // The rest straight from in
+    if (nblocks > 0) {
+        fn(stream->ctx, stream->next_block, in, out, nblocks);
+        stream->next_block += nblocks;
+        in += nblocks * AES_BLOCK_SIZE;
+        length -= nblocks * AES_BLOCK_SIZE;
+        *written += nblocks * AES_BLOCK_SIZE;
+    }
+
+    memcpy(stream->buf + stream->held, in, length);
+    stream->held += length;
+    return 0;
+}
+
+int taes_stream_final(taes_stream *stream, uint8_t *out, size_t *written) {
+    if (!stream || !stream->ctx || !out || !written) {
+        return -1;
+    }
+    *written = 0;
+
+    // Counter mode requires more than one block for Ciphertext Stealing
+    int ret = -1;
+    if (stream->total > AES_BLOCK_SIZE) {
+        const taes_backend *backend = taes_get_backend();
+        taes_blocks_fn fn = stream->decrypt ? backend->ctr_decrypt_blocks : backend->ctr_encrypt_blocks;
+
+        if (stream->held % AES_BLOCK_SIZE == 0) {
+            // No partial block: the held block (if any) is an ordinary one
+            fn(stream->ctx, stream->next_block, stream->buf, out, stream->held / AES_BLOCK_SIZE);
+            ret = 0;
+        } else {
+            // Held: the last full block and the partial one (17 to 31 bytes)
+            taes_ctx tail_ctx = *stream->ctx;
+            taes_advance_tweak(&tail_ctx, stream->next_block);
+            ret = stream->decrypt ? ctr_decrypt_cts(&tail_ctx, stream->buf, out, stream->held, fn)
+                                  : ctr_encrypt_cts(&tail_ctx, stream->buf, out, stream->held, fn);
+            taes_cleanup(&tail_ctx);
+        }
+        if (ret == 0) {
+            *written = stream->held;
+        }
+    }
+
+    memset(stream, 0, sizeof(*stream));
+    return ret;
+}
@@ -0,0 +1,382 @@
+// T-AES implementation using 32-bit T-tables
+// Each middle round is 16 table lookups: Te0..Te3 fold SubBytes, ShiftRows
+// and MixColumns of one state byte into a column word (Td0..Td3 do the same
+// for decryption with the equivalent inverse cipher). The state is kept as
+// four little-endian column words, the same layout as the round keys in
+// taes_ctx, so the tweaked round key is just another four key words.
+//
+// Table lookups are indexed by secret data; this backend is fast on CPUs
+// without AES-NI but not constant-time.
+#include "../include/taes.h"
+#include "../include/counter_mode.h"
+#include "taes_backend.h"
+#include <string.h>
+
+static uint32_t Te[4][256];
+static uint32_t Td[4][256];
+static uint8_t sbox_t[256];
+static uint8_t inv_sbox_t[256];
+static int tables_ready;
+
+static inline uint8_t xtime(uint8_t a) {
+    return (uint8_t)((a << 1) ^ ((a & 0x80) ? 0x1b : 0));
+}
+
+static inline uint32_t rotl32(uint32_t w, int n) {
+    return (w << n) | (w >> (32 - n));
+}
+
+// Build the S-boxes and T-tables: the S-box from the multiplicative inverse
+// in GF(2^8) (via log/exp tables with generator 3) and the affine transform
+__attribute__((constructor))
+static void build_tables(void) {
+    if (tables_ready) {
+        return;
+    }
+
+    uint8_t exp_t[256], log_t[256];
+    uint8_t x = 1;
+    for (int i = 0; i < 255; i++) {
+        exp_t[i] = x;
+        log_t[x] = (uint8_t)i;
+        x ^= xtime(x);
+    }
+
+    for (int i = 0; i < 256; i++) {
+        uint8_t inv = i ? exp_t[(255 - log_t[i]) % 255] : 0;
+        uint8_t s = inv;
+        for (int shift = 1; shift <= 4; shift++) {
+            s ^= (uint8_t)((inv << shift) | (inv >> (8 - shift)));
+        }
+        s ^= 0x63;
+        sbox_t[i] = s;
+        inv_sbox_t[s] = (uint8_t)i;
+    }
+
+    for (int i = 0; i < 256; i++) {
+        // Column (2s, s, s, 3s), rows 0..3 in bytes 0..3
+        uint8_t s = sbox_t[i];
+        uint8_t s2 = xtime(s);
+        Te[0][i] = (uint32_t)s2 | ((uint32_t)s << 8) | ((uint32_t)s << 16) | ((uint32_t)(s2 ^ s) << 24);
+
+        // Column (14t, 9t, 13t, 11t) for t = InvSubBytes(i)
+        uint8_t t = inv_sbox_t[i];
+        uint8_t t2 = xtime(t), t4 = xtime(t2), t8 = xtime(t4);
+        Td[0][i] = (uint32_t)(t8 ^ t4 ^ t2) | ((uint32_t)(t8 ^ t) << 8) |
+                   ((uint32_t)(t8 ^ t4 ^ t) << 16) | ((uint32_t)(t8 ^ t2 ^ t) << 24);
+
+        for (int r = 1; r < 4; r++) {
+            Te[r][i] = rotl32(Te[0][i], 8 * r);
+            Td[r][i] = rotl32(Td[0][i], 8 * r);
+        }
+    }
+
+    tables_ready = 1;
+}
+
+// Read 4 bytes as a little-endian word
+static inline uint32_t load_le32(const uint8_t *bytes) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint32_t w;
+    memcpy(&w, bytes, 4);
+    return w;
+#else
+    return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) |
+           ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+#endif
+}
+
+static inline void store_le32(uint8_t *bytes, uint32_t w) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    memcpy(bytes, &w, 4);
+#else
+    bytes[0] = (uint8_t)w;
+    bytes[1] = (uint8_t)(w >> 8);
+    bytes[2] = (uint8_t)(w >> 16);
+    bytes[3] = (uint8_t)(w >> 24);
+#endif
+}
+
+#define B0(w) ((w) & 0xff)
+#define B1(w) (((w) >> 8) & 0xff)
+#define B2(w) (((w) >> 16) & 0xff)
+#define B3(w) ((w) >> 24)
+
+// One middle encryption round: SubBytes + ShiftRows + MixColumns + AddRoundKey
+#define ENC_ROUND(k) do {                                                           \
+        uint32_t t0 = Te[0][B0(s0)] ^ Te[1][B1(s1)] ^ Te[2][B2(s2)] ^ Te[3][B3(s3)] ^ (k)[0]; \
+        uint32_t t1 = Te[0][B0(s1)] ^ Te[1][B1(s2)] ^ Te[2][B2(s3)] ^ Te[3][B3(s0)] ^ (k)[1]; \
+        uint32_t t2 = Te[0][B0(s2)] ^ Te[1][B1(s3)] ^ Te[2][B2(s0)] ^ Te[3][B3(s1)] ^ (k)[2]; \
+        uint32_t t3 = Te[0][B0(s3)] ^ Te[1][B1(s0)] ^ Te[2][B2(s1)] ^ Te[3][B3(s2)] ^ (k)[3]; \
+        s0 = t0; s1 = t1; s2 = t2; s3 = t3;                                          \
+    } while (0)
+
+// One middle round of the equivalent inverse cipher: InvSubBytes +
+// InvShiftRows + InvMixColumns + AddRoundKey (with an InvMixColumns'd key)
+#define DEC_ROUND(k) do {                                                           \
+        uint32_t t0 = Td[0][B0(s0)] ^ Td[1][B1(s3)] ^ Td[2][B2(s2)] ^ Td[3][B3(s1)] ^ (k)[0]; \
+        uint32_t t1 = Td[0][B0(s1)] ^ Td[1][B1(s0)] ^ Td[2][B2(s3)] ^ Td[3][B3(s2)] ^ (k)[1]; \
+        uint32_t t2 = Td[0][B0(s2)] ^ Td[1][B1(s1)] ^ Td[2][B2(s0)] ^ Td[3][B3(s3)] ^ (k)[2]; \
+        uint32_t t3 = Td[0][B0(s3)] ^ Td[1][B1(s2)] ^ Td[2][B2(s1)] ^ Td[3][B3(s0)] ^ (k)[3]; \
+        s0 = t0; s1 = t1; s2 = t2; s3 = t3;                                          \
+    } while (0)
+
+// Final rounds: S-box bytes only, no MixColumns
+#define SUB4(box, a, b, c, d) \
+    ((uint32_t)box[B0(a)] | ((uint32_t)box[B1(b)] << 8) | ((uint32_t)box[B2(c)] << 16) | ((uint32_t)box[B3(d)] << 24))
+
+// Key schedule as words: rk[4 * round + column]
+static inline void load_key_words(const uint8_t *bytes, uint32_t *words, int n) {
+    for (int i = 0; i < n; i++) {
+        words[i] = load_le32(bytes + 4 * i);
+    }
+}
+
+// InvMixColumns of one column word: Td(SubBytes(x)) undoes the InvSubBytes
+static inline uint32_t inv_mix_column(uint32_t w) {
+    return Td[0][sbox_t[B0(w)]] ^ Td[1][sbox_t[B1(w)]] ^ Td[2][sbox_t[B2(w)]] ^ Td[3][sbox_t[B3(w)]];
+}
+
+// Encrypt one block given the key words and the tweaked round key words
+static inline void encrypt_words(const uint32_t *rk, const uint32_t *tk, int nr, int tr,
+                                 const uint8_t *in, uint8_t *out) {
+    uint32_t s0 = load_le32(in) ^ rk[0];
+    uint32_t s1 = load_le32(in + 4) ^ rk[1];
+    uint32_t s2 = load_le32(in + 8) ^ rk[2];
+    uint32_t s3 = load_le32(in + 12) ^ rk[3];
+
+    for (int round = 1; round < tr; round++) {
+        ENC_ROUND(rk + 4 * round);
+    }
+    ENC_ROUND(tk);
+    for (int round = tr + 1; round < nr; round++) {
+        ENC_ROUND(rk + 4 * round);
+    }
+
+    const uint32_t *k = rk + 4 * nr;
+    store_le32(out, SUB4(sbox_t, s0, s1, s2, s3) ^ k[0]);
+    store_le32(out + 4, SUB4(sbox_t, s1, s2, s3, s0) ^ k[1]);
+    store_le32(out + 8, SUB4(sbox_t, s2, s3, s0, s1) ^ k[2]);
+    store_le32(out + 12, SUB4(sbox_t, s3, s0, s1, s2) ^ k[3]);
+}
+
+// Decrypt one block; dk holds InvMixColumns'd middle keys and tk_imc the
+// InvMixColumns'd tweaked round key, rk0/rk_last the untransformed outer keys
+static inline void decrypt_words(const uint32_t *dk, const uint32_t *tk_imc, const uint32_t *rk0,
+                                 const uint32_t *rk_last, int nr, int tr,
+                                 const uint8_t *in, uint8_t *out) {
+    uint32_t s0 = load_le32(in) ^ rk_last[0];
+    uint32_t s1 = load_le32(in + 4) ^ rk_last[1];
+    uint32_t s2 = load_le32(in + 8) ^ rk_last[2];
+    uint32_t s3 = load_le32(in + 12) ^ rk_last[3];
+
+    for (int round = nr - 1; round > tr; round--) {
+        DEC_ROUND(dk + 4 * round);
+    }
+    DEC_ROUND(tk_imc);
+    for (int round = tr - 1; round >= 1; round--) {
+        DEC_ROUND(dk + 4 * round);
+    }
+
+    store_le32(out, SUB4(inv_sbox_t, s0, s3, s2, s1) ^ rk0[0]);
+    store_le32(out + 4, SUB4(inv_sbox_t, s1, s0, s3, s2) ^ rk0[1]);
+    store_le32(out + 8, SUB4(inv_sbox_t, s2, s1, s0, s3) ^ rk0[2]);
+    store_le32(out + 12, SUB4(inv_sbox_t, s3, s2, s1, s0) ^ rk0[3]);
+}
+
+// InvMixColumns'd middle round keys: the precomputed ones of a decryption
+// context, otherwise derived into dk
+static void load_dec_key_words(const taes_ctx *ctx, uint32_t dk[60]) {
+    int nr = ctx->num_rounds;
+
+    if (ctx->has_dec_round_keys) {
+        load_key_words(ctx->dec_round_keys, dk, 4 * (nr + 1));
+        return;
+    }
+
+    load_key_words(ctx->round_keys, dk, 4 * (nr + 1));
+    for (int i = 4; i < 4 * nr; i++) {
+        dk[i] = inv_mix_column(dk[i]);
+    }
+}
+
+// Nonzero once the tables are built (always, after library load)
+int taes_ttable_available(void) {
+    build_tables();
+    return 1;
+}
+
+// Initialize context (key expansion shared with the portable backend)
+int taes_init_ttable(taes_ctx *ctx, const uint8_t *key, int key_size, const uint8_t *tweak) {
+    build_tables();
+    return taes_init_portable(ctx, key, key_size, tweak);
+}
+
+// Initialize a decryption context: also store InvMixColumns of the middle
+// round keys (the same schedule the AES-NI backend uses)
+int taes_init_decrypt_ttable(taes_ctx *ctx, const uint8_t *key, int key_size, const uint8_t *tweak) {
+    if (taes_init_ttable(ctx, key, key_size, tweak) != 0) {
+        return -1;
+    }
+
+    memcpy(ctx->dec_round_keys, ctx->round_keys, sizeof(ctx->dec_round_keys));
+    for (int i = 4; i < 4 * ctx->num_rounds; i++) {
+        store_le32(ctx->dec_round_keys + 4 * i, inv_mix_column(load_le32(ctx->round_keys + 4 * i)));
+    }
+    ctx->has_dec_round_keys = 1;
+    return 0;
+}
+
+// Encrypt a single block
+void taes_encrypt_block_ttable(const taes_ctx *ctx, const uint8_t *plaintext, uint8_t *ciphertext) {
+    uint32_t rk[60], tk[4];
+    load_key_words(ctx->round_keys, rk, 4 * (ctx->num_rounds + 1));
+    load_key_words(ctx->tweaked_round_key, tk, 4);
+    encrypt_words(rk, tk, ctx->num_rounds, ctx->tweak_round, plaintext, ciphertext);
+}
+
+// Decrypt a single block
+void taes_decrypt_block_ttable(const taes_ctx *ctx, const uint8_t *ciphertext, uint8_t *plaintext) {
+    uint32_t dk[60], rk0[4], rk_last[4], tk[4];
+    const int nr = ctx->num_rounds;
+
+    load_dec_key_words(ctx, dk);
+    load_key_words(ctx->round_keys, rk0, 4);
+    load_key_words(ctx->round_keys + 16 * nr, rk_last, 4);
+    load_key_words(ctx->tweaked_round_key, tk, 4);
+    for (int c = 0; c < 4; c++) {
+        tk[c] = inv_mix_column(tk[c]);
+    }
+    decrypt_words(dk, tk, rk0, rk_last, nr, ctx->tweak_round, ciphertext, plaintext);
+}
+
+// Encrypt nblocks consecutive blocks, block j using tweak + first + j
+void ctr_encrypt_blocks_ttable(const taes_ctx *ctx, uint64_t first, const uint8_t *in,
+                               uint8_t *out, size_t nblocks) {
+    uint32_t rk[60];
+    const int nr = ctx->num_rounds;
+    const int tr = ctx->tweak_round;
+    load_key_words(ctx->round_keys, rk, 4 * (nr + 1));
+
+    // Tweaked round key of the next block as a 128-bit counter
+    unsigned __int128 tk = 0;
+    for (int i = 15; i >= 0; i--) {
+        tk = (tk << 8) | ctx->tweaked_round_key[i];
+    }
+    tk += first;
+
+    for (size_t i = 0; i < nblocks; i++, tk++) {
+        uint32_t tk_words[4] = {
+            (uint32_t)tk, (uint32_t)(tk >> 32), (uint32_t)(tk >> 64), (uint32_t)(tk >> 96),
+        };
+        encrypt_words(rk, tk_words, nr, tr, in + i * AES_BLOCK_SIZE, out + i * AES_BLOCK_SIZE);
+    }
+}
+
+// Decrypt nblocks consecutive blocks, block j using tweak + first + j
+// InvMixColumns is linear over XOR and tk + j == tk ^ j when tk is a
+// multiple of 8 and j < 8, so the tweaked key is transformed once per 8
+// blocks: imc(tk + j) = imc(tk) ^ imc(j)
+void ctr_decrypt_blocks_ttable(const taes_ctx *ctx, uint64_t first, const uint8_t *in,
+                               uint8_t *out, size_t nblocks) {
+    uint32_t dk[60], rk0[4], rk_last[4];
+    const int nr = ctx->num_rounds;
+    const int tr = ctx->tweak_round;
+    load_dec_key_words(ctx, dk);
+    load_key_words(ctx->round_keys, rk0, 4);
+    load_key_words(ctx->round_keys + 16 * nr, rk_last, 4);
+
+    // imc(j) for j < 8 only touches the low column
+    uint32_t imc_offset[8];
+    for (uint32_t j = 0; j < 8; j++) {
+        imc_offset[j] = inv_mix_column(j);
+    }
+
+    unsigned __int128 tk = 0;
+    for (int i = 15; i >= 0; i--) {
+        tk = (tk << 8) | ctx->tweaked_round_key[i];
+    }
+    tk += first;
+
+    uint32_t base[4] = {0};
+    for (size_t i = 0; i < nblocks; i++, tk++) {
+        unsigned j = (unsigned)tk & 7;
+        if (i == 0 || j == 0) {
+            unsigned __int128 aligned = tk - j;
+            base[0] = inv_mix_column((uint32_t)aligned);
+            base[1] = inv_mix_column((uint32_t)(aligned >> 32));
+            base[2] = inv_mix_column((uint32_t)(aligned >> 64));
+            base[3] = inv_mix_column((uint32_t)(aligned >> 96));
+        }
+        uint32_t tk_imc[4] = {base[0] ^ imc_offset[j], base[1], base[2], base[3]};
+        decrypt_words(dk, tk_imc, rk0, rk_last, nr, tr, in + i * AES_BLOCK_SIZE, out + i * AES_BLOCK_SIZE);
+    }
+}
+
+// Tweaked round key RK + tweak as words (128-bit little-endian addition)
+static inline void tweak_key_words(unsigned __int128 rk, const uint8_t *tweak, uint32_t tk[4]) {
+    unsigned __int128 t = 0;
+    for (int i = 15; i >= 0; i--) {
+        t = (t << 8) | tweak[i];
+    }
+    t += rk;
+    tk[0] = (uint32_t)t;
+    tk[1] = (uint32_t)(t >> 32);
+    tk[2] = (uint32_t)(t >> 64);
+    tk[3] = (uint32_t)(t >> 96);
+}
+
+// The untweaked round key at the tweak round as a 128-bit integer
+static inline unsigned __int128 tweak_round_key(const uint32_t *rk, int tr) {
+    const uint32_t *k = rk + 4 * tr;
+    return (unsigned __int128)k[0] | ((unsigned __int128)k[1] << 32) |
+           ((unsigned __int128)k[2] << 64) | ((unsigned __int128)k[3] << 96);
+}
+
+// Encrypt nblocks blocks, block i with tweak tweaks[i] (16 bytes each)
+void taes_encrypt_blocks_ttable(const taes_ctx *ctx, const uint8_t *plaintext, uint8_t *ciphertext,
+                                const uint8_t *tweaks, size_t nblocks) {
+    uint32_t rk[60], tk[4];
+    const int nr = ctx->num_rounds;
+    const int tr = ctx->tweak_round;
+    load_key_words(ctx->round_keys, rk, 4 * (nr + 1));
+    unsigned __int128 rk_tr = tweak_round_key(rk, tr);
+
+    for (size_t i = 0; i < nblocks; i++) {
+        tweak_key_words(rk_tr, tweaks + i * TWEAK_SIZE, tk);
+        encrypt_words(rk, tk, nr, tr, plaintext + i * AES_BLOCK_SIZE, ciphertext + i * AES_BLOCK_SIZE);
+    }
+}
+
+// Decrypt nblocks blocks, block i with tweak tweaks[i]; every block's
+// tweaked round key gets its own InvMixColumns
+void taes_decrypt_blocks_ttable(const taes_ctx *ctx, const uint8_t *ciphertext, uint8_t *plaintext,
+                                const uint8_t *tweaks, size_t nblocks) {
+    uint32_t dk[60], rk0[4], rk_last[4], tk[4];
+    const int nr = ctx->num_rounds;
+    const int tr = ctx->tweak_round;
+    load_dec_key_words(ctx, dk);
+    load_key_words(ctx->round_keys, rk0, 4);
+    load_key_words(ctx->round_keys + 16 * nr, rk_last, 4);
+    load_key_words(ctx->round_keys + 16 * tr, tk, 4);
+    unsigned __int128 rk_tr = tweak_round_key(tk, 0);
+
+    for (size_t i = 0; i < nblocks; i++) {
+        tweak_key_words(rk_tr, tweaks + i * TWEAK_SIZE, tk);
+        for (int c = 0; c < 4; c++) {
+            tk[c] = inv_mix_column(tk[c]);
+        }
+        decrypt_words(dk, tk, rk0, rk_last, nr, tr, ciphertext + i * AES_BLOCK_SIZE, plaintext + i * AES_BLOCK_SIZE);
+    }
+}
+
+// Counter mode on the T-table backend (same output as counter_mode_encrypt())
+int counter_mode_encrypt_ttable(const taes_ctx *ctx, const uint8_t *plaintext,
+                                uint8_t *ciphertext, size_t length) {
+    return ctr_encrypt_cts(ctx, plaintext, ciphertext, length, ctr_encrypt_blocks_ttable);
+}
+
+int counter_mode_decrypt_ttable(const taes_ctx *ctx, const uint8_t *ciphertext,
+                                uint8_t *plaintext, size_t length) {
+    return ctr_decrypt_cts(ctx, ciphertext, plaintext, length, ctr_decrypt_blocks_ttable);
+}
@@ -0,0 +1,273 @@
+// Incremental re-encryption (see taes_update.h)
+// The blocks before the stolen pair are handled in pieces of UPDATE_PIECE
+// bytes: the diff marks a piece's dirty blocks in a bitmap (a page at a time
+// is compared first, so unchanged stretches cost one memcmp()), and the runs
+// of either bitmap are re-encrypted as sectors of one block and written
+// with pwrite(). The stolen pair is counter mode of its own under the tweak
+// advanced to its first block.
+#define _POSIX_C_SOURCE 200809L
+#include "../include/taes_update.h"
+#include "../include/counter_mode.h"
+#include "../include/taes_sector.h"
+#include "taes_io.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Bytes compared or read at a time
+#define UPDATE_PIECE (4 * 1024 * 1024)
+#define PIECE_BLOCKS (UPDATE_PIECE / AES_BLOCK_SIZE)
+
+// Blocks compared at once before looking at single ones (a page)
+#define COMPARE_BLOCKS 256
+
+static int file_size(int fd, uint64_t *size) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return -1;
+    }
+    *size = (uint64_t)st.st_size;
+    return 0;
+}
+
+// Blocks of a message before its stolen pair (all of them if there is none)
+static uint64_t plain_blocks(uint64_t length) {
+    uint64_t blocks = length / AES_BLOCK_SIZE;
+    return length % AES_BLOCK_SIZE == 0 || blocks == 0 ? blocks : blocks - 1;
+}
+
+static int is_dirty(const uint8_t *bits, uint64_t i) {
+    return bits[i / 8] >> (i % 8) & 1;
+}
+
+// The next run of dirty blocks from *at on and before end, clean gaps of up
+// to TAES_UPDATE_MERGE_GAP blocks included: [*at, *at + *count). 0 when
+// there is none.
+static int next_run(const uint8_t *bits, uint64_t *at, uint64_t end, uint64_t *count) {
+    uint64_t i = *at;
+    while (i < end && !is_dirty(bits, i)) {
+        i = i % 8 == 0 && bits[i / 8] == 0 ? i + 8 : i + 1;
+    }
+    if (i >= end) {
+        return 0;
+    }
+    uint64_t start = i;
+    uint64_t last = i;
+    for (i++; i < end && i - last - 1 <= TAES_UPDATE_MERGE_GAP; i++) {
+        if (is_dirty(bits, i)) {
+            last = i;
+        }
+    }
+    *at = start;
+    *count = last + 1 - start;
+    return 1;
+}
+
+// Encrypt count blocks of new plaintext at buf in place, the first being
+// block first, and write them over the ciphertext
+static int write_blocks(const taes_ctx *ctx, int ct_fd, uint8_t *buf, uint64_t first, size_t count,
+                        taes_update_stats *stats) {
+    taes_sector_encrypt(ctx, first, AES_BLOCK_SIZE, buf, buf, count);
+    stats->written += count;
+    return pwrite_all(ct_fd, buf, count * AES_BLOCK_SIZE, first * AES_BLOCK_SIZE);
+}
+
+// Read blocks [first, first + count) of the new plaintext and rewrite them,
+// a piece at a time
+static int rewrite_range(const taes_ctx *ctx, int new_fd, int ct_fd, uint8_t *buf, uint64_t first,
+                         uint64_t count, taes_update_stats *stats) {
+    while (count > 0) {
+        size_t n = count < PIECE_BLOCKS ? (size_t)count : PIECE_BLOCKS;
+        if (pread_exact(new_fd, buf, n * AES_BLOCK_SIZE, first * AES_BLOCK_SIZE) != 0 ||
+            write_blocks(ctx, ct_fd, buf, first, n, stats) != 0) {
+            return -1;
+        }
+        first += n;
+        count -= n;
+    }
+    return 0;
+}
+
+// Encrypt the new stolen pair, bytes from block first to new_length
+static int write_pair(const taes_ctx *ctx, int new_fd, int ct_fd, uint64_t first, uint64_t new_length,
+                      taes_update_stats *stats) {
+    uint8_t plain[3 * AES_BLOCK_SIZE];
+    uint8_t cipher[3 * AES_BLOCK_SIZE];
+    size_t length = (size_t)(new_length - first * AES_BLOCK_SIZE);
+    if (pread_exact(new_fd, plain, length, first * AES_BLOCK_SIZE) != 0) {
+        return -1;
+    }
+    taes_ctx pair = *ctx;
+    taes_advance_tweak(&pair, first);
+    counter_mode_encrypt(&pair, plain, cipher, length);
+    taes_cleanup(&pair);
+    stats->dirty += 2;
+    stats->written += 2;
+    return pwrite_all(ct_fd, cipher, length, first * AES_BLOCK_SIZE);
+}
+
+// Check the lengths and start the stats; 0 to go on
+static int begin(const taes_ctx *ctx, uint64_t old_length, int new_fd, int ct_fd, uint64_t *new_length,
+                 taes_update_stats *stats) {
+    uint64_t ct_length;
+    if (!ctx) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (file_size(new_fd, new_length) != 0 || file_size(ct_fd, &ct_length) != 0) {
+        return -1;
+    }
+    if (*new_length <= AES_BLOCK_SIZE) {
+        return TAES_UPDATE_BAD_LENGTH;
+    }
+    // An interrupted update leaves the file at least as long as it was, or
+    // already at the new length
+    if (ct_length < old_length && ct_length != *new_length) {
+        errno = EINVAL;
+        return -1;
+    }
+    memset(stats, 0, sizeof(*stats));
+    stats->blocks = (*new_length + AES_BLOCK_SIZE - 1) / AES_BLOCK_SIZE;
+    return 0;
+}
+
+// Compare a piece of n blocks, of which the first m are in the old
+// plaintext's ordinary blocks, and mark the dirty ones in bits
+static uint64_t diff_piece(const uint8_t *new_data, const uint8_t *old_data, size_t n, size_t m,
+                           uint8_t *bits) {
+    uint64_t dirty = 0;
+    memset(bits, 0, (n + 7) / 8);
+    for (size_t j = 0; j < n;) {
+        size_t stretch = n - j < COMPARE_BLOCKS ? n - j : COMPARE_BLOCKS;
+        if (j + stretch <= m &&
+            memcmp(new_data + j * AES_BLOCK_SIZE, old_data + j * AES_BLOCK_SIZE, stretch * AES_BLOCK_SIZE) == 0) {
+            j += stretch;
+            continue;
+        }
+        for (size_t end = j + stretch; j < end; j++) {
+            if (j >= m || memcmp(new_data + j * AES_BLOCK_SIZE, old_data + j * AES_BLOCK_SIZE, AES_BLOCK_SIZE) != 0) {
+                bits[j / 8] |= (uint8_t)(1u << (j % 8));
+                dirty++;
+            }
+        }
+    }
+    return dirty;
+}
+
+int taes_update_fd(const taes_ctx *ctx, int old_fd, int new_fd, int ct_fd, taes_update_stats *stats) {
+    taes_update_stats local;
+    stats = stats ? stats : &local;
+    uint64_t old_length;
+    uint64_t new_length;
+    if (file_size(old_fd, &old_length) != 0) {
+        return -1;
+    }
+    int ret = begin(ctx, old_length, new_fd, ct_fd, &new_length, stats);
+    if (ret != 0) {
+        return ret;
+    }
+    uint64_t old_plain = plain_blocks(old_length);
+    uint64_t new_plain = plain_blocks(new_length);
+    uint8_t *new_data = malloc(UPDATE_PIECE);
+    uint8_t *old_data = malloc(UPDATE_PIECE);
+    uint8_t *bits = malloc(PIECE_BLOCKS / 8);
+    if (!new_data || !old_data || !bits) {
+        ret = -1;
+    }
+
+    for (uint64_t first = 0; ret == 0 && first < new_plain; first += PIECE_BLOCKS) {
+        size_t n = new_plain - first < PIECE_BLOCKS ? (size_t)(new_plain - first) : PIECE_BLOCKS;
+        size_t m = old_plain <= first ? 0 : old_plain - first < n ? (size_t)(old_plain - first) : n;
+        if (pread_exact(new_fd, new_data, n * AES_BLOCK_SIZE, first * AES_BLOCK_SIZE) != 0 ||
+            pread_exact(old_fd, old_data, m * AES_BLOCK_SIZE, first * AES_BLOCK_SIZE) != 0) {
+            ret = -1;
+            break;
+        }
+        stats->dirty += diff_piece(new_data, old_data, n, m, bits);
+        uint64_t at = 0;
+        uint64_t count;
+        while (ret == 0 && next_run(bits, &at, n, &count)) {
+            ret = write_blocks(ctx, ct_fd, new_data + at * AES_BLOCK_SIZE, first + at, (size_t)count, stats);
+            at += count;
+        }
+    }
+
+    if (ret == 0 && new_length % AES_BLOCK_SIZE != 0) {
+        // The pair stays if the length and its plaintext do
+        uint64_t offset = new_plain * AES_BLOCK_SIZE;
+        size_t length = (size_t)(new_length - offset);
+        int same = 0;
+        if (old_length == new_length) {
+            uint8_t a[3 * AES_BLOCK_SIZE];
+            uint8_t b[3 * AES_BLOCK_SIZE];
+            if (pread_exact(old_fd, a, length, offset) != 0 || pread_exact(new_fd, b, length, offset) != 0) {
+                ret = -1;
+            }
+            same = ret == 0 && memcmp(a, b, length) == 0;
+        }
+        if (ret == 0 && !same) {
+            ret = write_pair(ctx, new_fd, ct_fd, new_plain, new_length, stats);
+        }
+    }
+    if (ret == 0 && ftruncate(ct_fd, (off_t)new_length) != 0) {
+        ret = -1;
+    }
+    free(new_data);
+    free(old_data);
+    free(bits);
+    return ret;
+}
+
+int taes_update_blocks_fd(const taes_ctx *ctx, uint64_t old_length, const uint8_t *dirty,
+                          uint64_t nblocks, int new_fd, int ct_fd, taes_update_stats *stats) {
+    taes_update_stats local;
+    stats = stats ? stats : &local;
+    uint64_t new_length;
+    if (!dirty && nblocks > 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    int ret = begin(ctx, old_length, new_fd, ct_fd, &new_length, stats);
+    if (ret != 0) {
+        return ret;
+    }
+    uint64_t new_plain = plain_blocks(new_length);
+    // The bitmap counts up to the old stolen pair; every block after it is
+    // rewritten
+    uint64_t mapped = plain_blocks(old_length);
+    mapped = nblocks < mapped ? nblocks : mapped;
+    mapped = new_plain < mapped ? new_plain : mapped;
+    uint8_t *buf = malloc(UPDATE_PIECE);
+    if (!buf) {
+        return -1;
+    }
+
+    for (uint64_t i = 0; i < mapped; i++) {
+        stats->dirty += (uint64_t)is_dirty(dirty, i);
+    }
+    uint64_t at = 0;
+    uint64_t count;
+    while (ret == 0 && next_run(dirty, &at, mapped, &count)) {
+        ret = rewrite_range(ctx, new_fd, ct_fd, buf, at, count, stats);
+        at += count;
+    }
+    if (ret == 0 && mapped < new_plain) {
+        stats->dirty += new_plain - mapped;
+        ret = rewrite_range(ctx, new_fd, ct_fd, buf, mapped, new_plain - mapped, stats);
+    }
+
+    if (ret == 0 && new_length % AES_BLOCK_SIZE != 0) {
+        int same = old_length == new_length && new_plain + 1 < nblocks &&
+                   !is_dirty(dirty, new_plain) && !is_dirty(dirty, new_plain + 1);
+        if (!same) {
+            ret = write_pair(ctx, new_fd, ct_fd, new_plain, new_length, stats);
+        }
+    }
+    if (ret == 0 && ftruncate(ct_fd, (off_t)new_length) != 0) {
+        ret = -1;
+    }
+    free(buf);
+    return ret;
+}
@@ -0,0 +1,676 @@
+// T-AES counter mode using VAES (AES instructions on 256/512-bit vectors)
+// Each VAES instruction runs one AES round on 2 (ymm) or 4 (zmm) independent
+// blocks. The kernels are compiled per function with target attributes, so
+// this file builds without -m flags and only runs them after CPUID checks;
+// without VAES everything falls back to the 128-bit AES-NI path.
+#include "../include/taes.h"
+#include "../include/counter_mode.h"
+#include "taes_backend.h"
+#include <stdatomic.h>
+#include <string.h>
+#include <immintrin.h>
+
+#define VAES512_TARGET __attribute__((target("aes,vaes,avx512f")))
+#define VAES256_TARGET __attribute__((target("aes,vaes,avx2")))
+
+// Vector registers in flight per batch: 8 zmm = 32 blocks, 8 ymm = 16 blocks
+#define VAES_REGS 8
+
+// Loop over the registers of a batch (fully unrolled)
+#define FOR_EACH_REG(r) _Pragma("GCC unroll 8") for (int r = 0; r < VAES_REGS; r++)
+
+// Blocks per VAES instruction in use: 4 (AVX-512), 2 (AVX2) or 0 (AES-NI
+// fallback); -1 until detected. Atomic: the kernels read it on pool threads
+// while the first caller, or taes_vaes_select(), may be storing it.
+static atomic_int vaes_lanes = -1;
+
+static int detect_vaes_lanes(void) {
+    __builtin_cpu_init();
+    if (!__builtin_cpu_supports("aes") || !__builtin_cpu_supports("vaes")) {
+        return 0;
+    }
+    if (__builtin_cpu_supports("avx512f")) {
+        return 4;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return 2;
+    }
+    return 0;
+}
+
+// Blocks processed per VAES instruction on this CPU (0: AES-NI fallback)
+int taes_vaes_lanes(void) {
+    int lanes = atomic_load_explicit(&vaes_lanes, memory_order_relaxed);
+    if (lanes < 0) {
+        // Every thread that gets here detects the same value
+        lanes = detect_vaes_lanes();
+        atomic_store_explicit(&vaes_lanes, lanes, memory_order_relaxed);
+    }
+    return lanes;
+}
+
+// Limit the vector width, e.g. to compare ymm and zmm or to avoid AVX-512
+// frequency drops. Returns the width now in use (never more than the CPU has).
+int taes_vaes_select(int max_lanes) {
+    int lanes = detect_vaes_lanes();
+    if (max_lanes < lanes) {
+        lanes = max_lanes >= 2 ? 2 : 0;
+    }
+    atomic_store_explicit(&vaes_lanes, lanes, memory_order_relaxed);
+    return lanes;
+}
+
+// Tweaked round key of block `first` as two 64-bit halves
+static inline void first_tweak_key(const taes_ctx *ctx, uint64_t first, uint64_t *lo, uint64_t *hi) {
+    memcpy(lo, ctx->tweaked_round_key, 8);
+    memcpy(hi, ctx->tweaked_round_key + 8, 8);
+    *lo += first;
+    *hi += *lo < first;
+}
+
+// imc(j) for j < n, the in-batch offsets of the decryption tweak keys (see
+// ctr_decrypt_blocks_ni(): for an aligned tk, imc(tk + j) = imc(tk) ^ imc(j))
+__attribute__((target("aes")))
+static void imc_offsets(__m128i *offsets, int n) {
+    for (int j = 0; j < n; j++) {
+        offsets[j] = _mm_aesimc_si128(_mm_cvtsi32_si128(j));
+    }
+}
+
+// InvMixColumns schedule: the precomputed one of a decryption context,
+// otherwise derived into dk_buf
+__attribute__((target("aes")))
+static const __m128i *dec_round_keys(const taes_ctx *ctx, __m128i dk_buf[15]) {
+    if (ctx->has_dec_round_keys) {
+        return (const __m128i *)ctx->dec_round_keys;
+    }
+
+    const __m128i *rk = (const __m128i *)ctx->round_keys;
+    for (int round = 1; round < ctx->num_rounds; round++) {
+        dk_buf[round] = _mm_aesimc_si128(_mm_loadu_si128(&rk[round]));
+    }
+    return dk_buf;
+}
+
+// ---------------------------------------------------------------------------
+// AVX-512: four blocks per zmm register
+// ---------------------------------------------------------------------------
+
+// Four independent 128-bit little-endian additions
+VAES512_TARGET
+static inline __m512i add128_x4(__m512i a, __m512i b) {
+    __m512i sum = _mm512_add_epi64(a, b);
+    // Carries out of the low halves (even qwords) go into the high halves
+    __mmask8 carry = _mm512_cmplt_epu64_mask(sum, b) & 0x55;
+    return _mm512_mask_add_epi64(sum, (__mmask8)(carry << 1), sum, _mm512_set1_epi64(1));
+}
+
+// Encrypt nblocks consecutive blocks, block j using tweak + first + j
+VAES512_TARGET
+static void ctr_encrypt_blocks_vaes512(const taes_ctx *ctx, uint64_t first, const uint8_t *in,
+                                       uint8_t *out, size_t nblocks) {
+    enum { LANES = 4, BATCH = VAES_REGS * LANES };
+    const __m128i *rk = (const __m128i *)ctx->round_keys;
+    const int nr = ctx->num_rounds;
+    const int tr = ctx->tweak_round;
+
+    __m512i rkz[15];
+    for (int round = 0; round <= nr; round++) {
+        rkz[round] = _mm512_broadcast_i32x4(_mm_loadu_si128(&rk[round]));
+    }
+
+    // Register r, lane j holds the tweaked round key of block 4r + j
+    uint64_t lo, hi;
+    first_tweak_key(ctx, first, &lo, &hi);
+    __m512i tk = _mm512_broadcast_i32x4(_mm_set_epi64x((long long)hi, (long long)lo));
+    __m512i tks[VAES_REGS];
+    FOR_EACH_REG(r) {
+        tks[r] = add128_x4(tk, _mm512_set_epi64(0, 4 * r + 3, 0, 4 * r + 2, 0, 4 * r + 1, 0, 4 * r));
+    }
+    const __m512i step = _mm512_set_epi64(0, BATCH, 0, BATCH, 0, BATCH, 0, BATCH);
+
+    size_t i = 0;
+    for (; i + BATCH <= nblocks; i += BATCH) {
+        const __m512i *src = (const __m512i *)(in + i * AES_BLOCK_SIZE);
+        __m512i *dst = (__m512i *)(out + i * AES_BLOCK_SIZE);
+        __m512i b[VAES_REGS];
+
+        FOR_EACH_REG(r) b[r] = _mm512_xor_si512(_mm512_loadu_si512(src + r), rkz[0]);
+        for (int round = 1; round < tr; round++) {
+            FOR_EACH_REG(r) b[r] = _mm512_aesenc_epi128(b[r], rkz[round]);
+        }
+        FOR_EACH_REG(r) {
+            b[r] = _mm512_aesenc_epi128(b[r], tks[r]);
+            tks[r] = add128_x4(tks[r], step);
+        }
+        for (int round = tr + 1; round < nr; round++) {
+            FOR_EACH_REG(r) b[r] = _mm512_aesenc_epi128(b[r], rkz[round]);
+        }
+        FOR_EACH_REG(r) _mm512_storeu_si512(dst + r, _mm512_aesenclast_epi128(b[r], rkz[nr]));
+    }
+
+    if (i < nblocks) {
+        ctr_encrypt_blocks_ni(ctx, first + i, in + i * AES_BLOCK_SIZE, out + i * AES_BLOCK_SIZE, nblocks - i);
+    }
+}
+
+// Decrypt nblocks consecutive blocks, block j using tweak + first + j
+// Batches are aligned to a multiple of 32 blocks so the per-block InvMixColumns
+// of the tweaked key costs one AESIMC per batch, as in ctr_decrypt_blocks_ni()
+VAES512_TARGET
+static void ctr_decrypt_blocks_vaes512(const taes_ctx *ctx, uint64_t first, const uint8_t *in,
+                                       uint8_t *out, size_t nblocks) {
+    enum { LANES = 4, BATCH = VAES_REGS * LANES };
+    const __m128i *rk = (const __m128i *)ctx->round_keys;
+    const int nr = ctx->num_rounds;
+    const int tr = ctx->tweak_round;
+
+    uint64_t lo, hi;
+    first_tweak_key(ctx, first, &lo, &hi);
+    size_t head = (size_t)(-lo & (BATCH - 1));
+    if (head >= nblocks) {
+        ctr_decrypt_blocks_ni(ctx, first, in, out, nblocks);
+        return;
+    }
+    if (head > 0) {
+        ctr_decrypt_blocks_ni(ctx, first, in, out, head);
+        lo += head;
+        hi += lo < head;
+    }
+
+    __m128i dk_buf[15];
+    const __m128i *dk = dec_round_keys(ctx, dk_buf);
+    __m512i dkz[15];
+    dkz[0] = _mm512_broadcast_i32x4(_mm_loadu_si128(&rk[0]));
+    for (int round = 1; round < nr; round++) {
+        dkz[round] = _mm512_broadcast_i32x4(_mm_loadu_si128(&dk[round]));
+    }
+    dkz[nr] = _mm512_broadcast_i32x4(_mm_loadu_si128(&rk[nr]));
+
+    __m128i offsets[BATCH];
+    imc_offsets(offsets, BATCH);
+
+    size_t i = head;
+    for (; i + BATCH <= nblocks; i += BATCH) {
+        const __m512i *src = (const __m512i *)(in + i * AES_BLOCK_SIZE);
+        __m512i *dst = (__m512i *)(out + i * AES_BLOCK_SIZE);
+        __m512i b[VAES_REGS];
+
+        __m512i tk_imc = _mm512_broadcast_i32x4(
+            _mm_aesimc_si128(_mm_set_epi64x((long long)hi, (long long)lo)));
+        lo += BATCH;
+        hi += lo < BATCH;
+
+        FOR_EACH_REG(r) b[r] = _mm512_xor_si512(_mm512_loadu_si512(src + r), dkz[nr]);
+        for (int round = nr - 1; round > tr; round--) {
+            FOR_EACH_REG(r) b[r] = _mm512_aesdec_epi128(b[r], dkz[round]);
+        }
+        FOR_EACH_REG(r) {
+            __m512i key = _mm512_xor_si512(tk_imc, _mm512_loadu_si512(&offsets[LANES * r]));
+            b[r] = _mm512_aesdec_epi128(b[r], key);
+        }
+        for (int round = tr - 1; round >= 1; round--) {
+            FOR_EACH_REG(r) b[r] = _mm512_aesdec_epi128(b[r], dkz[round]);
+        }
+        FOR_EACH_REG(r) _mm512_storeu_si512(dst + r, _mm512_aesdeclast_epi128(b[r], dkz[0]));
+    }
+
+    if (i < nblocks) {
+        ctr_decrypt_blocks_ni(ctx, first + i, in + i * AES_BLOCK_SIZE, out + i * AES_BLOCK_SIZE, nblocks - i);
+    }
+}
+
+// Blocks with a tweak each (taes_encrypt_blocks()): register r holds blocks
+// 4r..4r+3 of a batch, with tweaked keys RK + tweaks[j] loaded four at a time
+VAES512_TARGET
+static void tweak_blocks_vaes512(const taes_ctx *ctx, const uint8_t *in, uint8_t *out,
+                                 const uint8_t *tweaks, size_t nblocks, int decrypt) {
+    enum { LANES = 4, BATCH = VAES_REGS * LANES };
+    const __m128i *rk = (const __m128i *)ctx->round_keys;
+    const int nr = ctx->num_rounds;
+    const int tr = ctx->tweak_round;
+    const __m512i zero = _mm512_setzero_si512();
+
+    // Round keys in the order they are applied; decryption uses the
+    // InvMixColumns schedule for the middle rounds
+    __m128i dk_buf[15];
+    const __m128i *mid = decrypt ? dec_round_keys(ctx, dk_buf) : rk;
+    __m512i keys[15];
+    keys[0] = _mm512_broadcast_i32x4(_mm_loadu_si128(&rk[decrypt ? nr : 0]));
+    for (int n = 1; n < nr; n++) {
+        keys[n] = _mm512_broadcast_i32x4(_mm_loadu_si128(&mid[decrypt ? nr - n : n]));
+    }
+    keys[nr] = _mm512_broadcast_i32x4(_mm_loadu_si128(&rk[decrypt ? 0 : nr]));
+    const __m512i rk_tr = _mm512_broadcast_i32x4(_mm_loadu_si128(&rk[tr]));
+    const int before = decrypt ? nr - tr : tr;
+
+    size_t i = 0;
+    for (; i + BATCH <= nblocks; i += BATCH) {
+        const __m512i *src = (const __m512i *)(in + i * AES_BLOCK_SIZE);
+        const __m512i *tw = (const __m512i *)(tweaks + i * TWEAK_SIZE);
+        __m512i *dst = (__m512i *)(out + i * AES_BLOCK_SIZE);
+        __m512i b[VAES_REGS];
+
+        FOR_EACH_REG(r) b[r] = _mm512_xor_si512(_mm512_loadu_si512(src + r), keys[0]);
+        for (int n = 1; n < before; n++) {
+            FOR_EACH_REG(r) b[r] = decrypt ? _mm512_aesdec_epi128(b[r], keys[n])
+                                           : _mm512_aesenc_epi128(b[r], keys[n]);
+        }
+        // imc(x) = AESDEC(AESENCLAST(x, 0), 0) transforms four keys at once
+        FOR_EACH_REG(r) {
+            __m512i tk = add128_x4(rk_tr, _mm512_loadu_si512(tw + r));
+            if (decrypt) {
+                tk = _mm512_aesdec_epi128(_mm512_aesenclast_epi128(tk, zero), zero);
+                b[r] = _mm512_aesdec_epi128(b[r], tk);
+            } else {
+                b[r] = _mm512_aesenc_epi128(b[r], tk);
+            }
+        }
+        for (int n = before + 1; n < nr; n++) {
+            FOR_EACH_REG(r) b[r] = decrypt ? _mm512_aesdec_epi128(b[r], keys[n])
+                                           : _mm512_aesenc_epi128(b[r], keys[n]);
+        }
+        FOR_EACH_REG(r) {
+            _mm512_storeu_si512(dst + r, decrypt ? _mm512_aesdeclast_epi128(b[r], keys[nr])
+                                                 : _mm512_aesenclast_epi128(b[r], keys[nr]));
+        }
+    }
+
+    if (i < nblocks) {
+        (decrypt ? taes_decrypt_blocks_ni : taes_encrypt_blocks_ni)(
+            ctx, in + i * AES_BLOCK_SIZE, out + i * AES_BLOCK_SIZE, tweaks + i * TWEAK_SIZE, nblocks - i);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// AVX2: two blocks per ymm register
+// ---------------------------------------------------------------------------
+
+// Two independent 128-bit little-endian additions (same carry trick as add128())
+VAES256_TARGET
+static inline __m256i add128_x2(__m256i a, __m256i b) {
+    __m256i sum = _mm256_add_epi64(a, b);
+    __m256i carry = _mm256_or_si256(_mm256_and_si256(a, b),
+                                    _mm256_andnot_si256(sum, _mm256_or_si256(a, b)));
+    carry = _mm256_srli_epi64(carry, 63);
+    // Byte shift within each 128-bit lane: low carry into high half
+    return _mm256_add_epi64(sum, _mm256_slli_si256(carry, 8));
+}
+
+// Encrypt nblocks consecutive blocks, block j using tweak + first + j
+VAES256_TARGET
+static void ctr_encrypt_blocks_vaes256(const taes_ctx *ctx, uint64_t first, const uint8_t *in,
+                                       uint8_t *out, size_t nblocks) {
+    enum { LANES = 2, BATCH = VAES_REGS * LANES };
+    const __m128i *rk = (const __m128i *)ctx->round_keys;
+    const int nr = ctx->num_rounds;
+    const int tr = ctx->tweak_round;
+
+    __m256i rky[15];
+    for (int round = 0; round <= nr; round++) {
+        rky[round] = _mm256_broadcastsi128_si256(_mm_loadu_si128(&rk[round]));
+    }
+
+    // Lane offsets: register r, lane j is block 2r + j of the batch
+    __m256i offsets[VAES_REGS];
+    FOR_EACH_REG(r) offsets[r] = _mm256_set_epi64x(0, 2 * r + 1, 0, 2 * r);
+
+    uint64_t lo, hi;
+    first_tweak_key(ctx, first, &lo, &hi);
+
+    size_t i = 0;
+    for (; i + BATCH <= nblocks; i += BATCH) {
+        const __m256i *src = (const __m256i *)(in + i * AES_BLOCK_SIZE);
+        __m256i *dst = (__m256i *)(out + i * AES_BLOCK_SIZE);
+        __m256i b[VAES_REGS];
+
+        // With only 16 ymm registers the batch's tweaked keys are rebuilt
+        // from the scalar counter instead of being kept live across rounds
+        __m256i tk = _mm256_broadcastsi128_si256(_mm_set_epi64x((long long)hi, (long long)lo));
+        const int carries = lo > UINT64_MAX - (BATCH - 1);
+        lo += BATCH;
+        hi += lo < BATCH;
+
+        FOR_EACH_REG(r) b[r] = _mm256_xor_si256(_mm256_loadu_si256(src + r), rky[0]);
+        for (int round = 1; round < tr; round++) {
+            FOR_EACH_REG(r) b[r] = _mm256_aesenc_epi128(b[r], rky[round]);
+        }
+        FOR_EACH_REG(r) {
+            __m256i key = carries ? add128_x2(tk, offsets[r]) : _mm256_add_epi64(tk, offsets[r]);
+            b[r] = _mm256_aesenc_epi128(b[r], key);
+        }
+        for (int round = tr + 1; round < nr; round++) {
+            FOR_EACH_REG(r) b[r] = _mm256_aesenc_epi128(b[r], rky[round]);
+        }
+        FOR_EACH_REG(r) _mm256_storeu_si256(dst + r, _mm256_aesenclast_epi128(b[r], rky[nr]));
+    }
+
+    if (i < nblocks) {
+        ctr_encrypt_blocks_ni(ctx, first + i, in + i * AES_BLOCK_SIZE, out + i * AES_BLOCK_SIZE, nblocks - i);
+    }
+}
+
+// Decrypt nblocks consecutive blocks, block j using tweak + first + j
+// (batches aligned to a multiple of 16 blocks, see ctr_decrypt_blocks_vaes512())
+VAES256_TARGET
+static void ctr_decrypt_blocks_vaes256(const taes_ctx *ctx, uint64_t first, const uint8_t *in,
+                                       uint8_t *out, size_t nblocks) {
+    enum { LANES = 2, BATCH = VAES_REGS * LANES };
+    const __m128i *rk = (const __m128i *)ctx->round_keys;
+    const int nr = ctx->num_rounds;
+    const int tr = ctx->tweak_round;
+
+    uint64_t lo, hi;
+    first_tweak_key(ctx, first, &lo, &hi);
+    size_t head = (size_t)(-lo & (BATCH - 1));
+    if (head >= nblocks) {
+        ctr_decrypt_blocks_ni(ctx, first, in, out, nblocks);
+        return;
+    }
+    if (head > 0) {
+        ctr_decrypt_blocks_ni(ctx, first, in, out, head);
+        lo += head;
+        hi += lo < head;
+    }
+
+    __m128i dk_buf[15];
+    const __m128i *dk = dec_round_keys(ctx, dk_buf);
+    __m256i dky[15];
+    dky[0] = _mm256_broadcastsi128_si256(_mm_loadu_si128(&rk[0]));
+    for (int round = 1; round < nr; round++) {
+        dky[round] = _mm256_broadcastsi128_si256(_mm_loadu_si128(&dk[round]));
+    }
+    dky[nr] = _mm256_broadcastsi128_si256(_mm_loadu_si128(&rk[nr]));
+
+    __m128i offsets[BATCH];
+    imc_offsets(offsets, BATCH);
+
+    size_t i = head;
+    for (; i + BATCH <= nblocks; i += BATCH) {
+        const __m256i *src = (const __m256i *)(in + i * AES_BLOCK_SIZE);
+        __m256i *dst = (__m256i *)(out + i * AES_BLOCK_SIZE);
+        __m256i b[VAES_REGS];
+
+        __m256i tk_imc = _mm256_broadcastsi128_si256(
+            _mm_aesimc_si128(_mm_set_epi64x((long long)hi, (long long)lo)));
+        lo += BATCH;
+        hi += lo < BATCH;
+
+        FOR_EACH_REG(r) b[r] = _mm256_xor_si256(_mm256_loadu_si256(src + r), dky[nr]);
+        for (int round = nr - 1; round > tr; round--) {
+            FOR_EACH_REG(r) b[r] = _mm256_aesdec_epi128(b[r], dky[round]);
+        }
+        FOR_EACH_REG(r) {
+            __m256i key = _mm256_xor_si256(tk_imc, _mm256_loadu_si256((const __m256i *)&offsets[LANES * r]));
+            b[r] = _mm256_aesdec_epi128(b[r], key);
+        }
+        for (int round = tr - 1; round >= 1; round--) {
+            FOR_EACH_REG(r) b[r] = _mm256_aesdec_epi128(b[r], dky[round]);
+        }
+        FOR_EACH_REG(r) _mm256_storeu_si256(dst + r, _mm256_aesdeclast_epi128(b[r], dky[0]));
+    }
+
+    if (i < nblocks) {
+        ctr_decrypt_blocks_ni(ctx, first + i, in + i * AES_BLOCK_SIZE, out + i * AES_BLOCK_SIZE, nblocks - i);
+    }
+}
+
+// Blocks with a tweak each, two per ymm (see tweak_blocks_vaes512())
+VAES256_TARGET
+static void tweak_blocks_vaes256(const taes_ctx *ctx, const uint8_t *in, uint8_t *out,
+                                 const uint8_t *tweaks, size_t nblocks, int decrypt) {
+    enum { LANES = 2, BATCH = VAES_REGS * LANES };
+    const __m128i *rk = (const __m128i *)ctx->round_keys;
+    const int nr = ctx->num_rounds;
+    const int tr = ctx->tweak_round;
+    const __m256i zero = _mm256_setzero_si256();
+
+    __m128i dk_buf[15];
+    const __m128i *mid = decrypt ? dec_round_keys(ctx, dk_buf) : rk;
+    __m256i keys[15];
+    keys[0] = _mm256_broadcastsi128_si256(_mm_loadu_si128(&rk[decrypt ? nr : 0]));
+    for (int n = 1; n < nr; n++) {
+        keys[n] = _mm256_broadcastsi128_si256(_mm_loadu_si128(&mid[decrypt ? nr - n : n]));
+    }
+    keys[nr] = _mm256_broadcastsi128_si256(_mm_loadu_si128(&rk[decrypt ? 0 : nr]));
+    const __m256i rk_tr = _mm256_broadcastsi128_si256(_mm_loadu_si128(&rk[tr]));
+    const int before = decrypt ? nr - tr : tr;
+
+    size_t i = 0;
+    for (; i + BATCH <= nblocks; i += BATCH) {
+        const __m256i *src = (const __m256i *)(in + i * AES_BLOCK_SIZE);
+        const __m256i *tw = (const __m256i *)(tweaks + i * TWEAK_SIZE);
+        __m256i *dst = (__m256i *)(out + i * AES_BLOCK_SIZE);
+        __m256i b[VAES_REGS];
+
+        FOR_EACH_REG(r) b[r] = _mm256_xor_si256(_mm256_loadu_si256(src + r), keys[0]);
+        for (int n = 1; n < before; n++) {
+            FOR_EACH_REG(r) b[r] = decrypt ? _mm256_aesdec_epi128(b[r], keys[n])
+                                           : _mm256_aesenc_epi128(b[r], keys[n]);
+        }
+        FOR_EACH_REG(r) {
+            __m256i tk = add128_x2(rk_tr, _mm256_loadu_si256(tw + r));
+            if (decrypt) {
+                tk = _mm256_aesdec_epi128(_mm256_aesenclast_epi128(tk, zero), zero);
+                b[r] = _mm256_aesdec_epi128(b[r], tk);
+            } else {
+                b[r] = _mm256_aesenc_epi128(b[r], tk);
+            }
+        }
+        for (int n = before + 1; n < nr; n++) {
+            FOR_EACH_REG(r) b[r] = decrypt ? _mm256_aesdec_epi128(b[r], keys[n])
+                                           : _mm256_aesenc_epi128(b[r], keys[n]);
+        }
+        FOR_EACH_REG(r) {
+            _mm256_storeu_si256(dst + r, decrypt ? _mm256_aesdeclast_epi128(b[r], keys[nr])
+                                                 : _mm256_aesenclast_epi128(b[r], keys[nr]));
+        }
+    }
+
+    if (i < nblocks) {
+        (decrypt ? taes_decrypt_blocks_ni : taes_encrypt_blocks_ni)(
+            ctx, in + i * AES_BLOCK_SIZE, out + i * AES_BLOCK_SIZE, tweaks + i * TWEAK_SIZE, nblocks - i);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Counter mode
+// ---------------------------------------------------------------------------
+
+void ctr_encrypt_blocks_vaes(const taes_ctx *ctx, uint64_t first, const uint8_t *in,
+                             uint8_t *out, size_t nblocks) {
+    switch (taes_vaes_lanes()) {
+    case 4:
+        ctr_encrypt_blocks_vaes512(ctx, first, in, out, nblocks);
+        break;
+    case 2:
+        ctr_encrypt_blocks_vaes256(ctx, first, in, out, nblocks);
+        break;
+    default:
+        ctr_encrypt_blocks_ni(ctx, first, in, out, nblocks);
+        break;
+    }
+}
+
+void ctr_decrypt_blocks_vaes(const taes_ctx *ctx, uint64_t first, const uint8_t *in,
+                             uint8_t *out, size_t nblocks) {
+    switch (taes_vaes_lanes()) {
+    case 4:
+        ctr_decrypt_blocks_vaes512(ctx, first, in, out, nblocks);
+        break;
+    case 2:
+        ctr_decrypt_blocks_vaes256(ctx, first, in, out, nblocks);
+        break;
+    default:
+        ctr_decrypt_blocks_ni(ctx, first, in, out, nblocks);
+        break;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Blocks with a tweak each
+// ---------------------------------------------------------------------------
+
+void taes_encrypt_blocks_vaes(const taes_ctx *ctx, const uint8_t *plaintext, uint8_t *ciphertext,
+                              const uint8_t *tweaks, size_t nblocks) {
+    switch (taes_vaes_lanes()) {
+    case 4:
+        tweak_blocks_vaes512(ctx, plaintext, ciphertext, tweaks, nblocks, 0);
+        break;
+    case 2:
+        tweak_blocks_vaes256(ctx, plaintext, ciphertext, tweaks, nblocks, 0);
+        break;
+    default:
+        taes_encrypt_blocks_ni(ctx, plaintext, ciphertext, tweaks, nblocks);
+        break;
+    }
+}
+
+void taes_decrypt_blocks_vaes(const taes_ctx *ctx, const uint8_t *ciphertext, uint8_t *plaintext,
+                              const uint8_t *tweaks, size_t nblocks) {
+    switch (taes_vaes_lanes()) {
+    case 4:
+        tweak_blocks_vaes512(ctx, ciphertext, plaintext, tweaks, nblocks, 1);
+        break;
+    case 2:
+        tweak_blocks_vaes256(ctx, ciphertext, plaintext, tweaks, nblocks, 1);
+        break;
+    default:
+        taes_decrypt_blocks_ni(ctx, ciphertext, plaintext, tweaks, nblocks);
+        break;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Multi-buffer: 16 streams, four consecutive blocks of one stream per zmm
+// ---------------------------------------------------------------------------
+
+#define MB_VAES_LANES 16
+
+// Loop over the sixteen lanes (fully unrolled)
+#define FOR_EACH_MB_LANE(l) _Pragma("GCC unroll 16") for (int l = 0; l < MB_VAES_LANES; l++)
+
+// Round key r of lane l in all four positions of a zmm
+#define MB_KEY512(r, l) _mm512_broadcast_i32x4(_mm_load_si128((const __m128i *)mgr->keys[r][l]))
+
+// Each register holds up to four blocks of one lane, so the round keys are
+// the lane's broadcast and the tweak keys tk + 0..3. A lane with fewer than
+// four blocks left uses masked loads and stores.
+VAES512_TARGET
+static inline __attribute__((always_inline))
+void mb_rounds_vaes512(taes_mb_mgr *mgr, size_t nblocks, const int nr, const int tr, const int decrypt) {
+    const uint8_t *src[MB_VAES_LANES];
+    uint8_t *dst[MB_VAES_LANES];
+    uint64_t lo[MB_VAES_LANES], hi[MB_VAES_LANES];
+    const __m512i offsets = _mm512_set_epi64(0, 3, 0, 2, 0, 1, 0, 0);
+    const __m512i zero = _mm512_setzero_si512();
+    const int before = decrypt ? nr - tr : tr;  // Rounds before the tweak round
+
+    FOR_EACH_MB_LANE(l) {
+        taes_mb_lane *lane = &mgr->lane[l];
+        src[l] = lane->job ? lane->in : mgr->scratch;
+        dst[l] = lane->job ? lane->out : mgr->scratch;
+        memcpy(&lo[l], lane->tweaked_key, 8);
+        memcpy(&hi[l], lane->tweaked_key + 8, 8);
+    }
+
+    for (size_t i = 0; i < nblocks; i += 4) {
+        size_t k = nblocks - i < 4 ? nblocks - i : 4;
+        __mmask8 mask = (__mmask8)((1u << (2 * k)) - 1);
+        __m512i b[MB_VAES_LANES];
+
+        FOR_EACH_MB_LANE(l) {
+            b[l] = _mm512_maskz_loadu_epi64(mask, src[l] + i * AES_BLOCK_SIZE);
+            b[l] = _mm512_xor_si512(b[l], MB_KEY512(decrypt ? nr : 0, l));
+        }
+
+        // Rounds before the tweak round (from the top when decrypting)
+        TAES_UNROLL
+        for (int n = 1; n < before; n++) {
+            int round = decrypt ? nr - n : n;
+            FOR_EACH_MB_LANE(l) {
+                b[l] = decrypt ? _mm512_aesdec_epi128(b[l], MB_KEY512(round, l))
+                               : _mm512_aesenc_epi128(b[l], MB_KEY512(round, l));
+            }
+        }
+
+        // Tweak round: tk + 0..3 of the lane (InvMixColumns'd for decryption,
+        // with imc(x) = AESDEC(AESENCLAST(x, 0), 0))
+        FOR_EACH_MB_LANE(l) {
+            __m512i tks = _mm512_add_epi64(_mm512_broadcast_i32x4(_mm_set_epi64x((long long)hi[l], (long long)lo[l])),
+                                           offsets);
+            if (decrypt) {
+                tks = _mm512_aesdec_epi128(_mm512_aesenclast_epi128(tks, zero), zero);
+                b[l] = _mm512_aesdec_epi128(b[l], tks);
+            } else {
+                b[l] = _mm512_aesenc_epi128(b[l], tks);
+            }
+            lo[l] += k;
+        }
+
+        // Rounds after the tweak round
+        TAES_UNROLL
+        for (int n = before + 1; n < nr; n++) {
+            int round = decrypt ? nr - n : n;
+            FOR_EACH_MB_LANE(l) {
+                b[l] = decrypt ? _mm512_aesdec_epi128(b[l], MB_KEY512(round, l))
+                               : _mm512_aesenc_epi128(b[l], MB_KEY512(round, l));
+            }
+        }
+
+        FOR_EACH_MB_LANE(l) {
+            b[l] = decrypt ? _mm512_aesdeclast_epi128(b[l], MB_KEY512(0, l))
+                           : _mm512_aesenclast_epi128(b[l], MB_KEY512(nr, l));
+            _mm512_mask_storeu_epi64(dst[l] + i * AES_BLOCK_SIZE, mask, b[l]);
+        }
+    }
+
+    FOR_EACH_MB_LANE(l) {
+        taes_mb_lane *lane = &mgr->lane[l];
+        if (lane->job) {
+            lane->in += nblocks * AES_BLOCK_SIZE;
+            lane->out += nblocks * AES_BLOCK_SIZE;
+        }
+    }
+}
+
+VAES512_TARGET
+static void mb_encrypt_vaes512(taes_mb_mgr *mgr, size_t nblocks) {
+    switch (mgr->num_rounds) {
+        case 10: mb_rounds_vaes512(mgr, nblocks, 10, 5, 0); break;
+        case 12: mb_rounds_vaes512(mgr, nblocks, 12, 6, 0); break;
+        default: mb_rounds_vaes512(mgr, nblocks, 14, 7, 0); break;
+    }
+}
+
+VAES512_TARGET
+static void mb_decrypt_vaes512(taes_mb_mgr *mgr, size_t nblocks) {
+    switch (mgr->num_rounds) {
+        case 10: mb_rounds_vaes512(mgr, nblocks, 10, 5, 1); break;
+        case 12: mb_rounds_vaes512(mgr, nblocks, 12, 6, 1); break;
+        default: mb_rounds_vaes512(mgr, nblocks, 14, 7, 1); break;
+    }
+}
+
+static const taes_mb_kernel mb_kernel_vaes512 = {
+    MB_VAES_LANES, mb_load_keys_ni, mb_encrypt_vaes512, mb_decrypt_vaes512,
+};
+
+// 16 lanes with AVX-512; CPUs with only the ymm width use the eight AES-NI lanes
+const taes_mb_kernel *taes_mb_kernel_vaes(void) {
+    return taes_vaes_lanes() == 4 ? &mb_kernel_vaes512 : taes_mb_kernel_ni();
+}
+
+// Encrypt using counter mode with incrementing tweaks (VAES, falls back to AES-NI)
+// Same output as counter_mode_encrypt()
+int counter_mode_encrypt_vaes(const taes_ctx *ctx, const uint8_t *plaintext,
+                              uint8_t *ciphertext, size_t length) {
+    return ctr_encrypt_cts(ctx, plaintext, ciphertext, length, ctr_encrypt_blocks_vaes);
+}
+
+// Decrypt using counter mode with incrementing tweaks (VAES, falls back to AES-NI)
+// Same output as counter_mode_decrypt()
+int counter_mode_decrypt_vaes(const taes_ctx *ctx, const uint8_t *ciphertext,
+                              uint8_t *plaintext, size_t length) {
+    return ctr_decrypt_cts(ctx, ciphertext, plaintext, length, ctr_decrypt_blocks_vaes);
+}
@@ -0,0 +1,209 @@
+// Client side of the taesd protocol (see taesd.h)
+#define _GNU_SOURCE
+#include "../include/taesd.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+int taesd_socket_path(const char *path, char *buf, size_t size) {
+    if (!path || !*path) {
+        path = getenv("TAESD_SOCKET");
+    }
+    int len;
+    if (path && *path) {
+        len = snprintf(buf, size, "%s", path);
+    } else {
+        // Per-user and owner-only, unlike a shared directory such as /tmp
+        const char *dir = getenv("XDG_RUNTIME_DIR");
+        if (!dir || !*dir) {
+            errno = ENOENT;
+            return -1;
+        }
+        len = snprintf(buf, size, "%s/%s", dir, TAESD_SOCKET_NAME);
+    }
+    if (len < 0 || (size_t)len >= size) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return 0;
+}
+
+int taesd_connect(const char *path) {
+    struct sockaddr_un addr = {0};
+    if (taesd_socket_path(path, addr.sun_path, sizeof(addr.sun_path)) != 0) {
+        return -1;
+    }
+    addr.sun_family = AF_UNIX;
+
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        return -1;
+    }
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(sock);
+        return -1;
+    }
+
+    // Whoever created the socket gets the passwords: it must be us
+    struct ucred cred;
+    socklen_t cred_len = sizeof(cred);
+    if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) != 0 || cred.uid != geteuid()) {
+        close(sock);
+        errno = EPERM;
+        return -1;
+    }
+    return sock;
+}
+
+// Send all of iov; the first sendmsg() carries fd (if >= 0)
+static int send_all(int sock, struct iovec *iov, int iovcnt, int fd) {
+    char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr msg = {0};
+
+    msg.msg_iov = iov;
+    msg.msg_iovlen = (size_t)iovcnt;
+    if (fd >= 0) {
+        memset(control, 0, sizeof(control));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+
+    while (msg.msg_iovlen > 0) {
+        ssize_t n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return -1;
+        }
+        msg.msg_control = NULL;
+        msg.msg_controllen = 0;
+
+        // Skip what was sent
+        while (msg.msg_iovlen > 0 && (size_t)n >= msg.msg_iov->iov_len) {
+            n -= (ssize_t)msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if (msg.msg_iovlen > 0) {
+            msg.msg_iov->iov_base = (uint8_t *)msg.msg_iov->iov_base + n;
+            msg.msg_iov->iov_len -= (size_t)n;
+        }
+    }
+    return 0;
+}
+
+static int recv_all(int sock, void *buf, size_t length) {
+    uint8_t *p = buf;
+    while (length > 0) {
+        ssize_t n = recv(sock, p, length, 0);
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        length -= (size_t)n;
+    }
+    return 0;
+}
+
+// Send a request, receive the response header
+static int exchange(int sock, const taesd_request *req, const char *password, const char *tweak_password,
+                    const uint8_t *inline_data, int fd, taesd_response *resp) {
+    struct iovec iov[4] = {
+        {(void *)req, sizeof(*req)},
+        {(void *)password, req->password_len},
+        {(void *)tweak_password, req->tweak_len},
+        {(void *)inline_data, inline_data ? req->length : 0},
+    };
+
+    if (send_all(sock, iov, 4, fd) != 0 || recv_all(sock, resp, sizeof(*resp)) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int taesd_crypt(int sock, int decrypt, int key_bits, const char *password, const char *tweak_password,
+                uint8_t *data, size_t length) {
+    if (sock < 0 || !password || (!data && length > 0)) {
+        return -1;
+    }
+
+    size_t password_len = strlen(password);
+    size_t tweak_len = tweak_password ? strlen(tweak_password) : 0;
+    if (password_len > TAESD_SECRET_MAX || tweak_len > TAESD_SECRET_MAX) {
+        return -1;
+    }
+
+    taesd_request req = {TAESD_MAGIC, decrypt ? TAESD_OP_DECRYPT : TAESD_OP_ENCRYPT, (uint32_t)key_bits,
+                         (uint32_t)password_len, (uint32_t)tweak_len, length > TAESD_INLINE_MAX, length};
+    taesd_response resp;
+
+    if (!req.shm) {
+        if (exchange(sock, &req, password, tweak_password, data, -1, &resp) != 0) {
+            return -1;
+        }
+        if (resp.status != 0) {
+            return -1;
+        }
+        return resp.length == length ? recv_all(sock, data, length) : -1;
+    }
+
+    // Large payload: share a memfd with the daemon, which works in place.
+    // Sealed at its size, so the daemon's mapping cannot lose pages under it.
+    int fd = memfd_create("taesd", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        return -1;
+    }
+    int ret = -1;
+    uint8_t *shared = MAP_FAILED;
+    if (ftruncate(fd, (off_t)length) == 0 && fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) == 0) {
+        shared = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (shared != MAP_FAILED) {
+        memcpy(shared, data, length);
+        if (exchange(sock, &req, password, tweak_password, NULL, fd, &resp) == 0 && resp.status == 0) {
+            memcpy(data, shared, length);
+            ret = 0;
+        }
+        munmap(shared, length);
+    }
+    close(fd);
+    return ret;
+}
+
+int taesd_stats(int sock, char *text, size_t size) {
+    taesd_request req = {TAESD_MAGIC, TAESD_OP_STATS, 0, 0, 0, 0, 0};
+    taesd_response resp;
+
+    if (sock < 0 || !text || size == 0) {
+        return -1;
+    }
+    if (exchange(sock, &req, NULL, NULL, NULL, -1, &resp) != 0 || resp.status != 0) {
+        return -1;
+    }
+
+    // Keep what fits, drain the rest
+    size_t keep = resp.length < size - 1 ? resp.length : size - 1;
+    if (recv_all(sock, text, keep) != 0) {
+        return -1;
+    }
+    text[keep] = '\0';
+    for (size_t left = resp.length - keep; left > 0;) {
+        char skip[256];
+        size_t n = left < sizeof(skip) ? left : sizeof(skip);
+        if (recv_all(sock, skip, n) != 0) {
+            return -1;
+        }
+        left -= n;
+    }
+    return 0;
+}
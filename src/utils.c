@@ -1,30 +1,108 @@
 // Utility functions for key derivation and helpers
-#include "../include/taes.h"
+#include "../include/taes_utils.h"
 #include <openssl/evp.h>
 #include <openssl/sha.h>
 #include <string.h>
 
-// Derive key from password using PBKDF2
-int derive_key_from_password(const char *password, uint8_t *key, int key_size) {
-    if (!password || !key) {
+// PBKDF2-HMAC-SHA256 with a fixed salt per purpose (key and tweak must not
+// come out equal for equal passwords). A fixed salt keeps the CLIs
+// deterministic: the same password always gives the same key. Containers
+// add a random salt of their own, kept in their header.
+#define PBKDF2_ITERATIONS 100000
+
+static const char key_salt[] = "T-AES key v1";
+static const char tweak_salt[] = "T-AES tweak v1";
+
+// PBKDF2 salted with the purpose's salt followed by extra_salt
+static int pbkdf2(const char *password, const char *purpose, const uint8_t *extra_salt, size_t extra_len,
+                  int iterations, uint8_t *out, int out_len) {
+    uint8_t salt[64];
+    size_t purpose_len = strlen(purpose);
+    if (purpose_len + extra_len > sizeof(salt)) {
         return -1;
     }
+    memcpy(salt, purpose, purpose_len);
+    if (extra_len > 0) {
+        memcpy(salt + purpose_len, extra_salt, extra_len);
+    }
 
-    // TODO: Implement key derivation using OpenSSL's PBKDF2
-    // Use a fixed salt for simplicity (in production, use random salt)
-    // Use appropriate iteration count
-
+    if (PKCS5_PBKDF2_HMAC(password, (int)strlen(password), salt, (int)(purpose_len + extra_len), iterations,
+                          EVP_sha256(), out_len, out) != 1) {
+        return -1;
+    }
     return 0;
 }
 
+// PBKDF2 with a salt of the caller's (a container header's random salt)
+// after the fixed one, and its iteration count
+int derive_key_with_salt(const char *password, const uint8_t *salt, size_t salt_len, int iterations,
+                         uint8_t *key, int key_size) {
+    if (!password || !key || (salt_len > 0 && !salt) || iterations <= 0) {
+        return -1;
+    }
+    if (key_size != AES_128_KEY_SIZE && key_size != AES_192_KEY_SIZE && key_size != AES_256_KEY_SIZE) {
+        return -1;
+    }
+    return pbkdf2(password, key_salt, salt, salt_len, iterations, key, key_size);
+}
+
+int derive_tweak_with_salt(const char *password, const uint8_t *salt, size_t salt_len, int iterations,
+                           uint8_t *tweak) {
+    if (!password || !tweak || (salt_len > 0 && !salt) || iterations <= 0) {
+        return -1;
+    }
+    return pbkdf2(password, tweak_salt, salt, salt_len, iterations, tweak, TWEAK_SIZE);
+}
+
+// Derive key from password using PBKDF2
+int derive_key_from_password(const char *password, uint8_t *key, int key_size) {
+    return derive_key_with_salt(password, NULL, 0, PBKDF2_ITERATIONS, key, key_size);
+}
+
 // Derive tweak from password using PBKDF2 (separate from key derivation)
 int derive_tweak_from_password(const char *password, uint8_t *tweak) {
-    if (!password || !tweak) {
+    return derive_tweak_with_salt(password, NULL, 0, PBKDF2_ITERATIONS, tweak);
+}
+
+// Context for a container: key and tweak from the passwords with the KDF
+// parameters of its header (taes_container.h); decrypt: taes_init_decrypt()
+int container_context(taes_ctx *ctx, const taes_container_params *params, const char *password,
+                      const char *tweak_password, int decrypt) {
+    if (!ctx || !params || params->kdf != TAES_CONTAINER_KDF_PBKDF2_SHA256 || params->kdf_iterations > INT32_MAX) {
         return -1;
     }
+    uint8_t key[32];
+    uint8_t tweak[TWEAK_SIZE];
+    int key_size = (int)params->key_bits / 8;
+    int iterations = (int)params->kdf_iterations;
+    int ret = -1;
+    if (derive_key_with_salt(password, params->salt, sizeof(params->salt), iterations, key, key_size) == 0 &&
+        derive_tweak_with_salt(tweak_password, params->salt, sizeof(params->salt), iterations, tweak) == 0) {
+        ret = decrypt ? taes_init_decrypt(ctx, key, key_size, tweak) : taes_init(ctx, key, key_size, tweak);
+    }
+    memset(key, 0, sizeof(key));
+    memset(tweak, 0, sizeof(tweak));
+    return ret;
+}
 
-    // TODO: Implement tweak derivation using OpenSSL's PBKDF2
-    // Use a different salt than key derivation
+// ECB mode of the CLIs (no tweak password): every block on its own under
+// the context's tweak, i.e. plain AES for the zero tweak. Whole blocks only.
+int ecb_encrypt(const taes_ctx *ctx, const uint8_t *in, uint8_t *out, size_t length) {
+    if (!ctx || !in || !out || length % AES_BLOCK_SIZE != 0) {
+        return -1;
+    }
+    for (size_t i = 0; i < length; i += AES_BLOCK_SIZE) {
+        taes_encrypt_block(ctx, in + i, out + i);
+    }
+    return 0;
+}
 
+int ecb_decrypt(const taes_ctx *ctx, const uint8_t *in, uint8_t *out, size_t length) {
+    if (!ctx || !in || !out || length % AES_BLOCK_SIZE != 0) {
+        return -1;
+    }
+    for (size_t i = 0; i < length; i += AES_BLOCK_SIZE) {
+        taes_decrypt_block(ctx, in + i, out + i);
+    }
     return 0;
 }
@@ -1,10 +1,30 @@
 // Test suite for T-AES implementation
+#define _GNU_SOURCE
 #include "../include/taes.h"
 #include "../include/counter_mode.h"
+#include "../include/taes_mb.h"
+#include "../include/taes_stream.h"
+#include "../include/taes_pipeline.h"
+#include "../include/taes_container.h"
+#include "../include/taes_sector.h"
+#include "../include/taes_image.h"
+#include "../include/taes_shard.h"
+#include "../include/taes_update.h"
+#include "../include/taes_pool.h"
+#include "../include/taes_async.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
 
 // Test vectors (standard AES test vectors can be used for basic validation)
 // TODO: Add proper T-AES test vectors
@@ -63,6 +83,51 @@ void test_tweak_effect(void) {
     printf("  PASSED: Different tweaks produce different ciphertexts\n");
 }
 
+// Test that taes_set_tweak/taes_advance_tweak match a full re-initialization
+void test_set_tweak(void) {
+    printf("Testing tweak update without re-keying...\n");
+
+    uint8_t key[16] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+                       0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f};
+    // Low 64 bits all ones so advancing carries into the upper half
+    uint8_t tweak[16] = {0xfe, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                         0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27};
+    uint8_t tweak_plus_3[16] = {0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                0x21, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27};
+    uint8_t plaintext[16] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+                             0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff};
+    uint8_t expected[16];
+    uint8_t ciphertext[16];
+    uint8_t decrypted[16];
+
+    taes_ctx ref, ctx;
+
+    // taes_set_tweak must be equivalent to taes_init with that tweak
+    assert(taes_init(&ref, key, 16, tweak) == 0);
+    assert(taes_init(&ctx, key, 16, NULL) == 0);
+    taes_set_tweak(&ctx, tweak);
+    taes_encrypt_block(&ref, plaintext, expected);
+    taes_encrypt_block(&ctx, plaintext, ciphertext);
+    assert(memcmp(expected, ciphertext, 16) == 0);
+    printf("  PASSED: taes_set_tweak matches taes_init\n");
+
+    // taes_advance_tweak must carry across the 64-bit boundary
+    taes_advance_tweak(&ctx, 3);
+    assert(memcmp(ctx.tweak, tweak_plus_3, 16) == 0);
+    taes_cleanup(&ref);
+    assert(taes_init(&ref, key, 16, tweak_plus_3) == 0);
+    assert(memcmp(ctx.tweaked_round_key, ref.tweaked_round_key, 16) == 0);
+    taes_encrypt_block(&ref, plaintext, expected);
+    taes_encrypt_block(&ctx, plaintext, ciphertext);
+    assert(memcmp(expected, ciphertext, 16) == 0);
+    taes_decrypt_block(&ctx, ciphertext, decrypted);
+    assert(memcmp(plaintext, decrypted, 16) == 0);
+    printf("  PASSED: taes_advance_tweak matches taes_init with tweak + n\n");
+
+    taes_cleanup(&ref);
+    taes_cleanup(&ctx);
+}
+
 // Test counter mode
 void test_counter_mode(void) {
     printf("Testing counter mode...\n");
@@ -96,6 +161,2043 @@ void test_counter_mode(void) {
     taes_cleanup(&ctx);
 }
 
+// Test Ciphertext Stealing on non-block-aligned lengths
+void test_ciphertext_stealing(void) {
+    printf("Testing Ciphertext Stealing...\n");
+
+    uint8_t key[16] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+                       0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f};
+    uint8_t tweak[16] = {0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
+                         0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f};
+    uint8_t plaintext[80];
+    uint8_t ciphertext[80];
+    uint8_t decrypted[80];
+
+    for (int i = 0; i < 80; i++) {
+        plaintext[i] = (uint8_t)(i * 7 + 3);
+    }
+
+    taes_ctx ctx;
+    assert(taes_init(&ctx, key, 16, tweak) == 0);
+
+    // One block is too short for stealing
+    assert(counter_mode_encrypt(&ctx, plaintext, ciphertext, 16) == -1);
+
+    for (size_t length = 17; length <= 80; length++) {
+        assert(counter_mode_encrypt(&ctx, plaintext, ciphertext, length) == 0);
+        assert(counter_mode_decrypt(&ctx, ciphertext, decrypted, length) == 0);
+        assert(memcmp(plaintext, decrypted, length) == 0);
+
+        // Blocks before the stolen pair are plain E(K, P[i], tweak + i)
+        size_t untouched = (length % 16) ? length / 16 - 1 : length / 16;
+        taes_ctx block_ctx = ctx;
+        for (size_t i = 0; i < untouched; i++) {
+            uint8_t block[16];
+            taes_encrypt_block(&block_ctx, plaintext + i * 16, block);
+            assert(memcmp(block, ciphertext + i * 16, 16) == 0);
+            taes_advance_tweak(&block_ctx, 1);
+        }
+    }
+    printf("  PASSED: Lengths 17..80 round-trip\n");
+
+    // In-place operation
+    memcpy(decrypted, plaintext, 45);
+    assert(counter_mode_encrypt(&ctx, decrypted, decrypted, 45) == 0);
+    assert(counter_mode_encrypt(&ctx, plaintext, ciphertext, 45) == 0);
+    assert(memcmp(decrypted, ciphertext, 45) == 0);
+    assert(counter_mode_decrypt(&ctx, decrypted, decrypted, 45) == 0);
+    assert(memcmp(decrypted, plaintext, 45) == 0);
+    printf("  PASSED: In-place encryption/decryption\n");
+
+    taes_cleanup(&ctx);
+}
+
+// Test that the AES-NI implementation matches the standard one
+void test_aes_ni_equivalence(void) {
+    printf("Testing AES-NI equivalence...\n");
+
+    if (!__builtin_cpu_supports("aes")) {
+        printf("  SKIPPED: CPU has no AES-NI\n");
+        return;
+    }
+
+    static const int key_sizes[] = {16, 24, 32};
+    static const size_t lengths[] = {17, 32, 127, 128, 129, 143, 144, 4096, 4100};
+    uint8_t key[32];
+    // Low 64 bits close to overflow so the 8-way kernel carries mid-batch
+    uint8_t tweak[16] = {0xfa, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                         0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f};
+    static uint8_t plaintext[4100];
+    static uint8_t expected[4100];
+    static uint8_t ciphertext[4100];
+    static uint8_t decrypted[4100];
+
+    for (int i = 0; i < 32; i++) {
+        key[i] = (uint8_t)(0xa5 ^ i);
+    }
+    for (size_t i = 0; i < sizeof(plaintext); i++) {
+        plaintext[i] = (uint8_t)(i * 31 + 1);
+    }
+
+    for (size_t k = 0; k < sizeof(key_sizes) / sizeof(key_sizes[0]); k++) {
+        taes_ctx ctx;
+        assert(taes_init_portable(&ctx, key, key_sizes[k], tweak) == 0);
+
+        taes_encrypt_block_portable(&ctx, plaintext, expected);
+        taes_encrypt_block_ni(&ctx, plaintext, ciphertext);
+        assert(memcmp(expected, ciphertext, 16) == 0);
+        taes_decrypt_block_ni(&ctx, ciphertext, decrypted);
+        assert(memcmp(plaintext, decrypted, 16) == 0);
+
+        for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+            size_t length = lengths[l];
+            assert(counter_mode_encrypt_portable(&ctx, plaintext, expected, length) == 0);
+            assert(counter_mode_encrypt_ni(&ctx, plaintext, ciphertext, length) == 0);
+            assert(memcmp(expected, ciphertext, length) == 0);
+            assert(counter_mode_decrypt_ni(&ctx, ciphertext, decrypted, length) == 0);
+            assert(memcmp(plaintext, decrypted, length) == 0);
+        }
+
+        taes_cleanup(&ctx);
+        printf("  PASSED: AES-%d block and counter mode match\n", key_sizes[k] * 8);
+    }
+}
+
+// Test the VAES counter-mode kernels at every vector width against the standard implementation
+void test_vaes_equivalence(void) {
+    printf("Testing VAES equivalence...\n");
+
+    if (!__builtin_cpu_supports("aes")) {
+        printf("  SKIPPED: CPU has no AES-NI\n");
+        return;
+    }
+
+    static const int key_sizes[] = {16, 24, 32};
+    static const int widths[] = {4, 2, 0};
+    // Around one and two batches of 16 and 32 blocks, with partial tails
+    static const size_t lengths[] = {17, 255, 256, 257, 511, 512, 527, 1040, 4096, 4100};
+    uint8_t key[32];
+    uint8_t tweak[16] = {0xe9, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                         0x28, 0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f};
+    static uint8_t plaintext[4100];
+    static uint8_t expected[4100];
+    static uint8_t ciphertext[4100];
+    static uint8_t decrypted[4100];
+
+    for (int i = 0; i < 32; i++) {
+        key[i] = (uint8_t)(0x3c + i * 5);
+    }
+    for (size_t i = 0; i < sizeof(plaintext); i++) {
+        plaintext[i] = (uint8_t)(i * 29 + 11);
+    }
+
+    for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); w++) {
+        int lanes = taes_vaes_select(widths[w]);
+        if (lanes != widths[w]) {
+            printf("  SKIPPED: %d blocks per instruction not supported\n", widths[w]);
+            continue;
+        }
+
+        for (size_t k = 0; k < sizeof(key_sizes) / sizeof(key_sizes[0]); k++) {
+            // Tweak low bytes at every offset within a 32-block batch,
+            // carrying out of the low 64 bits for most of them
+            for (int offset = 0; offset < 32; offset += 3) {
+                taes_ctx ctx, dec;
+                tweak[0] = (uint8_t)(0xe0 + offset);
+                assert(taes_init_portable(&ctx, key, key_sizes[k], tweak) == 0);
+                assert(taes_init_decrypt_ni(&dec, key, key_sizes[k], tweak) == 0);
+
+                for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+                    size_t length = lengths[l];
+                    assert(counter_mode_encrypt_portable(&ctx, plaintext, expected, length) == 0);
+                    assert(counter_mode_encrypt_vaes(&ctx, plaintext, ciphertext, length) == 0);
+                    assert(memcmp(expected, ciphertext, length) == 0);
+                    assert(counter_mode_decrypt_vaes(&ctx, ciphertext, decrypted, length) == 0);
+                    assert(memcmp(plaintext, decrypted, length) == 0);
+                    memset(decrypted, 0, length);
+                    assert(counter_mode_decrypt_vaes(&dec, ciphertext, decrypted, length) == 0);
+                    assert(memcmp(plaintext, decrypted, length) == 0);
+                }
+
+                taes_cleanup(&ctx);
+                taes_cleanup(&dec);
+            }
+        }
+        if (lanes > 0) {
+            printf("  PASSED: %d blocks per instruction match counter_mode_encrypt()\n", lanes);
+        } else {
+            printf("  PASSED: AES-NI fallback matches counter_mode_encrypt()\n");
+        }
+    }
+
+    taes_vaes_select(4);
+}
+
+// Test decryption contexts with the precomputed InvMixColumns schedule
+void test_aes_ni_decrypt_context(void) {
+    printf("Testing AES-NI decryption context...\n");
+
+    if (!__builtin_cpu_supports("aes")) {
+        printf("  SKIPPED: CPU has no AES-NI\n");
+        return;
+    }
+
+    static const int key_sizes[] = {16, 24, 32};
+    static const size_t lengths[] = {17, 32, 48, 130, 256, 1000};
+    uint8_t key[32];
+    uint8_t tweak[16] = {0, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                         0x08, 0x07, 0x06, 0x05, 0x04, 0x03, 0x02, 0x01};
+    static uint8_t plaintext[1000];
+    static uint8_t ciphertext[1000];
+    static uint8_t decrypted[1000];
+
+    for (int i = 0; i < 32; i++) {
+        key[i] = (uint8_t)(i * 13 + 7);
+    }
+    for (size_t i = 0; i < sizeof(plaintext); i++) {
+        plaintext[i] = (uint8_t)(i * 17 + 3);
+    }
+
+    for (size_t k = 0; k < sizeof(key_sizes) / sizeof(key_sizes[0]); k++) {
+        // Every alignment of the first tweak within a batch of 8, the last
+        // ones carrying out of the low 64 bits mid-call
+        for (int offset = 0xf0; offset <= 0xff; offset++) {
+            taes_ctx ref, dec;
+            tweak[0] = (uint8_t)offset;
+            assert(taes_init_portable(&ref, key, key_sizes[k], tweak) == 0);
+            assert(taes_init_decrypt_ni(&dec, key, key_sizes[k], tweak) == 0);
+            assert(dec.has_dec_round_keys && !ref.has_dec_round_keys);
+
+            taes_encrypt_block_portable(&ref, plaintext, ciphertext);
+            taes_decrypt_block_ni(&dec, ciphertext, decrypted);
+            assert(memcmp(plaintext, decrypted, 16) == 0);
+
+            for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+                size_t length = lengths[l];
+                assert(counter_mode_encrypt_portable(&ref, plaintext, ciphertext, length) == 0);
+                assert(counter_mode_decrypt_ni(&dec, ciphertext, decrypted, length) == 0);
+                assert(memcmp(plaintext, decrypted, length) == 0);
+            }
+
+            // The schedule follows the tweak through taes_set_tweak()
+            taes_set_tweak(&ref, NULL);
+            taes_set_tweak(&dec, NULL);
+            assert(counter_mode_encrypt_portable(&ref, plaintext, ciphertext, 130) == 0);
+            assert(counter_mode_decrypt_ni(&dec, ciphertext, decrypted, 130) == 0);
+            assert(memcmp(plaintext, decrypted, 130) == 0);
+
+            taes_cleanup(&ref);
+            taes_cleanup(&dec);
+        }
+        printf("  PASSED: AES-%d decryption context matches taes_init\n", key_sizes[k] * 8);
+    }
+}
+
+// Test AESKEYGENASSIST key expansion and batch key setup against taes_init()
+void test_aes_ni_key_expansion(void) {
+    printf("Testing AES-NI key expansion...\n");
+
+    if (!__builtin_cpu_supports("aes")) {
+        printf("  SKIPPED: CPU has no AES-NI\n");
+        return;
+    }
+
+    enum { NUM_KEYS = 7 };  // One interleaved group of four plus three single keys
+    static const int key_sizes[] = {16, 24, 32};
+    uint8_t keys[NUM_KEYS][32];
+    uint8_t tweaks[NUM_KEYS][16];
+    const uint8_t *key_ptrs[NUM_KEYS];
+    const uint8_t *tweak_ptrs[NUM_KEYS];
+    taes_ctx ctxs[NUM_KEYS];
+    taes_ctx *ctx_ptrs[NUM_KEYS];
+
+    for (int i = 0; i < NUM_KEYS; i++) {
+        for (int j = 0; j < 32; j++) {
+            keys[i][j] = (uint8_t)(i * 37 + j * 11 + 5);
+        }
+        for (int j = 0; j < 16; j++) {
+            tweaks[i][j] = (uint8_t)(0xff - i - j);
+        }
+        key_ptrs[i] = keys[i];
+        tweak_ptrs[i] = tweaks[i];
+        ctx_ptrs[i] = &ctxs[i];
+    }
+
+    for (size_t k = 0; k < sizeof(key_sizes) / sizeof(key_sizes[0]); k++) {
+        int key_size = key_sizes[k];
+        size_t schedule_bytes = 16 * (key_size / 4 + 7);
+        taes_ctx ref, ctx;
+
+        for (int i = 0; i < NUM_KEYS; i++) {
+            assert(taes_init_portable(&ref, keys[i], key_size, tweaks[i]) == 0);
+            assert(taes_init_ni(&ctx, keys[i], key_size, tweaks[i]) == 0);
+            assert(memcmp(ref.round_keys, ctx.round_keys, schedule_bytes) == 0);
+            assert(memcmp(ref.tweaked_round_key, ctx.tweaked_round_key, 16) == 0);
+            assert(ref.num_rounds == ctx.num_rounds && ref.tweak_round == ctx.tweak_round);
+        }
+
+        assert(taes_init_many_ni(ctx_ptrs, key_ptrs, key_size, tweak_ptrs, NUM_KEYS) == 0);
+        for (int i = 0; i < NUM_KEYS; i++) {
+            assert(taes_init_portable(&ref, keys[i], key_size, tweaks[i]) == 0);
+            assert(memcmp(ref.round_keys, ctxs[i].round_keys, schedule_bytes) == 0);
+            assert(memcmp(ref.tweaked_round_key, ctxs[i].tweaked_round_key, 16) == 0);
+        }
+
+        taes_cleanup(&ref);
+        taes_cleanup(&ctx);
+        printf("  PASSED: AES-%d schedules match taes_init\n", key_size * 8);
+    }
+
+    assert(taes_init_many_ni(ctx_ptrs, key_ptrs, 20, NULL, NUM_KEYS) == -1);
+}
+
+// Test the T-table backend against the portable implementation
+void test_ttable_equivalence(void) {
+    printf("Testing T-table backend...\n");
+
+    static const int key_sizes[] = {16, 24, 32};
+    static const size_t lengths[] = {17, 32, 100, 128, 129, 1000};
+    uint8_t key[32];
+    uint8_t tweak[16] = {0xfb, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                         0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0x3e, 0x3f};
+    static uint8_t plaintext[1000];
+    static uint8_t expected[1000];
+    static uint8_t ciphertext[1000];
+    static uint8_t decrypted[1000];
+
+    for (int i = 0; i < 32; i++) {
+        key[i] = (uint8_t)(0xc3 ^ (i * 9));
+    }
+    for (size_t i = 0; i < sizeof(plaintext); i++) {
+        plaintext[i] = (uint8_t)(i * 37 + 5);
+    }
+
+    for (size_t k = 0; k < sizeof(key_sizes) / sizeof(key_sizes[0]); k++) {
+        taes_ctx ref, ctx, dec;
+        assert(taes_init_portable(&ref, key, key_sizes[k], tweak) == 0);
+        assert(taes_init_ttable(&ctx, key, key_sizes[k], tweak) == 0);
+        assert(taes_init_decrypt_ttable(&dec, key, key_sizes[k], tweak) == 0);
+
+        for (int b = 0; b < 8; b++) {
+            taes_encrypt_block_portable(&ref, plaintext + 16 * b, expected);
+            taes_encrypt_block_ttable(&ctx, plaintext + 16 * b, ciphertext);
+            assert(memcmp(expected, ciphertext, 16) == 0);
+            taes_decrypt_block_ttable(&ctx, ciphertext, decrypted);
+            assert(memcmp(plaintext + 16 * b, decrypted, 16) == 0);
+            taes_decrypt_block_ttable(&dec, ciphertext, decrypted);
+            assert(memcmp(plaintext + 16 * b, decrypted, 16) == 0);
+        }
+
+        for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+            size_t length = lengths[l];
+            assert(counter_mode_encrypt_portable(&ref, plaintext, expected, length) == 0);
+            assert(counter_mode_encrypt_ttable(&ctx, plaintext, ciphertext, length) == 0);
+            assert(memcmp(expected, ciphertext, length) == 0);
+            assert(counter_mode_decrypt_ttable(&ctx, ciphertext, decrypted, length) == 0);
+            assert(memcmp(plaintext, decrypted, length) == 0);
+            assert(counter_mode_decrypt_ttable(&dec, ciphertext, decrypted, length) == 0);
+            assert(memcmp(plaintext, decrypted, length) == 0);
+        }
+
+        taes_cleanup(&ref);
+        taes_cleanup(&ctx);
+        taes_cleanup(&dec);
+        printf("  PASSED: AES-%d T-table blocks and counter mode match\n", key_sizes[k] * 8);
+    }
+}
+
+// Test the bitsliced backend against the portable one; the lengths cover
+// short and full 8-block passes, and the tweak carries past 64 bits inside
+// a pass, so each block slot must get its own tweaked round key
+void test_bitslice_equivalence(void) {
+    printf("Testing bitsliced backend...\n");
+
+    static const int key_sizes[] = {16, 24, 32};
+    static const size_t lengths[] = {17, 48, 100, 128, 129, 255, 1000};
+    uint8_t key[32];
+    uint8_t tweak[16] = {0xfd, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                         0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47};
+    static uint8_t plaintext[1000];
+    static uint8_t expected[1000];
+    static uint8_t ciphertext[1000];
+    static uint8_t decrypted[1000];
+
+    for (int i = 0; i < 32; i++) {
+        key[i] = (uint8_t)(0x5a ^ (i * 13));
+    }
+    for (size_t i = 0; i < sizeof(plaintext); i++) {
+        plaintext[i] = (uint8_t)(i * 29 + 11);
+    }
+
+    for (size_t k = 0; k < sizeof(key_sizes) / sizeof(key_sizes[0]); k++) {
+        taes_ctx ref, ctx;
+        assert(taes_init_portable(&ref, key, key_sizes[k], tweak) == 0);
+        assert(taes_init_bitslice(&ctx, key, key_sizes[k], tweak) == 0);
+        // The table-free key expansion gives the same schedule
+        assert(memcmp(ref.round_keys, ctx.round_keys, 16 * (size_t)(ref.num_rounds + 1)) == 0);
+        assert(memcmp(ref.tweaked_round_key, ctx.tweaked_round_key, 16) == 0);
+
+        for (int b = 0; b < 8; b++) {
+            taes_encrypt_block_portable(&ref, plaintext + 16 * b, expected);
+            taes_encrypt_block_bitslice(&ctx, plaintext + 16 * b, ciphertext);
+            assert(memcmp(expected, ciphertext, 16) == 0);
+            taes_decrypt_block_bitslice(&ctx, ciphertext, decrypted);
+            assert(memcmp(plaintext + 16 * b, decrypted, 16) == 0);
+        }
+
+        for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+            size_t length = lengths[l];
+            assert(counter_mode_encrypt_portable(&ref, plaintext, expected, length) == 0);
+            assert(counter_mode_encrypt_bitslice(&ctx, plaintext, ciphertext, length) == 0);
+            assert(memcmp(expected, ciphertext, length) == 0);
+            assert(counter_mode_decrypt_bitslice(&ctx, ciphertext, decrypted, length) == 0);
+            assert(memcmp(plaintext, decrypted, length) == 0);
+        }
+
+        taes_cleanup(&ref);
+        taes_cleanup(&ctx);
+        printf("  PASSED: AES-%d bitsliced blocks and counter mode match\n", key_sizes[k] * 8);
+    }
+}
+
+// Test runtime backend selection: every backend the CPU supports gives the
+// portable backend's results through the public API
+void test_backend_dispatch(void) {
+    printf("Testing backend dispatch...\n");
+
+    const char *backend = taes_backend_name();
+
+    static const char *const names[] = {"portable", "ttable", "bitslice", "aesni", "vaes"};
+    uint8_t key[32];
+    uint8_t tweak[16];
+    static uint8_t plaintext[1000];
+    static uint8_t expected[1000];
+    static uint8_t ciphertext[1000];
+    static uint8_t decrypted[1000];
+
+    for (int i = 0; i < 32; i++) {
+        key[i] = (uint8_t)(i * 7 + 1);
+    }
+    for (int i = 0; i < 16; i++) {
+        tweak[i] = (uint8_t)(0xf0 + i);
+    }
+    for (size_t i = 0; i < sizeof(plaintext); i++) {
+        plaintext[i] = (uint8_t)(i * 3 + 9);
+    }
+
+    taes_ctx ref;
+    assert(taes_init_portable(&ref, key, 32, tweak) == 0);
+    assert(counter_mode_encrypt_portable(&ref, plaintext, expected, sizeof(plaintext)) == 0);
+
+    for (size_t n = 0; n < sizeof(names) / sizeof(names[0]); n++) {
+        if (taes_set_backend(names[n]) != 0) {
+            printf("  SKIPPED: %s not supported on this CPU\n", names[n]);
+            continue;
+        }
+        assert(strcmp(taes_backend_name(), names[n]) == 0);
+
+        taes_ctx ctx, dec;
+        assert(taes_init(&ctx, key, 32, tweak) == 0);
+        assert(taes_init_decrypt(&dec, key, 32, tweak) == 0);
+        assert(memcmp(ref.round_keys, ctx.round_keys, sizeof(ref.round_keys)) == 0);
+
+        taes_encrypt_block(&ctx, plaintext, ciphertext);
+        assert(memcmp(expected, ciphertext, 16) == 0);
+        taes_decrypt_block(&dec, ciphertext, decrypted);
+        assert(memcmp(plaintext, decrypted, 16) == 0);
+
+        assert(counter_mode_encrypt(&ctx, plaintext, ciphertext, sizeof(plaintext)) == 0);
+        assert(memcmp(expected, ciphertext, sizeof(plaintext)) == 0);
+        assert(counter_mode_decrypt(&dec, ciphertext, decrypted, sizeof(plaintext)) == 0);
+        assert(memcmp(plaintext, decrypted, sizeof(plaintext)) == 0);
+
+        taes_cleanup(&ctx);
+        taes_cleanup(&dec);
+        printf("  PASSED: %s backend matches the portable one\n", names[n]);
+    }
+
+    assert(taes_set_backend("no-such-backend") == -1);
+    assert(taes_set_backend(NULL) == -1);
+    printf("  PASSED: Unknown backend names are rejected\n");
+
+    taes_cleanup(&ref);
+    assert(taes_set_backend(backend) == 0);
+}
+
+// Test the multi-buffer API on every backend: jobs with their own keys,
+// tweaks (some carrying past 64 bits mid-job) and lengths, some in place, must give
+// exactly the single-stream results. The decryptions are submitted while
+// encryptions are still in the lanes, so the change of direction flushes them.
+void test_multi_buffer(void) {
+    printf("Testing multi-buffer API...\n");
+
+    const char *backend = taes_backend_name();
+
+    enum { NUM_JOBS = 40, MAX_LENGTH = 600 };
+    static const char *const names[] = {"portable", "aesni", "vaes"};
+    static const int key_sizes[] = {16, 32, 24};
+    static uint8_t plaintext[NUM_JOBS][MAX_LENGTH];
+    static uint8_t expected[NUM_JOBS][MAX_LENGTH];
+    static uint8_t ciphertext[NUM_JOBS][MAX_LENGTH];
+    static uint8_t decrypted[NUM_JOBS][MAX_LENGTH];
+    static taes_ctx ctxs[NUM_JOBS];
+    static taes_mb_job jobs[NUM_JOBS];
+    static taes_mb_job dec[NUM_JOBS];
+    size_t lengths[NUM_JOBS];
+
+    for (int i = 0; i < NUM_JOBS; i++) {
+        // 17..MAX_LENGTH, every fourth one a multiple of 16
+        lengths[i] = i % 4 == 0 ? 16 * (size_t)(2 + i / 2) : 17 + (size_t)(i * 149) % (MAX_LENGTH - 17);
+        for (size_t j = 0; j < MAX_LENGTH; j++) {
+            plaintext[i][j] = (uint8_t)(i * 61 + j * 7 + 3);
+        }
+    }
+
+    for (size_t n = 0; n < sizeof(names) / sizeof(names[0]); n++) {
+        if (taes_set_backend(names[n]) != 0) {
+            printf("  SKIPPED: %s not supported on this CPU\n", names[n]);
+            continue;
+        }
+
+        // One manager for all key sizes
+        taes_mb_mgr mgr;
+        taes_mb_init(&mgr);
+
+        for (size_t k = 0; k < sizeof(key_sizes) / sizeof(key_sizes[0]); k++) {
+            for (int i = 0; i < NUM_JOBS; i++) {
+                uint8_t key[32];
+                uint8_t tweak[16];
+                for (int j = 0; j < 32; j++) {
+                    key[j] = (uint8_t)(i * 13 + j * 5 + (int)k);
+                }
+                for (int j = 0; j < 16; j++) {
+                    tweak[j] = (uint8_t)(i + j);
+                }
+                assert(taes_init(&ctxs[i], key, key_sizes[k], tweak) == 0);
+                if (i % 3 == 0) {
+                    // Low half of the tweaked round key wraps a few blocks in
+                    memset(ctxs[i].tweaked_round_key, 0xff, 8);
+                    ctxs[i].tweaked_round_key[0] = (uint8_t)(0xfe - i);
+                }
+                assert(counter_mode_encrypt_portable(&ctxs[i], plaintext[i], expected[i], lengths[i]) == 0);
+            }
+
+            // Encrypt; odd jobs in place
+            for (int i = 0; i < NUM_JOBS; i++) {
+                if (i % 2) {
+                    memcpy(ciphertext[i], plaintext[i], lengths[i]);
+                }
+                jobs[i] = (taes_mb_job){&ctxs[i], i % 2 ? ciphertext[i] : plaintext[i],
+                                        ciphertext[i], lengths[i], 0, 0};
+                assert(taes_mb_submit(&mgr, &jobs[i]) == 0);
+            }
+
+            // Decrypt; submitting the first decryption completes every
+            // encryption
+            for (int i = 0; i < NUM_JOBS; i++) {
+                dec[i] = (taes_mb_job){&ctxs[i], ciphertext[i], decrypted[i], lengths[i], 1, 0};
+                assert(taes_mb_submit(&mgr, &dec[i]) == 0);
+                if (i == 0) {
+                    for (int j = 0; j < NUM_JOBS; j++) {
+                        assert(jobs[j].status == 0);
+                        assert(memcmp(expected[j], ciphertext[j], lengths[j]) == 0);
+                    }
+                }
+            }
+            assert(taes_mb_flush(&mgr) >= 0);
+            assert(mgr.active == 0);
+            for (int i = 0; i < NUM_JOBS; i++) {
+                assert(dec[i].status == 0);
+                assert(memcmp(plaintext[i], decrypted[i], lengths[i]) == 0);
+                taes_cleanup(&ctxs[i]);
+            }
+            printf("  PASSED: %s, AES-%d: %d jobs match counter mode\n", names[n], key_sizes[k] * 8, NUM_JOBS);
+        }
+    }
+
+    taes_mb_mgr mgr;
+    taes_mb_job bad = {&ctxs[0], plaintext[0], ciphertext[0], 16, 0, 0};
+    taes_mb_init(&mgr);
+    assert(taes_mb_submit(&mgr, &bad) == -1 && bad.status == -1);
+    bad.length = 17;
+    bad.in = NULL;
+    assert(taes_mb_submit(&mgr, &bad) == -1 && bad.status == -1);
+    assert(taes_mb_flush(&mgr) == 0);
+    printf("  PASSED: Invalid jobs are rejected\n");
+
+    assert(taes_set_backend(backend) == 0);
+}
+
+// Test taes_encrypt_blocks() / taes_decrypt_blocks() on every backend: each
+// block must match taes_set_tweak() + a single-block call with its own tweak.
+// The tweaks are sparse and unordered, some carrying past 64 bits.
+void test_tweak_array(void) {
+    printf("Testing per-block tweak arrays...\n");
+
+    const char *backend = taes_backend_name();
+
+    enum { MAX_BLOCKS = 100 };
+    // VAES at both vector widths
+    static const struct {
+        const char *name;
+        int vaes_lanes;
+    } backends[] = {
+        {"portable", 0}, {"ttable", 0}, {"bitslice", 0}, {"aesni", 0}, {"vaes", 4}, {"vaes", 2},
+    };
+    static const int key_sizes[] = {16, 24, 32};
+    static const size_t counts[] = {1, 7, 8, 9, 33, MAX_BLOCKS};
+    uint8_t key[32];
+    uint8_t plaintext[MAX_BLOCKS * 16];
+    uint8_t expected[MAX_BLOCKS * 16];
+    uint8_t ciphertext[MAX_BLOCKS * 16];
+    uint8_t decrypted[MAX_BLOCKS * 16];
+    uint8_t tweaks[MAX_BLOCKS * 16];
+
+    for (int j = 0; j < 32; j++) {
+        key[j] = (uint8_t)(j * 11 + 1);
+    }
+    for (int i = 0; i < MAX_BLOCKS * 16; i++) {
+        plaintext[i] = (uint8_t)(i * 5 + 9);
+    }
+    memset(tweaks, 0, sizeof(tweaks));
+    for (int i = 0; i < MAX_BLOCKS; i++) {
+        // Row IDs: scattered, and every fifth one with a full low half
+        uint64_t row = (uint64_t)((i * 7919) % 1000003) * 4099;
+        for (int j = 0; j < 8; j++) {
+            tweaks[i * 16 + j] = i % 5 == 0 ? 0xff : (uint8_t)(row >> (8 * j));
+        }
+        tweaks[i * 16 + 8] = (uint8_t)(i % 3);
+    }
+
+    for (size_t k = 0; k < sizeof(key_sizes) / sizeof(key_sizes[0]); k++) {
+        taes_ctx ref;
+        assert(taes_init_portable(&ref, key, key_sizes[k], NULL) == 0);
+        for (int i = 0; i < MAX_BLOCKS; i++) {
+            taes_set_tweak(&ref, tweaks + i * 16);
+            taes_encrypt_block_portable(&ref, plaintext + i * 16, expected + i * 16);
+        }
+        taes_cleanup(&ref);
+
+        for (size_t n = 0; n < sizeof(backends) / sizeof(backends[0]); n++) {
+            const char *name = backends[n].name;
+            int lanes = backends[n].vaes_lanes;
+            if (taes_set_backend(name) != 0 || (lanes && taes_vaes_select(lanes) != lanes)) {
+                if (k == 0) {
+                    printf("  SKIPPED: %s (%d lanes) not supported on this CPU\n", name, lanes);
+                }
+                continue;
+            }
+
+            taes_ctx ctx, dctx;
+            assert(taes_init(&ctx, key, key_sizes[k], NULL) == 0);
+            assert(taes_init_decrypt(&dctx, key, key_sizes[k], NULL) == 0);
+            for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+                size_t len = counts[c] * 16;
+                taes_encrypt_blocks(&ctx, plaintext, ciphertext, tweaks, counts[c]);
+                assert(memcmp(expected, ciphertext, len) == 0);
+                taes_decrypt_blocks(&ctx, ciphertext, decrypted, tweaks, counts[c]);
+                assert(memcmp(plaintext, decrypted, len) == 0);
+
+                // In place, with the decryption context
+                memcpy(decrypted, ciphertext, len);
+                taes_decrypt_blocks(&dctx, decrypted, decrypted, tweaks, counts[c]);
+                assert(memcmp(plaintext, decrypted, len) == 0);
+                taes_encrypt_blocks(&dctx, decrypted, decrypted, tweaks, counts[c]);
+                assert(memcmp(expected, decrypted, len) == 0);
+            }
+            taes_cleanup(&ctx);
+            taes_cleanup(&dctx);
+            if (lanes) {
+                printf("  PASSED: %s (%d lanes), AES-%d matches per-block tweaks\n", name, lanes, key_sizes[k] * 8);
+            } else {
+                printf("  PASSED: %s, AES-%d matches per-block tweaks\n", name, key_sizes[k] * 8);
+            }
+        }
+    }
+
+    taes_vaes_select(4);
+    assert(taes_set_backend(backend) == 0);
+}
+
+// Counts runs of each task of test_parallel_counter_mode()'s taes_pool_run()
+static void count_task(void *arg, size_t task) {
+    __atomic_fetch_add(&((int *)arg)[task], 1, __ATOMIC_RELAXED);
+}
+
+// Test the thread pool and parallel counter mode: every task runs once, and
+// any thread count and chunk size gives exactly the serial output, also
+// when the tweak carries past 64 bits inside a chunk
+void test_parallel_counter_mode(void) {
+    printf("Testing parallel counter mode...\n");
+
+    enum { MAX_LENGTH = 5000, NUM_TASKS = 1000 };
+    static const int threads[] = {1, 3, 4};
+    static const size_t lengths[] = {17, 32, 100, 1024, 4111, MAX_LENGTH};
+    static const size_t chunks[] = {16, 48, 1000, 0};
+    static uint8_t plaintext[MAX_LENGTH];
+    static uint8_t expected[MAX_LENGTH];
+    static uint8_t ciphertext[MAX_LENGTH];
+    static uint8_t decrypted[MAX_LENGTH];
+    static int runs[NUM_TASKS];
+    uint8_t key[32];
+    uint8_t tweak[16];
+
+    for (int i = 0; i < 32; i++) {
+        key[i] = (uint8_t)(i * 3 + 7);
+    }
+    // Low 64 bits of the tweak wrap after 40 blocks
+    memset(tweak, 0xff, 8);
+    tweak[0] = 0xd7;
+    memset(tweak + 8, 0x42, 8);
+    for (int i = 0; i < MAX_LENGTH; i++) {
+        plaintext[i] = (uint8_t)(i * 13 + 1);
+    }
+
+    for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+        taes_pool *pool = taes_pool_create(threads[t]);
+        assert(pool != NULL);
+        assert(taes_pool_threads(pool) == threads[t]);
+
+        memset(runs, 0, sizeof(runs));
+        taes_pool_run(pool, NUM_TASKS, count_task, runs);
+        for (int i = 0; i < NUM_TASKS; i++) {
+            assert(runs[i] == 1);
+        }
+
+        for (int key_size = 16; key_size <= 32; key_size += 8) {
+            taes_ctx ctx;
+            assert(taes_init(&ctx, key, key_size, tweak) == 0);
+            for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+                size_t len = lengths[l];
+                assert(counter_mode_encrypt(&ctx, plaintext, expected, len) == 0);
+                for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+                    assert(counter_mode_encrypt_parallel(pool, &ctx, plaintext, ciphertext, len, chunks[c]) == 0);
+                    assert(memcmp(expected, ciphertext, len) == 0);
+                    assert(counter_mode_decrypt_parallel(pool, &ctx, ciphertext, decrypted, len, chunks[c]) == 0);
+                    assert(memcmp(plaintext, decrypted, len) == 0);
+
+                    // In place
+                    assert(counter_mode_encrypt_parallel(pool, &ctx, decrypted, decrypted, len, chunks[c]) == 0);
+                    assert(memcmp(expected, decrypted, len) == 0);
+                }
+            }
+            taes_cleanup(&ctx);
+        }
+        printf("  PASSED: %d thread(s): tasks run once, output matches serial\n", threads[t]);
+        taes_pool_destroy(pool);
+    }
+
+    // No pool runs on the caller; the usual length limits apply
+    taes_ctx ctx;
+    assert(taes_init(&ctx, key, 16, tweak) == 0);
+    assert(counter_mode_encrypt(&ctx, plaintext, expected, 1000) == 0);
+    assert(counter_mode_encrypt_parallel(NULL, &ctx, plaintext, ciphertext, 1000, 64) == 0);
+    assert(memcmp(expected, ciphertext, 1000) == 0);
+    assert(counter_mode_encrypt_parallel(NULL, &ctx, plaintext, ciphertext, 16, 0) == -1);
+    assert(counter_mode_decrypt_parallel(NULL, NULL, ciphertext, plaintext, 100, 0) == -1);
+    taes_cleanup(&ctx);
+    taes_pool_destroy(NULL);
+    printf("  PASSED: Serial fallback and invalid arguments\n");
+}
+
+// Stream a message through taes_stream_update() in pieces of `piece` bytes
+// (the last one shorter) and finish it; returns the bytes written
+static size_t stream_pieces(const taes_ctx *ctx, int decrypt, const uint8_t *in, size_t length,
+                            size_t piece, uint8_t *out) {
+    taes_stream stream;
+    size_t total = 0;
+    size_t written;
+
+    assert(taes_stream_init(&stream, ctx, decrypt) == 0);
+    for (size_t off = 0; off < length; off += piece) {
+        size_t n = length - off < piece ? length - off : piece;
+        assert(taes_stream_update(&stream, in + off, n, out + total, &written) == 0);
+        assert(written % AES_BLOCK_SIZE == 0 && written <= n + AES_BLOCK_SIZE - 1);
+        total += written;
+        assert(length - total >= AES_BLOCK_SIZE || off + n < TAES_STREAM_HELD_MAX);
+    }
+    assert(taes_stream_final(&stream, out + total, &written) == 0);
+    assert(written <= TAES_STREAM_HELD_MAX);
+    return total + written;
+}
+
+// Test the streaming API: any split of the input gives exactly the one-shot
+// counter-mode output, on every backend, past a 64-bit tweak carry
+void test_stream(void) {
+    printf("Testing streaming counter mode...\n");
+
+    const char *backend = taes_backend_name();
+
+    enum { MAX_LENGTH = 4111 };
+    static const char *backends[] = {"portable", "aesni", "vaes"};
+    static const size_t lengths[] = {17, 31, 32, 33, 48, 63, 100, 1024, MAX_LENGTH};
+    static const size_t pieces[] = {1, 7, 16, 17, 33, 1000, MAX_LENGTH};
+    static uint8_t plaintext[MAX_LENGTH];
+    static uint8_t expected[MAX_LENGTH];
+    static uint8_t ciphertext[MAX_LENGTH];
+    static uint8_t decrypted[MAX_LENGTH];
+    uint8_t key[32];
+    uint8_t tweak[16];
+
+    for (int i = 0; i < 32; i++) {
+        key[i] = (uint8_t)(i * 5 + 3);
+    }
+    // Low 64 bits of the tweak wrap after 20 blocks
+    memset(tweak, 0xff, 8);
+    tweak[0] = 0xeb;
+    memset(tweak + 8, 0x17, 8);
+    for (int i = 0; i < MAX_LENGTH; i++) {
+        plaintext[i] = (uint8_t)(i * 29 + 11);
+    }
+
+    for (size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); b++) {
+        if (taes_set_backend(backends[b]) != 0) {
+            printf("  SKIPPED: %s backend not supported on this CPU\n", backends[b]);
+            continue;
+        }
+        for (int key_size = 16; key_size <= 32; key_size += 8) {
+            taes_ctx ctx;
+            taes_ctx dec_ctx;
+            assert(taes_init(&ctx, key, key_size, tweak) == 0);
+            assert(taes_init_decrypt(&dec_ctx, key, key_size, tweak) == 0);
+            for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+                size_t len = lengths[l];
+                assert(counter_mode_encrypt(&ctx, plaintext, expected, len) == 0);
+                for (size_t p = 0; p < sizeof(pieces) / sizeof(pieces[0]); p++) {
+                    assert(stream_pieces(&ctx, 0, plaintext, len, pieces[p], ciphertext) == len);
+                    assert(memcmp(expected, ciphertext, len) == 0);
+                    assert(stream_pieces(&dec_ctx, 1, ciphertext, len, pieces[p], decrypted) == len);
+                    assert(memcmp(plaintext, decrypted, len) == 0);
+                }
+            }
+            taes_cleanup(&ctx);
+            taes_cleanup(&dec_ctx);
+        }
+        printf("  PASSED: %s: every split matches one-shot counter mode\n", backends[b]);
+    }
+    assert(taes_set_backend(backend) == 0);
+
+    // Messages of 16 bytes or less fail at final, as in one shot; empty
+    // updates are fine
+    taes_ctx ctx;
+    taes_stream stream;
+    size_t written;
+    assert(taes_init(&ctx, key, 16, tweak) == 0);
+    assert(taes_stream_init(&stream, &ctx, 0) == 0);
+    assert(taes_stream_update(&stream, NULL, 0, NULL, &written) == 0 && written == 0);
+    assert(taes_stream_update(&stream, plaintext, 16, ciphertext, &written) == 0 && written == 0);
+    assert(taes_stream_final(&stream, ciphertext, &written) == -1 && written == 0);
+    assert(taes_stream_init(&stream, NULL, 0) == -1);
+    taes_cleanup(&ctx);
+    printf("  PASSED: Short messages and invalid arguments\n");
+}
+
+// Run taes_pipeline() from a file holding in[0..length) to a file; returns
+// its result, with the output in out
+static int pipeline_file(const taes_ctx *ctx, int flags, const uint8_t *in, size_t length, int workers,
+                         uint8_t *out) {
+    FILE *src = tmpfile();
+    FILE *dst = tmpfile();
+    assert(src && dst);
+    assert(fwrite(in, 1, length, src) == length && fflush(src) == 0);
+    rewind(src);
+
+    int ret = taes_pipeline(ctx, flags, fileno(src), fileno(dst), workers, 4096);
+    if (ret == 0) {
+        assert(fseek(dst, 0, SEEK_END) == 0 && (size_t)ftell(dst) == length);
+        rewind(dst);
+        assert(fread(out, 1, length, dst) == length);
+    }
+    fclose(src);
+    fclose(dst);
+    return ret;
+}
+
+// Test the pipelined filter: with 4 KB buffers, lengths around buffer
+// boundaries (where the read-ahead block decides Ciphertext Stealing) give
+// the one-shot counter-mode and ECB output, for one and several workers
+void test_pipeline(void) {
+    printf("Testing pipelined filter...\n");
+
+    enum { MAX_LENGTH = 3 * 4096 + 100 };
+    static const size_t lengths[] = {17, 100, 4095, 4096, 4097, 4111, 4112, 4113, 4127,
+                                     8192 + 16, 8192 + 17, MAX_LENGTH};
+    static const int workers[] = {1, 3};
+    static uint8_t plaintext[MAX_LENGTH];
+    static uint8_t expected[MAX_LENGTH];
+    static uint8_t ciphertext[MAX_LENGTH];
+    static uint8_t decrypted[MAX_LENGTH];
+    uint8_t key[16];
+    uint8_t tweak[16];
+
+    for (int i = 0; i < 16; i++) {
+        key[i] = (uint8_t)(i * 9 + 1);
+        tweak[i] = (uint8_t)(0xf0 + i);
+    }
+    for (int i = 0; i < MAX_LENGTH; i++) {
+        plaintext[i] = (uint8_t)(i * 31 + 5);
+    }
+    taes_ctx ctx;
+    taes_ctx dec_ctx;
+    assert(taes_init(&ctx, key, 16, tweak) == 0);
+    assert(taes_init_decrypt(&dec_ctx, key, 16, tweak) == 0);
+
+    for (size_t w = 0; w < sizeof(workers) / sizeof(workers[0]); w++) {
+        for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+            size_t len = lengths[l];
+            assert(counter_mode_encrypt(&ctx, plaintext, expected, len) == 0);
+            assert(pipeline_file(&ctx, 0, plaintext, len, workers[w], ciphertext) == 0);
+            assert(memcmp(expected, ciphertext, len) == 0);
+            assert(pipeline_file(&dec_ctx, TAES_PIPELINE_DECRYPT, ciphertext, len, workers[w], decrypted) == 0);
+            assert(memcmp(plaintext, decrypted, len) == 0);
+
+            // ECB takes whole blocks only
+            size_t whole = len / AES_BLOCK_SIZE * AES_BLOCK_SIZE;
+            for (size_t i = 0; i < whole; i += AES_BLOCK_SIZE) {
+                taes_encrypt_block(&ctx, plaintext + i, expected + i);
+            }
+            assert(pipeline_file(&ctx, TAES_PIPELINE_ECB, plaintext, whole, workers[w], ciphertext) == 0);
+            assert(memcmp(expected, ciphertext, whole) == 0);
+            if (whole != len) {
+                assert(pipeline_file(&ctx, TAES_PIPELINE_ECB, plaintext, len, workers[w], ciphertext) ==
+                       TAES_PIPELINE_BAD_LENGTH);
+            }
+        }
+        printf("  PASSED: %d worker(s): counter mode and ECB match one shot\n", workers[w]);
+    }
+
+    // 16 bytes or less cannot be counter mode
+    assert(pipeline_file(&ctx, 0, plaintext, 16, 1, ciphertext) == TAES_PIPELINE_BAD_LENGTH);
+    assert(pipeline_file(&ctx, 0, plaintext, 0, 1, ciphertext) == TAES_PIPELINE_BAD_LENGTH);
+    assert(pipeline_file(&ctx, TAES_PIPELINE_ECB, plaintext, 0, 1, ciphertext) == 0);
+    assert(taes_pipeline(NULL, 0, 0, 1, 1, 0) == -1);
+    taes_cleanup(&ctx);
+    taes_cleanup(&dec_ctx);
+    printf("  PASSED: Short input and invalid arguments\n");
+}
+
+// Test taes_crypt_fd(): a regular input file mapped into a mapped output
+// file (lengths around its 8 MB window), and into a pipe or a write-only
+// descriptor (written from a buffer with write()), gives the one-shot
+// counter-mode output
+void test_crypt_fd(void) {
+    printf("Testing mapped file mode...\n");
+
+    enum { WINDOW = 8 * 1024 * 1024 };
+    static const size_t lengths[] = {17, 4111, WINDOW, WINDOW + 15, WINDOW + 16, WINDOW + 17, 2 * WINDOW + 33};
+    size_t max_length = 2 * WINDOW + 33;
+    uint8_t *plaintext = malloc(max_length);
+    uint8_t *expected = malloc(max_length);
+    uint8_t *output = malloc(max_length);
+    uint8_t key[32];
+    uint8_t tweak[16];
+    assert(plaintext && expected && output);
+
+    for (int i = 0; i < 32; i++) {
+        key[i] = (uint8_t)(i * 7 + 2);
+    }
+    memset(tweak, 0xff, sizeof(tweak));  // Carries through all 128 bits
+    for (size_t i = 0; i < max_length; i++) {
+        plaintext[i] = (uint8_t)(i * 37 + (i >> 12));
+    }
+    taes_ctx ctx;
+    taes_ctx dec_ctx;
+    assert(taes_init(&ctx, key, 32, tweak) == 0);
+    assert(taes_init_decrypt(&dec_ctx, key, 32, tweak) == 0);
+
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        size_t len = lengths[l];
+        FILE *src = tmpfile();
+        FILE *dst = tmpfile();
+        assert(src && dst);
+        assert(fwrite(plaintext, 1, len, src) == len && fflush(src) == 0);
+        rewind(src);
+        assert(counter_mode_encrypt(&ctx, plaintext, expected, len) == 0);
+
+        assert(taes_crypt_fd(&ctx, 0, fileno(src), fileno(dst), 2) == 0);
+        assert(fseek(dst, 0, SEEK_END) == 0 && (size_t)ftell(dst) == len);
+        rewind(dst);
+        assert(fread(output, 1, len, dst) == len);
+        assert(memcmp(expected, output, len) == 0);
+
+        // And back, from the mapped ciphertext
+        FILE *back = tmpfile();
+        assert(back);
+        assert(lseek(fileno(dst), 0, SEEK_SET) == 0);  // rewind() may only reset the buffer
+        assert(taes_crypt_fd(&dec_ctx, TAES_PIPELINE_DECRYPT, fileno(dst), fileno(back), 2) == 0);
+        rewind(back);
+        assert(fread(output, 1, len, back) == len);
+        assert(memcmp(plaintext, output, len) == 0);
+        fclose(back);
+        fclose(src);
+        fclose(dst);
+    }
+    printf("  PASSED: Mapped input and output, windows of 8 MB\n");
+
+    // Pipe (read back afterwards: the data fits) and write-only output
+    size_t len = 40000;
+    int fds[2];
+    FILE *src = tmpfile();
+    assert(src && pipe(fds) == 0);
+    assert(fwrite(plaintext, 1, len, src) == len && fflush(src) == 0);
+    rewind(src);
+    assert(taes_crypt_fd(&ctx, 0, fileno(src), fds[1], 1) == 0);
+    close(fds[1]);
+    size_t got = 0;
+    ssize_t n;
+    while ((n = read(fds[0], output + got, max_length - got)) > 0) {
+        got += (size_t)n;
+    }
+    close(fds[0]);
+    assert(counter_mode_encrypt(&ctx, plaintext, expected, len) == 0);
+    assert(got == len && memcmp(expected, output, len) == 0);
+
+    // Write-only (as `> file` opens it): written, not mapped
+    FILE *dst = tmpfile();
+    char path[64];
+    assert(dst);
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fileno(dst));
+    int wronly = open(path, O_WRONLY);
+    assert(wronly >= 0);
+    rewind(src);
+    assert(taes_crypt_fd(&ctx, 0, fileno(src), wronly, 1) == 0);
+    close(wronly);
+    assert(fread(output, 1, max_length, dst) == len && memcmp(expected, output, len) == 0);
+    fclose(dst);
+    fclose(src);
+    printf("  PASSED: Pipe and write-only output\n");
+
+    // Length errors come before any output
+    src = tmpfile();
+    dst = tmpfile();
+    assert(fwrite(plaintext, 1, 47, src) == 47 && fflush(src) == 0);
+    rewind(src);
+    assert(taes_crypt_fd(&ctx, TAES_PIPELINE_ECB, fileno(src), fileno(dst), 1) == TAES_PIPELINE_BAD_LENGTH);
+    assert(fseek(dst, 0, SEEK_END) == 0 && ftell(dst) == 0);
+    fclose(src);
+    fclose(dst);
+    printf("  PASSED: Bad lengths are refused before writing\n");
+
+    taes_cleanup(&ctx);
+    taes_cleanup(&dec_ctx);
+    free(plaintext);
+    free(expected);
+    free(output);
+}
+
+// Test random-access decryption: every range of several message lengths
+// (with and without a stolen pair) matches the whole decryption, from the
+// whole ciphertext and from just the span it needs, on every backend
+void test_decrypt_range(void) {
+    printf("Testing range decryption...\n");
+
+    const char *backend = taes_backend_name();
+
+    enum { MAX_LENGTH = 100 };
+    static const char *backends[] = {"portable", "aesni", "vaes"};
+    static const size_t lengths[] = {17, 31, 32, 33, 47, 48, 63, 64, 65, MAX_LENGTH};
+    uint8_t plaintext[MAX_LENGTH];
+    uint8_t ciphertext[MAX_LENGTH];
+    uint8_t out[MAX_LENGTH];
+    uint8_t key[16];
+    uint8_t tweak[16];
+
+    for (int i = 0; i < 16; i++) {
+        key[i] = (uint8_t)(i * 11 + 4);
+    }
+    memset(tweak, 0xff, 8);  // Low 64 bits wrap after 2 blocks
+    tweak[0] = 0xfe;
+    memset(tweak + 8, 0x21, 8);
+    for (int i = 0; i < MAX_LENGTH; i++) {
+        plaintext[i] = (uint8_t)(i * 7 + 3);
+    }
+
+    for (size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); b++) {
+        if (taes_set_backend(backends[b]) != 0) {
+            printf("  SKIPPED: %s backend not supported on this CPU\n", backends[b]);
+            continue;
+        }
+        taes_ctx ctx;
+        assert(taes_init_decrypt(&ctx, key, 16, tweak) == 0);
+        for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+            size_t total = lengths[l];
+            assert(counter_mode_encrypt(&ctx, plaintext, ciphertext, total) == 0);
+            for (size_t off = 0; off <= total; off++) {
+                for (size_t len = 0; off + len <= total; len++) {
+                    size_t span_off;
+                    size_t span_len;
+                    memset(out, 0, sizeof(out));
+                    assert(counter_mode_decrypt_range(&ctx, ciphertext, total, off, len, out) == 0);
+                    assert(memcmp(plaintext + off, out, len) == 0);
+
+                    // Only the span, in a buffer of its exact size
+                    assert(counter_mode_range_span(total, off, len, &span_off, &span_len) == 0);
+                    assert(span_off <= off && span_off + span_len <= total);
+                    uint8_t *span = malloc(span_len ? span_len : 1);
+                    assert(span);
+                    memcpy(span, ciphertext + span_off, span_len);
+                    memset(out, 0, sizeof(out));
+                    assert(counter_mode_decrypt_span(&ctx, span, total, off, len, out) == 0);
+                    assert(memcmp(plaintext + off, out, len) == 0);
+                    free(span);
+                }
+            }
+        }
+        taes_cleanup(&ctx);
+        printf("  PASSED: %s: every range of every length matches\n", backends[b]);
+    }
+    assert(taes_set_backend(backend) == 0);
+
+    // Ranges must lie within a valid counter-mode message
+    taes_ctx ctx;
+    size_t span_off;
+    size_t span_len;
+    assert(taes_init_decrypt(&ctx, key, 16, tweak) == 0);
+    assert(counter_mode_decrypt_range(&ctx, ciphertext, 16, 0, 16, out) == -1);
+    assert(counter_mode_decrypt_range(&ctx, ciphertext, 40, 30, 11, out) == -1);
+    assert(counter_mode_decrypt_range(&ctx, ciphertext, 40, 41, 0, out) == -1);
+    assert(counter_mode_decrypt_range(&ctx, ciphertext, 40, 1, SIZE_MAX, out) == -1);
+    assert(counter_mode_range_span(40, 0, 8, &span_off, &span_len) == 0 && span_off == 0 && span_len == 16);
+    assert(counter_mode_range_span(40, 20, 1, &span_off, &span_len) == 0 && span_off == 16 && span_len == 24);
+    taes_cleanup(&ctx);
+    printf("  PASSED: Invalid ranges and spans\n");
+}
+
+// Whole contents of a file, from its start
+static size_t file_contents(FILE *f, uint8_t *out, size_t max) {
+    assert(fflush(f) == 0 && lseek(fileno(f), 0, SEEK_SET) == 0);
+    size_t have = 0;
+    ssize_t n;
+    while ((n = read(fileno(f), out + have, max - have)) > 0) {
+        have += (size_t)n;
+    }
+    assert(n == 0);
+    return have;
+}
+
+static FILE *file_with(const uint8_t *data, size_t length) {
+    FILE *f = tmpfile();
+    assert(f);
+    assert(write(fileno(f), data, length) == (ssize_t)length);
+    assert(lseek(fileno(f), 0, SEEK_SET) == 0);
+    return f;
+}
+
+// Test the sector API: on every backend, a run of sectors is counter mode
+// over the disk at the run's offset, whatever the sector size and wherever
+// the run starts; runs near the end of the block numbering are refused
+void test_sector(void) {
+    printf("Testing sector API...\n");
+
+    const char *backend = taes_backend_name();
+
+    enum { DISK = 16 * 512 };
+    static const char *backends[] = {"portable", "aesni", "vaes"};
+    static uint8_t disk[DISK];
+    static uint8_t expected[DISK];
+    static uint8_t out[DISK];
+    uint8_t key[32];
+    uint8_t tweak[16];
+
+    for (int i = 0; i < 32; i++) {
+        key[i] = (uint8_t)(i * 5 + 9);
+    }
+    memset(tweak, 0xff, 16);  // The low half wraps in the first sector
+    tweak[0] = 0xf0;
+    for (int i = 0; i < DISK; i++) {
+        disk[i] = (uint8_t)(i * 3 + i / 512);
+    }
+
+    for (size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); b++) {
+        if (taes_set_backend(backends[b]) != 0) {
+            printf("  SKIPPED: %s backend not supported on this CPU\n", backends[b]);
+            continue;
+        }
+        taes_ctx enc;
+        taes_ctx dec;
+        assert(taes_init(&enc, key, 32, tweak) == 0);
+        assert(taes_init_decrypt(&dec, key, 32, tweak) == 0);
+        assert(counter_mode_encrypt(&enc, disk, expected, DISK) == 0);
+
+        // Every run of 512-byte sectors, and the 4 KB sectors they make up
+        for (size_t first = 0; first < 16; first++) {
+            for (size_t count = 0; first + count <= 16; count++) {
+                assert(taes_sector_encrypt(&enc, first, 512, disk + first * 512, out, count) == 0);
+                assert(memcmp(out, expected + first * 512, count * 512) == 0);
+                assert(taes_sector_decrypt(&dec, first, 512, out, out, count) == 0);
+                assert(memcmp(out, disk + first * 512, count * 512) == 0);
+            }
+        }
+        assert(taes_sector_encrypt(&enc, 1, TAES_SECTOR_4K, disk + 4096, out, 1) == 0);
+        assert(memcmp(out, expected + 4096, 4096) == 0);
+        memcpy(out, disk, DISK);
+        assert(taes_sector_encrypt(&enc, 0, TAES_SECTOR_4K, out, out, 2) == 0);
+        assert(memcmp(out, expected, DISK) == 0);
+        assert(taes_sector_decrypt(&dec, 0, TAES_SECTOR_4K, out, out, 2) == 0);
+        assert(memcmp(out, disk, DISK) == 0);
+        taes_cleanup(&enc);
+        taes_cleanup(&dec);
+        printf("  PASSED: %s: sector runs are counter mode at their offset\n", backends[b]);
+    }
+    assert(taes_set_backend(backend) == 0);
+
+    // Sector sizes are whole blocks; the last block number is 2^64 - 1
+    taes_ctx ctx;
+    assert(taes_init(&ctx, key, 16, tweak) == 0);
+    assert(taes_sector_encrypt(&ctx, 0, 0, disk, out, 1) == -1);
+    assert(taes_sector_encrypt(&ctx, 0, 520, disk, out, 1) == -1);
+    assert(taes_sector_encrypt(&ctx, 0, 512, NULL, out, 1) == -1);
+    assert(taes_sector_encrypt(&ctx, 0, 512, NULL, NULL, 0) == 0);
+    assert(taes_sector_encrypt(&ctx, UINT64_MAX / 32 - 1, 512, disk, out, 1) == 0);
+    assert(taes_sector_encrypt(&ctx, UINT64_MAX / 32 - 1, 512, disk, out, 2) == -1);
+    assert(taes_sector_encrypt(&ctx, UINT64_MAX / 32, 512, disk, out, 1) == -1);
+    assert(taes_sector_encrypt(&ctx, 0, 512, disk, out, SIZE_MAX / 16) == -1);
+    taes_cleanup(&ctx);
+    printf("  PASSED: Invalid sector sizes and runs\n");
+}
+
+// An image of IMAGE_SECTORS 4 KB sectors: data, a hole in sectors
+// [hole_start, hole_end) (none if 0), data; returns its path in `path`
+static void make_image(char *path, const uint8_t *data, size_t sectors, size_t hole_start,
+                       size_t hole_end) {
+    strcpy(path, "/tmp/taes_image_XXXXXX");
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    size_t head = (hole_end ? hole_start : sectors) * 4096;
+    assert(pwrite(fd, data, head, 0) == (ssize_t)head);
+    if (hole_end) {
+        size_t tail = (sectors - hole_end) * 4096;
+        assert(pwrite(fd, data + hole_end * 4096, tail, (off_t)hole_end * 4096) == (ssize_t)tail);
+    }
+    close(fd);
+}
+
+static void image_contents(const char *path, uint8_t *out, size_t length) {
+    int fd = open(path, O_RDONLY);
+    assert(fd >= 0 && pread(fd, out, length, 0) == (ssize_t)length);
+    close(fd);
+}
+
+static void remove_image(const char *path, const char *journal) {
+    unlink(path);
+    unlink(journal);
+}
+
+// After a killed run: if the journal's latest record has a batch in flight,
+// tear the batch's first sector, half written (first half as the finished
+// image has it, second half as before the run). Returns 1 if it did. Reads
+// the journal layout of taes_image.c.
+static int tear_in_flight(const char *path, const char *journal, const uint8_t *plain,
+                          const uint8_t *expected) {
+    uint8_t header[72];
+    uint8_t slot[2][64];
+    int fd = open(journal, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    int ok = pread(fd, header, sizeof(header), 0) == (ssize_t)sizeof(header);
+    uint64_t slot_size = 0;
+    memcpy(&slot_size, header + 56, 8);
+    for (int i = 0; ok && i < 2; i++) {
+        ok = pread(fd, slot[i], sizeof(slot[i]), (off_t)(4096 + i * slot_size)) == (ssize_t)sizeof(slot[i]);
+    }
+    close(fd);
+    if (!ok) {
+        return 0;
+    }
+    uint64_t seq[2];
+    memcpy(&seq[0], slot[0] + 8, 8);
+    memcpy(&seq[1], slot[1] + 8, 8);
+    const uint8_t *latest = seq[1] > seq[0] ? slot[1] : slot[0];
+    uint32_t state;
+    uint32_t windows;
+    uint64_t offset;
+    memcpy(&state, latest + 28, 4);
+    memcpy(&windows, latest + 40, 4);
+    memcpy(&offset, latest + 48, 8);
+    if (state != 0 || windows == 0) {
+        return 0;
+    }
+    fd = open(path, O_WRONLY);
+    assert(fd >= 0);
+    assert(pwrite(fd, expected + offset, 2048, (off_t)offset) == 2048);
+    assert(pwrite(fd, plain + offset + 2048, 2048, (off_t)offset + 2048) == 2048);
+    close(fd);
+    return 1;
+}
+
+// Test in-place image encryption: sectors end up as taes_sector_encrypt()
+// of their contents and holes stay holes; finished, foreign and mismatched
+// journals are refused; and runs killed at any point, with a sector in
+// flight torn, resume to the same image as an uninterrupted run
+void test_image(void) {
+    printf("Testing in-place image encryption...\n");
+
+    enum { SECTORS = 64, HOLE_START = 20, HOLE_END = 40, BIG = 256 };
+    static uint8_t plain[BIG * 4096];
+    static uint8_t expected[BIG * 4096];
+    static uint8_t out[BIG * 4096];
+    char path[64];
+    char journal[80];
+    uint8_t key[32];
+    uint8_t tweak[16];
+
+    for (int i = 0; i < 32; i++) {
+        key[i] = (uint8_t)(i * 11 + 2);
+    }
+    memset(tweak, 0x5a, 16);
+    uint64_t seed = 42;
+    for (size_t i = 0; i < sizeof(plain); i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        plain[i] = (uint8_t)(seed >> 56);
+    }
+    taes_ctx enc;
+    taes_ctx dec;
+    taes_ctx wrong_enc;
+    taes_ctx wrong_dec;
+    assert(taes_init(&enc, key, 32, tweak) == 0);
+    assert(taes_init_decrypt(&dec, key, 32, tweak) == 0);
+    key[0] ^= 1;
+    assert(taes_init(&wrong_enc, key, 32, tweak) == 0);
+    assert(taes_init_decrypt(&wrong_dec, key, 32, tweak) == 0);
+
+    // Small windows and batches: many batches and journal records
+    taes_image_options options = {0};
+    options.window = 4 * 4096;
+    options.batch = 2;
+    options.threads = 2;
+    make_image(path, plain, SECTORS, HOLE_START, HOLE_END);
+    snprintf(journal, sizeof(journal), "%s.journal", path);
+    int fd = open(path, O_RDONLY);
+    assert(fd >= 0);
+    int holes = lseek(fd, 0, SEEK_HOLE) == HOLE_START * 4096;
+    close(fd);
+    memcpy(expected, plain, SECTORS * 4096);
+    memset(expected + HOLE_START * 4096, 0, (HOLE_END - HOLE_START) * 4096);
+    uint8_t *original = out;  // The plaintext as read back: zeros in the hole
+    uint8_t *got = out + SECTORS * 4096;
+    memcpy(original, expected, SECTORS * 4096);
+    if (holes) {
+        assert(taes_sector_encrypt(&enc, 0, 4096, expected, expected, HOLE_START) == 0);
+        assert(taes_sector_encrypt(&enc, HOLE_END, 4096, expected + HOLE_END * 4096,
+                                   expected + HOLE_END * 4096, SECTORS - HOLE_END) == 0);
+    } else {
+        assert(taes_sector_encrypt(&enc, 0, 4096, expected, expected, SECTORS) == 0);
+    }
+
+    taes_image_stats stats;
+    assert(taes_image_crypt(&enc, &dec, path, journal, &options, &stats) == 0);
+    assert(stats.size == SECTORS * 4096 && stats.resumed_at == 0);
+    assert(stats.processed + stats.skipped == SECTORS * 4096);
+    assert(!holes || stats.skipped == (HOLE_END - HOLE_START) * 4096);
+    image_contents(path, got, SECTORS * 4096);
+    assert(memcmp(got, expected, SECTORS * 4096) == 0);
+    fd = open(path, O_RDONLY);
+    assert(!holes || lseek(fd, 0, SEEK_HOLE) == HOLE_START * 4096);
+    close(fd);
+    printf("  PASSED: Sectors encrypted in place%s\n", holes ? ", holes skipped" : " (no hole support)");
+
+    // A second run would encrypt twice; another key or sector size must not
+    // decrypt; the other direction starts over once this one has finished
+    assert(taes_image_crypt(&enc, &dec, path, journal, &options, NULL) == TAES_IMAGE_COMPLETE);
+    options.flags = TAES_IMAGE_DECRYPT;
+    assert(taes_image_crypt(&wrong_enc, &wrong_dec, path, journal, &options, NULL) == TAES_IMAGE_MISMATCH);
+    options.sector_size = 512;
+    assert(taes_image_crypt(&enc, &dec, path, journal, &options, NULL) == TAES_IMAGE_MISMATCH);
+    options.sector_size = 0;
+    assert(taes_image_crypt(&enc, &dec, path, journal, &options, &stats) == 0);
+    image_contents(path, got, SECTORS * 4096);
+    assert(memcmp(got, original, SECTORS * 4096) == 0);
+    options.flags = 0;
+    printf("  PASSED: Finished, foreign-key and foreign-geometry journals refused\n");
+
+    // Not a journal; a size that is not whole sectors
+    assert(truncate(journal, 100) == 0);
+    assert(taes_image_crypt(&enc, &dec, path, journal, &options, NULL) == TAES_IMAGE_MISMATCH);
+    unlink(journal);
+    assert(truncate(path, SECTORS * 4096 + 512) == 0);
+    errno = 0;
+    assert(taes_image_crypt(&enc, &dec, path, journal, &options, NULL) == -1 && errno == EINVAL);
+    remove_image(path, journal);
+    printf("  PASSED: Foreign journal and partial sector refused\n");
+
+    // Kill runs at varying points (some before the first record, some with
+    // a batch half written), resume them, and compare with one clean run
+    options.window = 4096;
+    options.batch = 4;
+    make_image(path, plain, BIG, 0, 0);
+    snprintf(journal, sizeof(journal), "%s.journal", path);
+    assert(taes_image_crypt(&enc, &dec, path, journal, &options, NULL) == 0);
+    image_contents(path, expected, sizeof(expected));
+    remove_image(path, journal);
+    int resumed = 0;
+    int torn = 0;
+    for (int delay = 0; delay < 12; delay++) {
+        make_image(path, plain, BIG, 0, 0);
+        snprintf(journal, sizeof(journal), "%s.journal", path);
+        for (int kill_run = 0; kill_run < 3; kill_run++) {
+            pid_t child = fork();
+            assert(child >= 0);
+            if (child == 0) {
+                // A run that got to the end before its kill leaves the
+                // next one COMPLETE
+                int rc = taes_image_crypt(&enc, &dec, path, journal, &options, NULL);
+                _exit(rc == 0 || rc == TAES_IMAGE_COMPLETE ? 0 : 1);
+            }
+            struct timespec pause = {0, (long)(delay * (kill_run + 1)) * 500000L};
+            nanosleep(&pause, NULL);
+            kill(child, SIGKILL);
+            int status;
+            assert(waitpid(child, &status, 0) == child);
+            assert(WIFSIGNALED(status) || (WIFEXITED(status) && WEXITSTATUS(status) == 0));
+        }
+        torn += tear_in_flight(path, journal, plain, expected);
+        int rc = taes_image_crypt(&enc, &dec, path, journal, &options, &stats);
+        assert(rc == 0 || rc == TAES_IMAGE_COMPLETE);
+        resumed += rc == 0 && stats.resumed_at > 0;
+        image_contents(path, out, sizeof(out));
+        assert(memcmp(out, expected, sizeof(out)) == 0);
+        remove_image(path, journal);
+    }
+    printf("  PASSED: Killed runs resume to the same image (%d resumed mid-way, %d torn)\n", resumed, torn);
+
+    taes_cleanup(&enc);
+    taes_cleanup(&dec);
+    taes_cleanup(&wrong_enc);
+    taes_cleanup(&wrong_dec);
+}
+
+// Test sharded counter mode: shards cover the message in whole blocks with
+// the stolen pair in the last one; shard outputs concatenated are the
+// single-pass ciphertext, in pieces or not, on a pool or not; manifests
+// round-trip, sets are checked, and verification finds a changed shard
+void test_shard(void) {
+    printf("Testing sharded counter mode...\n");
+
+    enum { BIG = 9 * 1024 * 1024 + 3 };
+    static const size_t totals[] = {17, 31, 32, 33, 100, 4101, BIG};
+    static const uint32_t counts[] = {1, 2, 3, 7, 40};
+    uint8_t *plain = malloc(BIG);
+    uint8_t *expected = malloc(BIG);
+    uint8_t *out = malloc(BIG);
+    assert(plain && expected && out);
+    uint8_t key[32];
+    uint8_t tweak[16];
+    for (int i = 0; i < 32; i++) {
+        key[i] = (uint8_t)(i * 13 + 1);
+    }
+    memset(tweak, 0xff, 16);  // The low half wraps early
+    tweak[0] = 0xfe;
+    for (size_t i = 0; i < BIG; i++) {
+        plain[i] = (uint8_t)(i * 7 + i / 4093);
+    }
+    taes_ctx enc;
+    taes_ctx dec;
+    assert(taes_init(&enc, key, 32, tweak) == 0);
+    assert(taes_init_decrypt(&dec, key, 32, tweak) == 0);
+    taes_pool *pool = taes_pool_create(3);
+    assert(pool);
+
+    // Ranges
+    taes_shard shard;
+    for (uint64_t total = 17; total < 300; total++) {
+        for (uint32_t n = 1; n < 12; n++) {
+            uint64_t next = 0;
+            for (uint32_t k = 0; k < n; k++) {
+                assert(taes_shard_range(total, k, n, &shard) == 0);
+                assert(shard.offset == next && shard.offset % 16 == 0);
+                next = shard.offset + shard.length;
+            }
+            assert(next == total && (total % 16 == 0 || shard.length > 16));
+        }
+    }
+    assert(taes_shard_range(16, 0, 1, &shard) == -1);
+    assert(taes_shard_range(100, 3, 3, &shard) == -1);
+    assert(taes_shard_range(100, 0, 0, &shard) == -1);
+    printf("  PASSED: Shards cover the message, stolen pair in the last\n");
+
+    for (size_t t = 0; t < sizeof(totals) / sizeof(totals[0]); t++) {
+        size_t total = totals[t];
+        assert(counter_mode_encrypt(&enc, plain, expected, total) == 0);
+        FILE *in = file_with(plain, total);
+        FILE *ct = file_with(expected, total);
+        for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+            uint32_t n = counts[c];
+            taes_shard *shards = calloc(n, sizeof(taes_shard));
+            assert(shards);
+            FILE *joined = tmpfile();
+            assert(joined);
+            for (uint32_t k = 0; k < n; k++) {
+                assert(taes_shard_range(total, k, n, &shards[k]) == 0);
+                assert(taes_shard_crypt_fd(&enc, TAES_SHARD_DIGEST, fileno(in), shards[k].offset, &shards[k],
+                                           fileno(joined), k % 2 ? pool : NULL) == 0);
+                // Decrypting the shard from the whole ciphertext: the plaintext
+                // and the same digest
+                FILE *p = tmpfile();
+                taes_shard back = shards[k];
+                assert(p && taes_shard_crypt_fd(&dec, TAES_SHARD_DECRYPT | TAES_SHARD_DIGEST, fileno(ct),
+                                                back.offset, &back, fileno(p), pool) == 0);
+                assert(file_contents(p, out, BIG) == back.length);
+                assert(memcmp(out, plain + back.offset, back.length) == 0);
+                assert(memcmp(back.digest, shards[k].digest, TAES_SHARD_DIGEST_SIZE) == 0);
+                fclose(p);
+            }
+            assert(file_contents(joined, out, BIG) == total);
+            assert(memcmp(out, expected, total) == 0);
+
+            // Merge in any order, verify, then change one byte
+            uint32_t bad = 0;
+            for (uint32_t k = 0; k < n / 2; k++) {
+                taes_shard swap = shards[k];
+                shards[k] = shards[n - 1 - k];
+                shards[n - 1 - k] = swap;
+            }
+            assert(taes_shard_check_set(shards, n) == 0);
+            assert(taes_shard_verify_fd(fileno(joined), shards, n, pool, &bad) == 0);
+            size_t at = total * 2 / 3;
+            uint8_t flipped = out[at] ^ 1;
+            assert(pwrite(fileno(joined), &flipped, 1, (off_t)at) == 1);
+            assert(taes_shard_verify_fd(fileno(joined), shards, n, pool, &bad) == TAES_SHARD_MISMATCH);
+            assert(shards[bad].offset <= at && at < shards[bad].offset + shards[bad].length);
+            assert(ftruncate(fileno(joined), (off_t)total - 1) == 0);
+            assert(taes_shard_verify_fd(fileno(joined), shards, n, NULL, &bad) == TAES_SHARD_MISMATCH &&
+                   bad == n);
+            fclose(joined);
+            free(shards);
+        }
+        fclose(in);
+        fclose(ct);
+        printf("  PASSED: %zu bytes: concatenated shards are the single-pass ciphertext\n", total);
+    }
+
+    // A pre-split slice: counter mode under the tweak advanced to its block
+    taes_ctx slice = enc;
+    taes_advance_tweak(&slice, 64);
+    assert(counter_mode_encrypt(&enc, plain, expected, 4101) == 0);
+    assert(counter_mode_encrypt(&slice, plain + 1024, out, 4101 - 1024) == 0);
+    assert(memcmp(out, expected + 1024, 4101 - 1024) == 0);
+    taes_cleanup(&slice);
+    printf("  PASSED: A slice at a block offset matches its part of the message\n");
+
+    // Manifest lines
+    char line[TAES_SHARD_LINE_MAX];
+    taes_shard parsed;
+    taes_shard set[3];
+    assert(taes_shard_range(1000, 1, 3, &shard) == 0);
+    for (int i = 0; i < TAES_SHARD_DIGEST_SIZE; i++) {
+        shard.digest[i] = (uint8_t)(i * 9);
+    }
+    taes_shard_format(&shard, line);
+    assert(taes_shard_parse(line, &parsed) == 0 && memcmp(&parsed, &shard, sizeof(shard)) == 0);
+    line[strlen(line) - 2] = 'g';
+    assert(taes_shard_parse(line, &parsed) == -1);
+    assert(taes_shard_parse("taes-shard 1 1 3 1000 320 336 00", &parsed) == -1);
+    snprintf(line, sizeof(line), "taes-shard 1 1 3 1000 320 320 %064d", 0);
+    assert(taes_shard_parse(line, &parsed) == -1);   // Not the range of shard 1 of 3
+    snprintf(line, sizeof(line), "taes-shard 1 1 3 1000 320 336 %064d\n", 0);
+    assert(taes_shard_parse(line, &parsed) == 0);
+    for (uint32_t k = 0; k < 3; k++) {
+        assert(taes_shard_range(1000, k, 3, &set[k]) == 0);
+    }
+    set[2] = set[1];
+    assert(taes_shard_check_set(set, 3) == -1 && errno == EBADMSG);
+    assert(taes_shard_check_set(set, 2) == -1);
+    assert(taes_shard_range(1001, 2, 3, &set[2]) == 0);
+    set[1] = set[0];
+    assert(taes_shard_range(1000, 1, 3, &set[1]) == 0);
+    assert(taes_shard_check_set(set, 3) == -1);
+    printf("  PASSED: Manifest lines and incomplete or mixed sets\n");
+
+    taes_pool_destroy(pool);
+    taes_cleanup(&enc);
+    taes_cleanup(&dec);
+    free(plain);
+    free(expected);
+    free(out);
+}
+
+// Cut length bytes at base into segments of 0 to max_seg bytes (random
+// sizes from *seed); returns the number of segments
+static int split_chain(uint8_t *base, size_t length, size_t max_seg, uint64_t *seed, struct iovec *iov,
+                       int max_iov) {
+    int n = 0;
+    for (size_t pos = 0; pos < length; n++) {
+        assert(n < max_iov);
+        *seed = *seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        size_t seg = (size_t)(*seed >> 33) % (max_seg + 1);
+        if (seg > length - pos) {
+            seg = length - pos;
+        }
+        iov[n].iov_base = base + pos;
+        iov[n].iov_len = seg;
+        pos += seg;
+    }
+    return n;
+}
+
+// Test scatter-gather counter mode: chains split at random, differently
+// for input and output (empty segments, segments shorter than a block,
+// runs of many blocks), give the flat result on every backend, also in
+// place
+void test_counter_mode_iovec(void) {
+    printf("Testing scatter-gather counter mode...\n");
+
+    const char *backend = taes_backend_name();
+
+    enum { MAX_LENGTH = 4096 + 7, MAX_IOV = 4 * MAX_LENGTH };
+    static const char *backends[] = {"portable", "aesni", "vaes"};
+    static const size_t lengths[] = {17, 31, 32, 33, 100, 255, 256, 257, 1000, MAX_LENGTH};
+    static const size_t max_segs[] = {1, 3, 17, 64, 300, 5000};
+    static uint8_t plaintext[MAX_LENGTH];
+    static uint8_t expected[MAX_LENGTH];
+    static uint8_t out[MAX_LENGTH];
+    static uint8_t back[MAX_LENGTH];
+    static struct iovec in_iov[MAX_IOV];
+    static struct iovec out_iov[MAX_IOV];
+    uint8_t key[24];
+    uint8_t tweak[16];
+    uint64_t seed = 12345;
+
+    for (int i = 0; i < 24; i++) {
+        key[i] = (uint8_t)(i * 17 + 6);
+    }
+    memset(tweak, 0xff, 16);  // The low half wraps after a few blocks
+    tweak[0] = 0xfa;
+    for (int i = 0; i < MAX_LENGTH; i++) {
+        plaintext[i] = (uint8_t)(i * 11 + i / 97);
+    }
+
+    for (size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); b++) {
+        if (taes_set_backend(backends[b]) != 0) {
+            printf("  SKIPPED: %s backend not supported on this CPU\n", backends[b]);
+            continue;
+        }
+        taes_ctx enc;
+        taes_ctx dec;
+        assert(taes_init(&enc, key, 24, tweak) == 0);
+        assert(taes_init_decrypt(&dec, key, 24, tweak) == 0);
+        for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+            size_t length = lengths[l];
+            assert(counter_mode_encrypt(&enc, plaintext, expected, length) == 0);
+            for (size_t m = 0; m < sizeof(max_segs) / sizeof(max_segs[0]); m++) {
+                int nin = split_chain(plaintext, length, max_segs[m], &seed, in_iov, MAX_IOV);
+                int nout = split_chain(out, length, max_segs[(m + 2) % 6], &seed, out_iov, MAX_IOV);
+                memset(out, 0, length);
+                assert(counter_mode_encryptv(&enc, in_iov, nin, out_iov, nout) == 0);
+                assert(memcmp(out, expected, length) == 0);
+
+                // Decrypt in place over yet another split
+                memcpy(back, out, length);
+                nin = split_chain(back, length, max_segs[m], &seed, in_iov, MAX_IOV);
+                assert(counter_mode_decryptv(&dec, in_iov, nin, in_iov, nin) == 0);
+                assert(memcmp(back, plaintext, length) == 0);
+            }
+        }
+        taes_cleanup(&enc);
+        taes_cleanup(&dec);
+        printf("  PASSED: %s: every split matches flat counter mode\n", backends[b]);
+    }
+    assert(taes_set_backend(backend) == 0);
+
+    // Chains must be valid, of equal length, and longer than a block
+    taes_ctx ctx;
+    assert(taes_init(&ctx, key, 16, tweak) == 0);
+    struct iovec a[2] = {{plaintext, 20}, {plaintext + 20, 10}};
+    struct iovec c[2] = {{out, 15}, {out + 15, 14}};
+    assert(counter_mode_encryptv(&ctx, a, 2, c, 2) == -1);
+    c[1].iov_len = 15;
+    assert(counter_mode_encryptv(&ctx, a, 2, c, 2) == 0);
+    assert(counter_mode_encryptv(&ctx, a, 1, c, 1) == -1);
+    assert(counter_mode_encryptv(&ctx, a, -1, c, 2) == -1);
+    assert(counter_mode_encryptv(&ctx, NULL, 2, c, 2) == -1);
+    a[1].iov_base = NULL;
+    assert(counter_mode_encryptv(&ctx, a, 2, c, 2) == -1);
+    taes_cleanup(&ctx);
+    printf("  PASSED: Invalid chains\n");
+}
+
+// Test the container format: with 4 KB chunks, lengths around chunk
+// boundaries (a last chunk of 16 bytes or less takes 16 from the one
+// before) round-trip through the streamed reader and random reads, on the
+// caller and on a pool; chunk k is counter mode under the tweak plus
+// k * 2^64; appends leave the old chunks as they are, and one cut short
+// leaves the old container
+void test_container(void) {
+    printf("Testing container format...\n");
+
+    enum { CHUNK = 4096, MAX_LENGTH = 5 * CHUNK + 100, MAX_FILE = MAX_LENGTH + 4096 };
+    static const size_t lengths[] = {17, 100, CHUNK, CHUNK + 1, CHUNK + 16, CHUNK + 17,
+                                     2 * CHUNK + 16, 4 * CHUNK + 17, MAX_LENGTH};
+    static uint8_t plaintext[MAX_LENGTH];
+    static uint8_t out[MAX_LENGTH];
+    static uint8_t file[MAX_FILE];
+    static uint8_t grown[MAX_FILE];
+    uint8_t key[16];
+    uint8_t tweak[16];
+    taes_container_params params = {128, TAES_CONTAINER_KDF_PBKDF2_SHA256, 1000, {0}, CHUNK};
+
+    for (int i = 0; i < 16; i++) {
+        key[i] = (uint8_t)(i * 13 + 2);
+        tweak[i] = (uint8_t)(0x40 + i);
+        params.salt[i] = (uint8_t)i;
+    }
+    for (int i = 0; i < MAX_LENGTH; i++) {
+        plaintext[i] = (uint8_t)(i * 29 + i / 251);
+    }
+    taes_ctx enc;
+    taes_ctx dec;
+    assert(taes_init(&enc, key, 16, tweak) == 0);
+    assert(taes_init_decrypt(&dec, key, 16, tweak) == 0);
+    taes_pool *pool = taes_pool_create(3);
+    assert(pool);
+    taes_pool *pools[] = {NULL, pool};
+
+    for (int p = 0; p < 2; p++) {
+        for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+            size_t total = lengths[l];
+            FILE *src = file_with(plaintext, total);
+            FILE *dst = tmpfile();
+            FILE *back = tmpfile();
+            assert(dst && back);
+            assert(taes_container_encrypt(&enc, &params, fileno(src), fileno(dst), pools[p]) == 0);
+
+            // Streamed: header, then the chunks
+            taes_container_params read_back;
+            assert(lseek(fileno(dst), 0, SEEK_SET) == 0);
+            assert(taes_container_read_params(fileno(dst), &read_back) == 0);
+            assert(memcmp(&read_back, &params, sizeof(params)) == 0);
+            assert(taes_container_decrypt(&dec, &read_back, fileno(dst), fileno(back), pools[p]) == 0);
+            assert(file_contents(back, out, MAX_LENGTH) == total && memcmp(out, plaintext, total) == 0);
+
+            // Random reads, across chunk boundaries
+            taes_container *c = taes_container_open(fileno(dst));
+            assert(c && taes_container_length(c) == total);
+            static const size_t offsets[] = {0, 1, CHUNK - 17, CHUNK - 16, CHUNK - 1, CHUNK, 2 * CHUNK + 5};
+            static const size_t sizes[] = {0, 1, 16, 17, 40, CHUNK, MAX_LENGTH};
+            for (size_t o = 0; o < sizeof(offsets) / sizeof(offsets[0]); o++) {
+                for (size_t z = 0; z < sizeof(sizes) / sizeof(sizes[0]) && offsets[o] <= total; z++) {
+                    size_t len = sizes[z] < total - offsets[o] ? sizes[z] : total - offsets[o];
+                    memset(out, 0, len);
+                    assert(taes_container_read(c, &dec, offsets[o], len, out) == 0);
+                    assert(memcmp(out, plaintext + offsets[o], len) == 0);
+                }
+            }
+            assert(taes_container_read(c, &dec, total, 1, out) == -1);
+            taes_container_close(c);
+            fclose(src);
+            fclose(dst);
+            fclose(back);
+        }
+        printf("  PASSED: %s: streamed and random reads give the plaintext\n", p ? "Pool" : "Caller");
+    }
+
+    // Layout: header, frames, end frame, index, footer. 4097 bytes are
+    // chunks of 4080 and 17; chunk 1 is counter mode under tweak + 2^64.
+    FILE *src = file_with(plaintext, CHUNK + 1);
+    FILE *dst = tmpfile();
+    assert(dst && taes_container_encrypt(&enc, &params, fileno(src), fileno(dst), NULL) == 0);
+    size_t size = file_contents(dst, file, MAX_FILE);
+    assert(size == TAES_CONTAINER_HEADER_SIZE + 3 * TAES_CONTAINER_FRAME_SIZE + CHUNK + 1 + 2 * 16 +
+                       TAES_CONTAINER_FOOTER_SIZE);
+    assert(memcmp(file, "TAESCTR1", 8) == 0 && memcmp(file + size - 8, "TAESIDX1", 8) == 0);
+    assert(file[64] == (CHUNK - 16) % 256 && file[65] == (CHUNK - 16) / 256);
+    uint8_t expected[CHUNK];
+    assert(counter_mode_encrypt(&enc, plaintext, expected, CHUNK - 16) == 0);
+    assert(memcmp(file + 72, expected, CHUNK - 16) == 0);
+    taes_ctx next = enc;
+    uint8_t next_tweak[16];
+    memcpy(next_tweak, tweak, 16);
+    next_tweak[8]++;
+    taes_set_tweak(&next, next_tweak);
+    assert(counter_mode_encrypt(&next, plaintext + CHUNK - 16, expected, 17) == 0);
+    assert(memcmp(file + 72 + CHUNK - 16 + 8, expected, 17) == 0);
+    fclose(src);
+    printf("  PASSED: Layout, short last chunk and per-chunk tweaks\n");
+
+    // Appends: new chunks after the old ones, which are not rewritten
+    taes_container *c = taes_container_open(fileno(dst));
+    assert(c);
+    src = file_with(plaintext, 16);
+    assert(taes_container_append(c, &enc, fileno(src), pool) == TAES_CONTAINER_BAD_LENGTH);
+    fclose(src);
+    src = file_with(plaintext, 0);
+    assert(taes_container_append(c, &enc, fileno(src), pool) == 0);
+    fclose(src);
+    assert(file_contents(dst, out, MAX_LENGTH) == size);
+    src = file_with(plaintext + 100, 3 * CHUNK);
+    assert(taes_container_append(c, &enc, fileno(src), pool) == 0);
+    fclose(src);
+    assert(taes_container_length(c) == 4 * CHUNK + 1);
+    taes_container_close(c);
+
+    size_t new_size = file_contents(dst, out, MAX_LENGTH);
+    assert(new_size > size && memcmp(out, file, 72 + CHUNK + 1 + 8) == 0);
+    c = taes_container_open(fileno(dst));
+    assert(c && taes_container_length(c) == 4 * CHUNK + 1);
+    assert(taes_container_read(c, &dec, 0, 4 * CHUNK + 1, out) == 0);
+    assert(memcmp(out, plaintext, CHUNK + 1) == 0 && memcmp(out + CHUNK + 1, plaintext + 100, 3 * CHUNK) == 0);
+    taes_container_close(c);
+
+    // A streamed read steps over the old index and footer
+    taes_container_params read_back;
+    FILE *back = tmpfile();
+    assert(back && lseek(fileno(dst), 0, SEEK_SET) == 0);
+    assert(taes_container_read_params(fileno(dst), &read_back) == 0);
+    assert(taes_container_decrypt(&dec, &read_back, fileno(dst), fileno(back), pool) == 0);
+    assert(file_contents(back, out, MAX_LENGTH) == 4 * CHUNK + 1);
+    assert(memcmp(out, plaintext, CHUNK + 1) == 0 && memcmp(out + CHUNK + 1, plaintext + 100, 3 * CHUNK) == 0);
+    fclose(back);
+    printf("  PASSED: Appends\n");
+
+    // Appends cut short, with the header naming the old end: a partial one
+    // (before the new chunks were linked in) or a whole one (after). Random
+    // reads see the old container, and appending again gives the same file
+    // as the append that was not cut short.
+    assert(file_contents(dst, grown, MAX_FILE) == new_size);
+    for (int linked = 0; linked < 2; linked++) {
+        FILE *cut = linked ? file_with(grown, new_size) : file_with(file, size);
+        if (!linked) {
+            assert(pwrite(fileno(cut), plaintext, 3000, (off_t)size) == 3000);
+        }
+        uint8_t end[8];
+        for (int i = 0; i < 8; i++) {
+            end[i] = (uint8_t)((uint64_t)size >> (8 * i));
+        }
+        assert(pwrite(fileno(cut), end, sizeof(end), 44) == (ssize_t)sizeof(end));
+        c = taes_container_open(fileno(cut));
+        assert(c && taes_container_length(c) == CHUNK + 1);
+        assert(taes_container_read(c, &dec, 0, CHUNK + 1, out) == 0 && memcmp(out, plaintext, CHUNK + 1) == 0);
+        if (!linked) {
+            back = tmpfile();
+            assert(back && lseek(fileno(cut), 0, SEEK_SET) == 0);
+            assert(taes_container_read_params(fileno(cut), &read_back) == 0);
+            assert(taes_container_decrypt(&dec, &read_back, fileno(cut), fileno(back), NULL) == 0);
+            assert(file_contents(back, out, MAX_LENGTH) == CHUNK + 1);
+            fclose(back);
+        }
+        src = file_with(plaintext + 100, 3 * CHUNK);
+        assert(taes_container_append(c, &enc, fileno(src), pool) == 0);
+        fclose(src);
+        taes_container_close(c);
+        assert(file_contents(cut, out, MAX_LENGTH) == new_size && memcmp(out, grown, new_size) == 0);
+        fclose(cut);
+    }
+    printf("  PASSED: Appends cut short leave the old container\n");
+
+    // Errors: too short, bad parameters, damaged or truncated containers
+    src = file_with(plaintext, 16);
+    FILE *empty = tmpfile();
+    assert(empty);
+    assert(taes_container_encrypt(&enc, &params, fileno(src), fileno(empty), NULL) == TAES_CONTAINER_BAD_LENGTH);
+    assert(file_contents(empty, out, MAX_LENGTH) == 0);
+    taes_container_params bad = params;
+    bad.key_bits = 256;
+    assert(taes_container_encrypt(&enc, &bad, fileno(src), fileno(empty), NULL) == -1);
+    fclose(src);
+
+    assert(taes_container_open(fileno(empty)) == NULL);
+    file[size - 1] ^= 1;
+    assert(write(fileno(empty), file, size) == (ssize_t)size);
+    assert(taes_container_open(fileno(empty)) == NULL);
+    file[size - 1] ^= 1;
+    fclose(empty);
+
+    src = file_with(file, 72 + CHUNK);
+    assert(taes_container_read_params(fileno(src), &read_back) == 0);
+    errno = 0;
+    assert(taes_container_decrypt(&dec, &read_back, fileno(src), fileno(dst), NULL) == -1 && errno == EBADMSG);
+    fclose(src);
+    fclose(dst);
+    printf("  PASSED: Short input, bad parameters and damaged containers\n");
+
+    taes_cleanup(&enc);
+    taes_cleanup(&dec);
+    taes_pool_destroy(pool);
+}
+
+// One of several threads collecting test_async_queue()'s completions at once
+typedef struct {
+    taes_queue *queue;
+    int *completed;           // Shared count, under lock
+    int total;
+    pthread_mutex_t *lock;
+} async_poller;
+
+static void *poll_completions(void *arg) {
+    async_poller *p = arg;
+    for (;;) {
+        taes_async_completion c;
+        if (taes_poll(p->queue, &c, 1) == 1) {
+            assert(c.status == 0);
+            pthread_mutex_lock(p->lock);
+            (*(int *)c.user_data)++;
+            (*p->completed)++;
+            pthread_mutex_unlock(p->lock);
+            continue;
+        }
+        pthread_mutex_lock(p->lock);
+        int finished = *p->completed >= p->total;
+        pthread_mutex_unlock(p->lock);
+        if (finished) {
+            return NULL;
+        }
+        sched_yield();
+    }
+}
+
+// Test the asynchronous queue: small and large jobs of both directions and
+// several key sizes, submitted as fast as the depth allows and collected
+// through the eventfd, each give the counter-mode result exactly once
+void test_async_queue(void) {
+    printf("Testing asynchronous job queue...\n");
+
+    const char *backend = taes_backend_name();
+
+    enum { NUM_JOBS = 200, MAX_LENGTH = 9000 };
+    static const char *const names[] = {"portable", "aesni", "vaes"};
+    static const int threads[] = {1, 3};
+    static uint8_t plaintext[NUM_JOBS][MAX_LENGTH];
+    static uint8_t expected[NUM_JOBS][MAX_LENGTH];
+    static uint8_t output[NUM_JOBS][MAX_LENGTH];
+    static taes_ctx ctxs[NUM_JOBS];
+    size_t lengths[NUM_JOBS];
+    int done[NUM_JOBS];
+
+    for (int i = 0; i < NUM_JOBS; i++) {
+        uint8_t key[32];
+        uint8_t tweak[16];
+        for (int j = 0; j < 32; j++) {
+            key[j] = (uint8_t)(i * 7 + j);
+        }
+        for (int j = 0; j < 16; j++) {
+            tweak[j] = (uint8_t)(i * 3 + j * 5);
+        }
+        // Mostly small jobs (batched), every tenth one large
+        lengths[i] = i % 10 == 0 ? MAX_LENGTH - (size_t)i : 17 + (size_t)(i * 37) % 1000;
+        for (size_t j = 0; j < lengths[i]; j++) {
+            plaintext[i][j] = (uint8_t)(i + j * 11);
+        }
+        assert(taes_init(&ctxs[i], key, 16 + 8 * (i / 70), tweak) == 0);
+        assert(counter_mode_encrypt(&ctxs[i], plaintext[i], expected[i], lengths[i]) == 0);
+    }
+
+    for (size_t n = 0; n < sizeof(names) / sizeof(names[0]); n++) {
+        if (taes_set_backend(names[n]) != 0) {
+            printf("  SKIPPED: %s not supported on this CPU\n", names[n]);
+            continue;
+        }
+
+        for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+            taes_queue *queue = taes_queue_create(threads[t], 32);
+            assert(queue != NULL);
+            int efd = taes_queue_eventfd(queue);
+            assert(efd >= 0);
+
+            // Even jobs encrypt, odd ones decrypt the expected ciphertext in place
+            for (int pass = 0; pass < 2; pass++) {
+                memset(done, 0, sizeof(done));
+                for (int i = 0; i < NUM_JOBS; i++) {
+                    if (i % 2) {
+                        memcpy(output[i], expected[i], lengths[i]);
+                    }
+                }
+
+                int submitted = 0;
+                int completed = 0;
+                while (completed < NUM_JOBS) {
+                    while (submitted < NUM_JOBS) {
+                        int i = submitted;
+                        taes_async_job job = {&ctxs[i], i % 2 ? output[i] : plaintext[i], output[i], lengths[i],
+                                              i % 2, &done[i]};
+                        int ret = taes_submit(queue, &job);
+                        assert(ret == 0 || ret == TAES_ASYNC_FULL);
+                        if (ret == TAES_ASYNC_FULL) {
+                            break;
+                        }
+                        submitted++;
+                    }
+
+                    struct pollfd pfd = {efd, POLLIN, 0};
+                    assert(poll(&pfd, 1, 10000) == 1);
+                    uint64_t count;
+                    assert(read(efd, &count, sizeof(count)) == sizeof(count) && count > 0);
+
+                    taes_async_completion c[8];
+                    size_t got;
+                    while ((got = taes_poll(queue, c, 8)) > 0) {
+                        for (size_t k = 0; k < got; k++) {
+                            assert(c[k].status == 0);
+                            (*(int *)c[k].user_data)++;
+                        }
+                        completed += (int)got;
+                    }
+                }
+
+                for (int i = 0; i < NUM_JOBS; i++) {
+                    assert(done[i] == 1);
+                    assert(memcmp(i % 2 ? plaintext[i] : expected[i], output[i], lengths[i]) == 0);
+                }
+            }
+            printf("  PASSED: %s, %d worker(s): %d jobs match counter mode\n", names[n], threads[t],
+                   2 * NUM_JOBS);
+            taes_queue_destroy(queue);
+        }
+    }
+
+    // Several pollers on a shallow queue: every completion reaches one of
+    // them, and the depth stays usable while they race over the ring
+    {
+        enum { POLLERS = 3 };
+        taes_queue *queue = taes_queue_create(2, 4);
+        assert(queue != NULL);
+        pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+        int completed = 0;
+        async_poller poller = {queue, &completed, NUM_JOBS, &lock};
+        pthread_t tids[POLLERS];
+        memset(done, 0, sizeof(done));
+        for (int i = 0; i < POLLERS; i++) {
+            assert(pthread_create(&tids[i], NULL, poll_completions, &poller) == 0);
+        }
+        for (int i = 0; i < NUM_JOBS; i++) {
+            taes_async_job job = {&ctxs[i], plaintext[i], output[i], lengths[i], 0, &done[i]};
+            int ret;
+            while ((ret = taes_submit(queue, &job)) == TAES_ASYNC_FULL) {
+                sched_yield();
+            }
+            assert(ret == 0);
+        }
+        for (int i = 0; i < POLLERS; i++) {
+            pthread_join(tids[i], NULL);
+        }
+        for (int i = 0; i < NUM_JOBS; i++) {
+            assert(done[i] == 1);
+            assert(memcmp(expected[i], output[i], lengths[i]) == 0);
+        }
+        taes_queue_destroy(queue);
+        printf("  PASSED: %d pollers each get distinct completions, none lost\n", POLLERS);
+    }
+
+    // Depth limit and invalid jobs; destroy finishes what is still queued
+    taes_queue *queue = taes_queue_create(1, 4);
+    assert(queue != NULL);
+    taes_async_job job = {&ctxs[1], plaintext[1], output[1], lengths[1], 0, NULL};
+    for (int i = 0; i < 4; i++) {
+        assert(taes_submit(queue, &job) == 0);
+    }
+    assert(taes_submit(queue, &job) == TAES_ASYNC_FULL);
+    job.length = 16;
+    assert(taes_submit(queue, &job) == -1);
+    taes_queue_destroy(queue);
+    assert(memcmp(expected[1], output[1], lengths[1]) == 0);
+    taes_queue_destroy(NULL);
+    printf("  PASSED: Depth limit, invalid jobs and shutdown\n");
+
+    for (int i = 0; i < NUM_JOBS; i++) {
+        taes_cleanup(&ctxs[i]);
+    }
+    assert(taes_set_backend(backend) == 0);
+}
+
 // Test all key sizes
 void test_key_sizes(void) {
     printf("Testing different key sizes...\n");
@@ -135,14 +2237,274 @@ void test_key_sizes(void) {
     printf("  PASSED: AES-256\n");
 }
 
+// Update a ciphertext of old_plain to new_plain, by diff or by a bitmap of
+// the changed blocks (nblocks of them, within the shorter plaintext), and
+// check it is the new plaintext's ciphertext; a second run, as after an
+// interruption, leaves it so
+static taes_update_stats check_update(const taes_ctx *enc, const uint8_t *old_plain, size_t old_length,
+                                      const uint8_t *new_plain, size_t new_length, int use_bitmap,
+                                      uint64_t nblocks) {
+    uint8_t *ct = malloc(old_length + new_length);
+    uint8_t *expected = malloc(new_length);
+    uint8_t *bitmap = calloc(nblocks / 8 + 1, 1);
+    assert(ct && expected && bitmap);
+    assert(counter_mode_encrypt(enc, old_plain, ct, old_length) == 0);
+    assert(counter_mode_encrypt(enc, new_plain, expected, new_length) == 0);
+    size_t shorter = old_length < new_length ? old_length : new_length;
+    for (uint64_t i = 0; i < nblocks; i++) {
+        size_t n = shorter - i * 16 < 16 ? shorter - i * 16 : 16;
+        if (memcmp(old_plain + i * 16, new_plain + i * 16, n) != 0) {
+            bitmap[i / 8] |= (uint8_t)(1u << (i % 8));
+        }
+    }
+    FILE *old_f = file_with(old_plain, old_length);
+    FILE *new_f = file_with(new_plain, new_length);
+    FILE *ct_f = file_with(ct, old_length);
+    taes_update_stats stats;
+    taes_update_stats again;
+    for (int run = 0; run < 2; run++) {
+        if (use_bitmap) {
+            assert(taes_update_blocks_fd(enc, old_length, bitmap, nblocks, fileno(new_f), fileno(ct_f),
+                                         run ? &again : &stats) == 0);
+        } else {
+            assert(taes_update_fd(enc, fileno(old_f), fileno(new_f), fileno(ct_f), run ? &again : &stats) == 0);
+        }
+        assert(file_contents(ct_f, ct, old_length + new_length) == new_length);
+        assert(memcmp(ct, expected, new_length) == 0);
+    }
+    assert(stats.blocks == (new_length + 15) / 16 && stats.dirty <= stats.written &&
+           stats.written <= stats.blocks);
+    fclose(old_f);
+    fclose(new_f);
+    fclose(ct_f);
+    free(ct);
+    free(expected);
+    free(bitmap);
+    return stats;
+}
+
+// Test incremental re-encryption: by diff and by bitmap, only changed blocks
+// (and nearby ones) are rewritten, the stolen pair is redone when the
+// length or tail changes, and growing, shrinking and block-aligned lengths
+// give the new plaintext's ciphertext
+void test_update(void) {
+    printf("Testing incremental re-encryption...\n");
+
+    enum { BIG = 9 * 1024 * 1024 + 3 };
+    uint8_t *old_plain = malloc(BIG);
+    uint8_t *new_plain = malloc(BIG);
+    assert(old_plain && new_plain);
+    uint8_t key[32];
+    uint8_t tweak[16];
+    for (int i = 0; i < 32; i++) {
+        key[i] = (uint8_t)(i * 5 + 3);
+    }
+    memset(tweak, 0xff, 16);
+    tweak[0] = 0xf0;
+    for (size_t i = 0; i < BIG; i++) {
+        old_plain[i] = (uint8_t)(i * 11 + i / 4099);
+    }
+    taes_ctx enc;
+    assert(taes_init(&enc, key, 32, tweak) == 0);
+
+    for (int use_bitmap = 0; use_bitmap < 2; use_bitmap++) {
+        const char *how = use_bitmap ? "bitmap" : "diff";
+        uint64_t all = (BIG + 15) / 16;
+        taes_update_stats stats;
+
+        // Scattered edits, across pieces: a block each, far apart
+        static const size_t edits[] = {0, 5000, 4 * 1024 * 1024 - 1, 4 * 1024 * 1024, 8 * 1024 * 1024 + 77};
+        memcpy(new_plain, old_plain, BIG);
+        for (size_t e = 0; e < sizeof(edits) / sizeof(edits[0]); e++) {
+            new_plain[edits[e]] ^= 0x5a;
+        }
+        stats = check_update(&enc, old_plain, BIG, new_plain, BIG, use_bitmap, all);
+        assert(stats.dirty == 5 && stats.written == 5);
+        stats = check_update(&enc, old_plain, BIG, old_plain, BIG, use_bitmap, all);
+        assert(stats.dirty == 0 && stats.written == 0);
+        printf("  PASSED: %s: only changed blocks rewritten\n", how);
+
+        // Two edits a page apart are one run; further apart, two
+        memcpy(new_plain, old_plain, BIG);
+        new_plain[16 * 1000] ^= 1;
+        new_plain[16 * (1001 + TAES_UPDATE_MERGE_GAP)] ^= 1;
+        stats = check_update(&enc, old_plain, BIG, new_plain, BIG, use_bitmap, all);
+        assert(stats.dirty == 2 && stats.written == TAES_UPDATE_MERGE_GAP + 2);
+        new_plain[16 * (1002 + TAES_UPDATE_MERGE_GAP)] ^= 1;
+        new_plain[16 * (1001 + TAES_UPDATE_MERGE_GAP)] ^= 1;
+        stats = check_update(&enc, old_plain, BIG, new_plain, BIG, use_bitmap, all);
+        assert(stats.dirty == 2 && stats.written == 2);
+        printf("  PASSED: %s: nearby changes merged into one write\n", how);
+
+        // The tail alone changes: the stolen pair only
+        memcpy(new_plain, old_plain, BIG);
+        new_plain[BIG - 1] ^= 1;
+        stats = check_update(&enc, old_plain, BIG, new_plain, BIG, use_bitmap, all);
+        assert(stats.dirty == 2 && stats.written == 2);
+
+        // Lengths change: grown, shrunk, to and from whole blocks
+        static const size_t lengths[][2] = {{100, 4101}, {4101, 33}, {64, 70}, {70, 64}, {17, 32},
+                                            {32, 17}, {1000, 1000 + 16}, {BIG, BIG - 20}};
+        for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+            size_t old_length = lengths[l][0];
+            size_t new_length = lengths[l][1];
+            size_t common = (old_length < new_length ? old_length : new_length) / 16;
+            memcpy(new_plain, old_plain, BIG);
+            new_plain[new_length / 3] ^= 1;
+            stats = check_update(&enc, old_plain, old_length, new_plain, new_length, use_bitmap, common);
+            if (old_length == BIG) {
+                assert(stats.written == 3);   // The edit and the new pair
+            }
+        }
+        printf("  PASSED: %s: length and tail changes fix up the stolen pair\n", how);
+
+        // A short bitmap: the blocks past it count as changed
+        if (use_bitmap) {
+            stats = check_update(&enc, old_plain, 4101, old_plain, 4101, 1, 100);
+            assert(stats.dirty == 4101 / 16 - 1 - 100 + 2 && stats.written == stats.dirty);   // And the pair
+            printf("  PASSED: Blocks past the bitmap rewritten\n");
+        }
+    }
+
+    // Too short, and not the old plaintext's ciphertext
+    FILE *a = file_with(old_plain, 100);
+    FILE *b = file_with(old_plain, 16);
+    FILE *c = file_with(old_plain, 50);
+    assert(taes_update_fd(&enc, fileno(a), fileno(b), fileno(c), NULL) == TAES_UPDATE_BAD_LENGTH);
+    assert(taes_update_fd(&enc, fileno(a), fileno(a), fileno(c), NULL) == -1 && errno == EINVAL);
+    assert(taes_update_blocks_fd(&enc, 100, NULL, 0, fileno(a), fileno(c), NULL) == -1 && errno == EINVAL);
+    fclose(a);
+    fclose(b);
+    fclose(c);
+    printf("  PASSED: Short plaintexts and wrong ciphertexts refused\n");
+
+    taes_cleanup(&enc);
+    free(old_plain);
+    free(new_plain);
+}
+
+// Test transcryption: on every length, in place or not, serial or on a
+// pool, and through both filter routes, re-encrypting under a new key (of
+// another size) and tweak gives decrypt-then-encrypt's ciphertext
+void test_transcrypt(void) {
+    printf("Testing transcryption...\n");
+
+    enum { WINDOW = 8 * 1024 * 1024, MAX = WINDOW + 4096 + 17 };
+    static const size_t lengths[] = {17, 31, 32, 33, 100, TAES_TRANSCRYPT_TILE, TAES_TRANSCRYPT_TILE + 5,
+                                     3 * TAES_TRANSCRYPT_TILE + 16 + 5, 4096 + 16, 9000, WINDOW + 17, MAX};
+    uint8_t *plain = malloc(MAX);
+    uint8_t *old_ct = malloc(MAX);
+    uint8_t *expected = malloc(MAX);
+    uint8_t *out = malloc(MAX);
+    assert(plain && old_ct && expected && out);
+    uint8_t old_key[16];
+    uint8_t new_key[32];
+    uint8_t old_tweak[16];
+    uint8_t new_tweak[16];
+    for (int i = 0; i < 32; i++) {
+        new_key[i] = (uint8_t)(i * 3 + 7);
+    }
+    memcpy(old_key, new_key + 9, 16);
+    memset(old_tweak, 0xff, 16);   // Carries early
+    old_tweak[0] = 0xf8;
+    memset(new_tweak, 0x21, 16);
+    for (size_t i = 0; i < MAX; i++) {
+        plain[i] = (uint8_t)(i * 29 + (i >> 11));
+    }
+    taes_ctx old_enc;
+    taes_ctx from;
+    taes_ctx to;
+    assert(taes_init(&old_enc, old_key, 16, old_tweak) == 0);
+    assert(taes_init_decrypt(&from, old_key, 16, old_tweak) == 0);
+    assert(taes_init(&to, new_key, 32, new_tweak) == 0);
+    taes_pool *pool = taes_pool_create(3);
+    assert(pool);
+
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        size_t len = lengths[l];
+        assert(counter_mode_encrypt(&old_enc, plain, old_ct, len) == 0);
+        assert(counter_mode_encrypt(&to, plain, expected, len) == 0);
+
+        memset(out, 0, len);
+        assert(taes_transcrypt(&from, &to, old_ct, out, len) == 0);
+        assert(memcmp(out, expected, len) == 0);
+        memset(out, 0, len);
+        assert(taes_transcrypt_parallel(pool, &from, &to, old_ct, out, len, 4096 + 16) == 0);
+        assert(memcmp(out, expected, len) == 0);
+        memcpy(out, old_ct, len);
+        assert(taes_transcrypt_parallel(pool, &from, &to, out, out, len, 0) == 0);
+        assert(memcmp(out, expected, len) == 0);
+
+        // Mapped and pipelined (4 KB buffers) filters
+        FILE *src = file_with(old_ct, len);
+        FILE *dst = tmpfile();
+        assert(dst && taes_transcrypt_fd(&from, &to, fileno(src), fileno(dst), 2) == 0);
+        assert(file_contents(dst, out, MAX) == len && memcmp(out, expected, len) == 0);
+        fclose(dst);
+        dst = tmpfile();
+        assert(lseek(fileno(src), 0, SEEK_SET) == 0);
+        assert(dst && taes_transcrypt_pipeline(&from, &to, fileno(src), fileno(dst), 2, 4096) == 0);
+        assert(file_contents(dst, out, MAX) == len && memcmp(out, expected, len) == 0);
+        fclose(dst);
+        fclose(src);
+        printf("  PASSED: %zu bytes: one pass equals decrypt then encrypt\n", len);
+    }
+
+    assert(taes_transcrypt(&from, &to, old_ct, out, 16) == -1);
+    assert(taes_transcrypt(&from, NULL, old_ct, out, 100) == -1);
+    FILE *src = file_with(old_ct, 16);
+    FILE *dst = tmpfile();
+    assert(dst && taes_transcrypt_fd(&from, &to, fileno(src), fileno(dst), 1) == TAES_PIPELINE_BAD_LENGTH);
+    assert(taes_transcrypt_fd(&from, NULL, fileno(src), fileno(dst), 1) == -1 && errno == EINVAL);
+    fclose(src);
+    fclose(dst);
+    printf("  PASSED: Short inputs and missing contexts refused\n");
+
+    taes_pool_destroy(pool);
+    taes_cleanup(&old_enc);
+    taes_cleanup(&from);
+    taes_cleanup(&to);
+    free(plain);
+    free(old_ct);
+    free(expected);
+    free(out);
+}
+
 int main(void) {
+    // The tests run on the default backend (or TAES_BACKEND); the ones that
+    // go through several restore it, and the equivalence tests compare with
+    // the _portable functions
     printf("T-AES Test Suite\n");
     printf("================\n\n");
 
     test_basic_encrypt_decrypt();
     test_tweak_effect();
+    test_set_tweak();
     test_counter_mode();
+    test_ciphertext_stealing();
     test_key_sizes();
+    test_ttable_equivalence();
+    test_bitslice_equivalence();
+    test_aes_ni_equivalence();
+    test_aes_ni_key_expansion();
+    test_aes_ni_decrypt_context();
+    test_vaes_equivalence();
+    test_backend_dispatch();
+    test_multi_buffer();
+    test_tweak_array();
+    test_parallel_counter_mode();
+    test_stream();
+    test_pipeline();
+    test_crypt_fd();
+    test_decrypt_range();
+    test_counter_mode_iovec();
+    test_container();
+    test_sector();
+    test_image();
+    test_shard();
+    test_update();
+    test_transcrypt();
+    test_async_queue();
 
     printf("\nAll tests passed!\n");
     return 0;